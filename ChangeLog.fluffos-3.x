@@ -22,6 +22,39 @@ EFUN/Package changes:
   * PACKAGE_SHA1: Fix incorrect sha1() hash generation, verified with tests. (voltara@lpmuds.net)
   * enable_commands() now accept a int argument, which default to 0, same as old behavior.
     When passing 1, driver will setup actions by calling init on its environment, sibling, inventory objects. (in that order).
+  * call_out() accepts a float delay, call outs and tick events are scheduled on a millisecond
+    timing wheel instead of once per second.
+  * PACKAGE_ASYNC: requests run on a pool of worker threads, callbacks are called as soon as the
+    request finishes. Requests on the same file still complete in order.
+  * find_call_out()/remove_call_out() on a handle no longer mistake a string call out for a function,
+    call outs are kept on their object, destructing an object with call outs no longer hashes them.
+  * reset() and clean_up() are driven by a queue of due objects checked for a few milliseconds
+    every second, instead of scanning all objects every 5 minutes. mud_status(1) shows the queue.
+  * The automatic reclaim_objects() pass runs incrementally with a time budget per second, only after
+    objects were destructed, and skips objects whose variables can't refer to other objects.
+  * websocket ports send all queued output as one frame (with 16/64 bit extended lengths) in a single
+    write, and resume partial writes. websocket_handshake_done(1) turns on permessage-deflate, the
+    mudlib must have accepted the extension in its handshake reply. Pings are answered with a pong
+    and a close frame with a close before the connection is dropped; only text, binary and
+    continuation frames reach the input.
+  * driver_latency_stats(): histograms of event loop, timed event and command to output latency.
+    driver_latency_stats(0, 1) clears them after reading, for percentiles over a recent window.
+  * every call_other() in LPC code, and every function pointer to call_other, caches the functions
+    it resolved for the last 4 programs it called, cache_stats() shows the hit rate and the busiest
+    call sites.
+  * mappings use an open addressed hash table (linear probing, Robin Hood insertion) that caches
+    the hash of each key, and keep their keys and values in blocks of their own instead of nodes
+    chained across the heap.  Iteration order follows the storage order.  sizeof() of a mapping
+    with a ref into it, and refs made from a mapping held in a local variable, no longer go wrong.
+  * mappings of up to 8 keys have no hash table, a lookup compares the key with each of their
+    nodes.  mud_status() counts them as "Mappings(small)", and memory_summary() includes the
+    table of the others.
+  * filter(), map() and sort_array() work on an array argument that nothing else refers to,
+    such as the result of a slice or another efun, in place instead of copying it first.
+  * += on a string leaves room at the end of it for the next append, so building a long string
+    piece by piece no longer copies all of it every time.
+  * The shared string table doubles once it holds more strings than it has chains, moving its
+    strings over a few chains at a time; mud_status(1) shows its load and chain lengths.
 
 New compile options/packages:
   * PACKAGE_TRIM: (zoilder), rtrim, ltrim, and trim for string trimming.
@@ -30,6 +63,31 @@ New compile options/packages:
   * SANE_SORTING: Use faster sorting implementation for "sort_array()", but requires
                   LPC code to return conforming results.
   * REVERSE_DEFER: fifo execution order for defer() efun (default to lifo)
+  * COMPUTED_GOTO_DISPATCH: (default on) with GCC/clang, eval_instruction() jumps from each opcode
+                  handler straight to the next one instead of going back through the switch.
+  * SUPERINSTRUCTIONS: (default on) compile common sequences (if (local), local && x,
+                  local < 0..255, local = 0..255, local += x) into fused opcodes.  The set in use is
+                  src/superinstructions.spec; regenerate it from an OPCPROF_2D dump with
+                  "make superinstructions PROFILE=<file>.eop-2d".
+  * BINARIES: (default on) compiled programs are saved in the "save binaries directory" of the config
+                  file and loaded from there, without compiling, while the source, every file it included
+                  and the programs it inherits are unchanged.  flush_program_cache() removes them.
+                  Only programs the master apply valid_save_binary(string file) approves are cached, and
+                  mud_status(1) counts the programs loaded, saved and refused.
+  * INCLUDE_CACHE_SIZE: (default 8MB) #include files are kept in memory between compiles, together
+                  with the defines they made, and files that only set defines aren't lexed again while
+                  they and the defines they depend on are unchanged.  mud_status(1) reports its use.
+  * SAMPLING_PROFILER: (default on) start_profiler() and stop_profiler(), or "profile start/stop" on
+                  the console, sample the LPC call stacks on a CPU time timer and report how often each
+                  was seen, in the folded format flamegraph tools read.  The master apply
+                  valid_profiler(object, string efun) decides who may use the efuns.
+  * EVAL_DEADLINE: (default off) the eval cost limit is a deadline on the monotonic clock, checked at
+                  backward branches and function calls, instead of a timer set with a system call for every
+                  heart beat, call_out and command.  A periodic timer catches efuns that run too long.
+                  With it, "maximum evaluation cost" counts real time rather than CPU time.
+  * TYPED_OPCODES: (default on) functions compiled with strict types use int and float versions of
+                  the arithmetic and comparison operators, and array and mapping versions of indexing,
+                  where the compiler knows the operand types.  Other values fall back to the generic ones.
 
 Misc:
   * FluffOS now provide 64bit LPC runtime regardless of host system. (including 32bit linux/CYGWIN).
@@ -668,6 +668,33 @@ filter_array(svalue_t *arg, int num_arg)
 
     process_efun_callback(1, &ftc, F_FILTER);
 
+    if (vec->ref == 1) {
+      /* Nobody else can see vec, so the elements that are kept are moved
+       * to its front instead of copied to a new array.  The slots behind
+       * them are always zero, should an error free vec halfway through.
+       */
+      for (cnt = 0; cnt < size; cnt++) {
+        push_svalue(&vec->item[cnt]);
+        v = call_efun_callback(&ftc, 1);
+        if (IS_ZERO(v)) {
+          free_svalue(&vec->item[cnt], "filter_array");
+          vec->item[cnt] = const0u;
+        } else if (res++ != cnt) {
+          vec->item[res - 1] = vec->item[cnt];
+          vec->item[cnt] = const0u;
+        }
+      }
+      if (res) {
+        r = resize_array(vec, res);
+      } else {
+        free_array(vec);
+        r = &the_null_array;
+      }
+      pop_n_elems(num_arg - 1);
+      sp->u.arr = r;
+      return;
+    }
+
     /* allocate a full size array and push it onto the stack so that if an
          * error occurs, it'll get cleaned up.  can't use empty array because
          * if an error occurs, it'll contain garbage and crash the driver
@@ -1073,17 +1100,33 @@ map_array(svalue_t *arg, int num_arg)
 
     process_efun_callback(1, &ftc, F_MAP);
 
-    r = int_allocate_array(size);
+    if (arr->ref == 1) {
+      /* nobody else can see arr, so the results replace its elements */
+      for (cnt = 0; cnt < size; cnt++) {
+        push_svalue(arr->item + cnt);
+        v = call_efun_callback(&ftc, 1);
+        if (v) { assign_svalue(&arr->item[cnt], v); }
+        else { break; }
+      }
+      for (; cnt < size; cnt++) {
+        free_svalue(&arr->item[cnt], "map_array");
+        arr->item[cnt] = const0u;
+      }
+      arr->ref++;
+      r = arr;
+    } else {
+      r = int_allocate_array(size);
 
-    push_refed_array(r);
+      push_refed_array(r);
 
-    for (cnt = 0; cnt < size; cnt++) {
-      push_svalue(arr->item + cnt);
-      v = call_efun_callback(&ftc, 1);
-      if (v) { assign_svalue_no_free(&r->item[cnt], v); }
-      else { break; }
+      for (cnt = 0; cnt < size; cnt++) {
+        push_svalue(arr->item + cnt);
+        v = call_efun_callback(&ftc, 1);
+        if (v) { assign_svalue_no_free(&r->item[cnt], v); }
+        else { break; }
+      }
+      sp--;
     }
-    sp--;
   }
 
   pop_n_elems(num_arg);
@@ -1259,7 +1302,13 @@ f_sort_array(void)
 
   switch (arg[1].type) {
     case T_NUMBER: {
-      tmp = builtin_sort_array(copy_array(tmp), arg[1].u.number);
+      /* an array nobody else can see is sorted in place */
+      if (tmp->ref == 1) {
+        builtin_sort_array(tmp, arg[1].u.number);
+        tmp->ref++;
+      } else {
+        tmp = builtin_sort_array(copy_array(tmp), arg[1].u.number);
+      }
       break;
     }
 
@@ -1279,7 +1328,11 @@ f_sort_array(void)
       sort_array_ftc = &ftc;
       process_efun_callback(1, &ftc, F_SORT_ARRAY);
 
-      tmp = copy_array(tmp);
+      if (tmp->ref == 1) {
+        tmp->ref++;
+      } else {
+        tmp = copy_array(tmp);
+      }
       push_refed_array(tmp);
 #ifdef SANE_SORTING
       qsort((char *) tmp->item, tmp->size, sizeof(tmp->item), sort_array_cmp);
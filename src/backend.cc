@@ -10,21 +10,18 @@
 #include "port.h"
 #include "master.h"
 #include "eval.h"
+#include "latency.h"
+#include "profiler.h"
 
 #include "event.h"
 
-#ifdef PACKAGE_ASYNC
-#include "packages/async.h"
-#endif
-
 #ifdef WIN32
 #include <process.h>
 void CDECL alarm_loop(void *);
 #endif
 
-#include <deque>
+#include <algorithm>
 #include <functional>
-#include <map>
 
 error_context_t *current_error_context = 0;
 
@@ -32,67 +29,258 @@ error_context_t *current_error_context = 0;
  * The 'current_time' is updated in the backend loop.
  */
 long current_virtual_time;
+int64_t current_virtual_time_ms;
 
-static std::multimap<long, tick_event *, std::less<long>> g_tick_queue;
+/*
+ * Tick events are kept in a hierarchical timing wheel (Varghese & Lauck),
+ * laid out like the classic BSD/Linux kernel timer wheel:
+ *
+ *   level 0: 256 slots of 1 ms
+ *   level 1:  64 slots of 256 ms
+ *   level 2:  64 slots of ~16 s
+ *   level 3:  64 slots of ~17 min
+ *   level 4:  64 slots of ~18 hours
+ *
+ * Insert and cancel are O(1). Whenever level 0 wraps around, the next slot
+ * of the level above is cascaded down and re-inserted.  Events further away
+ * than the top level can hold are parked in its last slot and re-inserted
+ * as it comes around, so any delay works.
+ */
+#define TW_ROOT_BITS 8
+#define TW_LEVEL_BITS 6
+#define TW_ROOT_SIZE (1 << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE (1 << TW_LEVEL_BITS)
+#define TW_ROOT_MASK (TW_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK (TW_LEVEL_SIZE - 1)
+#define TW_NUM_LEVELS 4
+#define TW_MAX_DELAY ((int64_t(1) << (TW_ROOT_BITS + TW_NUM_LEVELS * TW_LEVEL_BITS)) - 1)
+#define TW_INDEX(t, n) \
+  (((t) >> (TW_ROOT_BITS + (n) * TW_LEVEL_BITS)) & TW_LEVEL_MASK)
+
+static struct {
+  // next millisecond to be processed, everything before it has fired.
+  int64_t now;
+  int64_t pending;
+  tick_link root[TW_ROOT_SIZE];
+  tick_link levels[TW_NUM_LEVELS][TW_LEVEL_SIZE];
+} g_tick_wheel;
+
+static inline void tick_link_append(tick_link *head, tick_link *node)
+{
+  node->prev = head->prev;
+  node->next = head;
+  head->prev->next = node;
+  head->prev = node;
+}
 
-tick_event *add_tick_event(int delay_secs,
-                           tick_event::callback_type callback)
+static inline void tick_link_remove(tick_link *node)
 {
-  auto event = new tick_event(callback);
-  g_tick_queue.insert(std::make_pair(current_virtual_time + delay_secs, event));
-  return event;
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  node->prev = node->next = node;
 }
 
-void call_tick_events()
+// Moves all nodes of 'from' to the tail of 'to'.
+static inline void tick_link_splice(tick_link *from, tick_link *to)
 {
-  if (g_tick_queue.empty()) {
+  if (from->next == from) {
     return;
   }
+  from->next->prev = to->prev;
+  to->prev->next = from->next;
+  from->prev->next = to;
+  to->prev = from->prev;
+  from->prev = from->next = from;
+}
 
-  auto iter_start = g_tick_queue.cbegin();
-  if (iter_start->first > current_virtual_time) {
-    return;
+static void tick_wheel_insert(tick_event *event)
+{
+  int64_t expires = event->expire_ms;
+  int64_t delta = expires - g_tick_wheel.now;
+  tick_link *slot;
+
+  if (delta < 0) {
+    // Already due, run it with the slot being processed next.
+    slot = &g_tick_wheel.root[g_tick_wheel.now & TW_ROOT_MASK];
+  } else if (delta < TW_ROOT_SIZE) {
+    slot = &g_tick_wheel.root[expires & TW_ROOT_MASK];
+  } else if (delta < (1 << (TW_ROOT_BITS + TW_LEVEL_BITS))) {
+    slot = &g_tick_wheel.levels[0][TW_INDEX(expires, 0)];
+  } else if (delta < (1 << (TW_ROOT_BITS + 2 * TW_LEVEL_BITS))) {
+    slot = &g_tick_wheel.levels[1][TW_INDEX(expires, 1)];
+  } else if (delta < (1 << (TW_ROOT_BITS + 3 * TW_LEVEL_BITS))) {
+    slot = &g_tick_wheel.levels[2][TW_INDEX(expires, 2)];
+  } else {
+    if (delta > TW_MAX_DELAY) {
+      // Park it as far as we can, it gets re-inserted on cascade.
+      expires = g_tick_wheel.now + TW_MAX_DELAY;
+    }
+    slot = &g_tick_wheel.levels[3][TW_INDEX(expires, 3)];
+  }
+  tick_link_append(slot, event);
+}
+
+// Re-insert all events of one slot in a upper level, returns the slot index
+// so the caller knows whether this level wrapped around too.
+static int tick_wheel_cascade(int level, int index)
+{
+  tick_link list;
+
+  tick_link_splice(&g_tick_wheel.levels[level][index], &list);
+  while (list.next != &list) {
+    auto event = static_cast<tick_event *>(list.next);
+    tick_link_remove(event);
+    tick_wheel_insert(event);
   }
-  auto iter_end = g_tick_queue.upper_bound(current_virtual_time);
+  return index;
+}
+
+tick_event *add_tick_event_ms(int64_t delay_msecs,
+                              tick_event::callback_type callback)
+{
+  if (delay_msecs < 0) {
+    delay_msecs = 0;
+  }
+  auto event = new tick_event(callback);
+  // Events added from inside a running slot always wait for the next one.
+  event->expire_ms = std::max(current_virtual_time_ms + delay_msecs,
+                              g_tick_wheel.now);
+  tick_wheel_insert(event);
+  g_tick_wheel.pending++;
+  return event;
+}
 
-  std::deque<tick_event *> all_events;
+tick_event *add_tick_event(int delay_secs,
+                           tick_event::callback_type callback)
+{
+  return add_tick_event_ms((int64_t) delay_secs * 1000, callback);
+}
+
+void cancel_tick_event(tick_event *event)
+{
+  tick_link_remove(event);
+  g_tick_wheel.pending--;
+  delete event;
+}
 
-  // Extract all eligible events
-  for (auto iter = iter_start; iter != iter_end; iter++) {
-    all_events.push_back(iter->second);
+/*
+ * Milliseconds until the next slot that may hold a due event, capped at
+ * 'max_msecs'.  Only level 0 is scanned, a cascade boundary counts as a
+ * possible event.
+ */
+static int64_t tick_wheel_next_delay(int64_t now_ms, int64_t max_msecs)
+{
+  if (!g_tick_wheel.pending) {
+    return max_msecs;
   }
-  g_tick_queue.erase(iter_start, iter_end);
+  int64_t t = g_tick_wheel.now;
+  for (int i = 0; i < TW_ROOT_SIZE && t - now_ms < max_msecs; i++, t++) {
+    auto slot = &g_tick_wheel.root[t & TW_ROOT_MASK];
+    if (slot->next != slot || (i && !(t & TW_ROOT_MASK))) {
+      break;
+    }
+  }
+  return std::max<int64_t>(0, std::min(t - now_ms, max_msecs));
+}
 
-  // TODO: randomly shuffle the events
+/*
+ * Run all events which expires at or before 'now_ms'.
+ */
+void call_tick_events(int64_t now_ms)
+{
+  if (!g_tick_wheel.pending) {
+    g_tick_wheel.now = std::max(g_tick_wheel.now, now_ms + 1);
+    current_virtual_time_ms = now_ms;
+    current_virtual_time = now_ms / 1000;
+    return;
+  }
 
   // FIXME: push econ check into event callback!
   error_context_t econ;
   if (!save_context(&econ)) {
     fatal("BUG: call_tick_events can not save context!");
   }
-  for (auto event: all_events) {
-    if (event->valid) {
+  while (g_tick_wheel.now <= now_ms) {
+    int64_t t = g_tick_wheel.now;
+    int index = t & TW_ROOT_MASK;
+
+    if (!index &&
+        !tick_wheel_cascade(0, TW_INDEX(t, 0)) &&
+        !tick_wheel_cascade(1, TW_INDEX(t, 1)) &&
+        !tick_wheel_cascade(2, TW_INDEX(t, 2))) {
+      tick_wheel_cascade(3, TW_INDEX(t, 3));
+    }
+
+    tick_link due;
+    tick_link_splice(&g_tick_wheel.root[index], &due);
+    g_tick_wheel.now = t + 1;
+
+    if (due.next == &due) {
+      if (!g_tick_wheel.pending) {
+        g_tick_wheel.now = now_ms + 1;
+      }
+      continue;
+    }
+
+    current_virtual_time_ms = t;
+    current_virtual_time = t / 1000;
+    latency_record(&latency_tick_lag, (now_ms - t) * 1000);
+
+    // TODO: randomly shuffle the events
+    while (due.next != &due) {
+      auto event = static_cast<tick_event *>(due.next);
+      tick_link_remove(event);
+      g_tick_wheel.pending--;
+      int64_t start_usecs = get_monotonic_usec();
       try {
         event->callback();
       } catch (const char *) {
         restore_context(&econ);
       }
+      latency_record(&latency_tick_callback,
+                     get_monotonic_usec() - start_usecs);
+      delete event;
     }
-    delete event;
   }
   pop_context(&econ);
+
+  current_virtual_time_ms = now_ms;
+  current_virtual_time = now_ms / 1000;
+}
+
+static void clear_tick_list(tick_link *head, int *count)
+{
+  while (head->next != head) {
+    auto event = static_cast<tick_event *>(head->next);
+    tick_link_remove(event);
+    delete event;
+    (*count)++;
+  }
+}
+
+/*
+ * Start the virtual clock at the current time, must be called before any
+ * tick event is added.
+ */
+void init_virtual_time()
+{
+  current_virtual_time_ms = get_current_time_ms();
+  current_virtual_time = current_virtual_time_ms / 1000;
+  g_tick_wheel.now = current_virtual_time_ms;
 }
 
 void clear_tick_events()
 {
   int i = 0;
-  if (!g_tick_queue.empty()) {
-    for (auto iter: g_tick_queue) {
-      delete iter.second;
-      i++;
+  for (auto &slot : g_tick_wheel.root) {
+    clear_tick_list(&slot, &i);
+  }
+  for (auto &level : g_tick_wheel.levels) {
+    for (auto &slot : level) {
+      clear_tick_list(&slot, &i);
     }
-    g_tick_queue.clear();
   }
+  g_tick_wheel.pending = 0;
   debug_message("clear_tick_events: %d leftover events cleared.\n", i);
 }
 
@@ -161,15 +349,12 @@ void backend(struct event_base *base)
 
   // Register various tick events
   add_tick_event(0, tick_event::callback_type(call_heart_beat));
-  add_tick_event(5 * 60, tick_event::callback_type(look_for_objects_to_swap));
-  add_tick_event(60,
-                 tick_event::callback_type(std::bind(reclaim_objects, true)));
+  add_tick_event(1, tick_event::callback_type(look_for_objects_to_swap));
+  add_tick_event(1, tick_event::callback_type(reclaim_objects_tick));
 #ifdef PACKAGE_MUDLIB_STATS
   add_tick_event(60 * 60, tick_event::callback_type(mudlib_stats_decay));
 #endif
 
-  current_virtual_time = get_current_time();
-
   while (1)
     try {
       clear_state();
@@ -195,30 +380,25 @@ void backend(struct event_base *base)
 #if DEBUG
         try {
 #endif
-          /* Run event loop for at most 1 second, this current handles
-           * listening socket events, user socket events, and lpc socket events.
+          /* Run event loop until the next tick event is due, but at most 1
+           * second, this current handles listening socket events, user
+           * socket events, and lpc socket events.
            *
            * It currently also handles user command, longer term plan is to
            * merge all callbacks execution into tick event loop and move all
            * I/O to dedicated threads.
            */
-          run_for_at_most_one_second(base);
+          run_for_at_most(base,
+                          tick_wheel_next_delay(get_current_time_ms(), 1000));
 
 #if DEBUG
         } catch (...) { // catch everything
           fatal("BUG: jumped out of event loop!");
         }
 #endif
-        int64_t real_time = get_current_time();
-
-        while (current_virtual_time < real_time) {
-          call_tick_events();
-          current_virtual_time++;
-        }
-
-#ifdef PACKAGE_ASYNC
-        // TODO: Move this into timer based.
-        check_reqs();
+        call_tick_events(get_current_time_ms());
+#ifdef SAMPLING_PROFILER
+        profiler_drain();
 #endif
       }
     } catch (const char *) {
@@ -226,11 +406,248 @@ void backend(struct event_base *base)
     }
 } /* backend() */
 
+/*
+ * Objects waiting for reset() or clean_up() are kept in a binary min-heap
+ * keyed on the time they should next be looked at, so each tick only
+ * touches the objects that are due.
+ *
+ * Keys are allowed to be early: time_of_ref moves on every apply without
+ * updating the heap, an object that turns out not to be due yet is simply
+ * queued again at its real deadline.  An object in reset state has no
+ * reset deadline until something calls it, apply_low() then queues it
+ * through touch_object_reset().
+ */
+typedef struct {
+  int when;
+  object_t *ob;
+} reset_entry_t;
+
+static reset_entry_t *reset_queue = 0;  /* 1-based */
+static int reset_queue_size = 0;
+static int reset_queue_max = 0;
+static int num_reset_checks = 0, num_resets = 0, num_clean_ups = 0;
+
+static void reset_queue_set(int i, reset_entry_t entry)
+{
+  reset_queue[i] = entry;
+  entry.ob->reset_index = i;
+}
+
+static void reset_queue_up(int i)
+{
+  reset_entry_t entry = reset_queue[i];
+
+  while (i > 1 && reset_queue[i / 2].when > entry.when) {
+    reset_queue_set(i, reset_queue[i / 2]);
+    i /= 2;
+  }
+  reset_queue_set(i, entry);
+}
+
+static void reset_queue_down(int i)
+{
+  reset_entry_t entry = reset_queue[i];
+  int child;
+
+  while ((child = i * 2) <= reset_queue_size) {
+    if (child < reset_queue_size &&
+        reset_queue[child + 1].when < reset_queue[child].when) {
+      child++;
+    }
+    if (reset_queue[child].when >= entry.when) {
+      break;
+    }
+    reset_queue_set(i, reset_queue[child]);
+    i = child;
+  }
+  reset_queue_set(i, entry);
+}
+
+void unschedule_object_reset(object_t *ob)
+{
+  int i = ob->reset_index;
+
+  if (!i) {
+    return;
+  }
+  ob->reset_index = 0;
+  if (i != reset_queue_size) {
+    object_t *moved = reset_queue[reset_queue_size].ob;
+
+    reset_queue[i] = reset_queue[reset_queue_size--];
+    reset_queue_up(i);
+    reset_queue_down(moved->reset_index);
+  } else {
+    reset_queue_size--;
+  }
+}
+
+/*
+ * (Re)queue an object at the earliest time reset() or clean_up() may be
+ * due, or drop it from the queue if neither will ever be.
+ */
+void schedule_object_reset(object_t *ob)
+{
+  int when = 0, due = 0;
+
+  if (ob->flags & O_DESTRUCTED) {
+    unschedule_object_reset(ob);
+    return;
+  }
+#if !defined(NO_RESETS) && !defined(LAZY_RESETS)
+  if ((ob->flags & O_WILL_RESET) && !(ob->flags & O_RESET_STATE)) {
+    when = ob->next_reset;
+    due = 1;
+  }
+#endif
+  if (time_to_clean_up > 0 && (ob->flags & O_WILL_CLEAN_UP)) {
+    int clean_up_time = ob->time_of_ref + time_to_clean_up;
+    if (!due || clean_up_time < when) {
+      when = clean_up_time;
+    }
+    due = 1;
+  }
+  if (!due) {
+    unschedule_object_reset(ob);
+    return;
+  }
+
+  int i = ob->reset_index;
+  if (!i) {
+    if (reset_queue_size + 1 >= reset_queue_max) {
+      if (reset_queue_max) {
+        reset_queue_max *= 2;
+        reset_queue = RESIZE(reset_queue, reset_queue_max, reset_entry_t,
+                             TAG_RESET, "schedule_object_reset");
+      } else {
+        reset_queue_max = 1024;
+        reset_queue = CALLOCATE(reset_queue_max, reset_entry_t,
+                                TAG_RESET, "schedule_object_reset");
+      }
+    }
+    i = ++reset_queue_size;
+    reset_queue[i].ob = ob;
+  }
+  reset_queue[i].when = when;
+  reset_queue_up(i);
+  reset_queue_down(ob->reset_index);
+}
+
+/*
+ * Called when an object in reset state is used again, from then on it is
+ * waiting for its next reset.
+ */
+void touch_object_reset(object_t *ob)
+{
+#if !defined(NO_RESETS) && !defined(LAZY_RESETS)
+  if ((ob->flags & O_WILL_RESET) &&
+      (!ob->reset_index || reset_queue[ob->reset_index].when > ob->next_reset)) {
+    schedule_object_reset(ob);
+  }
+#endif
+}
+
+/*
+ * Whether reset() or clean_up() is due in ob now, which isn't the case
+ * any more when it was used since it was queued.
+ */
+static int reset_or_clean_up_due(object_t *ob)
+{
+#if !defined(NO_RESETS) && !defined(LAZY_RESETS)
+  if ((ob->flags & O_WILL_RESET) && !(ob->flags & O_RESET_STATE) &&
+      ob->next_reset <= current_virtual_time) {
+    return 1;
+  }
+#endif
+  return time_to_clean_up > 0 && (ob->flags & O_WILL_CLEAN_UP) &&
+         current_virtual_time - ob->time_of_ref >= time_to_clean_up;
+}
+
+/*
+ * Give one due object its reset() and/or clean_up().
+ */
+static void reset_or_clean_up(object_t *ob)
+{
+  int ready_for_clean_up = 0;
+
+  /*
+   * Check reference time before reset() is called.
+   */
+  if (current_virtual_time - ob->time_of_ref >= time_to_clean_up) {
+    ready_for_clean_up = 1;
+  }
+#if !defined(NO_RESETS) && !defined(LAZY_RESETS)
+  /*
+   * Should this object have reset(1) called ?
+   */
+  if ((ob->flags & O_WILL_RESET)
+      && (ob->next_reset <= current_virtual_time)
+      && !(ob->flags & O_RESET_STATE)) {
+    debug(d_flag, "RESET /%s\n", ob->obname);
+    num_resets++;
+    set_eval(max_cost);
+    reset_object(ob);
+    if (ob->flags & O_DESTRUCTED) {
+      return;
+    }
+  }
+#endif
+  if (time_to_clean_up > 0) {
+    /*
+     * Has enough time passed, to give the object a chance to
+     * self-destruct ? Save the O_RESET_STATE, which will be cleared.
+     *
+     * Only call clean_up in objects that has defined such a function.
+     *
+     * Only if the clean_up returns a non-zero value, will it be called
+     * again.
+     */
+
+    if (ready_for_clean_up && (ob->flags & O_WILL_CLEAN_UP)) {
+      int save_reset_state = ob->flags & O_RESET_STATE;
+      svalue_t *svp;
+
+      debug(d_flag, "clean up /%s\n", ob->obname);
+      num_clean_ups++;
+
+      /*
+       * Supply a flag to the object that says if this program is
+       * inherited by other objects. Cloned objects might as well
+       * believe they are not inherited. Swapped objects will not
+       * have a ref count > 1 (and will have an invalid ob->prog
+       * pointer).
+       *
+       * Note that if it is in the apply_low cache, it will also
+       * get a flag of 1, which may cause the mudlib not to clean
+       * up the object.  This isn't bad because:
+       * (1) one expects it is rare for objects that have untouched
+       * long enough to clean_up to still be in the cache, especially
+       * on busy MUDs.
+       * (2) the ones that are are the more heavily used ones, so
+       * keeping them around seems justified.
+       */
+
+      push_number(ob->flags & (O_CLONE) ? 0 : ob->prog->ref);
+      set_eval(max_cost);
+      svp = apply(APPLY_CLEAN_UP, ob, 1, ORIGIN_DRIVER);
+      if (ob->flags & O_DESTRUCTED) {
+        return;
+      }
+      if (!svp || (svp->type == T_NUMBER && svp->u.number == 0)) {
+        ob->flags &= ~O_WILL_CLEAN_UP;
+      }
+      ob->flags |= save_reset_state;
+    }
+  }
+}
+
 /*
  * Despite the name, this routine takes care of several things.
- * It will run once every 5 minutes.
+ * It will run once every second.
  *
- * . It will loop through all objects.
+ * . It will take due objects off the reset queue for about
+ *   RESET_USECS_PER_TICK.  Objects whose deadline moved since they were
+ *   queued are only queued again, which doesn't count against that.
  *
  *   . If an object is found in a state of not having done reset, and the
  *     delay to next reset has passed, then reset() will be done.
@@ -238,126 +655,76 @@ void backend(struct event_base *base)
  *   . If the object has a existed more than the time limit given for swapping,
  *     then 'clean_up' will first be called in the object
  *
- * There are some problems if the object self-destructs in clean_up, so
- * special care has to be taken of how the linked list is used.
+ *   . Objects still alive are queued again for their next deadline.
+ *
+ * Objects left over when the time runs out are handled next second.
  */
 static void look_for_objects_to_swap()
 {
-  /* Next time is in 5 minutes */
-  add_tick_event(5 * 60, tick_event::callback_type(look_for_objects_to_swap));
+  add_tick_event(1, tick_event::callback_type(look_for_objects_to_swap));
 
   object_t *ob;
-  volatile object_t *next_ob, *last_good_ob;
   error_context_t econ;
+  int64_t deadline = get_monotonic_usec() + RESET_USECS_PER_TICK;
 
-  /*
-   * Objects object can be destructed, which means that next object to
-   * investigate is saved in next_ob. If very unlucky, that object can be
-   * destructed too. In that case, the loop is simply restarted.
-   */
-  next_ob = obj_list;
-  last_good_ob = obj_list;
   save_context(&econ);
-  while (1)
-    try {
-
-      while ((ob = (object_t *) next_ob)) {
-        int ready_for_clean_up = 0;
-
-        if (ob->flags & O_DESTRUCTED) {
-          if (last_good_ob->flags & O_DESTRUCTED) {
-            ob = obj_list; /* restart */
-          } else {
-            ob = (object_t *) last_good_ob;
-          }
-        }
-        next_ob = ob->next_all;
-
-        /*
-         * Check reference time before reset() is called.
-         */
-        if (current_virtual_time - ob->time_of_ref >= time_to_clean_up) {
-          ready_for_clean_up = 1;
-        }
-#if !defined(NO_RESETS) && !defined(LAZY_RESETS)
-        /*
-         * Should this object have reset(1) called ?
-         */
-        if ((ob->flags & O_WILL_RESET)
-            && (ob->next_reset <= current_virtual_time)
-            && !(ob->flags & O_RESET_STATE)) {
-          debug(d_flag, "RESET /%s\n", ob->obname);
-          set_eval(max_cost);
-          reset_object(ob);
-          if (ob->flags & O_DESTRUCTED) {
-            continue;
-          }
-        }
-#endif
-        if (time_to_clean_up > 0) {
-          /*
-           * Has enough time passed, to give the object a chance to
-           * self-destruct ? Save the O_RESET_STATE, which will be cleared.
-           *
-           * Only call clean_up in objects that has defined such a function.
-           *
-           * Only if the clean_up returns a non-zero value, will it be called
-           * again.
-           */
+  while (reset_queue_size && reset_queue[1].when <= current_virtual_time) {
+    ob = reset_queue[1].ob;
+    if (!reset_or_clean_up_due(ob)) {
+      /* used since it was queued; this moves it to its new deadline */
+      schedule_object_reset(ob);
+      continue;
+    }
+    unschedule_object_reset(ob);
+    num_reset_checks++;
 
-          if (ready_for_clean_up && (ob->flags & O_WILL_CLEAN_UP)) {
-            int save_reset_state = ob->flags & O_RESET_STATE;
-            svalue_t *svp;
-
-            debug(d_flag, "clean up /%s\n", ob->obname);
-
-            /*
-             * Supply a flag to the object that says if this program is
-             * inherited by other objects. Cloned objects might as well
-             * believe they are not inherited. Swapped objects will not
-             * have a ref count > 1 (and will have an invalid ob->prog
-             * pointer).
-             *
-             * Note that if it is in the apply_low cache, it will also
-             * get a flag of 1, which may cause the mudlib not to clean
-             * up the object.  This isn't bad because:
-             * (1) one expects it is rare for objects that have untouched
-             * long enough to clean_up to still be in the cache, especially
-             * on busy MUDs.
-             * (2) the ones that are are the more heavily used ones, so
-             * keeping them around seems justified.
-             */
-
-            push_number(ob->flags & (O_CLONE) ? 0 : ob->prog->ref);
-            set_eval(max_cost);
-            svp = apply(APPLY_CLEAN_UP, ob, 1, ORIGIN_DRIVER);
-            if (ob->flags & O_DESTRUCTED) {
-              continue;
-            }
-            if (!svp || (svp->type == T_NUMBER && svp->u.number == 0)) {
-              ob->flags &= ~O_WILL_CLEAN_UP;
-            }
-            ob->flags |= save_reset_state;
-          }
-        }
-        last_good_ob = ob;
-      }
-      break;
+    /* keep ob around for rescheduling, even if it destructs itself. */
+    add_ref(ob, "look_for_objects_to_swap");
+    try {
+      reset_or_clean_up(ob);
     } catch (const char *) {
       restore_context(&econ);
-
     }
+    schedule_object_reset(ob);
+    free_object(&ob, "look_for_objects_to_swap");
+    if (get_monotonic_usec() >= deadline) {
+      break;
+    }
+  }
   pop_context(&econ);
 } /* look_for_objects_to_swap() */
 
-/* Call all heart_beat() functions in all objects.  Also call the next reset,
- * and the call out.
- * We do heart beats by moving each object done to the end of the heart beat
- * list before we call its function, and always using the item at the head
- * of the list as our function to call.  We keep calling heart beats until
- * a timeout or we have done num_heart_objs calls.  It is done this way so
- * that objects can delete heart beating objects from the list from within
- * their heart beat without truncating the current round of heart beats.
+int reset_queue_status(outbuffer_t *ob, int verbose)
+{
+  if (verbose == 1) {
+    outbuf_add(ob, "Reset/clean_up queue:\n");
+    outbuf_add(ob, "---------------------\n");
+    outbuf_addv(ob, "Objects queued: %d, next due in: %d secs\n",
+                reset_queue_size, reset_queue_size ?
+                (int) (reset_queue[1].when - current_virtual_time) : 0);
+    outbuf_addv(ob, "Checked: %d, resets: %d, clean_ups: %d\n",
+                num_reset_checks, num_resets, num_clean_ups);
+  }
+  return reset_queue_max * sizeof(reset_entry_t);
+}
+
+
+/* Call heart_beat() functions in all objects.
+ *
+ * Heart beats are not run in one burst: HEARTBEAT_INTERVAL is cut into
+ * HEART_BEAT_SLICES slices, every object hashes to a stable phase slot and
+ * each tick runs only the objects of one slot.  Every object still gets
+ * one heart beat per interval, but the work is spread evenly and the event
+ * loop gets to run between slices.
+ *
+ * Within a slot, objects can delete heart beating objects from the list
+ * from within their heart beat, set_heart_beat() adjusts heart_beat_index
+ * and num_hb_to_do so the current round is not truncated.
+ *
+ * Objects whose program has no heart_beat() are kept in a separate parked
+ * slot which is never visited, they still count as having a heart beat.
+ * They leave it through set_heart_beat(), or when replace_program() gives
+ * them a program with a heart_beat().
  *
  * Set command_giver to current_object if it is a living object. If the object
  * is shadowed, check the shadowed object if living. There is no need to save
@@ -369,86 +736,189 @@ typedef struct {
   short time_to_heart_beat;
 } heart_beat_t;
 
-static heart_beat_t *heart_beats = 0;
-static int max_heart_beats = 0;
+typedef struct {
+  heart_beat_t *list;
+  int num;
+  int max;
+} heart_beat_slot_t;
+
+#define HEART_BEAT_SLICE_MSECS (HEARTBEAT_INTERVAL * 1000 / HEART_BEAT_SLICES)
+
+/* Last slot is the parking slot. */
+static heart_beat_slot_t heart_beat_slots[HEART_BEAT_SLICES + 1];
+#define HEART_BEAT_PARKED (&heart_beat_slots[HEART_BEAT_SLICES])
+
+static int heart_beat_phase = 0; /* next slot to run */
+static heart_beat_slot_t *current_hb_slot = 0; /* slot being run */
 static int heart_beat_index = 0;
 static int num_hb_objs = 0;
 static int num_hb_to_do = 0;
 int time_for_hb = 0;
 
-static int num_hb_calls = 0; /* starts */
-static float perc_hb_probes = 100.0; /* decaying avge of how many complete */
+/* statistics, a round is one pass over all slots */
+static int num_hb_calls = 0; /* rounds started */
+static int64_t hb_round_usecs = 0; /* time used by the last round */
+static int64_t hb_round_max_slice_usecs = 0; /* slowest slice of it */
+static int hb_round_max_slice_objs = 0; /* biggest slice of it */
+static int64_t hb_acc_usecs = 0, hb_acc_max_slice_usecs = 0;
+static int hb_acc_max_slice_objs = 0;
+
+static int heart_beat_phase_of(object_t *ob)
+{
+  uint32_t h = (uint32_t)((uintptr_t) ob >> 4) * 2654435761u;
+  return (h >> 16) % HEART_BEAT_SLICES;
+}
+
+static heart_beat_t *heart_beat_slot_add(heart_beat_slot_t *slot,
+    object_t *ob)
+{
+  if (!slot->max) {
+    slot->list = CALLOCATE(slot->max = HEART_BEAT_CHUNK,
+                           heart_beat_t, TAG_HEART_BEAT,
+                           "set_heart_beat: 1");
+  } else if (slot->num == slot->max) {
+    slot->max += HEART_BEAT_CHUNK;
+    slot->list = RESIZE(slot->list, slot->max,
+                        heart_beat_t, TAG_HEART_BEAT,
+                        "set_heart_beat: 1");
+  }
+
+  heart_beat_t *hb = &slot->list[slot->num++];
+  hb->ob = ob;
+  return hb;
+}
+
+static void heart_beat_slot_remove(heart_beat_slot_t *slot, int index)
+{
+  int num;
+
+  if (slot == current_hb_slot && num_hb_to_do) {
+    if (index <= heart_beat_index) {
+      heart_beat_index--;
+    }
+    if (index < num_hb_to_do) {
+      num_hb_to_do--;
+    }
+  }
+
+  if ((num = (slot->num - (index + 1)))) {
+    memmove(slot->list + index, slot->list + (index + 1),
+            num * sizeof(heart_beat_t));
+  }
+  slot->num--;
+}
+
+/* Returns the slot holding 'ob' and its index there, or 0. */
+static heart_beat_slot_t *find_heart_beat(object_t *ob, int *index)
+{
+  heart_beat_slot_t *slots[2] = { &heart_beat_slots[heart_beat_phase_of(ob)],
+                                  HEART_BEAT_PARKED
+                                };
+
+  for (auto slot : slots) {
+    int i = slot->num;
+    while (i--) {
+      if (slot->list[i].ob == ob) {
+        *index = i;
+        return slot;
+      }
+    }
+  }
+  return 0;
+}
 
 void call_heart_beat()
 {
-  // Register for next call
-  add_tick_event(HEARTBEAT_INTERVAL,
-                 tick_event::callback_type(call_heart_beat));
+  // Register for next slice
+  add_tick_event_ms(HEART_BEAT_SLICE_MSECS,
+                    tick_event::callback_type(call_heart_beat));
 
   object_t *ob;
   heart_beat_t *curr_hb;
+  heart_beat_slot_t *slot;
   error_context_t econ;
 
+  if (heart_beat_phase == 0) {
+    num_hb_calls++;
+    hb_round_usecs = hb_acc_usecs;
+    hb_round_max_slice_usecs = hb_acc_max_slice_usecs;
+    hb_round_max_slice_objs = hb_acc_max_slice_objs;
+    hb_acc_usecs = hb_acc_max_slice_usecs = 0;
+    hb_acc_max_slice_objs = 0;
+  }
+  slot = &heart_beat_slots[heart_beat_phase];
+  if (++heart_beat_phase == HEART_BEAT_SLICES) {
+    heart_beat_phase = 0;
+  }
+
   current_interactive = 0;
 
-  if ((num_hb_to_do = num_hb_objs)) {
-    num_hb_calls++;
+  if ((num_hb_to_do = slot->num)) {
+    int64_t start_usecs = get_monotonic_usec();
+    int num_objs = num_hb_to_do;
+
+    current_hb_slot = slot;
     heart_beat_index = 0;
     save_context(&econ);
-    while (1) {
-      ob = (curr_hb = &heart_beats[heart_beat_index])->ob;
+    while (heart_beat_index < num_hb_to_do) {
+      ob = (curr_hb = &slot->list[heart_beat_index])->ob;
       DEBUG_CHECK(!(ob->flags & O_HEART_BEAT),
                   "Heartbeat not set in object on heartbeat list!");
-      /* is it time to do a heart beat ? */
-      curr_hb->heart_beat_ticks--;
-
-      if (ob->prog->heart_beat != 0) {
-        if (curr_hb->heart_beat_ticks < 1) {
-          object_t *new_command_giver;
-          curr_hb->heart_beat_ticks = curr_hb->time_to_heart_beat;
-          current_heart_beat = ob;
-          new_command_giver = ob;
+
+      if (ob->prog->heart_beat == 0) {
+        /* no heart_beat() any more, park it. */
+        heart_beat_t hb = *curr_hb;
+        heart_beat_slot_remove(slot, heart_beat_index);
+        *heart_beat_slot_add(HEART_BEAT_PARKED, ob) = hb;
+      } else if (--curr_hb->heart_beat_ticks < 1) {
+        /* is it time to do a heart beat ? */
+        object_t *new_command_giver;
+        curr_hb->heart_beat_ticks = curr_hb->time_to_heart_beat;
+        current_heart_beat = ob;
+        new_command_giver = ob;
 #ifndef NO_SHADOWS
-          while (new_command_giver->shadowing) {
-            new_command_giver = new_command_giver->shadowing;
-          }
+        while (new_command_giver->shadowing) {
+          new_command_giver = new_command_giver->shadowing;
+        }
 #endif
 #ifndef NO_ADD_ACTION
-          if (!(new_command_giver->flags & O_ENABLE_COMMANDS)) {
-            new_command_giver = 0;
-          }
+        if (!(new_command_giver->flags & O_ENABLE_COMMANDS)) {
+          new_command_giver = 0;
+        }
 #endif
 #ifdef PACKAGE_MUDLIB_STATS
-          add_heart_beats(&ob->stats, 1);
+        add_heart_beats(&ob->stats, 1);
 #endif
-          set_eval(max_cost);
-          try {
-            save_command_giver(new_command_giver);
-            if (ob->interactive) { //note, NOT same as new_command_giver
-              current_interactive = ob;
-            }
-            call_direct(ob, ob->prog->heart_beat - 1, ORIGIN_DRIVER, 0);
-            current_interactive = 0;
-            pop_stack(); /* pop the return value */
-            restore_command_giver();
-          } catch (const char *) {
-            restore_context(&econ);
+        set_eval(max_cost);
+        try {
+          save_command_giver(new_command_giver);
+          if (ob->interactive) { //note, NOT same as new_command_giver
+            current_interactive = ob;
           }
-
-          current_object = 0;
+          call_direct(ob, ob->prog->heart_beat - 1, ORIGIN_DRIVER, 0);
+          current_interactive = 0;
+          pop_stack(); /* pop the return value */
+          restore_command_giver();
+        } catch (const char *) {
+          restore_context(&econ);
         }
+
+        current_object = 0;
       }
-      if (++heart_beat_index == num_hb_to_do) {
-        break;
-      }
+      heart_beat_index++;
     }
     pop_context(&econ);
-    if (heart_beat_index < num_hb_to_do) {
-      perc_hb_probes = 100 * (float) heart_beat_index / num_hb_to_do;
-    } else {
-      perc_hb_probes = 100.0;
-    }
+    current_hb_slot = 0;
     heart_beat_index = num_hb_to_do = 0;
+
+    int64_t usecs = get_monotonic_usec() - start_usecs;
+    hb_acc_usecs += usecs;
+    if (usecs > hb_acc_max_slice_usecs) {
+      hb_acc_max_slice_usecs = usecs;
+    }
+    if (num_objs > hb_acc_max_slice_objs) {
+      hb_acc_max_slice_objs = num_objs;
+    }
   }
   current_prog = 0;
   current_heart_beat = 0;
@@ -457,58 +927,54 @@ void call_heart_beat()
 int query_heart_beat(object_t *ob)
 {
   int index;
+  heart_beat_slot_t *slot;
 
   if (!(ob->flags & O_HEART_BEAT)) {
     return 0;
   }
-  index = num_hb_objs;
-  while (index--) {
-    if (heart_beats[index].ob == ob) {
-      return heart_beats[index].time_to_heart_beat;
-    }
+  if ((slot = find_heart_beat(ob, &index))) {
+    return slot->list[index].time_to_heart_beat;
   }
   return 0;
 } /* query_heart_beat() */
 
+/* ob got a new program, move it out of the parked slot if it has a
+ * heart_beat() now.  The other way round is noticed by call_heart_beat(). */
+void heart_beat_program_changed(object_t *ob)
+{
+  int index;
+  heart_beat_slot_t *slot;
+
+  if (!(ob->flags & O_HEART_BEAT) || !ob->prog->heart_beat) {
+    return;
+  }
+  if ((slot = find_heart_beat(ob, &index)) == HEART_BEAT_PARKED) {
+    heart_beat_t hb = slot->list[index];
+
+    heart_beat_slot_remove(slot, index);
+    *heart_beat_slot_add(&heart_beat_slots[heart_beat_phase_of(ob)], ob) = hb;
+  }
+}
+
 /* add or remove an object from the heart beat list; does the major check...
  * If an object removes something from the list from within a heart beat,
- * various pointers in call_heart_beat could be stuffed, so we must
- * check current_heart_beat and adjust pointers.  */
+ * various pointers in call_heart_beat could be stuffed, so
+ * heart_beat_slot_remove() adjusts them.  */
 
 int set_heart_beat(object_t *ob, int to)
 {
   int index;
+  heart_beat_slot_t *slot;
 
   if (ob->flags & O_DESTRUCTED) {
     return 0;
   }
 
   if (!to) {
-    int num;
-
-    index = num_hb_objs;
-    while (index--) {
-      if (heart_beats[index].ob == ob) {
-        break;
-      }
-    }
-    if (index < 0) {
+    if (!(slot = find_heart_beat(ob, &index))) {
       return 0;
     }
-
-    if (num_hb_to_do) {
-      if (index <= heart_beat_index) {
-        heart_beat_index--;
-      }
-      if (index < num_hb_to_do) {
-        num_hb_to_do--;
-      }
-    }
-
-    if ((num = (num_hb_objs - (index + 1)))) {
-      memmove(heart_beats + index, heart_beats + (index + 1),
-              num * sizeof(heart_beat_t));
-    }
+    heart_beat_slot_remove(slot, index);
 
     num_hb_objs--;
     ob->flags &= ~O_HEART_BEAT;
@@ -520,32 +986,24 @@ int set_heart_beat(object_t *ob, int to)
       return 0;
     }
 
-    index = num_hb_objs;
-    while (index--) {
-      if (heart_beats[index].ob == ob) {
-        heart_beats[index].time_to_heart_beat =
-          heart_beats[index].heart_beat_ticks = to;
-        break;
-      }
-    }
-    DEBUG_CHECK(index < 0,
+    slot = find_heart_beat(ob, &index);
+    DEBUG_CHECK(!slot,
                 "Couldn't find enabled object in heart_beat list!\n");
+    if (slot == HEART_BEAT_PARKED && ob->prog->heart_beat) {
+      heart_beat_slot_remove(slot, index);
+      slot = &heart_beat_slots[heart_beat_phase_of(ob)];
+      heart_beat_slot_add(slot, ob);
+      index = slot->num - 1;
+    }
+    slot->list[index].time_to_heart_beat =
+      slot->list[index].heart_beat_ticks = to;
   } else {
     heart_beat_t *hb;
 
-    if (!max_heart_beats)
-      heart_beats = CALLOCATE(max_heart_beats = HEART_BEAT_CHUNK,
-                              heart_beat_t, TAG_HEART_BEAT,
-                              "set_heart_beat: 1");
-    else if (num_hb_objs == max_heart_beats) {
-      max_heart_beats += HEART_BEAT_CHUNK;
-      heart_beats = RESIZE(heart_beats, max_heart_beats,
-                           heart_beat_t, TAG_HEART_BEAT,
-                           "set_heart_beat: 1");
-    }
-
-    hb = &heart_beats[num_hb_objs++];
-    hb->ob = ob;
+    slot = ob->prog->heart_beat ? &heart_beat_slots[heart_beat_phase_of(ob)]
+           : HEART_BEAT_PARKED;
+    hb = heart_beat_slot_add(slot, ob);
+    num_hb_objs++;
     if (to < 0) {
       to = 1;
     }
@@ -559,18 +1017,17 @@ int set_heart_beat(object_t *ob, int to)
 
 int heart_beat_status(outbuffer_t *ob, int verbose)
 {
-  char buf[20];
-
   if (verbose == 1) {
     outbuf_add(ob, "Heart beat information:\n");
     outbuf_add(ob, "-----------------------\n");
-    outbuf_addv(ob, "Number of objects with heart beat: %d, starts: %d\n",
-                num_hb_objs, num_hb_calls);
-
-    /* passing floats to varargs isn't highly portable so let sprintf
-     handle it */
-    sprintf(buf, "%.2f", perc_hb_probes);
-    outbuf_addv(ob, "Percentage of HB calls completed last time: %s\n", buf);
+    outbuf_addv(ob, "Number of objects with heart beat: %d (%d without heart_beat()), starts: %d\n",
+                num_hb_objs, HEART_BEAT_PARKED->num, num_hb_calls);
+    outbuf_addv(ob, "Slices per interval: %d, one every %d ms\n",
+                HEART_BEAT_SLICES, HEART_BEAT_SLICE_MSECS);
+    outbuf_addv(ob, "Last round: %" PRId64 " usecs, slowest slice: %" PRId64
+                " usecs, biggest slice: %d objects\n",
+                hb_round_usecs, hb_round_max_slice_usecs,
+                hb_round_max_slice_objs);
   }
   return (0);
 } /* heart_beat_status() */
@@ -711,31 +1168,35 @@ char *query_load_av()
 #ifdef F_HEART_BEATS
 array_t *get_heart_beats()
 {
-  int nob = 0, n = num_hb_objs;
-  heart_beat_t *hb = heart_beats;
+  int nob = 0;
   object_t **obtab;
   array_t *arr;
 #ifdef F_SET_HIDE
   int apply_valid_hide = 1, display_hidden = 0;
 #endif
-  if (n) {
-    obtab = CALLOCATE(n, object_t *, TAG_TEMPORARY, "heart_beats");
+  if (num_hb_objs) {
+    obtab = CALLOCATE(num_hb_objs, object_t *, TAG_TEMPORARY, "heart_beats");
   } else {
     obtab = NULL;
   }
-  while (n--) {
+  for (auto &slot : heart_beat_slots) {
+    heart_beat_t *hb = slot.list;
+    int n = slot.num;
+
+    for (; n--; hb++) {
 #ifdef F_SET_HIDE
-    if (hb->ob->flags & O_HIDDEN) {
-      if (apply_valid_hide) {
-        apply_valid_hide = 0;
-        display_hidden = valid_hide(current_object);
-      }
-      if (!display_hidden) {
-        continue;
+      if (hb->ob->flags & O_HIDDEN) {
+        if (apply_valid_hide) {
+          apply_valid_hide = 0;
+          display_hidden = valid_hide(current_object);
+        }
+        if (!display_hidden) {
+          continue;
+        }
       }
-    }
 #endif
-    obtab[nob++] = (hb++)->ob;
+      obtab[nob++] = hb->ob;
+    }
   }
 
   arr = allocate_empty_array(nob);
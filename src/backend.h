@@ -15,25 +15,41 @@
  * backend.c
  */
 extern long current_virtual_time;
+extern int64_t current_virtual_time_ms;
 extern object_t *current_heart_beat;
 extern error_context_t *current_error_context;
 extern int time_for_hb;
 
+// Intrusive circular list link, an unlinked node points to itself.
+struct tick_link {
+  tick_link *prev, *next;
+
+  tick_link() : prev(this), next(this) {}
+};
+
 // API for register event to be executed on each tick.
-struct tick_event {
-  bool valid;
+//
+// Events live in a hierarchical timing wheel with millisecond slots, the
+// links are owned by the wheel.
+struct tick_event : tick_link {
+  int64_t expire_ms;
 
   typedef std::function<void ()> callback_type;
   callback_type callback;
 
   tick_event(callback_type &callback) :
-    valid(true),
+    expire_ms(0),
     callback(callback) {}
 };
 
 // Register a event to run after a certain number of seconds.
 tick_event *add_tick_event(int, tick_event::callback_type);
+// Register a event to run after a certain number of milliseconds.
+tick_event *add_tick_event_ms(int64_t, tick_event::callback_type);
+// Remove a pending event and free it, must not be called on a running event.
+void cancel_tick_event(tick_event *);
 void clear_tick_events();
+void init_virtual_time();
 
 void backend(struct event_base *);
 
@@ -41,7 +57,12 @@ void clear_state(void);
 int parse_command(char *, object_t *);
 int set_heart_beat(object_t *, int);
 int query_heart_beat(object_t *);
+void heart_beat_program_changed(object_t *);
 int heart_beat_status(outbuffer_t *, int);
+void schedule_object_reset(object_t *);
+void unschedule_object_reset(object_t *);
+void touch_object_reset(object_t *);
+int reset_queue_status(outbuffer_t *, int);
 void preload_objects(int);
 void remove_destructed_objects(void);
 void update_load_av(void);
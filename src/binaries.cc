@@ -0,0 +1,816 @@
+/*
+ * binaries.c
+ * The compiled program cache, see binaries.h.
+ *
+ * A cache file holds the program block with its pointers turned into
+ * offsets, followed by the strings the program owns and its line number
+ * information.  It is only used when all of these match what they were
+ * at compile time:
+ *   - the driver binary and the config settings which make predefines,
+ *   - the simul_efuns (the code calls them by index),
+ *   - the source file and every file it included,
+ *   - the programs of the inherited objects, compared by their
+ *     source_hash, which covers their own includes and inherits.
+ *
+ * String switch tables are keyed by string address; the offsets of those
+ * tables are recorded by the code generator (A_PATCH) so their keys can
+ * be saved as string indices and sorted again after loading.
+ */
+
+#include "std.h"
+#include "lpc_incl.h"
+#include "file_incl.h"
+#include "binaries.h"
+#include "lex.h"
+#include "main.h"
+#include "otable.h"
+#include "simul_efun.h"
+#include "master.h"
+
+#include <vector>
+
+#define BINARY_MAGIC    "LPCB"
+#define BINARY_VERSION  1
+
+#define FNV_OFFSET      0xcbf29ce484222325ULL
+#define FNV_PRIME       0x100000001b3ULL
+
+/* the file which is being loaded or compiled, see load_binary() */
+static uint64_t binary_source_hash;
+static int binary_allowed;
+
+/* for mud_status() */
+static int binaries_loaded, binaries_rejected, binaries_saved, binaries_denied;
+
+/* program_t pointers which point into the program block, with the type
+   each one is assigned through */
+#define NUM_PROG_AREAS 11
+#define PROG_AREAS(X) \
+  X(program, char) \
+  X(function_table, function_t) \
+  X(function_flags, unsigned short) \
+  X(classes, class_def_t) \
+  X(class_members, class_member_entry_t) \
+  X(strings, char *) \
+  X(variable_table, char *) \
+  X(variable_types, unsigned short) \
+  X(inherit, inherit_t) \
+  X(argument_types, unsigned short) \
+  X(type_start, unsigned short)
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)data;
+
+  while (len--) {
+    h = (h ^ *p++) * FNV_PRIME;
+  }
+  return h;
+}
+
+static uint64_t hash_string(uint64_t h, const char *str)
+{
+  return hash_bytes(h, str, strlen(str) + 1);
+}
+
+static uint64_t hash_number(uint64_t h, uint64_t n)
+{
+  return hash_bytes(h, &n, sizeof(n));
+}
+
+/* hash the whole of 'f' without moving its offset; 0 on errors */
+static uint64_t hash_fd(int f)
+{
+  char buf[8192];
+  uint64_t h = FNV_OFFSET;
+  off_t off = 0;
+  ssize_t n;
+
+  while ((n = pread(f, buf, sizeof(buf), off)) > 0) {
+    h = hash_bytes(h, buf, n);
+    off += n;
+  }
+  return n < 0 ? 0 : h;
+}
+
+/* 'name' is a mudlib path, as recorded in A_INCLUDES */
+static uint64_t hash_file(const char *name)
+{
+  uint64_t h;
+  int f;
+
+  while (*name == '/') {
+    name++;
+  }
+  if ((f = open(name, O_RDONLY)) == -1) {
+    return 0;
+  }
+  h = hash_fd(f);
+  close(f);
+  return h;
+}
+
+/*
+ * Everything outside the mudlib a compile depends on: the driver (any
+ * rebuild may change opcodes or structure layouts) and the settings
+ * which end up as predefines or include paths.
+ */
+static uint64_t driver_id(void)
+{
+  static uint64_t id;
+  char buf[1024];
+  struct stat st;
+  lpc_predef_t *pd;
+  uint64_t h;
+
+  if (id) {
+    return id;
+  }
+  get_version(buf);
+  h = hash_string(FNV_OFFSET, buf);
+  h = hash_number(h, sizeof(program_t));
+  h = hash_number(h, sizeof(function_t));
+  h = hash_number(h, NUM_OPCODES);
+  if (stat("/proc/self/exe", &st) != -1) {
+    h = hash_number(h, st.st_mtime);
+    h = hash_number(h, st.st_size);
+  } else {
+    h = hash_string(h, __DATE__ " " __TIME__);
+  }
+  h = hash_string(h, MUD_NAME);
+  h = hash_string(h, INCLUDE_DIRS);
+  h = hash_string(h, GLOBAL_INCLUDE_FILE);
+  h = hash_number(h, external_port[0].port);
+  for (pd = lpc_predefs; pd; pd = pd->next) {
+    h = hash_string(h, pd->flag);
+  }
+  return id = h;
+}
+
+/* simul_efun calls are compiled to an index into simuls[] */
+static uint64_t simul_id(void)
+{
+  extern int num_simul_efun;
+  uint64_t h = FNV_OFFSET;
+  function_t *funp;
+  int i;
+
+  for (i = 0; i < num_simul_efun; i++) {
+    if ((funp = simuls[i].func)) {
+      h = hash_string(h, funp->funcname);
+      h = hash_number(h, funp->type);
+      h = hash_number(h, funp->num_arg);
+    } else {
+      h = hash_number(h, 0);
+    }
+  }
+  return h;
+}
+
+/* where the binary of 'name' (a program filename) lives, or 0 if none */
+static const char *binary_file(const char *name, char *buf, int size)
+{
+  const char *dir = SAVE_BINARIES;
+  int len;
+
+  if (!dir || !*dir) {
+    return 0;
+  }
+  while (*dir == '/') {
+    dir++;
+  }
+  len = strlen(name);
+  if (len > 2 && !strcmp(name + len - 2, ".c")) {
+    len -= 2;
+  }
+  if (snprintf(buf, size, "%s/%.*s.b", dir, len, name) >= size) {
+    return 0;
+  }
+  return buf;
+}
+
+/*
+ * Reading is done from a copy of the whole file, every read is checked
+ * against its end, and the file is rejected as soon as one fails.
+ */
+typedef struct {
+  const char *p;
+  const char *end;
+  int ok;
+} binary_reader_t;
+
+static const char *read_bytes(binary_reader_t *r, size_t len)
+{
+  const char *p = r->p;
+
+  if (!r->ok || (size_t)(r->end - r->p) < len) {
+    r->ok = 0;
+    return 0;
+  }
+  r->p += len;
+  return p;
+}
+
+static uint32_t read_u32(binary_reader_t *r)
+{
+  const char *p = read_bytes(r, sizeof(uint32_t));
+  uint32_t n = 0;
+
+  if (p) {
+    memcpy(&n, p, sizeof(n));
+  }
+  return n;
+}
+
+static uint64_t read_u64(binary_reader_t *r)
+{
+  const char *p = read_bytes(r, sizeof(uint64_t));
+  uint64_t n = 0;
+
+  if (p) {
+    memcpy(&n, p, sizeof(n));
+  }
+  return n;
+}
+
+/* a string written by write_string(); 0 for a null one, or on errors */
+static const char *read_string(binary_reader_t *r)
+{
+  uint32_t len = read_u32(r);
+  const char *p;
+
+  if (len == UINT32_MAX) {
+    return 0;
+  }
+  if (!(p = read_bytes(r, len)) || !len || p[len - 1]) {
+    r->ok = 0;
+    return 0;
+  }
+  return p;
+}
+
+static void write_u32(FILE *fp, uint32_t n)
+{
+  fwrite(&n, sizeof(n), 1, fp);
+}
+
+static void write_u64(FILE *fp, uint64_t n)
+{
+  fwrite(&n, sizeof(n), 1, fp);
+}
+
+static void write_string(FILE *fp, const char *str)
+{
+  uint32_t len;
+
+  if (!str) {
+    write_u32(fp, UINT32_MAX);
+    return;
+  }
+  len = strlen(str) + 1;
+  write_u32(fp, len);
+  fwrite(str, len, 1, fp);
+}
+
+/*
+ * The entries of the string switch table at 'addr', as (key, address)
+ * pairs of SWITCH_CASE_SIZE bytes; 0 if the table doesn't make sense.
+ */
+#define SWITCH_CASE_SIZE (sizeof(LPC_INT) + sizeof(short))
+
+static char *switch_table(program_t *prog, int addr, int *num)
+{
+  unsigned short stable, etable;
+  unsigned char kind;
+  char *pc;
+
+  if (addr < 0 || addr + 7 > prog->program_size) {
+    return 0;
+  }
+  pc = prog->program + addr;
+  kind = *pc;
+  if ((kind & 0x0f) != 0x0f || (kind >> 4) == 0x0f) {
+    return 0;
+  }
+  memcpy(&stable, pc + 1, sizeof(short));
+  memcpy(&etable, pc + 3, sizeof(short));
+  if (etable < stable || addr + etable > prog->program_size ||
+      (etable - stable) % SWITCH_CASE_SIZE) {
+    return 0;
+  }
+  *num = (etable - stable) / SWITCH_CASE_SIZE;
+  return pc + stable;
+}
+
+static int switch_case_compare(const void *x, const void *y)
+{
+  LPC_INT a, b;
+
+  memcpy(&a, x, sizeof(LPC_INT));
+  memcpy(&b, y, sizeof(LPC_INT));
+  return COMPARE_NUMS(a, b);
+}
+
+static void make_dirs(char *path)
+{
+  char *p;
+
+  for (p = strchr(path, '/'); p; p = strchr(p + 1, '/')) {
+    *p = 0;
+    mkdir(path, 0770);
+    *p = '/';
+  }
+}
+
+void save_binary(program_t *prog, mem_block_t *includes, mem_block_t *patches)
+{
+  char file[MAXPATHLEN], tmp[MAXPATHLEN + 8];
+  const char *name, *end;
+  program_t *copy;
+  uint64_t h, inc_hash;
+  int i, j, k, num, ok = 1;
+  char *p, *table;
+  FILE *fp;
+
+  if (!binary_file(prog->filename, file, sizeof(file))) {
+    return;
+  }
+
+  h = hash_number(FNV_OFFSET, binary_source_hash);
+  end = includes->block + includes->current_size;
+  for (name = includes->block; name < end; name += strlen(name) + 1) {
+    inc_hash = hash_file(name);
+    ok = ok && inc_hash;
+    h = hash_number(h, inc_hash);
+  }
+  for (i = 0; i < prog->num_inherited; i++) {
+    h = hash_number(h, prog->inherit[i].prog->source_hash);
+  }
+  prog->source_hash = h;
+  if (!ok || !binary_source_hash || !binary_allowed) {
+    return;
+  }
+
+  /* the block, with everything that only means something in this process
+     cleared */
+  p = (char *)DXALLOC(prog->total_size, TAG_TEMPORARY, "save_binary");
+  memcpy(p, prog, prog->total_size);
+  copy = (program_t *)p;
+#define RELOCATE_AREA(field, type) \
+  if (prog->field) { \
+    copy->field = (type *)(p + ((char *)prog->field - (char *)prog)); \
+  }
+  PROG_AREAS(RELOCATE_AREA)
+#undef RELOCATE_AREA
+  for (i = 0; i < copy->num_functions_defined; i++) {
+    copy->function_table[i].funcname = 0;
+#ifdef PROFILE_FUNCTIONS
+    copy->function_table[i].calls = 0;
+    copy->function_table[i].self = 0;
+    copy->function_table[i].children = 0;
+#endif
+  }
+  memset(copy->strings, 0, copy->num_strings * sizeof(char *));
+  memset(copy->variable_table, 0,
+         copy->num_variables_defined * sizeof(char *));
+  for (i = 0; i < copy->num_inherited; i++) {
+    copy->inherit[i].prog = 0;
+  }
+  /* string switch keys become string index + 1 */
+  for (i = 0; ok && i < patches->current_size / (int) sizeof(int); i++) {
+    if (!(table = switch_table(copy, ((int *)patches->block)[i], &num))) {
+      ok = 0;
+      break;
+    }
+    for (j = 0; j < num; j++, table += SWITCH_CASE_SIZE) {
+      LPC_INT key;
+
+      memcpy(&key, table, sizeof(LPC_INT));
+      if (!key) {
+        continue;
+      }
+      for (k = 0; k < prog->num_strings; k++) {
+        if (key == (LPC_INT)((POINTER_INT) prog->strings[k])) {
+          break;
+        }
+      }
+      if (k == prog->num_strings) {
+        ok = 0;
+        break;
+      }
+      key = k + 1;
+      memcpy(table, &key, sizeof(LPC_INT));
+    }
+  }
+  if (!ok) {
+    FREE(p);
+    return;
+  }
+
+  sprintf(tmp, "%s.tmp", file);
+  make_dirs(tmp);
+  if (!(fp = fopen(tmp, "w"))) {
+    debug_perror("save_binary", tmp);
+    FREE(p);
+    return;
+  }
+  fwrite(BINARY_MAGIC, 4, 1, fp);
+  write_u32(fp, BINARY_VERSION);
+  write_u64(fp, driver_id());
+  write_u64(fp, simul_id());
+  write_u64(fp, binary_source_hash);
+  write_u64(fp, prog->source_hash);
+
+  write_u32(fp, includes->current_size);
+  fwrite(includes->block, includes->current_size, 1, fp);
+  for (name = includes->block; name < end; name += strlen(name) + 1) {
+    write_u64(fp, hash_file(name));
+  }
+  write_u32(fp, prog->num_inherited);
+  for (i = 0; i < prog->num_inherited; i++) {
+    write_string(fp, prog->inherit[i].prog->filename);
+    write_u64(fp, prog->inherit[i].prog->source_hash);
+  }
+  write_u32(fp, patches->current_size);
+  fwrite(patches->block, patches->current_size, 1, fp);
+
+  write_u32(fp, prog->total_size);
+#define WRITE_AREA(field, type) \
+  write_u32(fp, prog->field ? (char *)prog->field - (char *)prog : 0);
+  PROG_AREAS(WRITE_AREA)
+#undef WRITE_AREA
+  fwrite(p, prog->total_size, 1, fp);
+  FREE(p);
+
+  write_string(fp, prog->filename);
+  for (i = 0; i < prog->num_functions_defined; i++) {
+    write_string(fp, prog->function_table[i].funcname);
+  }
+  for (i = 0; i < prog->num_strings; i++) {
+    write_string(fp, prog->strings[i]);
+  }
+  for (i = 0; i < prog->num_variables_defined; i++) {
+    write_string(fp, prog->variable_table[i]);
+  }
+  write_u32(fp, prog->file_info[0]);
+  fwrite(prog->file_info, prog->file_info[0], 1, fp);
+
+  if (ferror(fp) | fclose(fp) || rename(tmp, file) == -1) {
+    debug_perror("save_binary", file);
+    unlink(tmp);
+  } else {
+    binaries_saved++;
+  }
+}
+
+/* 'len' bytes at offset 'off' of the block, past the header */
+static int area_ok(program_t *header, uint32_t off, size_t len)
+{
+  uint32_t size = header->total_size;
+
+  return !off || (off >= sizeof(program_t) && off <= size &&
+                  len <= size - off);
+}
+
+/* make sure the inherited objects are loaded; this may run LPC code */
+static int load_inherits(binary_reader_t r, int num)
+{
+  char buf[MAX_OBJECT_NAME_SIZE];
+  const char *name;
+
+  while (num--) {
+    name = read_string(&r);
+    read_u64(&r);
+    if (!r.ok || !strip_name(name, buf, sizeof(buf))) {
+      return 0;
+    }
+    if (!lookup_object_hash(buf) && !load_object(buf, 0)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static program_t *read_binary(const char *name, const char *buf, int size,
+                              uint64_t source_hash)
+{
+  binary_reader_t r = { buf, buf + size, 1 };
+  binary_reader_t inherits, strings;
+  char obname[MAX_OBJECT_NAME_SIZE];
+  const char *inc, *end, *str, *block, *patches, *line_info;
+  uint32_t offsets[NUM_PROG_AREAS];
+  program_t header, *prog;
+  int i, j, num, num_patches, line_info_size;
+  uint64_t prog_hash;
+  object_t *ob;
+  char *p, *table;
+
+  if (!(str = read_bytes(&r, 4)) || memcmp(str, BINARY_MAGIC, 4) ||
+      read_u32(&r) != BINARY_VERSION || read_u64(&r) != driver_id() ||
+      read_u64(&r) != simul_id() || read_u64(&r) != source_hash) {
+    return 0;
+  }
+  prog_hash = read_u64(&r);
+
+  num = read_u32(&r);
+  if (!(inc = read_bytes(&r, num)) || (num && inc[num - 1])) {
+    return 0;
+  }
+  for (end = inc + num; inc < end; inc += strlen(inc) + 1) {
+    if (read_u64(&r) != hash_file(inc) || !r.ok) {
+      return 0;
+    }
+  }
+
+  num = read_u32(&r);
+  inherits = r;
+  for (i = 0; i < num; i++) {
+    read_string(&r);
+    read_u64(&r);
+  }
+
+  num_patches = read_u32(&r) / sizeof(int);
+  patches = read_bytes(&r, num_patches * sizeof(int));
+
+  size = read_u32(&r);
+  for (i = 0; i < NUM_PROG_AREAS; i++) {
+    offsets[i] = read_u32(&r);
+  }
+  if (!r.ok || size < (int) sizeof(program_t) ||
+      !(block = read_bytes(&r, size))) {
+    return 0;
+  }
+  memcpy(&header, block, sizeof(program_t));
+  if (header.total_size != size || header.num_inherited != num ||
+      !area_ok(&header, offsets[0], header.program_size) ||
+      !area_ok(&header, offsets[1],
+               header.num_functions_defined * sizeof(function_t)) ||
+      !area_ok(&header, offsets[2], (header.last_inherited +
+               header.num_functions_defined) * sizeof(unsigned short)) ||
+      !area_ok(&header, offsets[3], header.num_classes * sizeof(class_def_t)) ||
+      !area_ok(&header, offsets[4], 0) ||
+      !area_ok(&header, offsets[5], header.num_strings * sizeof(char *)) ||
+      !area_ok(&header, offsets[6],
+               header.num_variables_defined * sizeof(char *)) ||
+      !area_ok(&header, offsets[7],
+               header.num_variables_defined * sizeof(unsigned short)) ||
+      !area_ok(&header, offsets[8], num * sizeof(inherit_t)) ||
+      !area_ok(&header, offsets[9], 0) ||
+      !area_ok(&header, offsets[10],
+               header.num_functions_defined * sizeof(unsigned short)) ||
+      !offsets[0] || !offsets[1] || !offsets[2] || !offsets[5] ||
+      !offsets[6] || !offsets[7] || (num && !offsets[8])) {
+    return 0;
+  }
+
+  str = read_string(&r);
+  if (!str || strcmp(str, name)) {
+    return 0;
+  }
+  strings = r;
+  num = header.num_functions_defined + header.num_strings +
+        header.num_variables_defined;
+  for (i = 0; i < num; i++) {
+    if (!read_string(&r) && i >= header.num_functions_defined) {
+      return 0;
+    }
+  }
+  line_info_size = read_u32(&r);
+  if (!(line_info = read_bytes(&r, line_info_size)) || r.p != r.end ||
+      line_info_size < 2 * (int) sizeof(unsigned short) ||
+      ((unsigned short *)line_info)[0] != line_info_size ||
+      ((unsigned short *)line_info)[1] * sizeof(unsigned short) >
+      (unsigned) line_info_size) {
+    return 0;
+  }
+
+  /* everything is there; now the inherits must be the same programs */
+  if (!load_inherits(inherits, header.num_inherited)) {
+    return 0;
+  }
+
+  p = (char *)DXALLOC(size, TAG_PROGRAM, "load_binary");
+  memcpy(p, block, size);
+  prog = (program_t *)p;
+  i = 0;
+#define LOAD_AREA(field, type) \
+  prog->field = offsets[i] ? (type *)(p + offsets[i]) : 0; \
+  i++;
+  PROG_AREAS(LOAD_AREA)
+#undef LOAD_AREA
+  for (i = 0; i < prog->num_inherited; i++) {
+    str = read_string(&inherits);
+    strip_name(str, obname, sizeof(obname));
+    ob = lookup_object_hash(obname);
+    if (!ob || ob->prog->source_hash != read_u64(&inherits)) {
+      FREE(p);
+      return 0;
+    }
+    prog->inherit[i].prog = ob->prog;
+  }
+
+  /* string switch keys back to addresses, which sorts them differently */
+  for (i = 0; i < num_patches; i++) {
+    int addr;
+
+    memcpy(&addr, patches + i * sizeof(int), sizeof(int));
+    if (!(table = switch_table(prog, addr, &num))) {
+      FREE(p);
+      return 0;
+    }
+    for (j = 0; j < num; j++) {
+      LPC_INT key;
+
+      memcpy(&key, table + j * SWITCH_CASE_SIZE, sizeof(LPC_INT));
+      if (key < 0 || key > prog->num_strings) {
+        FREE(p);
+        return 0;
+      }
+    }
+  }
+
+  prog->filename = make_shared_string(name);
+  for (i = 0; i < prog->num_functions_defined; i++) {
+    str = read_string(&strings);
+    prog->function_table[i].funcname = str ? make_shared_string(str) : 0;
+  }
+  for (i = 0; i < prog->num_strings; i++) {
+    prog->strings[i] = make_shared_string(read_string(&strings));
+  }
+  for (i = 0; i < prog->num_variables_defined; i++) {
+    prog->variable_table[i] = make_shared_string(read_string(&strings));
+  }
+  for (i = 0; i < num_patches; i++) {
+    int addr;
+
+    memcpy(&addr, patches + i * sizeof(int), sizeof(int));
+    table = switch_table(prog, addr, &num);
+    for (j = 0; j < num; j++) {
+      LPC_INT key;
+
+      memcpy(&key, table + j * SWITCH_CASE_SIZE, sizeof(LPC_INT));
+      if (key) {
+        key = (LPC_INT)((POINTER_INT) prog->strings[key - 1]);
+        memcpy(table + j * SWITCH_CASE_SIZE, &key, sizeof(LPC_INT));
+      }
+    }
+    qsort(table, num, SWITCH_CASE_SIZE, switch_case_compare);
+  }
+
+  prog->file_info = (unsigned short *)DXALLOC(line_info_size,
+                    TAG_LINENUMBERS, "load_binary");
+  memcpy(prog->file_info, line_info, line_info_size);
+  prog->line_info = (unsigned char *)&prog->file_info[prog->file_info[1]];
+  prog->line_swap_index = 0;
+  prog->ref = 0;
+  prog->func_ref = 0;
+#ifdef DEBUGMALLOC_EXTENSIONS
+  prog->extra_ref = 0;
+  prog->extra_func_ref = 0;
+#endif
+  prog->id = ++last_program_id;
+  prog->call_sites = 0;
+  prog->func_lookup_mask = 0;
+  prog->func_lookup = 0;
+  prog->source_hash = prog_hash;
+
+  total_num_prog_blocks++;
+  total_prog_block_size += size;
+  reference_prog(prog, "load_binary");
+  for (i = 0; i < prog->num_inherited; i++) {
+    reference_prog(prog->inherit[i].prog, "inheritance");
+  }
+  return prog;
+}
+
+/*
+ * Whether the master lets 'name' be saved to and loaded from the cache.
+ * Everything loaded before the master, the master included, is compiled.
+ */
+static int valid_save_binary(const char *name)
+{
+  svalue_t *res;
+
+  if (!master_ob) {
+    return 0;
+  }
+  push_malloced_string(add_slash(name));
+  res = apply_master_ob(APPLY_VALID_SAVE_BINARY, 1);
+  if (!MASTER_APPROVED(res)) {
+    binaries_denied++;
+    return 0;
+  }
+  return 1;
+}
+
+program_t *load_binary(const char *name, int f)
+{
+  char file[MAXPATHLEN];
+  uint64_t source_hash;
+  program_t *prog = 0;
+  struct stat st;
+  char *buf;
+  int fd, size, allowed;
+
+  if (!binary_file(name, file, sizeof(file))) {
+    return 0;
+  }
+  allowed = valid_save_binary(name);
+  source_hash = hash_fd(f);
+  if (allowed && source_hash && (fd = open(file, O_RDONLY)) != -1) {
+    if (fstat(fd, &st) != -1 && st.st_size < INT_MAX) {
+      size = st.st_size;
+      std::vector<char> data(size);
+
+      buf = data.data();
+      if (read(fd, buf, size) == size) {
+        close(fd);
+        fd = -1;
+        prog = read_binary(name, buf, size, source_hash);
+      }
+    }
+    if (fd != -1) {
+      close(fd);
+    }
+    if (prog) {
+      binaries_loaded++;
+    } else {
+      binaries_rejected++;
+    }
+  }
+  /* set last, loading the inherits may have compiled something */
+  binary_source_hash = source_hash;
+  binary_allowed = allowed;
+  return prog;
+}
+
+int binaries_status(outbuffer_t *out, int verbose)
+{
+  if (verbose == 1) {
+    outbuf_add(out, "Program cache:\n");
+    outbuf_add(out, "--------------\n");
+    outbuf_addv(out, "Loaded: %d, out of date: %d, saved: %d, denied: %d\n",
+                binaries_loaded, binaries_rejected, binaries_saved,
+                binaries_denied);
+  }
+  return 0;
+}
+
+/* remove all binaries below 'dir', returns how many there were */
+static int remove_binaries(const char *dir)
+{
+  char path[MAXPATHLEN];
+  struct dirent *de;
+  struct stat st;
+  DIR *d;
+  int len, num = 0;
+
+  if (!(d = opendir(dir))) {
+    return 0;
+  }
+  while ((de = readdir(d))) {
+    if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+      continue;
+    }
+    if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) >=
+        (int) sizeof(path) || lstat(path, &st) == -1) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      num += remove_binaries(path);
+      rmdir(path);
+      continue;
+    }
+    len = strlen(de->d_name);
+    if (len > 2 && !strcmp(de->d_name + len - 2, ".b") && !unlink(path)) {
+      num++;
+    }
+  }
+  closedir(d);
+  return num;
+}
+
+#ifdef F_FLUSH_PROGRAM_CACHE
+void f_flush_program_cache(void)
+{
+  char name[MAX_OBJECT_NAME_SIZE], file[MAXPATHLEN];
+  const char *dir = SAVE_BINARIES;
+  int num = 0;
+
+  if (st_num_arg) {
+    if (strip_name(sp->u.string, name, sizeof(name) - 2)) {
+      strcat(name, ".c");
+      if (binary_file(name, file, sizeof(file)) && !unlink(file)) {
+        num = 1;
+      }
+    }
+    free_string_svalue(sp--);
+  } else if (dir && *dir) {
+    while (*dir == '/') {
+      dir++;
+    }
+    num = remove_binaries(dir);
+  }
+  push_number(num);
+}
+#endif
@@ -0,0 +1,27 @@
+#ifndef BINARIES_H
+#define BINARIES_H
+
+#include "compiler.h"
+
+/*
+ * binaries.c
+ *
+ * Compiled programs are kept in the "save binaries directory" of the
+ * config file, one file per source file, and are loaded from there
+ * instead of compiling as long as the source, every file it included and
+ * the programs it inherits are the same as when it was compiled.
+ */
+#ifdef BINARIES
+/*
+ * The cached program for 'name' (as in program_t.filename), or 0 if there
+ * is no valid one.  May load the inherited objects.  'f' is the open
+ * source file; its hash is kept for the save_binary() when the caller
+ * has to compile after all.
+ */
+program_t *load_binary(const char *name, int f);
+/* called by epilog() for every program it makes */
+void save_binary(program_t *, mem_block_t *, mem_block_t *);
+int binaries_status(outbuffer_t *, int);
+#endif
+
+#endif
@@ -8,40 +8,133 @@
 #include "sprintf.h"
 #include "eval.h"
 
-#include <unordered_map>
-
 #define DBG_CALLOUT(...) debug(call_out, __VA_ARGS__)
 
 /*
  * This file implements delayed calls of functions.
+ *
+ * pending_call_t entries come from slabs of CALLOUT_SLAB_SIZE entries which
+ * are never given back, freed entries go on a free list.  A handle encodes
+ * the index of its entry and the generation of that entry, so looking up a
+ * handle is an array index plus a compare.
+ *
+ * Every object keeps a doubly linked list of the call outs it owns (the
+ * object for named call outs, the function owner for function pointers),
+ * so remove_call_out(), find_call_out() and destructing only walk the
+ * call outs of that object.
  */
+#define CALLOUT_SLAB_BITS 8
+#define CALLOUT_SLAB_SIZE (1 << CALLOUT_SLAB_BITS)
+#define CALLOUT_SLAB_MASK (CALLOUT_SLAB_SIZE - 1)
 
-// main callout map, for fastest reference
-typedef std::unordered_map<LPC_INT, pending_call_t *> CalloutHandleMapType;
-static CalloutHandleMapType g_callout_handle_map;
-
-// Key is the pointer to the object, this provides an fast way for
-// remove_call_out() with object only, this map may contains invalidated
-// references and only get pruned during reclaim_callouts();
-typedef std::unordered_multimap<object_t *, LPC_INT> CalloutObjectMapType;
-static CalloutObjectMapType g_callout_object_handle_map;
+static pending_call_t **callout_slabs = 0;
+static int num_callout_slabs = 0;
+static int max_callout_slabs = 0;
+static pending_call_t *free_callouts = 0;
+static int num_callouts = 0;
 
-// TODO: It maybe possible to change to a per-object counter.
-
-// this counter starts with 1 because common wrong usage by passing a 0
-// (Uninitialized string) to remove_call_out, this allows us to quickly filter
-// that wrong call.
-static uint64_t unique = 1;
+#define CALLOUT_AT(i) \
+  (&callout_slabs[(i) >> CALLOUT_SLAB_BITS][(i) & CALLOUT_SLAB_MASK])
 
 static void free_call(pending_call_t *);
 static void free_called_call(pending_call_t *);
-void remove_all_call_out(object_t *);
+
+static void grow_call_outs()
+{
+  if (num_callout_slabs == max_callout_slabs) {
+    if (max_callout_slabs) {
+      max_callout_slabs *= 2;
+      callout_slabs = RESIZE(callout_slabs, max_callout_slabs,
+                             pending_call_t *, TAG_CALL_OUT, "grow_call_outs");
+    } else {
+      max_callout_slabs = 16;
+      callout_slabs = CALLOCATE(max_callout_slabs, pending_call_t *,
+                                TAG_CALL_OUT, "grow_call_outs");
+    }
+  }
+
+  pending_call_t *slab = CALLOCATE(CALLOUT_SLAB_SIZE, pending_call_t,
+                                   TAG_CALL_OUT, "grow_call_outs");
+  unsigned int base = num_callout_slabs << CALLOUT_SLAB_BITS;
+  callout_slabs[num_callout_slabs++] = slab;
+
+  for (int i = CALLOUT_SLAB_SIZE; i--;) {
+    slab[i].index = base + i;
+    slab[i].generation = 0;
+    slab[i].handle = 0;
+    slab[i].next = free_callouts;
+    free_callouts = &slab[i];
+  }
+}
+
+/* Takes a entry from the free list and links it to its owner. */
+static pending_call_t *alloc_call(object_t *owner)
+{
+  if (!free_callouts) {
+    grow_call_outs();
+  }
+  pending_call_t *cop = free_callouts;
+  free_callouts = cop->next;
+
+  if (++cop->generation > 0x7fffffff) {
+    cop->generation = 1;
+  }
+  cop->handle = ((LPC_INT) cop->generation << 32) | (cop->index + 1);
+
+  cop->owner = owner;
+  cop->prev = 0;
+  if (owner) {
+    cop->next = owner->call_outs;
+    if (owner->call_outs) {
+      owner->call_outs->prev = cop;
+    }
+    owner->call_outs = cop;
+  } else {
+    cop->next = 0;
+  }
+  num_callouts++;
+  return cop;
+}
+
+/* Unlinks a call out from its owner, its handle is no longer valid. */
+static void unlink_call(pending_call_t *cop)
+{
+  if (cop->owner) {
+    if (cop->prev) {
+      cop->prev->next = cop->next;
+    } else {
+      cop->owner->call_outs = cop->next;
+    }
+    if (cop->next) {
+      cop->next->prev = cop->prev;
+    }
+    cop->owner = 0;
+  }
+  cop->handle = 0;
+  num_callouts--;
+}
+
+static pending_call_t *find_call_by_handle(LPC_INT handle)
+{
+  LPC_INT index = (handle & 0xffffffff) - 1;
+
+  if (handle <= 0 || index < 0 ||
+      index >= ((LPC_INT) num_callout_slabs << CALLOUT_SLAB_BITS)) {
+    return 0;
+  }
+  pending_call_t *cop = CALLOUT_AT(index);
+  return cop->handle == handle ? cop : 0;
+}
 
 /*
  * Free a call out structure.
  */
 static void free_called_call(pending_call_t *cop)
 {
+  // Unlink first, dropping the last reference may free the owner.
+  if (cop->handle) {
+    unlink_call(cop);
+  }
   if (cop->ob) {
     free_string(cop->function.s);
     free_object(&cop->ob, "free_call");
@@ -57,10 +150,11 @@ static void free_called_call(pending_call_t *cop)
   }
 #endif
   if (cop->tick_event != NULL) {
-    cop->tick_event->valid = false;  // Will be freed by tick loop itself.
+    cancel_tick_event(cop->tick_event);
     cop->tick_event = NULL;
   }
-  FREE(cop);
+  cop->next = free_callouts;
+  free_callouts = cop;
 }
 
 static void free_call(pending_call_t *cop)
@@ -72,26 +166,31 @@ static void free_call(pending_call_t *cop)
 }
 
 /*
- * Setup a new call out.
+ * Setup a new call out, delay is in milliseconds.
  */
-LPC_INT new_call_out(object_t *ob, svalue_t *fun, int delay,
+LPC_INT new_call_out(object_t *ob, svalue_t *fun, int64_t delay_msecs,
                      int num_args, svalue_t *arg)
 {
-  if (delay < 0) {
-    delay = 0;
+  if (delay_msecs < 0) {
+    delay_msecs = 0;
   }
 
-  DBG_CALLOUT("new_call_out: /%s delay %i\n", ob->obname, delay);
+  DBG_CALLOUT("new_call_out: /%s delay %" PRId64 " ms\n", ob->obname,
+              delay_msecs);
 
-  pending_call_t *cop = CALLOCATE(1, pending_call_t,
-                                  TAG_CALL_OUT, "new_call_out");
+  pending_call_t *cop = alloc_call(fun->type == T_STRING ? ob :
+                                   fun->u.fp->hdr.owner);
 
-  cop->target_time = current_virtual_time + delay;
+  cop->target_time = current_virtual_time_ms + delay_msecs;
   DBG_CALLOUT("  target_time: %ld\n", cop->target_time);
 
   if (fun->type == T_STRING) {
     DBG_CALLOUT("  function: %s\n", fun->u.string);
-    cop->function.s = make_shared_string(fun->u.string);
+    if (fun->subtype == STRING_SHARED) {
+      cop->function.s = (char *) ref_string(fun->u.string);
+    } else {
+      cop->function.s = make_shared_string(fun->u.string);
+    }
     cop->ob = ob;
     add_ref(ob, "call_out");
   } else {
@@ -101,17 +200,8 @@ LPC_INT new_call_out(object_t *ob, svalue_t *fun, int delay,
     cop->ob = 0;
   }
 
-  cop->handle = current_virtual_time + (++unique);
-  if (unique > 0xffffffff) {
-    unique = 1;  // force wrapping around.
-  }
   DBG_CALLOUT("  handle: %" LPC_INT_FMTSTR_P "\n", cop->handle);
 
-  g_callout_handle_map.insert(std::make_pair(cop->handle, cop));
-  g_callout_object_handle_map.insert(
-    std::make_pair(cop->ob ? cop->ob : fun->u.fp->hdr.owner,
-                   cop->handle));
-
 #ifdef THIS_PLAYER_IN_CALL_OUT
   cop->command_giver = command_giver; /* save current user context */
   if (command_giver) {
@@ -126,7 +216,8 @@ LPC_INT new_call_out(object_t *ob, svalue_t *fun, int delay,
   }
 
   auto callback = std::bind(call_out, cop);
-  cop->tick_event = add_tick_event(delay, tick_event::callback_type(callback));
+  cop->tick_event = add_tick_event_ms(delay_msecs,
+                                      tick_event::callback_type(callback));
 
   return cop->handle;
 }
@@ -140,21 +231,23 @@ void call_out(pending_call_t *cop)
 {
   current_interactive = 0;
 
+  // The tick loop frees the event that is running.
+  cop->tick_event = NULL;
+
   object_t *ob, *new_command_giver;
   ob = (cop->ob ? cop->ob : cop->function.f->hdr.owner);
 
   DBG_CALLOUT("Executing callout: %s\n", ob ? ob->obname : "(null)");
 
-  DBG_CALLOUT("  handle: %ld\n", cop->handle);
+  DBG_CALLOUT("  handle: %" LPC_INT_FMTSTR_P "\n", cop->handle);
 
-  DBG_CALLOUT("  target_time: %ld, current_time: %ld, real_time: %ld\n",
-              cop->target_time, current_virtual_time, get_current_time());
+  DBG_CALLOUT("  target_time: %" PRId64 ", current_time: %" PRId64
+              ", real_time: %" PRId64 "\n", cop->target_time,
+              current_virtual_time_ms, get_current_time_ms());
 
-  // Remove self from callout map
-  {
-    int found = g_callout_handle_map.erase(cop->handle);
-    DEBUG_CHECK(!found, "BUG: Rogue callout, not found in map.\n");
-  }
+  // Remove self from the owner, it can no longer be found or removed.
+  DEBUG_CHECK(!cop->handle, "BUG: Rogue callout, already unlinked.\n");
+  unlink_call(cop);
 
   if (!ob || (ob->flags & O_DESTRUCTED)) {
     DBG_CALLOUT("  ob destructed, ignored.\n");
@@ -224,12 +317,31 @@ void call_out(pending_call_t *cop)
   free_called_call(cop);
 }
 
+// Seconds left until the call out runs, rounded up.
 static int time_left(pending_call_t *cop)
 {
-  // FIXME: This is not fully correct, call_out actually operates in
-  // real time, but target_time was set base on current_time, so we need to
-  // substract current_time here to get a correct value.
-  return cop->target_time - current_virtual_time;
+  int64_t msecs = cop->target_time - current_virtual_time_ms;
+  if (msecs <= 0) {
+    return 0;
+  }
+  return (msecs + 999) / 1000;
+}
+
+/*
+ * The next pending named call out to 'fun' owned by 'ob', or 0.
+ */
+static pending_call_t *find_named_call(object_t *ob, const char *fun)
+{
+  pending_call_t *found = 0;
+
+  for (auto cop = ob->call_outs; cop; cop = cop->next) {
+    if (cop->ob == ob &&
+        (cop->function.s == fun || strcmp(cop->function.s, fun) == 0) &&
+        (!found || cop->target_time <= found->target_time)) {
+      found = cop;
+    }
+  }
+  return found;
 }
 
 /*
@@ -243,26 +355,13 @@ int remove_call_out(object_t *ob, const char *fun)
 
   DBG_CALLOUT("remove_call_out: /%s \"%s\"\n", ob->obname, fun);
 
-  auto range = g_callout_object_handle_map.equal_range(ob);
-  auto iter = range.first;
-  while (iter != range.second) {
-    auto iter_handle = g_callout_handle_map.find(iter->second);
-    if (iter_handle == g_callout_handle_map.end()) {
-      iter = g_callout_object_handle_map.erase(iter);
-      continue;
-    }
-    auto cop = iter_handle->second;
-
-    if (cop->ob == ob && strcmp(cop->function.s, fun) == 0) {
-      auto remaining_time = time_left(cop);
-      free_call(cop);
-      g_callout_handle_map.erase(iter_handle);
-      g_callout_object_handle_map.erase(iter);
+  auto cop = find_named_call(ob, fun);
+  if (cop) {
+    auto remaining_time = time_left(cop);
+    free_call(cop);
 
-      DBG_CALLOUT("  found: remaining time %d.\n", remaining_time);
-      return remaining_time;
-    }
-    iter++;
+    DBG_CALLOUT("  found: remaining time %d.\n", remaining_time);
+    return remaining_time;
   }
   DBG_CALLOUT("  not found.\n");
   return -1;
@@ -275,19 +374,11 @@ int remove_call_out_by_handle(object_t *ob, LPC_INT handle)
   DBG_CALLOUT("remove_call_out_by_handle: ob: %s, handle: %" LPC_INT_FMTSTR_P ".\n",
               ob->obname, handle);
 
-  if (handle == 0 || handle < unique) {
-    DBG_CALLOUT("  invalid handle, ignored.\n");
-    return -1;
-  }
-
-  auto iter = g_callout_handle_map.find(handle);
-  if (iter != g_callout_handle_map.end()) {
-    auto cop = iter->second;
+  auto cop = find_call_by_handle(handle);
+  if (cop) {
     auto remaining_time = time_left(cop);
     free_call(cop);
 
-    g_callout_handle_map.erase(iter);
-
     DBG_CALLOUT("  found: remaining time %d.\n", remaining_time);
     return remaining_time;
   }
@@ -300,20 +391,11 @@ int find_call_out_by_handle(object_t *ob, LPC_INT handle)
   DBG_CALLOUT("find_call_out_by_handle: ob: %s, handle: %" LPC_INT_FMTSTR_P "\n",
               ob->obname, handle);
 
-  if (handle == 0 || handle < unique) {
-    DBG_CALLOUT("  invalid handle, ignored.\n");
-    return -1;
-  }
-
-  auto iter = g_callout_handle_map.find(handle);
-  if (iter != g_callout_handle_map.end()) {
-    auto cop = iter->second;
-    if (cop->handle == handle &&
-        (cop->ob == ob || cop->function.f->hdr.owner == ob)) {
-      auto remaining_time = time_left(cop);
-      DBG_CALLOUT("  found: remaining time %d.\n", remaining_time);
-      return remaining_time;
-    }
+  auto cop = find_call_by_handle(handle);
+  if (cop && cop->owner == ob) {
+    auto remaining_time = time_left(cop);
+    DBG_CALLOUT("  found: remaining time %d.\n", remaining_time);
+    return remaining_time;
   }
   DBG_CALLOUT("  not found.\n");
   return -1;
@@ -325,21 +407,11 @@ int find_call_out(object_t *ob, const char *fun)
 
   DBG_CALLOUT("find_call_out: ob:%s \"%s\"\n", ob->obname, fun);
 
-  auto range = g_callout_object_handle_map.equal_range(ob);
-  auto iter = range.first;
-  while (iter != range.second) {
-    auto iter_handle = g_callout_handle_map.find(iter->second);
-    if (iter_handle == g_callout_handle_map.end()) {
-      iter = g_callout_object_handle_map.erase(iter);
-      continue;
-    }
-    auto cop = iter_handle->second;
-    if (cop->ob == ob && strcmp(cop->function.s, fun) == 0) {
-      auto remaining_time = time_left(cop);
-      DBG_CALLOUT("  found: remaining time %d.\n", remaining_time);
-      return remaining_time;
-    }
-    iter++;
+  auto cop = find_named_call(ob, fun);
+  if (cop) {
+    auto remaining_time = time_left(cop);
+    DBG_CALLOUT("  found: remaining time %d.\n", remaining_time);
+    return remaining_time;
   }
   DBG_CALLOUT("  not found.\n");
   return -1;
@@ -347,30 +419,34 @@ int find_call_out(object_t *ob, const char *fun)
 
 int print_call_out_usage(outbuffer_t *ob, int verbose)
 {
+  int slab_bytes = num_callout_slabs * CALLOUT_SLAB_SIZE * sizeof(pending_call_t);
+  int bytes = slab_bytes + max_callout_slabs * sizeof(pending_call_t *);
+
   if (verbose == 1) {
     outbuf_add(ob, "Call out information:\n");
     outbuf_add(ob, "---------------------\n");
-    outbuf_addv(ob, "Number of allocated call outs: %8d, %8d bytes.\n",
-                g_callout_handle_map.size(), g_callout_handle_map.size() * sizeof(pending_call_t));
-    outbuf_addv(ob, "Current handle map bucket: %d\n", g_callout_handle_map.bucket_count());
-    outbuf_addv(ob, "Current handle map load_factor: %f\n", g_callout_handle_map.load_factor());
-    outbuf_addv(ob, "Current object map bucket: %d\n", g_callout_object_handle_map.bucket_count());
-    outbuf_addv(ob, "Current object map load_factor: %f\n", g_callout_object_handle_map.load_factor());
-    outbuf_addv(ob, "Number of garbage entry in object map: %d\n", g_callout_object_handle_map.size() - g_callout_handle_map.size());
+    outbuf_addv(ob, "Number of pending call outs: %8d, %8d bytes.\n",
+                num_callouts, num_callouts * sizeof(pending_call_t));
+    outbuf_addv(ob, "Number of call out slabs: %d, %d entries, %d bytes.\n",
+                num_callout_slabs, num_callout_slabs * CALLOUT_SLAB_SIZE,
+                slab_bytes);
   } else {
     if (verbose != -1)
-      outbuf_addv(ob, "call out:\t\t\t%8d %8d (load_factor %f)\n",
-                  g_callout_handle_map.size(), g_callout_handle_map.size() * sizeof(pending_call_t),
-                  g_callout_handle_map.load_factor());
+      outbuf_addv(ob, "call out:\t\t\t%8d %8d (%d allocated)\n",
+                  num_callouts, bytes,
+                  num_callout_slabs * CALLOUT_SLAB_SIZE);
   }
-  return g_callout_handle_map.size() * sizeof(pending_call_t);
+  return bytes;
 }
 
 #ifdef DEBUGMALLOC_EXTENSIONS
 void mark_call_outs()
 {
-  for (auto iter = g_callout_handle_map.cbegin(); iter != g_callout_handle_map.cend(); iter++) {
-    auto cop = iter->second;
+  for (int i = 0; i < num_callout_slabs * CALLOUT_SLAB_SIZE; i++) {
+    auto cop = CALLOUT_AT(i);
+    if (!cop->handle) {
+      continue;
+    }
     if (cop->vs) {
       cop->vs->extra_ref++;
     }
@@ -398,8 +474,11 @@ void mark_call_outs()
 array_t *get_all_call_outs()
 {
   int i = 0;
-  for (auto iter = g_callout_handle_map.cbegin(); iter != g_callout_handle_map.cend(); iter++) {
-    auto cop = iter->second;
+  for (int j = 0; j < num_callout_slabs * CALLOUT_SLAB_SIZE; j++) {
+    auto cop = CALLOUT_AT(j);
+    if (!cop->handle) {
+      continue;
+    }
     object_t *ob = (cop->ob ? cop->ob : cop->function.f->hdr.owner);
     if (ob && !(ob->flags & O_DESTRUCTED)) {
       i++;
@@ -409,8 +488,11 @@ array_t *get_all_call_outs()
   array_t *v = allocate_empty_array(i);
 
   i = 0;
-  for (auto iter = g_callout_handle_map.cbegin(); iter != g_callout_handle_map.cend(); iter++) {
-    auto cop = iter->second;
+  for (int j = 0; j < num_callout_slabs * CALLOUT_SLAB_SIZE; j++) {
+    auto cop = CALLOUT_AT(j);
+    if (!cop->handle) {
+      continue;
+    }
     array_t *vv;
     object_t *ob;
     ob = (cop->ob ? cop->ob : cop->function.f->hdr.owner);
@@ -460,29 +542,9 @@ remove_all_call_out(object_t *obj)
 {
   int i = 0;
 
-  auto range = g_callout_object_handle_map.equal_range(obj);
-  auto iter = range.first;
-
-  while (iter != range.second) {
-    auto iter_handle = g_callout_handle_map.find(iter->second);
-    if (iter_handle == g_callout_handle_map.end()) {
-      iter = g_callout_object_handle_map.erase(iter);
-      continue;
-    }
-    auto cop = iter_handle->second;
-    if ((cop->ob &&
-         ((cop->ob == obj) || (cop->ob->flags & O_DESTRUCTED))) ||
-        (!(cop->ob) &&
-         (cop->function.f->hdr.owner == obj ||
-          !cop->function.f->hdr.owner ||
-          (cop->function.f->hdr.owner->flags & O_DESTRUCTED)))) {
-      free_call(cop);
-      g_callout_handle_map.erase(iter_handle);
-      iter = g_callout_object_handle_map.erase(iter);
-      i++;
-    } else {
-      iter++;
-    }
+  while (obj->call_outs) {
+    free_call(obj->call_outs);
+    i++;
   }
   DBG_CALLOUT("remove_all_call_out: removed %d callouts.\n", i);
 }
@@ -490,12 +552,12 @@ remove_all_call_out(object_t *obj)
 void clear_call_outs()
 {
   int i = 0;
-  auto iter = g_callout_handle_map.begin();
-  while (iter != g_callout_handle_map.end()) {
-    auto cop = iter->second;
-    free_call(cop);
-    iter = g_callout_handle_map.erase(iter);
-    i++;
+  for (int j = 0; j < num_callout_slabs * CALLOUT_SLAB_SIZE; j++) {
+    auto cop = CALLOUT_AT(j);
+    if (cop->handle) {
+      free_call(cop);
+      i++;
+    }
   }
   debug_message("clear_call_outs: %d leftover callouts cleared.\n", i);
 }
@@ -504,49 +566,27 @@ void reclaim_call_outs()
 {
   DBG_CALLOUT("!!! reclaiming callouts.\n");
 
-  // removes call_outs to destructed objects
+  // removes call_outs to destructed objects, those should normally be gone
+  // with their owner already.
   int i = 0;
-  {
-    auto iter = g_callout_handle_map.begin();
-    while (iter != g_callout_handle_map.end()) {
-      auto cop = iter->second;
-      if ((cop->ob && (cop->ob->flags & O_DESTRUCTED)) ||
-          (!cop->ob && (cop->function.f->hdr.owner->flags & O_DESTRUCTED))) {
-        free_call(cop);
-        iter = g_callout_handle_map.erase(iter);
-        i++;
-      } else {
-        iter++;
-      }
+  for (int j = 0; j < num_callout_slabs * CALLOUT_SLAB_SIZE; j++) {
+    auto cop = CALLOUT_AT(j);
+    if (!cop->handle) {
+      continue;
     }
-  }
-  DBG_CALLOUT("reclaim_call_outs: %d callouts with destructed object.\n", i);
-
-  // GC all invalid object->handle entries
-  i = 0;
-  {
-    auto iter = g_callout_object_handle_map.begin();
-    while (iter != g_callout_object_handle_map.end()) {
-      if (g_callout_handle_map.find(iter->second) == g_callout_handle_map.end()) {
-        iter = g_callout_object_handle_map.erase(iter);
-        i++;
-      } else {
-        iter++;
-      }
+    if ((cop->ob && (cop->ob->flags & O_DESTRUCTED)) ||
+        (!cop->ob && (!cop->function.f->hdr.owner ||
+                      (cop->function.f->hdr.owner->flags & O_DESTRUCTED)))) {
+      free_call(cop);
+      i++;
     }
-  }
-  DBG_CALLOUT("reclaim_call_outs: %d garbage in object handle map.\n", i);
-
 #ifdef THIS_PLAYER_IN_CALL_OUT
-  i = 0;
-  for (auto iter = g_callout_handle_map.cbegin(); iter != g_callout_handle_map.cend(); iter++) {
-    auto cop = iter->second;
-    if (cop->command_giver && (cop->command_giver->flags & O_DESTRUCTED)) {
+    else if (cop->command_giver &&
+             (cop->command_giver->flags & O_DESTRUCTED)) {
       free_object(&cop->command_giver, "reclaim_call_outs");
       cop->command_giver = 0;
-      i++;
     }
-  }
-  DBG_CALLOUT("reclaim_call_outs: %d callouts with command_giver gone.\n", i);
 #endif
+  }
+  DBG_CALLOUT("reclaim_call_outs: %d callouts with destructed object.\n", i);
 }
@@ -10,15 +10,20 @@ struct tick_event;
  */
 
 typedef struct pending_call_s {
-  long target_time;
+  int64_t target_time;  /* in milliseconds */
   union string_or_func function;
   object_t *ob;
   array_t *vs;
 #ifdef THIS_PLAYER_IN_CALL_OUT
   object_t *command_giver;
 #endif
-  LPC_INT handle;
+  LPC_INT handle;  /* 0 when not pending */
   struct tick_event *tick_event;
+  /* owner's call out list, 'next' also links the free list */
+  object_t *owner;
+  struct pending_call_s *prev, *next;
+  unsigned int index;  /* position in the slabs */
+  unsigned int generation;
 } pending_call_t;
 
 void call_out(pending_call_t *cop);
@@ -29,7 +34,7 @@ void clear_call_outs(void);
 void reclaim_call_outs(void);
 int find_call_out_by_handle(object_t *, LPC_INT);
 int remove_call_out_by_handle(object_t *, LPC_INT);
-LPC_INT new_call_out(object_t *, svalue_t *, int, int, svalue_t *);
+LPC_INT new_call_out(object_t *, svalue_t *, int64_t, int, svalue_t *);
 int remove_call_out(object_t *, const char *);
 void remove_all_call_out(object_t *);
 int find_call_out(object_t *, const char *);
@@ -19,6 +19,7 @@
 #include "port.h"  // get_current_time
 #include "event.h"
 #include "dns.h"
+#include "latency.h"
 
 #include <algorithm>
 
@@ -38,6 +39,9 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+/* chunks of queued output handed to one sendmsg() */
+#define FLUSH_IOVECS 16
+
 #define TELOPT_MSSP 70
 #define TELOPT_COMPRESS 85
 #define TELOPT_COMPRESS2 86
@@ -135,6 +139,12 @@ static void end_compression(interactive_t *);
 static void start_compression(interactive_t *);
 static int send_compressed(interactive_t *ip, unsigned char *data, int length);
 static int flush_compressed_output(interactive_t *ip);
+#ifdef HAVE_ZLIB
+static void start_websocket_deflate(interactive_t *);
+static void end_websocket_deflate(interactive_t *);
+static int websocket_deflate(interactive_t *);
+static int websocket_inflate(interactive_t *, unsigned char *, int, int);
+#endif
 
 #ifdef NO_SNOOP
 #  define handle_snoop(str, len, who)
@@ -415,6 +425,269 @@ static int shadow_catch_message(object_t *ob, const char *str)
 }
 #endif
 
+/*
+ * Output to a user is queued in an evbuffer.  Messages are copied into it
+ * once, translating newlines while copying, and flush_message() hands the
+ * queued chunks to sendmsg() without copying them again.  A message is
+ * added a piece at a time, flushing whenever MESSAGE_BUF_SIZE bytes are
+ * queued, so long messages go out whole; only once the socket takes no
+ * more is the rest of a message dropped.
+ */
+
+/*
+ * Room left in the output queue, flushing first if the message doesn't fit.
+ * Returns -1 if the connection broke.
+ */
+static int output_room(interactive_t *ip, int wanted)
+{
+  int room = MESSAGE_BUF_SIZE - evbuffer_get_length(ip->output);
+
+  if (room < wanted) {
+    if (!flush_message(ip)) {
+      debug(connections, ("Broken connection during add_message."));
+      return -1;
+    }
+    room = MESSAGE_BUF_SIZE - evbuffer_get_length(ip->output);
+  }
+  return room;
+}
+
+static void output_add(interactive_t *ip, const char *data, int len)
+{
+  int room, n;
+
+  while (len > 0) {
+    if ((room = output_room(ip, len)) <= 0) {
+      return;
+    }
+    n = std::min(len, room);
+    evbuffer_add(ip->output, data, n);
+    data += n;
+    len -= n;
+  }
+}
+
+/*
+ * Copy at most 'max' bytes of 'data' to 'out', sending '\n' as "\r\n" and
+ * doubling IAC.  memchr() finds the next byte of either kind, so the runs
+ * in between are scanned and copied a vector at a time.  Returns the
+ * number of bytes written, and the number of bytes of 'data' they came
+ * from in *used.
+ */
+static int expand_newlines(char *out, int max, const char *data, int len,
+                           int *used)
+{
+  const char *begin = data, *end = data + len;
+  const char *nl = (const char *) memchr(data, '\n', len);
+  const char *iac = (const char *) memchr(data, 0xff, len);
+  char *start = out, *limit = out + max;
+
+  while (nl || iac) {
+    const char *hit = (!iac || (nl && nl < iac)) ? nl : iac;
+
+    if (hit - data + 2 > limit - out) {
+      end = hit;  /* leave it for the next piece */
+      break;
+    }
+    memcpy(out, data, hit - data);
+    out += hit - data;
+    *out++ = (hit == nl) ? '\r' : *hit;
+    *out++ = *hit;
+    data = hit + 1;
+    if (hit == nl) {
+      nl = (const char *) memchr(data, '\n', end - data);
+    } else {
+      iac = (const char *) memchr(data, 0xff, end - data);
+    }
+  }
+  len = std::min(end - data, limit - out);
+  memcpy(out, data, len);
+  *used = data + len - begin;
+  return out + len - start;
+}
+
+static void output_add_text(interactive_t *ip, const char *data, int len)
+{
+  const char *end = data + len, *p;
+  int size = len;
+
+  for (p = data; (p = (const char *) memchr(p, '\n', end - p)); p++) {
+    size++;
+  }
+  for (p = data; (p = (const char *) memchr(p, 0xff, end - p)); p++) {
+    size++;
+  }
+  if (size == len) {
+    output_add(ip, data, len);
+    return;
+  }
+
+  while (len > 0) {
+    struct evbuffer_iovec vec;
+    int room = output_room(ip, size), used;
+
+    /* an expanded byte takes two */
+    if (room < std::min(size, 2) ||
+        evbuffer_reserve_space(ip->output, std::min(size, room), &vec, 1) < 1) {
+      return;
+    }
+    vec.iov_len = expand_newlines((char *) vec.iov_base, std::min(size, room),
+                                  data, len, &used);
+    evbuffer_commit_space(ip->output, &vec, 1);
+    data += used;
+    len -= used;
+    size -= vec.iov_len;
+  }
+}
+
+/*
+ * Broadcasts.  While a broadcast is active, add_message() with exactly the
+ * broadcast text (the same pointer, which the caller keeps alive) encodes
+ * it only once per charset and connection type.  The encoded block is
+ * shared by all the output queues it goes to and freed with the last one.
+ * Snoops and shadows still see every recipient.
+ */
+#define BROADCAST_ENCODINGS 8
+/* smaller blocks are copied, a reference costs about as much */
+#define SHARED_OUTPUT_MIN 256
+
+typedef struct {
+  int refs;
+  int len;
+  char data[1];
+} shared_output_t;
+
+static struct {
+  int depth;
+  const char *text;
+  int len;
+  int num_encoded;
+  struct {
+    struct translation *trans;
+    int binary;
+    shared_output_t *block;
+  } encoded[BROADCAST_ENCODINGS];
+} broadcast;
+
+int broadcast_encodes = 0, broadcast_shares = 0;
+
+static void release_shared_output(shared_output_t *block)
+{
+  if (!--block->refs) {
+    FREE(block);
+  }
+}
+
+static void release_shared_output_cb(const void *, size_t, void *block)
+{
+  release_shared_output((shared_output_t *) block);
+}
+
+void begin_broadcast(const char *text, int len)
+{
+  if (broadcast.depth++) {
+    return;  /* nested broadcasts only share the outer message */
+  }
+  broadcast.text = text;
+  broadcast.len = len;
+  broadcast.num_encoded = 0;
+}
+
+void end_broadcast()
+{
+  if (--broadcast.depth) {
+    return;
+  }
+  for (int i = 0; i < broadcast.num_encoded; i++) {
+    release_shared_output(broadcast.encoded[i].block);
+  }
+  broadcast.num_encoded = 0;
+  broadcast.text = 0;
+}
+
+/*
+ * The encoded broadcast text for ip, or 0 if it can't be shared.
+ */
+static shared_output_t *broadcast_block(interactive_t *ip)
+{
+  int binary = 0;
+  int i;
+
+#ifndef NO_BUFFER_TYPE
+  binary = (ip->connection_type == PORT_BINARY);
+#endif
+  for (i = 0; i < broadcast.num_encoded; i++) {
+    if (broadcast.encoded[i].trans == ip->trans &&
+        broadcast.encoded[i].binary == binary) {
+      broadcast_shares++;
+      return broadcast.encoded[i].block;
+    }
+  }
+  if (i == BROADCAST_ENCODINGS) {
+    return 0;
+  }
+
+  int translen, size;
+  const char *trans = translate(ip->trans->outgoing, broadcast.text,
+                                broadcast.len, &translen);
+  const char *end = trans + translen, *p;
+
+  size = translen;
+  if (!binary) {
+    for (p = trans; (p = (const char *) memchr(p, '\n', end - p)); p++) {
+      size++;
+    }
+    for (p = trans; (p = (const char *) memchr(p, 0xff, end - p)); p++) {
+      size++;
+    }
+  }
+  shared_output_t *block = (shared_output_t *)
+                           DMALLOC(sizeof(shared_output_t) + size,
+                                   TAG_PERMANENT, "broadcast_block");
+  block->refs = 1;
+  if (binary) {
+    memcpy(block->data, trans, translen);
+    block->len = translen;
+  } else {
+    int used;
+
+    block->len = expand_newlines(block->data, size, trans, translen, &used);
+  }
+  broadcast.encoded[i].trans = ip->trans;
+  broadcast.encoded[i].binary = binary;
+  broadcast.encoded[i].block = block;
+  broadcast.num_encoded++;
+  broadcast_encodes++;
+  return block;
+}
+
+static void output_add_shared(interactive_t *ip, shared_output_t *block)
+{
+  if (block->len < SHARED_OUTPUT_MIN) {
+    output_add(ip, block->data, block->len);
+    return;
+  }
+
+  const char *data = block->data;
+  int len = block->len, room, n;
+
+  /* each piece holds a reference of its own */
+  while (len > 0) {
+    if ((room = output_room(ip, len)) <= 0) {
+      return;
+    }
+    n = std::min(len, room);
+    block->refs++;
+    if (evbuffer_add_reference(ip->output, data, n,
+                               release_shared_output_cb, block) == -1) {
+      block->refs--;
+      return;
+    }
+    data += n;
+    len -= n;
+  }
+}
+
 /*
  * Send a message to an interactive object. If that object is shadowed,
  * special handling is done.
@@ -422,10 +695,9 @@ static int shadow_catch_message(object_t *ob, const char *str)
 void add_message(object_t *who, const char *data, int len)
 {
   interactive_t *ip;
-  const char *cp;
-  const char *end;
   char *trans;
   int translen;
+  shared_output_t *block = 0;
   /*
    * if who->interactive is not valid, write message on stderr.
    * (maybe)
@@ -439,7 +711,12 @@ void add_message(object_t *who, const char *data, int len)
     return;
   }
   ip = who->interactive;
-  trans = translate(ip->trans->outgoing, data, len, &translen);
+  if (broadcast.text == data && broadcast.len == len) {
+    block = broadcast_block(ip);
+  }
+  if (!block) {
+    trans = translate(ip->trans->outgoing, data, len, &translen);
+  }
 #ifdef SHADOW_CATCH_MESSAGE
   /*
    * shadow handling.
@@ -453,42 +730,17 @@ void add_message(object_t *who, const char *data, int len)
 #endif                          /* NO_SHADOWS */
 
   /*
-   * write message into ip->message_buf.
+   * queue the message, translating newlines on the way.
    */
-  end = trans + translen;
-  for (cp = trans; cp < end; cp++) {
-    if (ip->message_length == MESSAGE_BUF_SIZE) {
-      if (!flush_message(ip)) {
-        debug(connections, ("Broken connection during add_message."));
-        return;
-      }
-      if (ip->message_length == MESSAGE_BUF_SIZE) {
-        break;
-      }
-    }
-    if ((*cp == '\n' || *cp == -1)
+  if (block) {
+    output_add_shared(ip, block);
+  } else
 #ifndef NO_BUFFER_TYPE
-        && ip->connection_type != PORT_BINARY
+  if (ip->connection_type == PORT_BINARY) {
+    output_add(ip, trans, translen);
+  } else
 #endif
-       ) {
-      if (ip->message_length == (MESSAGE_BUF_SIZE - 1)) {
-        if (!flush_message(ip)) {
-          debug(connections, ("Broken connection during add_message."));
-          return;
-        }
-        if (ip->message_length == (MESSAGE_BUF_SIZE - 1)) {
-          break;
-        }
-      }
-      ip->message_buf[ip->message_producer] = (*cp == '\n') ? '\r' : -1;
-      ip->message_producer = (ip->message_producer + 1)
-                             % MESSAGE_BUF_SIZE;
-      ip->message_length++;
-    }
-    ip->message_buf[ip->message_producer] = *cp;
-    ip->message_producer = (ip->message_producer + 1) % MESSAGE_BUF_SIZE;
-    ip->message_length++;
-  }
+    output_add_text(ip, trans, translen);
 
   handle_snoop(data, len, ip);
 
@@ -521,9 +773,6 @@ void add_vmessage(object_t *who, const char *format, ...)
 
 void add_binary_message_noflush(object_t *who, const unsigned char *data, int len)
 {
-  interactive_t *ip;
-  const unsigned char *cp, *end;
-
   /*
    * if who->interactive is not valid, bail
    */
@@ -531,26 +780,7 @@ void add_binary_message_noflush(object_t *who, const unsigned char *data, int le
       (who->interactive->iflags & (NET_DEAD | CLOSING))) {
     return;
   }
-  ip = who->interactive;
-
-  /*
-   * write message into ip->message_buf.
-   */
-  end = data + len;
-  for (cp = data; cp < end; cp++) {
-    if (ip->message_length == MESSAGE_BUF_SIZE) {
-      if (!flush_message(ip)) {
-        debug(connections, ("Broken connection during add_message."));
-        return;
-      }
-      if (ip->message_length == MESSAGE_BUF_SIZE) {
-        break;
-      }
-    }
-    ip->message_buf[ip->message_producer] = *cp;
-    ip->message_producer = (ip->message_producer + 1) % MESSAGE_BUF_SIZE;
-    ip->message_length++;
-  }
+  output_add(who->interactive, (const char *) data, len);
   add_message_calls++;
 }
 
@@ -562,12 +792,128 @@ void add_binary_message(object_t *who, const unsigned char *data, int len)
   }
 }
 
+/*
+ * Build the WebSocket iovec for the next write: whatever is left of the
+ * current frame header followed by the frame payload still queued in
+ * ip->output.  Once the previous frame has been written out completely, a
+ * pending control frame goes next, or else a new binary frame covering
+ * all queued output is started.
+ */
+static int websocket_iovecs(interactive_t *ip, struct evbuffer_iovec *vec, int max)
+{
+  int n, i, h = 0;
+  size_t len, want;
+
+  if (!ip->ws_out_remaining &&
+      ip->ws_out_header_sent == ip->ws_out_header_len) {
+    unsigned char *hdr = ip->ws_out_header;
+
+    ip->ws_out_header_sent = 0;
+    if (ip->ws_out_control_len) {
+      /* sent as a header without payload */
+      memcpy(hdr, ip->ws_out_control, ip->ws_out_control_len);
+      ip->ws_out_header_len = ip->ws_out_control_len;
+      ip->ws_out_control_len = 0;
+    } else {
+      hdr[0] = WS_FIN | 0x02;     /* final frame of a binary message */
+#ifdef HAVE_ZLIB
+      if (ip->ws_deflate) {
+        if (!websocket_deflate(ip)) {
+          return -1;
+        }
+        hdr[0] |= WS_RSV1;
+      }
+#endif
+      len = evbuffer_get_length(ip->output);
+      if (len < 126) {
+        hdr[1] = len;
+        ip->ws_out_header_len = 2;
+      } else if (len < 65536) {
+        hdr[1] = 126;
+        hdr[2] = len >> 8;
+        hdr[3] = len;
+        ip->ws_out_header_len = 4;
+      } else {
+        hdr[1] = 127;
+        for (i = 0; i < 8; i++) {
+          hdr[2 + i] = (uint64_t) len >> (56 - 8 * i);
+        }
+        ip->ws_out_header_len = 10;
+      }
+      ip->ws_out_remaining = len;
+    }
+  }
+  if (ip->ws_out_header_sent < ip->ws_out_header_len) {
+    vec[0].iov_base = ip->ws_out_header + ip->ws_out_header_sent;
+    vec[0].iov_len = ip->ws_out_header_len - ip->ws_out_header_sent;
+    h = 1;
+  }
+  if (!ip->ws_out_remaining) {
+    return h;
+  }
+  /* the last extent may run past this frame into output queued since */
+  n = evbuffer_peek(ip->output, ip->ws_out_remaining, NULL, vec + h, max - h);
+  n = std::min(n, max - h);
+  want = ip->ws_out_remaining;
+  for (i = h; i < h + n; i++) {
+    if (vec[i].iov_len >= want) {
+      vec[i].iov_len = want;
+      return i + 1;
+    }
+    want -= vec[i].iov_len;
+  }
+  return h + n;
+}
+
+/*
+ * Answer a complete incoming control frame: a ping with a pong carrying
+ * the same payload, and a close with a close echoing the status code,
+ * after which the connection is dropped.  Pongs are ignored.  The reply
+ * goes out as soon as the frame being written, if any, is finished.
+ */
+static void websocket_control(interactive_t *ip)
+{
+  unsigned char *frame = ip->ws_out_control;
+  int len = ip->ws_control_len;
+
+  if (ip->ws_in_opcode == WS_PONG) {
+    return;
+  }
+  if (ip->ws_in_opcode == WS_CLOSE) {
+    len = std::min(len, 2);
+  }
+  /* an unanswered ping is superseded by this one */
+  frame[0] = WS_FIN | (ip->ws_in_opcode == WS_PING ? WS_PONG : WS_CLOSE);
+  frame[1] = len;
+  memcpy(frame + 2, ip->ws_control, len);
+  ip->ws_out_control_len = 2 + len;
+  if (ip->ws_in_opcode == WS_CLOSE) {
+    remove_interactive(ip->ob, 0);   /* flushes the reply first */
+  } else {
+    flush_message(ip);
+  }
+}
+
+/*
+ * Account for num_bytes written from the websocket_iovecs() vector and
+ * return how many of them came out of ip->output.
+ */
+static int websocket_written(interactive_t *ip, int num_bytes)
+{
+  int hdr = std::min(num_bytes, ip->ws_out_header_len - ip->ws_out_header_sent);
+
+  ip->ws_out_header_sent += hdr;
+  ip->ws_out_remaining -= num_bytes - hdr;
+  return num_bytes - hdr;
+}
+
 /*
  * Flush outgoing message buffer of current interactive object.
  */
 int flush_message(interactive_t *ip)
 {
-  int length, num_bytes;
+  int length, num_bytes, drained;
+  int websocket;
 
   /*
    * if ip is not valid, do nothing.
@@ -576,47 +922,46 @@ int flush_message(interactive_t *ip)
     debug(connections, ("flush_message: invalid target!\n"));
     return 0;
   }
+  websocket = ip->connection_type == PORT_WEBSOCKET &&
+              (ip->iflags & HANDSHAKE_COMPLETE);
+#ifdef HAVE_ZLIB
+  websocket = websocket && !ip->compressed_stream;
+#endif
   /*
-   * write ip->message_buf[] to socket.
+   * write the queued output to the socket.
    */
-  while (ip->message_length != 0) {
-    if (ip->message_consumer < ip->message_producer) {
-      length = ip->message_producer - ip->message_consumer;
-    } else {
-      length = MESSAGE_BUF_SIZE - ip->message_consumer;
-    }
+  while ((length = evbuffer_get_length(ip->output)) != 0 ||
+         (websocket && (ip->ws_out_control_len ||
+                        ip->ws_out_header_sent < ip->ws_out_header_len))) {
 #ifdef HAVE_ZLIB
     if (ip->compressed_stream) {
-      num_bytes = send_compressed(ip, (unsigned char *)ip->message_buf +
-                                  ip->message_consumer,  length);
+      struct evbuffer_iovec vec;
+
+      evbuffer_peek(ip->output, -1, NULL, &vec, 1);
+      num_bytes = send_compressed(ip, (unsigned char *) vec.iov_base,
+                                  vec.iov_len);
     } else {
 #endif
-      if (ip->connection_type == PORT_WEBSOCKET && (ip->iflags & HANDSHAKE_COMPLETE)) {
+      /* evbuffer_iovec is laid out like struct iovec. */
+      struct evbuffer_iovec vec[FLUSH_IOVECS];
+      struct msghdr msg;
+      int n;
+
+      if (websocket) {
         ip->out_of_band = 0;
-        //ok we're in trouble, we have to send the whole thing at once, otherwise we don't know the size!
-        //try to get away with only sending small chunks
-        int sendsize = length;
-        if (length > 125) {
-          sendsize = 125;
-        }
-        unsigned short flags = htons(sendsize | 0x8200); //82 is final packet (of this message) type binary
-        int sendres = send(ip->fd, &flags, 2, 0);
-        if (sendres <= 0) {
-          return 1;    //wait
-        }
-        if (sendres == 1) {
-          ip->iflags |= NET_DEAD;
-          return 0;
-        }
-        num_bytes = send(ip->fd, ip->message_buf + ip->message_consumer, sendsize, 0);
-        if (num_bytes != sendsize) {
+        n = websocket_iovecs(ip, vec, FLUSH_IOVECS);
+        if (n < 0) {
           ip->iflags |= NET_DEAD;
           return 0;
         }
       } else {
-        num_bytes = send(ip->fd, ip->message_buf + ip->message_consumer,
-                         length, ip->out_of_band | MSG_NOSIGNAL);
+        n = evbuffer_peek(ip->output, -1, NULL, vec, FLUSH_IOVECS);
+        n = std::min(n, FLUSH_IOVECS);
       }
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = (struct iovec *) vec;
+      msg.msg_iovlen = n;
+      num_bytes = sendmsg(ip->fd, &msg, ip->out_of_band | MSG_NOSIGNAL);
 #ifdef HAVE_ZLIB
     }
 #endif
@@ -640,9 +985,11 @@ int flush_message(interactive_t *ip)
         return 0;
       }
     }
-    ip->message_consumer = (ip->message_consumer + num_bytes) %
-                           MESSAGE_BUF_SIZE;
-    ip->message_length -= num_bytes;
+    drained = num_bytes;
+    if (websocket) {
+      drained = websocket_written(ip, num_bytes);
+    }
+    evbuffer_drain(ip->output, drained);
     ip->out_of_band = 0;
     inet_packets++;
     inet_volume += num_bytes;
@@ -652,6 +999,13 @@ int flush_message(interactive_t *ip)
     external_port[ip->external_port].out_packets++;
     external_port[ip->external_port].out_volume += num_bytes;
 #endif
+    if (ip->command_usec) {
+      int64_t usecs = get_monotonic_usec() - ip->command_usec;
+
+      latency_record(&ip->command_latency, usecs);
+      latency_record(&latency_command_output, usecs);
+      ip->command_usec = 0;
+    }
   }
   return 1;
 }                               /* flush_message() */
@@ -1265,6 +1619,7 @@ void get_user_data(interactive_t *ip)
       if (ip->ws_size && ws_space > ip->ws_size) {
         ws_space = ip->ws_size;    //keep the next packet in the socket
       }
+      text_space = ws_space;
       break;
     case PORT_TELNET:
       text_space = MAX_TEXT - ip->text_end;
@@ -1335,11 +1690,37 @@ void get_user_data(interactive_t *ip)
         ip->ws_text_end += num_bytes;
         if (!ip->ws_size) {
           unsigned char *data = (unsigned char *)&ip->ws_text[ip->ws_text_start];
-          if (ip->ws_text_end - ip->ws_text_start < 8) {
+          int avail = ip->ws_text_end - ip->ws_text_start;
+          if (avail < 2 || avail < 2 + ((data[1] & 0x7f) == 126 ? 2 : 0) +
+                                   ((data[1] & 0x80) ? 4 : 0)) {
             break;
           }
           unsigned char msize = data[1];
           int size = msize & 0x7f;
+          int opcode = data[0] & WS_OPCODE;
+          if (opcode & WS_CONTROL) {
+            /* may come between the frames of a message, which it leaves
+               alone */
+            if (opcode > WS_PONG || !(data[0] & WS_FIN) ||
+                size > WS_MAX_CONTROL) {
+              ip->iflags |= NET_DEAD;
+              remove_interactive(ip->ob, 0);
+              return;
+            }
+            ip->ws_control_len = 0;
+          } else if (opcode > 0x02) {
+            /* reserved */
+            ip->iflags |= NET_DEAD;
+            remove_interactive(ip->ob, 0);
+            return;
+          } else if (opcode) {
+            /* a new text or binary message */
+            ip->ws_in_flags = data[0] & (WS_FIN | WS_RSV1);
+          } else {
+            /* continuation frames inherit RSV1 from the first frame */
+            ip->ws_in_flags = (ip->ws_in_flags & WS_RSV1) | (data[0] & WS_FIN);
+          }
+          ip->ws_in_opcode = opcode;
           ip->ws_text_start += 2;
           if (size == 126) {
             size = (data[2] << 8) | data[3];
@@ -1355,6 +1736,9 @@ void get_user_data(interactive_t *ip)
             ip->ws_text_start += 4;
           } else { ip->ws_mask = 0; }
           ip->ws_maskoffs = 0;
+          if (!size) {
+            num_bytes = 0;    /* nothing but the header */
+          }
         }
         int i;
         if (ip->ws_size) {
@@ -1388,6 +1772,25 @@ void get_user_data(interactive_t *ip)
             ip->ws_size -= left;
           }
         }
+        if (ip->ws_in_opcode & WS_CONTROL) {
+          memcpy(ip->ws_control + ip->ws_control_len, buf, num_bytes);
+          ip->ws_control_len += num_bytes;
+          if (!ip->ws_size) {
+            websocket_control(ip);
+          }
+          break;
+        }
+#ifdef HAVE_ZLIB
+        if (ip->ws_inflate && (ip->ws_in_flags & WS_RSV1)) {
+          if (!websocket_inflate(ip, buf, num_bytes,
+                                 !ip->ws_size && (ip->ws_in_flags & WS_FIN))) {
+            ip->iflags |= NET_DEAD;
+            remove_interactive(ip->ob, 0);
+            return;
+          }
+          num_bytes = 0;
+        }
+#endif
         //          for(i=0;i<num_bytes;i++)
         //              printf("%x ", buf[i]);
         //          puts("");
@@ -1412,10 +1815,13 @@ void get_user_data(interactive_t *ip)
 
         break; //they're not allowed to send the other stuff until we replied, so all data should be handshake stuff
       }
-      break;
+      /* FALLTHROUGH */
     case PORT_TELNET:
       copy_chars(ip, buf, num_bytes);
       if (cmd_in_buf(ip)) {
+        if (!ip->command_usec) {
+          ip->command_usec = get_monotonic_usec();
+        }
         ip->iflags |= CMD_IN_BUF;
         event_active(ip->ev_command, EV_TIMEOUT, 0);
       }
@@ -1710,16 +2116,25 @@ void new_user_handler(port_def_t *port)
 #endif
 #ifdef HAVE_ZLIB
   master_ob->interactive->compressed_stream = NULL;
+  master_ob->interactive->ws_deflate = NULL;
+  master_ob->interactive->ws_inflate = NULL;
 #endif
 
-  master_ob->interactive->message_producer = 0;
-  master_ob->interactive->message_consumer = 0;
-  master_ob->interactive->message_length = 0;
+  master_ob->interactive->output = evbuffer_new();
   master_ob->interactive->state = TS_DATA;
   master_ob->interactive->out_of_band = 0;
   master_ob->interactive->ws_text_start = 0;
   master_ob->interactive->ws_text_end = 0;
   master_ob->interactive->ws_size = 0;
+  master_ob->interactive->ws_in_flags = 0;
+  master_ob->interactive->ws_in_opcode = 0;
+  master_ob->interactive->ws_control_len = 0;
+  master_ob->interactive->ws_out_control_len = 0;
+  master_ob->interactive->ws_out_header_len = 0;
+  master_ob->interactive->ws_out_header_sent = 0;
+  master_ob->interactive->ws_out_remaining = 0;
+  master_ob->interactive->command_usec = 0;
+  latency_clear(&master_ob->interactive->command_latency);
 #ifdef USE_ICONV
   master_ob->interactive->trans = get_translator("UTF-8");
 #else
@@ -1959,6 +2374,10 @@ int process_user_command(interactive_t *ip)
   if (ip != command_giver->interactive) {
     fatal("BUG: process_user_command.");
   }
+  /* a command queued behind another one is timed from here */
+  if (!ip->command_usec) {
+    ip->command_usec = get_monotonic_usec();
+  }
 
   current_interactive = command_giver;    /* this is yuck phooey, sigh */
   if (ip) { clear_notify(ip->ob); }
@@ -2031,6 +2450,9 @@ exit:
    */
   if (IP_VALID(ip, command_giver)) {
     print_prompt(ip);
+    if (!evbuffer_get_length(ip->output)) {
+      ip->command_usec = 0;   /* no output to time */
+    }
     // FIXME: this doesn't belong here, should be moved to event.cc
     if (ip->iflags & CMD_IN_BUF) {
       event_active(ip->ev_command, EV_TIMEOUT, 0);
@@ -2100,6 +2522,7 @@ void remove_interactive(object_t *ob, int dested)
   if (ip->compressed_stream) {
     end_compression(ip);
   }
+  end_websocket_deflate(ip);
 #endif
 
   // Cleanup events
@@ -2148,6 +2571,7 @@ void remove_interactive(object_t *ob, int dested)
     if (all_users[idx] == ip) { break; }
   DEBUG_CHECK(idx == max_users, "remove_interactive: could not find and remove user!\n");
 
+  evbuffer_free(ip->output);
   FREE(ip->sb_buf);
   FREE(ip);
   ob->interactive = 0;
@@ -2651,33 +3075,168 @@ static void end_compression(interactive_t *ip)
   ip->compressed_stream = NULL;
 }
 
-static void start_compression(interactive_t *ip)
+/*
+ * Allocate a deflate stream; window_bits is negated for raw deflate
+ * output without the zlib header, as permessage-deflate wants it.
+ */
+static z_stream *new_deflate_stream(int window_bits, const char *desc)
 {
   z_stream *zcompress;
 
-  if (ip->compressed_stream) {
-    return ;
-  }
-  zcompress = (z_stream *) DXALLOC(sizeof(z_stream), TAG_INTERACTIVE,
-                                   "start_compression");
+  zcompress = (z_stream *) DXALLOC(sizeof(z_stream), TAG_INTERACTIVE, desc);
   zcompress->next_in = NULL;
   zcompress->avail_in = 0;
-  zcompress->next_out = ip->compress_buf;
-  zcompress->avail_out = COMPRESS_BUF_SIZE;
+  zcompress->next_out = NULL;
+  zcompress->avail_out = 0;
   zcompress->zalloc = zlib_alloc;
   zcompress->zfree = zlib_free;
   zcompress->opaque = NULL;
 
-  if (deflateInit(zcompress, 9) != Z_OK) {
+  if (deflateInit2(zcompress, 9, Z_DEFLATED, window_bits, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
     FREE(zcompress);
     fprintf(stderr, "Compression failed.\n");
+    return NULL;
+  }
+  return zcompress;
+}
+
+static void start_compression(interactive_t *ip)
+{
+  z_stream *zcompress;
+
+  if (ip->compressed_stream) {
+    return ;
+  }
+  if (!(zcompress = new_deflate_stream(MAX_WBITS, "start_compression"))) {
     return ;
   }
+  zcompress->next_out = ip->compress_buf;
+  zcompress->avail_out = COMPRESS_BUF_SIZE;
 
   // Ok, compressing.
   ip->compressed_stream = zcompress;
 }
 
+/*
+ * permessage-deflate (RFC 7692).  Both directions keep their sliding
+ * window between messages, so the mudlib must only accept offers that
+ * do not ask for server_no_context_takeover or a smaller window.
+ */
+static void start_websocket_deflate(interactive_t *ip)
+{
+  z_stream *zin;
+
+  if (ip->ws_deflate) {
+    return ;
+  }
+  zin = (z_stream *) DXALLOC(sizeof(z_stream), TAG_INTERACTIVE,
+                             "start_websocket_deflate");
+  zin->next_in = NULL;
+  zin->avail_in = 0;
+  zin->zalloc = zlib_alloc;
+  zin->zfree = zlib_free;
+  zin->opaque = NULL;
+  if (inflateInit2(zin, -MAX_WBITS) != Z_OK) {
+    FREE(zin);
+    fprintf(stderr, "Compression failed.\n");
+    return ;
+  }
+  if (!(ip->ws_deflate = new_deflate_stream(-MAX_WBITS,
+                         "start_websocket_deflate"))) {
+    inflateEnd(zin);
+    FREE(zin);
+    return ;
+  }
+  ip->ws_inflate = zin;
+}
+
+static void end_websocket_deflate(interactive_t *ip)
+{
+  if (ip->ws_deflate) {
+    deflateEnd(ip->ws_deflate);
+    FREE(ip->ws_deflate);
+    ip->ws_deflate = NULL;
+  }
+  if (ip->ws_inflate) {
+    inflateEnd(ip->ws_inflate);
+    FREE(ip->ws_inflate);
+    ip->ws_inflate = NULL;
+  }
+}
+
+/*
+ * Replace the queued output with one compressed message, minus the
+ * 00 00 ff ff trailer of the sync flush which the peer adds back.
+ */
+static int websocket_deflate(interactive_t *ip)
+{
+  z_stream *zcompress = ip->ws_deflate;
+  struct evbuffer *packed = evbuffer_new();
+  struct evbuffer_iovec in, out;
+  size_t left, len;
+
+  while ((left = evbuffer_get_length(ip->output)) != 0) {
+    evbuffer_peek(ip->output, -1, NULL, &in, 1);
+    zcompress->next_in = (Bytef *) in.iov_base;
+    zcompress->avail_in = in.iov_len;
+    do {
+      evbuffer_reserve_space(packed, COMPRESS_BUF_SIZE, &out, 1);
+      zcompress->next_out = (Bytef *) out.iov_base;
+      zcompress->avail_out = out.iov_len;
+      if (deflate(zcompress, in.iov_len == left ? Z_SYNC_FLUSH :
+                  Z_NO_FLUSH) == Z_STREAM_ERROR) {
+        evbuffer_free(packed);
+        return 0;
+      }
+      out.iov_len -= zcompress->avail_out;
+      evbuffer_commit_space(packed, &out, 1);
+    } while (!zcompress->avail_out);
+    evbuffer_drain(ip->output, in.iov_len);
+  }
+  len = evbuffer_get_length(packed);
+  evbuffer_remove_buffer(packed, ip->output, len > 4 ? len - 4 : 0);
+  evbuffer_free(packed);
+  return 1;
+}
+
+/*
+ * Inflate a chunk of a compressed message into the input buffer; the
+ * trailer stripped by the peer is fed back in after the final frame.
+ */
+static int websocket_inflate(interactive_t *ip, unsigned char *data,
+                             int length, int last)
+{
+  static unsigned char trailer[] = { 0x00, 0x00, 0xff, 0xff };
+  unsigned char out[MAX_TEXT];
+  z_stream *zin = ip->ws_inflate;
+  int pass, ret, len, space;
+
+  for (pass = 0; pass <= last; pass++) {
+    zin->next_in = pass ? trailer : data;
+    zin->avail_in = pass ? sizeof(trailer) : length;
+    do {
+      zin->next_out = out;
+      zin->avail_out = sizeof(out);
+      ret = inflate(zin, Z_SYNC_FLUSH);
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return 0;
+      }
+      /* copy_chars() trusts its caller to leave room; input that doesn't
+         fit is an error rather than something to cut short */
+      len = sizeof(out) - zin->avail_out;
+      space = MAX_TEXT - 1 - ip->text_end;
+      if (len > space) {
+        debug(connections, "websocket_inflate: fd %d, input overflow.\n",
+              ip->fd);
+        return 0;
+      }
+      copy_chars(ip, out, len);
+    } while (!zin->avail_out);
+  }
+  return 1;
+}
+
 static int flush_compressed_output(interactive_t *ip)
 {
   int iStart, nBlock, nWrite, len;
@@ -2841,12 +3400,22 @@ void f_request_term_size()
 #ifdef F_WEBSOCKET_HANDSHAKE_DONE
 void f_websocket_handshake_done()
 {
+  int deflate = 0;
+
+  if (st_num_arg == 1) {
+    deflate = (sp--)->u.number;
+  }
   if (!current_interactive) {
     return;
   }
 
   flush_message(current_interactive->interactive);
   current_interactive->interactive->iflags |= HANDSHAKE_COMPLETE;
+#ifdef HAVE_ZLIB
+  if (deflate) {
+    start_websocket_deflate(current_interactive->interactive);
+  }
+#endif
   object_t *ob = current_interactive; //command_giver;
   /* Ask permission to ask them for their terminal type */
   add_binary_message_noflush(ob, telnet_do_ttype, sizeof(telnet_do_ttype));
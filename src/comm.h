@@ -14,7 +14,9 @@
 #include "network_incl.h"
 
 #include "fliconv.h"
+#include "latency.h"
 #include "event2/event.h"
+#include "event2/buffer.h"
 
 #define MAX_TEXT                   2048
 #define MAX_SOCKET_PACKET_SIZE     1024
@@ -70,6 +72,16 @@ enum msgtypes {
 #define USING_GMCP          0x10000             /* we've negotiated gmcp */
 #define HANDSHAKE_COMPLETE  0x20000             /* websocket connected */
 
+#define WS_FIN              0x80
+#define WS_RSV1             0x40                /* message is deflated */
+#define WS_OPCODE           0x0f
+#define WS_CONTROL          0x08                /* set in control opcodes */
+#define WS_CLOSE            0x08
+#define WS_PING             0x09
+#define WS_PONG             0x0a
+/* control frames carry at most 125 bytes and are never fragmented */
+#define WS_MAX_CONTROL      125
+
 typedef struct interactive_s {
   object_t *ob;               /* points to the associated object         */
 #if defined(F_INPUT_TO) || defined(F_GET_CHAR)
@@ -112,10 +124,7 @@ typedef struct interactive_s {
   unsigned char compress_buf[COMPRESS_BUF_SIZE]; /* compress message buffer*/
 #endif
 
-  int message_producer;       /* message buffer producer index */
-  int message_consumer;       /* message buffer consumer index */
-  int message_length;         /* message buffer length */
-  unsigned char message_buf[MESSAGE_BUF_SIZE]; /* message buffer */
+  struct evbuffer *output;    /* queued output, at most MESSAGE_BUF_SIZE */
   int iflags;                 /* interactive flags */
   char out_of_band;           /* Send a telnet sync operation            */
   int state;                  /* Current telnet state.  Bingly wop       */
@@ -130,6 +139,26 @@ typedef struct interactive_s {
   int ws_size;
   int ws_mask;
   char ws_maskoffs;
+  unsigned char ws_in_flags;     /* FIN and RSV1 bits of the incoming message */
+  unsigned char ws_in_opcode;    /* opcode of the incoming frame            */
+  unsigned char ws_control_len;
+  unsigned char ws_control[WS_MAX_CONTROL]; /* incoming control payload  */
+  /* header of the outgoing frame (2 bytes plus at most a 64-bit extended
+     length), or a whole control frame */
+  unsigned char ws_out_header[2 + WS_MAX_CONTROL];
+  unsigned char ws_out_header_len;
+  unsigned char ws_out_header_sent; /* header bytes already written     */
+  unsigned char ws_out_control_len;
+  unsigned char ws_out_control[2 + WS_MAX_CONTROL]; /* reply waiting for
+                                                        the frame in progress */
+  int ws_out_remaining;          /* frame payload bytes still in output */
+#ifdef HAVE_ZLIB
+  struct z_stream_s *ws_deflate; /* permessage-deflate, if negotiated   */
+  struct z_stream_s *ws_inflate;
+#endif
+
+  int64_t command_usec;        /* when the pending command came in, or 0 */
+  latency_histogram_t command_latency; /* command to first output written */
 
   // libevent event handle.
   struct event *ev_read;
@@ -191,6 +220,7 @@ extern int num_user;
 extern int num_hidden_users;
 #endif
 extern int add_message_calls;
+extern int broadcast_encodes, broadcast_shares;
 
 extern interactive_t **all_users;
 extern int max_users;
@@ -200,6 +230,13 @@ extern void restore_sigttin(void);
 #endif
 
 void CDECL add_vmessage(object_t *, const char *, ...);
+void begin_broadcast(const char *, int);
+void end_broadcast(void);
+// Shares the encoding of 'text' among add_message() calls in its scope.
+struct broadcast_scope {
+  broadcast_scope(const char *text, int len) { begin_broadcast(text, len); }
+  ~broadcast_scope() { end_broadcast(); }
+};
 void add_message(object_t *, const char *, int);
 void add_binary_message_noflush(object_t *, const unsigned char *, int);
 void add_binary_message(object_t *, const unsigned char *, int);
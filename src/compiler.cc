@@ -9,6 +9,7 @@
 #include "icode.h"
 #include "lex.h"
 #include "simul_efun.h"
+#include "binaries.h"
 
 static void clean_parser(void);
 static void prolog(int, char *);
@@ -942,20 +943,13 @@ int compatible_types2(int t1, int t2)
 static int find_matching_function(program_t *prog, char *name,
                                   parse_node_t *node)
 {
-  int high = prog->num_functions_defined - 1;
-  int low = 0;
   int i, res;
 
-  /* Search our function table */
-  while (high >= low) {
-    int mid = (high + low) / 2;
-    char *p = prog->function_table[mid].funcname;
-
-    if (name < p) {
-      high = mid - 1;
-    } else if (name > p) {
-      low = mid + 1;
-    } else {
+  /* Search our function table.  It is sorted, but programs loaded from
+   * the binary cache aren't sorted by the current string addresses.
+   */
+  for (i = 0; i < prog->num_functions_defined; i++) {
+    if (prog->function_table[i].funcname == name) {
       int ri;
       int flags;
       int type;
@@ -963,7 +957,7 @@ static int find_matching_function(program_t *prog, char *name,
       /* Rely on the fact that functions in the table are not inherited
          or aliased */
       /* Non-inherited aliased ones are always removed anyway */
-      ri = prog->last_inherited + mid;
+      ri = prog->last_inherited + i;
 
       flags = prog->function_flags[ri];
 
@@ -973,7 +967,7 @@ static int find_matching_function(program_t *prog, char *name,
       node->kind = NODE_CALL_2;
       node->v.number = F_CALL_INHERITED;
       node->l.number = ri;
-      type = prog->function_table[mid].type;
+      type = prog->function_table[i].type;
       fix_class_type(&type, prog);
       node->type = type;
       return 1;
@@ -2142,9 +2136,12 @@ void yyerror(const char *str)
 
 void yywarn(const char *str)
 {
+  extern int num_parse_warning;
+
   if (!(pragmas & PRAGMA_WARNINGS)) { return; }
 
   smart_log(current_file, current_line, str, 1);
+  num_parse_warning++;
 }
 
 /*
@@ -2340,6 +2337,9 @@ static void handle_functions()
   }
 }
 
+/* ids for call_site_t, 0 is never used */
+unsigned int last_program_id;
+
 /*
  * The program has been compiled. Prepare a 'program_t' to be returned.
  */
@@ -2463,6 +2463,9 @@ static program_t *epilog(void)
   prog->total_size = size;
   prog->ref = 0;
   prog->func_ref = 0;
+  prog->id = ++last_program_id;
+  prog->num_call_sites = num_call_sites;
+  prog->call_sites = 0;
   ihe = lookup_ident("heart_beat");
   if (ihe && ihe->dn.function_num != -1) {
     prog->heart_beat = comp_def_index_map[ihe->dn.function_num] + 1;
@@ -2583,6 +2586,10 @@ static program_t *epilog(void)
   }
 #endif
 
+#ifdef BINARIES
+  save_binary(prog, &mem_block[A_INCLUDES], &mem_block[A_PATCH]);
+#endif
+
   for (i = 0; i < mem_block[A_FUNCTION_DEFS].current_size / sizeof(*fundefp); i++) {
     fundefp = FUNCTION_TEMP(i)->next;
     while (fundefp) {
@@ -39,6 +39,7 @@ typedef struct {
 #define A_ARGUMENT_TYPES        10      /* */
 #define A_ARGUMENT_INDEX        11      /* */
 #define NUMPAREAS               12
+#define A_PATCH                 12      /* for save_binary() */
 #define A_CASES                 13      /* keep track of cases */
 #define A_STRING_NEXT           14      /* next prog string in hash chain */
 #define A_STRING_REFS           15      /* reference count of prog string */
@@ -189,6 +190,7 @@ extern int max_num_locals;
 extern short compatible[11];
 extern short is_type[11];
 extern int comp_last_inherited;
+extern unsigned int last_program_id;
 
 char *get_type_modifiers(char *, char *, int);
 char *get_two_types(char *, char *, int, int);
@@ -268,6 +270,9 @@ parse_node_t *throw_away_mapping(parse_node_t *);
 
 char *allocate_in_mem_block(int, int);
 
+/* lex.c */
+int include_cache_status(outbuffer_t *, int);
+
 #endif
 
 
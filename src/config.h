@@ -25,6 +25,7 @@
 #define MASTER_FILE             CONFIG_STR(__MASTER_FILE__)
 #define SIMUL_EFUN              CONFIG_STR(__SIMUL_EFUN_FILE__)
 #define SWAP_FILE               CONFIG_STR(__SWAP_FILE__)
+#define SAVE_BINARIES           CONFIG_STR(__SAVE_BINARIES_DIR__)
 #define DEBUG_LOG_FILE          CONFIG_STR(__DEBUG_LOG_FILE__)
 #define DEFAULT_ERROR_MESSAGE   CONFIG_STR(__DEFAULT_ERROR_MESSAGE__)
 #define DEFAULT_FAIL_MESSAGE    CONFIG_STR(__DEFAULT_FAIL_MESSAGE__)
@@ -54,8 +55,7 @@
 #define INHERIT_CHAIN_SIZE      CONFIG_INT(__INHERIT_CHAIN_SIZE__)
 #define FD6_PORT        CONFIG_INT(__FD6_PORT__)
 #define FD6_KIND        CONFIG_INT(__FD6_KIND__)
-
-#define APPLY_CACHE_SIZE (1 << APPLY_CACHE_BITS)
+#define APPLY_CACHE_SIZE        CONFIG_INT(__APPLY_CACHE_SIZE__)
 
 #define NUM_CONSTS 5
 
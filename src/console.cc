@@ -17,6 +17,7 @@
 #include "dumpstat.h"
 #include "event.h"
 #include "object.h"
+#include "profiler.h"
 
 #define NAME_LEN 50
 
@@ -36,6 +37,9 @@ static int objcmpsize(const void *, const void *);
 static int objcmpidle(const void *, const void *);
 
 static void console_command(char *s);
+#ifdef SAMPLING_PROFILER
+static void console_profile(char *s);
+#endif
 
 static  void print_obj(int refs, int cpy, const char *obname, long lastref,
                        long sz)
@@ -100,8 +104,17 @@ static void console_command(char *s)
                if prefix=PREFIX is present, only items beginning with PREFIX\n\
                 will be displayed.  Note that ranges are applied and /then/ \n\
                 the prefixes are checked.  Specifying both may result in \n\
-                empty output\
+                empty output\n\
+    profile    Sample the LPC call stacks.  Format:\n\
+               profile start [usecs]\n\
+               profile stop [file]\n\
+               stop writes how often each stack was seen, as folded stacks\n\
+               for flamegraph tools, to the file or to the console\
 ");
+#ifdef SAMPLING_PROFILER
+    } else if (strncmp(s, "profile ", 8) == 0) {
+      console_profile(s + 8);
+#endif
     } else { // commands that can be followed by args
       int DEPTH = 1000; /* allow summarization to dir-level */
       char *prefix = (char *) 0;
@@ -305,6 +318,42 @@ static void console_command(char *s)
   }
 }
 
+#ifdef SAMPLING_PROFILER
+static void console_profile(char *s)
+{
+  char cmd[11], arg[160];
+  FILE *f;
+  int n;
+
+  arg[0] = '\0';
+  if (sscanf(s, "%10s %159s", cmd, arg) < 1) {
+    (void) puts("Usage: profile start [usecs] | profile stop [file]");
+  } else if (strcmp(cmd, "start") == 0) {
+    if (profiler_start(*arg ? atoi(arg) : 1000) < 0) {
+      (void) puts(profiler_running() ? "The profiler is already running."
+                  : "Can't start the profiler.");
+    } else {
+      (void) puts("Profiler started.");
+    }
+  } else if (strcmp(cmd, "stop") == 0) {
+    if ((n = profiler_stop()) < 0) {
+      (void) puts("The profiler isn't running.");
+    } else if (!*arg) {
+      profiler_dump(stdout);
+      printf("%d samples.\n", n);
+    } else if ((f = fopen(arg, "w"))) {
+      profiler_dump(f);
+      fclose(f);
+      printf("%d samples written to %s.\n", n, arg);
+    } else {
+      printf("Can't write %s: %s.\n", arg, strerror(errno));
+    }
+  } else {
+    (void) puts("Usage: profile start [usecs] | profile stop [file]");
+  }
+}
+#endif
+
 static int strcmpalpha(const char *aname, const char *bname, int depth)
 {
   int slash = 0;
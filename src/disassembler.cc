@@ -287,7 +287,7 @@ disassemble(FILE *f, char *code, int start, int end, program_t *prog)
 
     fprintf(f, "%04x: ", (unsigned)(pc - code));
 
-    pc++;
+    instr = EXTRACT_UCHAR(pc++);
     buff[0] = 0;
     sarg = 0;
 
@@ -384,7 +384,7 @@ disassemble(FILE *f, char *code, int start, int end, program_t *prog)
       case F_AGGREGATE:
       case F_AGGREGATE_ASSOC:
         COPY_SHORT(&sarg, pc);
-        sprintf(buff, "%d", sarg);
+        sprintf(buff, "%d", (short) sarg);
         pc += 2;
         break;
 
@@ -468,6 +468,46 @@ disassemble(FILE *f, char *code, int start, int end, program_t *prog)
         sprintf(buff, "LV%d", EXTRACT_UCHAR(pc));
         pc++;
         break;
+#ifdef F_LOCAL_BRANCH_WHEN_ZERO
+      case F_LOCAL_BRANCH_WHEN_ZERO:
+#endif
+#ifdef F_LOCAL_BRANCH_WHEN_NON_ZERO
+      case F_LOCAL_BRANCH_WHEN_NON_ZERO:
+#endif
+#ifdef F_LOCAL_LAND
+      case F_LOCAL_LAND:
+#endif
+        i = EXTRACT_UCHAR(pc++);
+        COPY_SHORT(&sarg, pc);
+        offset = (pc - code) + (unsigned short) sarg;
+        pc += 2;
+        sprintf(buff, "LV%ld %04x (%04x)", i, (unsigned) sarg,
+                (unsigned) offset);
+        break;
+#ifdef F_LOCAL_BYTE_BRANCH_GE
+      case F_LOCAL_BYTE_BRANCH_GE:
+        i = EXTRACT_UCHAR(pc++);
+        j = EXTRACT_UCHAR(pc++);
+        COPY_SHORT(&sarg, pc);
+        offset = (pc - code) + (unsigned short) sarg;
+        pc += 2;
+        sprintf(buff, "LV%ld >= %ld %04x (%04x)", i, j, (unsigned) sarg,
+                (unsigned) offset);
+        break;
+#endif
+#ifdef F_VOID_ASSIGN_LOCAL_BYTE
+      case F_VOID_ASSIGN_LOCAL_BYTE:
+        i = EXTRACT_UCHAR(pc++);
+        j = EXTRACT_UCHAR(pc++);
+        sprintf(buff, "LV%ld = %ld", i, j);
+        break;
+#endif
+#ifdef F_VOID_ADD_EQ_LOCAL
+      case F_VOID_ADD_EQ_LOCAL:
+        sprintf(buff, "LV%d", EXTRACT_UCHAR(pc));
+        pc++;
+        break;
+#endif
       case F_LOOP_COND_NUMBER:
         i = EXTRACT_UCHAR(pc++);
         COPY_INT(&iarg, pc);
@@ -514,6 +554,12 @@ disassemble(FILE *f, char *code, int start, int end, program_t *prog)
         pc += 3;
         break;
 
+      case F_CALL_OTHER_SITE:
+        COPY_SHORT(&sarg, pc);
+        sprintf(buff, "site %d, %d", sarg, pc[2]);
+        pc += 3;
+        break;
+
       case F_FUNCTION_CONSTRUCTOR:
         switch (EXTRACT_UCHAR(pc++)) {
           case FP_SIMUL:
@@ -547,6 +593,12 @@ disassemble(FILE *f, char *code, int start, int end, program_t *prog)
         }
         break;
 
+      case F_SHORT_INT:
+        COPY_SHORT(&sarg, pc);
+        sprintf(buff, "%d", (short) sarg);
+        pc += 2;
+        break;
+
       case F_NUMBER: {
         LPC_INT iarg_tmp;
 
@@ -29,6 +29,7 @@ typedef struct addr_name_query_s {
 void on_addr_name_result(int err, char type, int count,
                          int ttl, void *addresses, void *arg)
 {
+  event_dispatch_started();
 
   auto query = (addr_name_query_t *)arg;
 
@@ -92,6 +93,7 @@ struct addr_number_query {
 // query finished, call the LPC callback.
 void on_query_addr_by_name_finish(evutil_socket_t fd, short what, void *arg)
 {
+  event_dispatch_started();
   auto query = (addr_number_query *)arg;
 
   if (query->err) {
@@ -139,6 +141,7 @@ void on_query_addr_by_name_finish(evutil_socket_t fd, short what, void *arg)
 // intermediate result from evdns_getaddrinfo
 void on_getaddr_result(int err, evutil_addrinfo *res, void *arg)
 {
+  event_dispatch_started();
   auto query = (addr_number_query *)arg;
   query->err = err;
   query->res = res;
@@ -70,6 +70,9 @@ static int svalue_size(svalue_t *v)
       switch (v->u.fp->hdr.type) {
         case FP_EFUN:
           total += sizeof(efun_ptr_t);
+          if (v->u.fp->f.efun.site) {
+            total += sizeof(call_site_t);
+          }
           break;
         case FP_LOCAL | FP_NOT_BINDABLE:
           total += sizeof(local_ptr_t);
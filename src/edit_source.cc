@@ -32,7 +32,7 @@ static int nexpands = 0;
 
 FILE *yyin = 0, *yyout = 0;
 
-#define SYNTAX "edit_source [-process file] [-options] [-malloc] [-build_func_spec 'command'] [-build_efuns]\n"
+#define SYNTAX "edit_source [-process file] [-options] [-malloc] [-build_func_spec 'command'] [-build_efuns] [-superinstructions profile]\n"
 
 /* The files we fool with.  (Actually, there are more.  See -process).
  *
@@ -52,6 +52,7 @@ FILE *yyin = 0, *yyout = 0;
 #define EFUN_PROTO        "efun_protos.h"
 #define EFUN_DEFS         "efun_defs.cc"
 #define APPLIES_TABLE     "applies_table.cc"
+#define SUPERINSTRUCTIONS_SPEC "superinstructions.spec"
 
 #define PRAGMA_NOTE_CASE_START 1
 
@@ -1233,6 +1234,91 @@ static void handle_malloc()
   }
 }
 
+/*
+ * The superinstructions interpret.cc has handlers for, and the instruction
+ * pairs each one replaces, named as in an OPCPROF_2D dump.  Pairs starting
+ * with the superinstruction itself count too, so a profile taken from a
+ * driver which already uses it keeps it selected.
+ */
+static struct {
+  const char *name;
+  const char *first;
+  const char *second;
+} superinstructions[] = {
+  { "local_branch_when_zero", "local", "branch_when_zero" },
+  { "local_branch_when_non_zero", "local", "branch_when_non_zero" },
+  { "local_land", "local", "&&" },
+  /* push covers more than local < byte; close enough */
+  { "local_byte_branch_ge", "push", "branch_ge" },
+  { "void_assign_local_byte", "const0", "(void)assign_local" },
+  { "void_assign_local_byte", "const1", "(void)assign_local" },
+  { "void_assign_local_byte", "byte", "(void)assign_local" },
+  { "void_add_eq_local", "local_lvalue", "(void)+=" },
+};
+#define NUM_SUPERINSTRUCTIONS (sizeof(superinstructions) / sizeof(superinstructions[0]))
+
+/* fraction (1/n) of all executed instruction pairs a candidate needs */
+#define SUPERINSTRUCTION_MIN_SHARE 1000
+
+static void handle_superinstructions(char *profile)
+{
+  FILE *f = fopen(profile, "r");
+  char buf[1024], first[256], second[256];
+  unsigned long count, total = 0;
+  unsigned long score[NUM_SUPERINSTRUCTIONS];
+  unsigned int i, j;
+
+  if (!f) {
+    perror(profile);
+    exit(-1);
+  }
+  memset(score, 0, sizeof(score));
+  while (fgets(buf, sizeof(buf), f)) {
+    if (sscanf(buf, "%255s %255s : %lu", first, second, &count) != 3) {
+      continue;
+    }
+    total += count;
+    for (i = 0; i < NUM_SUPERINSTRUCTIONS; i++) {
+      if (!strcmp(first, superinstructions[i].name)) {
+        score[i] += count;
+        break;
+      }
+      if (!strcmp(first, superinstructions[i].first) &&
+          !strcmp(second, superinstructions[i].second)) {
+        score[i] += count;
+      }
+    }
+  }
+  fclose(f);
+
+  fprintf(stderr, "Selecting superinstructions from %s ...\n", profile);
+  open_output_file(SUPERINSTRUCTIONS_SPEC);
+  fprintf(yyout, "/* autogenerated by 'edit_source -superinstructions %s' */\n\n", profile);
+  for (i = 0; i < NUM_SUPERINSTRUCTIONS; i++) {
+    /* several entries may share a name; the first one sums them all */
+    for (j = 0; j < i; j++) {
+      if (!strcmp(superinstructions[i].name, superinstructions[j].name)) {
+        break;
+      }
+    }
+    if (j < i) {
+      continue;
+    }
+    count = score[i];
+    for (j = i + 1; j < NUM_SUPERINSTRUCTIONS; j++) {
+      if (!strcmp(superinstructions[i].name, superinstructions[j].name)) {
+        count += score[j];
+      }
+    }
+    if (count && count >= total / SUPERINSTRUCTION_MIN_SHARE) {
+      fprintf(yyout, "operator %s;\t/* %lu */\n", superinstructions[i].name, count);
+    } else {
+      fprintf(yyout, "/* operator %s; %lu */\n", superinstructions[i].name, count);
+    }
+  }
+  close_output_file();
+}
+
 int main(int argc, char **argv)
 {
   int idx = 1;
@@ -1255,6 +1341,8 @@ int main(int argc, char **argv)
       handle_build_func_spec(argv[++idx]);
     } else if (strcmp(argv[idx], "-build_efuns") == 0) {
       handle_build_efuns();
+    } else if (strcmp(argv[idx], "-superinstructions") == 0) {
+      handle_superinstructions(argv[++idx]);
     } else {
       fprintf(stderr, "Unrecognized flag %s\n", argv[idx]);
       exit(-1);
@@ -29,6 +29,12 @@
 #include "add_action.h"
 #include "eval.h"
 #include "interpret.h"
+#include "compiler.h"
+#include "binaries.h"
+
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
 
 int call_origin = 0;
 
@@ -146,6 +152,9 @@ f_bind(void)
 
   new_fp = ALLOCATE(funptr_t, TAG_FUNP, "f_bind");
   *new_fp = *old_fp;
+  if ((old_fp->hdr.type & 0x0f) == FP_EFUN) {
+    new_fp->f.efun.site = 0;
+  }
   new_fp->hdr.ref = 1;
   new_fp->hdr.owner = ob; /* one ref from being on stack */
   if (new_fp->hdr.args) {
@@ -165,8 +174,78 @@ f_bind(void)
 #endif
 
 #ifdef F_CACHE_STATS
+#define CALL_SITES_SHOWN 20
+
+typedef struct {
+  const program_t *prog;
+  const call_site_t *site;
+} call_site_ref_t;
+
+static bool busier_call_site(const call_site_ref_t &a, const call_site_ref_t &b)
+{
+  return a.site->hits + a.site->misses > b.site->hits + b.site->misses;
+}
+
+static void find_call_sites(const program_t *prog,
+                            std::unordered_set<const program_t *> &seen,
+                            std::vector<call_site_ref_t> &sites)
+{
+  int i;
+
+  if (!seen.insert(prog).second) {
+    return;
+  }
+  if (prog->call_sites) {
+    for (i = 0; i < prog->num_call_sites; i++) {
+      if (prog->call_sites[i].misses) {
+        sites.push_back({prog, &prog->call_sites[i]});
+      }
+    }
+  }
+  for (i = 0; i < prog->num_inherited; i++) {
+    find_call_sites(prog->inherit[i].prog, seen, sites);
+  }
+}
+
+/* the inline caches of F_CALL_OTHER_SITE, and the busiest sites */
+static void print_call_site_stats(outbuffer_t *ob)
+{
+  std::unordered_set<const program_t *> seen;
+  std::vector<call_site_ref_t> sites;
+  size_t i, n;
+  object_t *o;
+
+  for (o = obj_list; o; o = o->next_all) {
+    find_call_sites(o->prog, seen, sites);
+  }
+  n = std::min(sites.size(), (size_t) CALL_SITES_SHOWN);
+  std::partial_sort(sites.begin(), sites.begin() + n, sites.end(),
+                    busier_call_site);
+
+  outbuf_add(ob, "\nCall site caches\n");
+  outbuf_add(ob, "-------------------------------\n");
+  outbuf_addv(ob, "%% site hits:     %10.2f\n",
+              100 * ((LPC_FLOAT) call_site_hits /
+                     (call_site_hits + call_site_misses)));
+  outbuf_addv(ob, "site hits:       %10u\n", call_site_hits);
+  outbuf_addv(ob, "site misses:     %10u\n", call_site_misses);
+  outbuf_addv(ob, "sites used:      %10lu\n", (unsigned long) sites.size());
+  if (n) {
+    outbuf_addv(ob, "\nBusiest sites:\n%10s %10s  %s\n",
+                "hits", "misses", "location");
+  }
+  for (i = 0; i < n; i++) {
+    outbuf_addv(ob, "%10u %10u  %s\n", sites[i].site->hits,
+                sites[i].site->misses,
+                get_line_number((char *) sites[i].prog->program +
+                                sites[i].site->offset, sites[i].prog));
+  }
+}
+
 static void print_cache_stats(outbuffer_t *ob)
 {
+  unsigned int used, sets_evicted, max_evictions;
+
   outbuf_add(ob, "Function cache information\n");
   outbuf_add(ob, "-------------------------------\n");
   outbuf_addv(ob, "%% cache hits:    %10.2f\n",
@@ -180,6 +259,13 @@ static void print_cache_stats(outbuffer_t *ob)
   outbuf_addv(ob, "collisions:      %10lu\n", apply_low_collisions);
   outbuf_addv(ob, "%% collisions:    %10.2f\n",
               100 * ((LPC_FLOAT) apply_low_collisions / apply_low_call_others));
+  apply_cache_occupancy(&used, &sets_evicted, &max_evictions);
+  outbuf_addv(ob, "entries in use:  %10u\n", used);
+  outbuf_addv(ob, "%% occupancy:     %10.2f\n",
+              100 * ((LPC_FLOAT) used / APPLY_CACHE_SIZE));
+  outbuf_addv(ob, "sets evicted:    %10u\n", sets_evicted);
+  outbuf_addv(ob, "max set evicted: %10u\n", max_evictions);
+  print_call_site_stats(ob);
 }
 
 void f_cache_stats(void)
@@ -202,7 +288,9 @@ f__call_other(void)
   int i;
   int num_arg = st_num_arg;
   object_t *ob;
+  call_site_t *site = call_other_site;
 
+  call_other_site = 0;
   if (current_object->flags & O_DESTRUCTED) { /* No external calls allowed */
     pop_n_elems(num_arg);
     push_undefined();
@@ -211,6 +299,9 @@ f__call_other(void)
   arg = sp - num_arg + 1;
   if (arg[1].type == T_STRING) {
     funcname = arg[1].u.string;
+    if (arg[1].subtype != STRING_SHARED) {
+      site = 0;
+    }
   } else {                    /* must be T_ARRAY then */
     array_t *v = arg[1].u.arr;
     svalue_t *sv;
@@ -220,6 +311,9 @@ f__call_other(void)
       error("call_other: 1st elem of array for arg 2 must be a string\n");
     }
     funcname = sv->u.string;
+    if (sv->subtype != STRING_SHARED) {
+      site = 0;
+    }
     num_arg = 2 + merge_arg_lists(num_arg - 2, v, 1);
   }
 
@@ -246,7 +340,7 @@ f__call_other(void)
   }
 #endif
   call_origin = ORIGIN_CALL_OTHER;
-  if (apply_low(funcname, ob, num_arg - 2) == 0) {    /* Function not found */
+  if (apply_call_site(funcname, ob, num_arg - 2, site) == 0) {    /* Function not found */
     pop_2_elems();
     push_undefined();
     return;
@@ -269,9 +363,17 @@ f_call_out(void)
   svalue_t *arg = sp - st_num_arg + 1;
   int num = st_num_arg - 2;
   LPC_INT ret;
+  int64_t delay_msecs;
+
+  /* delay is in seconds, fractions of a second are allowed. */
+  if (arg[1].type == T_REAL) {
+    delay_msecs = (int64_t)(arg[1].u.real * 1000);
+  } else {
+    delay_msecs = (int64_t) arg[1].u.number * 1000;
+  }
 
   if (!(current_object->flags & O_DESTRUCTED)) {
-    ret = new_call_out(current_object, arg, arg[1].u.number, num, arg + 2);
+    ret = new_call_out(current_object, arg, delay_msecs, num, arg + 2);
     /* args have been transfered; don't free them;
        also don't need to free the int */
     sp -= num + 1;
@@ -1893,8 +1995,10 @@ void f_mud_status(void)
                 get_current_dir(dir_buf, 1024));
     outbuf_add(&ob, "add_message statistics\n");
     outbuf_add(&ob, "------------------------------\n");
-    outbuf_addv(&ob, "Calls to add_message: %d   Packets: %d   Average packet size: %f\n\n",
+    outbuf_addv(&ob, "Calls to add_message: %d   Packets: %d   Average packet size: %f\n",
                 add_message_calls, inet_packets, (float) inet_volume / inet_packets);
+    outbuf_addv(&ob, "Broadcasts encoded: %d   Shared with other users: %d\n\n",
+                broadcast_encodes, broadcast_shares);
 
     stat_living_objects(&ob);
 
@@ -1906,8 +2010,18 @@ void f_mud_status(void)
     outbuf_add(&ob, "\n");
     tot += heart_beat_status(&ob, verbose);
     outbuf_add(&ob, "\n");
+    tot += reset_queue_status(&ob, verbose);
+    outbuf_add(&ob, "\n");
+    tot += reclaim_status(&ob, verbose);
+    outbuf_add(&ob, "\n");
     tot += add_string_status(&ob, verbose);
     outbuf_add(&ob, "\n");
+    tot += include_cache_status(&ob, verbose);
+    outbuf_add(&ob, "\n");
+#ifdef BINARIES
+    tot += binaries_status(&ob, verbose);
+    outbuf_add(&ob, "\n");
+#endif
     tot += print_call_out_usage(&ob, verbose);
   } else {
     /* !verbose */
@@ -1938,12 +2052,15 @@ void f_mud_status(void)
     outbuf_addv(&ob, "Mappings:\t\t\t%8d %8d\n", num_mappings,
                 total_mapping_size);
     outbuf_addv(&ob, "Mappings(nodes):\t\t%8d\n", total_mapping_nodes);
+    outbuf_addv(&ob, "Mappings(small):\t\t%8d\n", num_small_mappings);
     outbuf_addv(&ob, "Interactives:\t\t\t%8d %8d\n", num_user,
                 num_user * sizeof(interactive_t));
 
     tot = show_otable_status(&ob, verbose) +
           heart_beat_status(&ob, verbose) +
+          reset_queue_status(&ob, verbose) +
           add_string_status(&ob, verbose) +
+          include_cache_status(&ob, verbose) +
           print_call_out_usage(&ob, verbose);
   }
 
@@ -3196,7 +3313,7 @@ f_sizeof(void)
       free_array(sp->u.arr);
       break;
     case T_MAPPING:
-      i = sp->u.map->count;
+      i = MAP_COUNT(sp->u.map);
       free_mapping(sp->u.map);
       break;
 #ifndef NO_BUFFER_TYPE
@@ -3932,7 +4049,7 @@ f_dump_file_descriptors(void)
 #ifdef F_RECLAIM_OBJECTS
 void f_reclaim_objects(void)
 {
-  push_number(reclaim_objects(false));
+  push_number(reclaim_objects());
 }
 #endif
 
@@ -3964,7 +4081,9 @@ f_memory_info(void)
           num_user * sizeof(interactive_t) +
           show_otable_status(0, -1) +
           heart_beat_status(0, -1) +
+          reset_queue_status(0, -1) +
           add_string_status(0, -1) +
+          include_cache_status(0, -1) +
           print_call_out_usage(0, -1) + res;
     push_number(tot);
     return;
@@ -4017,11 +4136,13 @@ f_set_reset(void)
 {
   if (st_num_arg == 2) {
     (sp - 1)->u.ob->next_reset = current_virtual_time + sp->u.number;
+    schedule_object_reset((sp - 1)->u.ob);
     free_object(&(--sp)->u.ob, "f_set_reset:1");
     sp--;
   } else {
     sp->u.ob->next_reset = current_virtual_time + TIME_TO_RESET / 2 +
                            random_number(TIME_TO_RESET / 2);
+    schedule_object_reset(sp->u.ob);
     free_object(&(sp--)->u.ob, "f_set_reset:2");
   }
 }
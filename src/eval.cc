@@ -5,11 +5,87 @@
 #include <time.h>
 #include "backend.h"
 #include "posix_timers.h"
+#include "eval.h"
 
-static struct timeval tv;
 int outoftime = 0;
 LPC_INT max_cost;
 
+#ifdef EVAL_DEADLINE
+/*
+ * The evaluation ends at eval_deadline, in nanoseconds on the monotonic
+ * clock.  Once it has passed the deadline is cleared, like the old one
+ * shot timer, so an error handler which resets outoftime can run.
+ */
+#define NO_DEADLINE INT64_MAX
+
+static volatile int64_t eval_deadline = NO_DEADLINE;
+static int eval_watchdog_started;
+int eval_check_countdown = EVAL_CHECK_INTERVAL;
+
+static inline int64_t eval_clock()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * (int64_t)1000000000 + ts.tv_nsec;
+}
+
+static inline void eval_expire(int64_t now)
+{
+  if (now >= eval_deadline) {
+    eval_deadline = NO_DEADLINE;
+    outoftime = 1;
+  }
+}
+
+/* runs in the timer signal handler */
+void eval_watchdog()
+{
+  if (eval_deadline != NO_DEADLINE) {
+    eval_expire(eval_clock());
+  }
+}
+
+void eval_check_deadline()
+{
+  eval_check_countdown = EVAL_CHECK_INTERVAL;
+  eval_expire(eval_clock());
+}
+
+void set_eval(LPC_INT etime)
+{
+  if (!eval_watchdog_started) {
+#ifdef POSIX_TIMERS
+    posix_eval_watchdog_set(EVAL_WATCHDOG_USECS);
+#else
+    signal(SIGVTALRM, (sighandler_t)sigalrm_handler);
+    uvalarm(EVAL_WATCHDOG_USECS, EVAL_WATCHDOG_USECS);
+#endif
+    eval_watchdog_started = 1;
+  }
+  if (etime < 0) {
+    etime = 0;
+  } else if (etime > INT64_MAX / 2000) {
+    etime = INT64_MAX / 2000;
+  }
+  eval_deadline = eval_clock() + etime * 1000;
+  eval_check_countdown = EVAL_CHECK_INTERVAL;
+  outoftime = 0;
+}
+
+LPC_INT get_eval()
+{
+  int64_t left;
+
+  if (eval_deadline == NO_DEADLINE) {
+    return 0;
+  }
+  left = eval_deadline - eval_clock();
+  return left > 0 ? left / 1000 : 0;
+}
+#else
+static struct timeval tv;
+
 void set_eval(LPC_INT etime)
 {
 #ifdef POSIX_TIMERS
@@ -35,4 +111,4 @@ LPC_INT get_eval()
   return 100;
 #endif
 }
-
+#endif
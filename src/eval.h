@@ -4,4 +4,21 @@ extern int outoftime;
 extern LPC_INT max_cost;
 void set_eval(LPC_INT time);
 LPC_INT get_eval();
+
+#ifdef EVAL_DEADLINE
+/* checks between looking at the clock in EVAL_CHECK() */
+#define EVAL_CHECK_INTERVAL 32
+/* period of the timer which checks the deadline during long efuns */
+#define EVAL_WATCHDOG_USECS 10000
+
+extern int eval_check_countdown;
+void eval_check_deadline(void);
+/* called by the timer signal handler */
+void eval_watchdog(void);
+
+/* at backward branches and function calls */
+#define EVAL_CHECK() SAFE(if (!--eval_check_countdown) { eval_check_deadline(); })
+#else
+#define EVAL_CHECK()
+#endif
 #endif
@@ -10,6 +10,8 @@
 #include "console.h" // for console
 #include "socket_efuns.h"  // for lpc sockets
 #include "eval.h" // for set_eval
+#include "port.h" // for get_monotonic_usec
+#include "latency.h"
 
 //FIXME: rewrite other part so this could become static.
 struct event_base *g_event_base = NULL;
@@ -38,15 +40,32 @@ event_base *init_event_base()
   return g_event_base;
 }
 
-static void exit_after_one_second(evutil_socket_t fd, short events, void *arg)
+static void exit_after_timeout(evutil_socket_t fd, short events, void *arg)
 {
   event_base_loopbreak((struct event_base *)arg);
 }
 
-int run_for_at_most_one_second(struct event_base *base)
+// When the first callback of the current pass through the event loop ran,
+// 0 while the loop is still waiting for events.
+static int64_t dispatch_usecs;
+
+// Every event callback calls this first, so the event loop latency covers
+// handling the events and not the wait for them.
+void event_dispatch_started()
+{
+  if (!dispatch_usecs) {
+    dispatch_usecs = get_monotonic_usec();
+  }
+}
+
+// Run the event loop until some events has been handled, or 'msecs'
+// milliseconds passed.
+int run_for_at_most(struct event_base *base, int64_t msecs)
 {
   int r;
-  struct timeval one_second = {1, 0};
+  struct timeval timeout = {(time_t)(msecs / 1000),
+                            (suseconds_t)((msecs % 1000) * 1000)
+                           };
   static struct event *ev = NULL;
   static int in_loop = 0;
 
@@ -57,14 +76,18 @@ int run_for_at_most_one_second(struct event_base *base)
     return 0;
   }
   if (ev == NULL) {
-    ev = evtimer_new(base, exit_after_one_second, base);
+    ev = evtimer_new(base, exit_after_timeout, base);
   }
-  event_add(ev, &one_second);
+  event_add(ev, &timeout);
 
-  debug(event, "Entering event loop for at most 1 sec! \n");
+  debug(event, "Entering event loop for at most %" PRId64 " msecs! \n", msecs);
   in_loop = 1;
+  dispatch_usecs = 0;
   r = event_base_loop(base, EVLOOP_ONCE);
   in_loop = 0;
+  if (dispatch_usecs) {
+    latency_record(&latency_event_loop, get_monotonic_usec() - dispatch_usecs);
+  }
 
   return r;
 }
@@ -81,6 +104,7 @@ static void maybe_schedule_user_command(interactive_t *user)
 
 static void on_user_command(evutil_socket_t fd, short what, void *arg)
 {
+  event_dispatch_started();
   debug(event, "User has an full command ready: %d:%s%s%s%s \n",
         (int) fd,
         (what & EV_TIMEOUT) ? " timeout" : "",
@@ -126,6 +150,7 @@ static void on_user_command(evutil_socket_t fd, short what, void *arg)
 
 static void on_user_read(evutil_socket_t fd, short what, void *arg)
 {
+  event_dispatch_started();
   debug(event, "Got an event on user socket %d:%s%s%s%s \n",
         (int) fd,
         (what & EV_TIMEOUT) ? " timeout" : "",
@@ -151,6 +176,7 @@ static void on_user_read(evutil_socket_t fd, short what, void *arg)
 
 static void on_user_write(evutil_socket_t fd, short what, void *arg)
 {
+  event_dispatch_started();
   debug(event, "Got an event on user socket %d:%s%s%s%s \n",
         (int) fd,
         (what & EV_TIMEOUT) ? " timeout" : "",
@@ -188,6 +214,7 @@ void new_user_event_listener(int idx)
 
 static void on_external_port_event(evutil_socket_t fd, short what, void *arg)
 {
+  event_dispatch_started();
   debug(event, "Got an event on listen socket %d:%s%s%s%s \n",
         (int) fd,
         (what & EV_TIMEOUT) ? " timeout" : "",
@@ -208,6 +235,7 @@ void new_external_port_event_listener(port_def_t *port)
 
 void on_lpc_sock_read(evutil_socket_t fd, short what, void *arg)
 {
+  event_dispatch_started();
   debug(event, "Got an event on socket %d:%s%s%s%s \n",
         (int) fd,
         (what & EV_TIMEOUT) ? " timeout" : "",
@@ -220,6 +248,7 @@ void on_lpc_sock_read(evutil_socket_t fd, short what, void *arg)
 }
 void on_lpc_sock_write(evutil_socket_t fd, short what, void *arg)
 {
+  event_dispatch_started();
   debug(event, "Got an event on socket %d:%s%s%s%s \n",
         (int) fd,
         (what & EV_TIMEOUT) ? " timeout" : "",
@@ -244,6 +273,7 @@ void new_lpc_socket_event_listener(int idx, evutil_socket_t real_fd)
 #ifdef HAS_CONSOLE
 static void on_console_event(evutil_socket_t fd, short what, void *arg)
 {
+  event_dispatch_started();
   debug(event, "Got an event on stdin socket %d:%s%s%s%s \n", (int) fd,
         (what & EV_TIMEOUT) ? " timeout" : "", (what & EV_READ) ? " read" : "",
         (what & EV_WRITE) ? " write" : "", (what & EV_SIGNAL) ? " signal" : "");
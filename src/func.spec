@@ -65,9 +65,9 @@ string capitalize(string);
 string *explode(string, string);
 mixed implode(mixed *, string | function, void | mixed);
 #ifdef CALLOUT_HANDLES
-int call_out(string | function, int, ...);
+int call_out(string | function, int | float, ...);
 #else
-void call_out(string | function, int, ...);
+void call_out(string | function, int | float, ...);
 #endif
 int member_array(mixed, string | mixed *, void | int, void | int);
 int input_to(string | function, ...);
@@ -333,6 +333,15 @@ int query_ed_mode();
 string cache_stats();
 #endif
 
+#ifdef BINARIES
+int flush_program_cache(string | void);
+#endif
+
+#ifdef SAMPLING_PROFILER
+void start_profiler(int | void);
+mixed stop_profiler(string | void);
+#endif
+
 mixed filter(string | mixed * | mapping, string | function, ...);
 mixed filter_array filter(mixed *, string | function, ...);
 mapping filter_mapping filter(mapping, string | function, ...);
@@ -345,6 +354,7 @@ mixed *map_array map(mixed *, string | function, ...);
  */
 string malloc_status();
 string mud_status(int default: 0);
+mapping driver_latency_stats(object | int | void, int | void);
 void dumpallobj(string | void);
 
 string dump_file_descriptors();
@@ -392,7 +402,7 @@ int *str_to_arr(string);
 string arr_to_str(int *);
 #endif
 void act_mxp();
-void websocket_handshake_done();
+void websocket_handshake_done(void | int);
 void request_term_type();
 void start_request_term_type();
 void request_term_size(void | int);
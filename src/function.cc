@@ -19,6 +19,11 @@ dealloc_funp(funptr_t *fp)
     case FP_FUNCTIONAL | FP_NOT_BINDABLE:
       prog = fp->f.functional.prog;
       break;
+    case FP_EFUN:
+      if (fp->f.efun.site) {
+        free_call_sites(fp->f.efun.site, 1);
+      }
+      break;
   }
 
   if (fp->hdr.owner) {
@@ -112,6 +117,7 @@ make_efun_funp(int opcode, svalue_t *args)
   fp->hdr.type = FP_EFUN;
 
   fp->f.efun.index = opcode;
+  fp->f.efun.site = 0;
 
   if (args->type == T_ARRAY) {
     fp->hdr.args = args->u.arr;
@@ -278,6 +284,13 @@ call_function_pointer(funptr_t *funp, int num_arg)
         for (j = 0; j < n; j++) {
           CHECK_TYPES(sp - num_arg + j + 1, instrs[i].type[j], j + 1, i);
         }
+        if (i == F__CALL_OTHER) {
+          if (!funp->f.efun.site) {
+            funp->f.efun.site = CALLOCATE(1, call_site_t, TAG_CALL_SITES,
+                                          "call_function_pointer");
+          }
+          call_other_site = funp->f.efun.site;
+        }
         (*efun_table[i - EFUN_BASE])();
 
         free_svalue(&apply_ret_value, "call_function_pointer");
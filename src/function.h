@@ -13,7 +13,11 @@ typedef struct {
 typedef local_ptr_t simul_ptr_t;
 
 /* FP_EFUN */
-typedef local_ptr_t efun_ptr_t;
+typedef struct {
+  short index;
+  /* inline cache when the efun is call_other, allocated when first called */
+  struct call_site_s *site;
+} efun_ptr_t;
 
 /* FP_FUNCTIONAL */
 typedef struct {
@@ -33,9 +33,19 @@ static void i_generate_loop(int, parse_node_t *, parse_node_t *,
                             parse_node_t *);
 static void i_update_branch_list(parse_node_t *, const char *);
 static int try_to_push(int, int);
+static void ins_forward_branch_offset(void);
+static int i_generate_superinstruction(parse_node_t *);
+static int i_generate_fused_branch(parse_node_t *, int, int);
+static int i_typed_operator(parse_node_t *);
 
 static int foreach_depth = 0;
 
+/* the function being generated was compiled with strict types */
+static int strict_function;
+
+/* F_CALL_OTHER_SITEs generated so far in this program */
+int num_call_sites;
+
 static int current_num_values;
 
 static unsigned int last_size_generated;
@@ -373,6 +383,7 @@ i_generate_node(parse_node_t *expr)
   if (expr->line && expr->line != line_being_generated) {
     switch_to_line(expr->line);
   }
+  if (i_generate_superinstruction(expr)) { return; }
   switch (expr->kind) {
     case NODE_FUNCTION: {
       unsigned short num;
@@ -381,8 +392,10 @@ i_generate_node(parse_node_t *expr)
       /* rest  - Sym                                              */
 
       num = FUNCTION_TEMP(expr->v.number)->u.index;
+      strict_function = FUNCTION_FLAGS(expr->v.number) & FUNC_STRICT_TYPES;
       FUNC(num)->address = generate_function(FUNC(num),
                                              expr->r.expr, expr->l.number);
+      strict_function = 0;
       break;
     }
     case NODE_TERNARY_OP:
@@ -390,7 +403,10 @@ i_generate_node(parse_node_t *expr)
       expr = expr->r.expr;
     case NODE_BINARY_OP:
       i_generate_node(expr->l.expr);
-      /* fall through */
+      i_generate_node(expr->r.expr);
+      end_pushes();
+      ins_byte(i_typed_operator(expr));
+      break;
     case NODE_UNARY_OP:
       i_generate_node(expr->r.expr);
       /* fall through */
@@ -697,7 +713,11 @@ i_generate_node(parse_node_t *expr)
         if (expr->kind != NODE_SWITCH_STRINGS) {
           mem_block[A_PROGRAM].block[addr] = (char)(0xf0 + i);
         } else {
+          int patch = addr;
+
           mem_block[A_PROGRAM].block[addr] = (char)(i * 0x10 + 0x0f);
+          /* the keys are string addresses, see save_binary() */
+          add_to_mem_block(A_PATCH, (char *)&patch, sizeof(patch));
         }
       }
       i_update_branch_list(branch_list[CJ_BREAK_SWITCH], "switch break");
@@ -799,8 +819,13 @@ i_generate_node(parse_node_t *expr)
 
       generate_expr_list(expr->r.expr);
       end_pushes();
-      /* max_arg == -1 must use F_EFUNV so that varargs expansion works*/
-      if (expr->l.number < 4 && instrs[f].max_arg != -1) {
+      if (f == F__CALL_OTHER && num_call_sites < USHRT_MAX) {
+        /* an F_EFUNV with an inline cache, see call_site_t */
+        ins_byte(F_CALL_OTHER_SITE);
+        ins_short(num_call_sites++);
+        ins_byte(expr->l.number); /* num args */
+      } else if (expr->l.number < 4 && instrs[f].max_arg != -1) {
+        /* max_arg == -1 must use F_EFUNV so that varargs expansion works*/
         ins_byte(F_EFUN0 + expr->l.number); /* F_EFUN0 to F_EFUN3 */
         ins_short(f); /* efun instruction */
       } else {
@@ -900,6 +925,7 @@ i_generate_if_branch(parse_node_t *node, int invert)
           break;
       }
   }
+  if (i_generate_fused_branch(node, generate_both, branch)) { return; }
   if (generate_both) {
     i_generate_node(node->l.expr);
     i_generate_node(node->r.expr);
@@ -909,6 +935,152 @@ i_generate_if_branch(parse_node_t *node, int invert)
   i_generate_forward_branch(branch);
 }
 
+/*
+ * Superinstructions: the instruction sequences listed in
+ * superinstructions.spec are generated as one fused opcode.  Only whole
+ * subtrees are fused, so no branch can ever land in the middle of one.
+ */
+static int i_generate_superinstruction(parse_node_t *expr)
+{
+  switch (expr->kind) {
+#ifdef F_VOID_ADD_EQ_LOCAL
+    case NODE_BINARY_OP:
+      /* local += expr; */
+      if (expr->v.number == F_VOID_ADD_EQ &&
+          IS_NODE(expr->r.expr, NODE_OPCODE_1, F_LOCAL_LVALUE)) {
+        i_generate_node(expr->l.expr);
+        end_pushes();
+        ins_byte(F_VOID_ADD_EQ_LOCAL);
+        ins_byte(expr->r.expr->l.number);
+        return 1;
+      }
+      break;
+#endif
+#ifdef F_VOID_ASSIGN_LOCAL_BYTE
+    case NODE_UNARY_OP_1:
+      /* local = 0..255; */
+      if (expr->v.number == F_VOID_ASSIGN_LOCAL &&
+          expr->r.expr->kind == NODE_NUMBER &&
+          (expr->r.expr->v.number & ~0xff) == 0) {
+        end_pushes();
+        ins_byte(F_VOID_ASSIGN_LOCAL_BYTE);
+        ins_byte(expr->l.number);
+        ins_byte(expr->r.expr->v.number);
+        return 1;
+      }
+      break;
+#endif
+#ifdef F_LOCAL_LAND
+    case NODE_LAND_LOR:
+      /* local && expr */
+      if (expr->v.number == F_LAND &&
+          IS_NODE(expr->l.expr, NODE_OPCODE_1, F_LOCAL)) {
+        end_pushes();
+        ins_byte(F_LOCAL_LAND);
+        ins_byte(expr->l.expr->l.number);
+        ins_forward_branch_offset();
+        i_generate_node(expr->r.expr);
+        i_update_forward_branch("&& or ||");
+        return 1;
+      }
+      break;
+#endif
+  }
+  return 0;
+}
+
+/*
+ * The typed version of a binary operator, if the operand types allow one.
+ * The types are what the compiler saw, the interpreter still checks them.
+ */
+static int i_typed_operator(parse_node_t *expr)
+{
+  int op = expr->v.number;
+#ifdef TYPED_OPCODES
+  int ltype = expr->l.expr->type, rtype = expr->r.expr->type;
+
+  if (!strict_function) {
+    return op;
+  }
+  if (ltype == TYPE_NUMBER && rtype == TYPE_NUMBER) {
+    switch (op) {
+      case F_ADD: return F_INT_ADD;
+      case F_SUBTRACT: return F_INT_SUBTRACT;
+      case F_MULTIPLY: return F_INT_MULTIPLY;
+      case F_EQ: return F_INT_EQ;
+      case F_NE: return F_INT_NE;
+      case F_LE: return F_INT_LE;
+      case F_LT: return F_INT_LT;
+      case F_GE: return F_INT_GE;
+      case F_GT: return F_INT_GT;
+    }
+  } else if (ltype == TYPE_REAL && rtype == TYPE_REAL) {
+    switch (op) {
+      case F_ADD: return F_REAL_ADD;
+      case F_SUBTRACT: return F_REAL_SUBTRACT;
+      case F_MULTIPLY: return F_REAL_MULTIPLY;
+      case F_DIVIDE: return F_REAL_DIVIDE;
+      case F_LE: return F_REAL_LE;
+      case F_LT: return F_REAL_LT;
+      case F_GE: return F_REAL_GE;
+      case F_GT: return F_REAL_GT;
+    }
+  } else if (op == F_INDEX && ltype == TYPE_NUMBER &&
+             (rtype & TYPE_MOD_ARRAY)) {
+    return F_ARRAY_INDEX;
+  } else if (op == F_INDEX && rtype == TYPE_MAPPING) {
+    return F_MAPPING_INDEX;
+  }
+#endif
+  return op;
+}
+
+/* if (local), if (!local) and if (local < 0..255) */
+static int i_generate_fused_branch(parse_node_t *node, int generate_both,
+                                   int branch)
+{
+  int op = 0, local = 0, arg = -1;
+
+  if (generate_both) {
+#ifdef F_LOCAL_BYTE_BRANCH_GE
+    if (branch == F_BRANCH_GE &&
+        IS_NODE(node->l.expr, NODE_OPCODE_1, F_LOCAL) &&
+        node->r.expr->kind == NODE_NUMBER &&
+        (node->r.expr->v.number & ~0xff) == 0) {
+      op = F_LOCAL_BYTE_BRANCH_GE;
+      local = node->l.expr->l.number;
+      arg = node->r.expr->v.number;
+    }
+#endif
+  } else if (IS_NODE(node, NODE_OPCODE_1, F_LOCAL)) {
+    local = node->l.number;
+#ifdef F_LOCAL_BRANCH_WHEN_ZERO
+    if (branch == F_BRANCH_WHEN_ZERO) {
+      op = F_LOCAL_BRANCH_WHEN_ZERO;
+    }
+#endif
+#ifdef F_LOCAL_BRANCH_WHEN_NON_ZERO
+    if (branch == F_BRANCH_WHEN_NON_ZERO) {
+      op = F_LOCAL_BRANCH_WHEN_NON_ZERO;
+    }
+#endif
+  }
+  if (!op) {
+    return 0;
+  }
+  if (node->line && node->line != line_being_generated) {
+    switch_to_line(node->line);
+  }
+  end_pushes();
+  ins_byte(op);
+  ins_byte(local);
+  if (arg != -1) {
+    ins_byte(arg);
+  }
+  ins_forward_branch_offset();
+  return 1;
+}
+
 void
 i_generate_inherited_init_call(int index, short f)
 {
@@ -924,6 +1096,12 @@ void i_generate_forward_branch(char b)
 {
   end_pushes();
   ins_byte(b);
+  ins_forward_branch_offset();
+}
+
+/* offset of a forward branch, filled in by i_update_forward_branch() */
+static void ins_forward_branch_offset(void)
+{
   if (nforward_branches == nforward_branches_max) {
     nforward_branches_max += 10;
     forward_branches = RESIZE(forward_branches, nforward_branches_max, int,
@@ -1008,6 +1186,7 @@ void
 i_initialize_parser()
 {
   foreach_depth = 0;
+  num_call_sites = 0;
 
   if (!forward_branches) {
     forward_branches = CALLOCATE(10, int, TAG_COMPILER, "forward_branches");
@@ -1090,6 +1269,7 @@ optimize_icode(char *start, char *pc, char *end)
         break;
       case F_SIMUL_EFUN:
       case F_CALL_FUNCTION_BY_ADDRESS:
+      case F_CALL_OTHER_SITE:
         pc += 3;
         break;
       case F_BRANCH_NE:
@@ -1197,7 +1377,32 @@ optimize_icode(char *start, char *pc, char *end)
 #endif
         pc += 2;
         break;
+      /* superinstructions; their branches aren't threaded */
+#ifdef F_LOCAL_BYTE_BRANCH_GE
+      case F_LOCAL_BYTE_BRANCH_GE:
+        pc += 4;
+        break;
+#endif
+#ifdef F_LOCAL_BRANCH_WHEN_ZERO
+      case F_LOCAL_BRANCH_WHEN_ZERO:
+#endif
+#ifdef F_LOCAL_BRANCH_WHEN_NON_ZERO
+      case F_LOCAL_BRANCH_WHEN_NON_ZERO:
+#endif
+#ifdef F_LOCAL_LAND
+      case F_LOCAL_LAND:
+#endif
+        pc += 3;
+        break;
+#ifdef F_VOID_ASSIGN_LOCAL_BYTE
+      case F_VOID_ASSIGN_LOCAL_BYTE:
+        pc += 2;
+        break;
+#endif
       case F_SHORT_STRING:
+#ifdef F_VOID_ADD_EQ_LOCAL
+      case F_VOID_ADD_EQ_LOCAL:
+#endif
       case F_LOOP_INCR:
       case F_WHILE_DEC:
       case F_LOCAL:
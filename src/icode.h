@@ -6,6 +6,8 @@
 #define _ICODE_H
 #include "trees.h"
 
+extern int num_call_sites;
+
 void i_generate___INIT(void);
 void i_generate_node(parse_node_t *);
 void i_generate_continue(void);
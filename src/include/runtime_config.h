@@ -32,7 +32,7 @@
 #define __LOG_DIR__                 CFG_STR(4)
 #define __INCLUDE_DIRS__            CFG_STR(5)
 
-#define __PLACEHOLDER1__            CFG_STR(6)
+#define __SAVE_BINARIES_DIR__       CFG_STR(6)
 
 #define __MASTER_FILE__             CFG_STR(7)
 #define __SIMUL_EFUN_FILE__         CFG_STR(8)
@@ -83,7 +83,9 @@
 #define __FD6_PORT__            CFG_INT(22)
 #define __FD6_KIND__            CFG_INT(23)
 
-#define RUNTIME_CONFIG_NEXT CFG_INT(24)
+#define __APPLY_CACHE_SIZE__    CFG_INT(24)
+
+#define RUNTIME_CONFIG_NEXT CFG_INT(25)
 
 /*
  * The following is for internal use (ie driver) only
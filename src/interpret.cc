@@ -14,9 +14,11 @@
 #include "regexp.h"
 #include "master.h"
 #include "eval.h"
+#include "md.h"
+#include "profiler.h"
 
 #include <algorithm>
-#include <functional>
+#include <atomic>
 
 #ifdef OPCPROF
 #include "opc.h"
@@ -147,7 +149,7 @@ void kill_ref(ref_t *ref)
     /* if some other ref references this mapping, it needs to remain
        locked */
     while (r) {
-      if (r->sv.u.map == ref->sv.u.map) {
+      if (r != ref && r->sv.u.map == ref->sv.u.map) {
         break;
       }
       r = r->next;
@@ -264,22 +266,18 @@ const char *type_name(int c)
  * function names are pointers to shared strings, which means that equality
  * can be tested simply through pointer comparison.
  */
-static program_t *ffbn_recurse(program_t *, char *, int *, int *);
-static program_t *ffbn_recurse2(program_t *, const char *, int *, int *, int *, int *);
-
 #ifndef NO_SHADOWS
 
 static char *check_shadow_functions(program_t *shadow, program_t *victim)
 {
   int i;
-  int pindex, runtime_index;
-  program_t *prog;
+  const function_lookup_t *found;
   char *fun;
 
   for (i = 0; i < shadow->num_functions_defined; i++) {
-    prog = ffbn_recurse(victim, shadow->function_table[i].funcname, &pindex, &runtime_index);
-    if (prog && (victim->function_flags[runtime_index] & DECL_NOMASK)) {
-      return prog->function_table[pindex].funcname;
+    found = lookup_function(victim, shadow->function_table[i].funcname);
+    if (found && (victim->function_flags[found->runtime_index] & DECL_NOMASK)) {
+      return found->prog->function_table[found->index].funcname;
     }
   }
 
@@ -746,8 +744,10 @@ void push_indexed_lvalue(int code)
   if (sp->type == T_LVALUE) {
     lv = sp->u.lvalue;
     if (!code && lv->type == T_MAPPING) {
+      mapping_t *map = lv->u.map;
+
       sp--;
-      if (!(lv = find_for_insert(lv->u.map, sp, 0))) {
+      if (!(lv = find_for_insert(map, sp, 0))) {
         mapping_too_large();
       }
       free_svalue(sp, "push_indexed_lvalue: 1");
@@ -755,7 +755,7 @@ void push_indexed_lvalue(int code)
       sp->u.lvalue = lv;
 #ifdef REF_RESERVED_WORD
       lv_owner_type = T_MAPPING;
-      lv_owner = (refed_t *)lv->u.map;
+      lv_owner = (refed_t *)map;
 #endif
       return;
     }
@@ -1265,17 +1265,23 @@ push_control_stack(int frkind)
     too_deep_error = 1;
     error("Too deep recursion.\n");
   }
+  /* filled in before csp moves, for the sampling profiler */
+  csp[1].caller_type = caller_type;
+  csp[1].ob = current_object;
+  csp[1].framekind = frkind;
+  csp[1].fr.table_index = -1;
+  csp[1].prev_ob = previous_ob;
+  csp[1].fp = fp;
+  csp[1].prog = current_prog;
+  csp[1].pc = pc;
+  csp[1].function_index_offset = function_index_offset;
+  csp[1].variable_index_offset = variable_index_offset;
+  csp[1].defers = NULL;
+#ifdef SAMPLING_PROFILER
+  csp[1].efun = 0;
+  std::atomic_signal_fence(std::memory_order_release);
+#endif
   csp++;
-  csp->caller_type = caller_type;
-  csp->ob = current_object;
-  csp->framekind = frkind;
-  csp->prev_ob = previous_ob;
-  csp->fp = fp;
-  csp->prog = current_prog;
-  csp->pc = pc;
-  csp->function_index_offset = function_index_offset;
-  csp->variable_index_offset = variable_index_offset;
-  csp->defers = NULL;
 }
 
 /*
@@ -1567,6 +1573,7 @@ setup_new_frame(int findex)
 
   func_entry = current_prog->function_table + findex;
   csp->fr.table_index = findex;
+  EVAL_CHECK();
 #ifdef PROFILE_FUNCTIONS
   get_cpu_times(&(csp->entry_secs), &(csp->entry_usecs));
   current_prog->function_table[findex].calls++;
@@ -1624,6 +1631,7 @@ function_t *setup_inherited_frame(int findex)
 
   func_entry = current_prog->function_table + findex;
   csp->fr.table_index = findex;
+  EVAL_CHECK();
 #ifdef PROFILE_FUNCTIONS
   get_cpu_times(&(csp->entry_secs), &(csp->entry_usecs));
   current_prog->function_table[findex].calls++;
@@ -1681,18 +1689,22 @@ void setup_fake_frame(funptr_t *fun)
     too_deep_error = 1;
     error("Too deep recursion.\n");
   }
+  csp[1].caller_type = caller_type;
+  csp[1].framekind = FRAME_FAKE | FRAME_OB_CHANGE;
+  csp[1].fr.funp = fun;
+  csp[1].ob = current_object;
+  csp[1].prev_ob = previous_ob;
+  csp[1].fp = fp;
+  csp[1].prog = current_prog;
+  csp[1].pc = pc;
+  csp[1].function_index_offset = function_index_offset;
+  csp[1].variable_index_offset = variable_index_offset;
+  csp[1].num_local_variables = 0;
+#ifdef SAMPLING_PROFILER
+  csp[1].efun = 0;
+  std::atomic_signal_fence(std::memory_order_release);
+#endif
   csp++;
-  csp->caller_type = caller_type;
-  csp->framekind = FRAME_FAKE | FRAME_OB_CHANGE;
-  csp->fr.funp = fun;
-  csp->ob = current_object;
-  csp->prev_ob = previous_ob;
-  csp->fp = fp;
-  csp->prog = current_prog;
-  csp->pc = pc;
-  csp->function_index_offset = function_index_offset;
-  csp->variable_index_offset = variable_index_offset;
-  csp->num_local_variables = 0;
 
   pc = (char *)&fake_program;
   caller_type = ORIGIN_FUNCTION_POINTER;
@@ -1806,6 +1818,7 @@ static void do_loop_cond_local()
 
     COPY_SHORT(&offset, pc);
     pc -= offset;
+    EVAL_CHECK();
   } else { pc += 2; }
 }
 
@@ -1822,6 +1835,7 @@ static void do_loop_cond_number()
 
       COPY_SHORT(&offset, pc);
       pc -= offset;
+      EVAL_CHECK();
     } else { pc += 2; }
   } else if (s1->type == T_REAL) {
     if (s1->u.real < i) {
@@ -1829,6 +1843,7 @@ static void do_loop_cond_number()
 
       COPY_SHORT(&offset, pc);
       pc -= offset;
+      EVAL_CHECK();
     } else { pc += 2; }
   } else { error("Right side of < is a number, left side is not.\n"); }
 }
@@ -1943,6 +1958,95 @@ static char *previous_pc[60];
 static int last;
 #endif
 
+#if defined(TRACE_CODE) || defined(TRACE) || defined(OPCPROF) || defined(OPCPROF_2D)
+#define INSTRUCTION_HOOKS
+/*
+ * Tracing and profiling done before every instruction, pc points just
+ * past the opcode.
+ */
+static inline void instruction_hooks(int instruction)
+{
+  int real_instruction;
+
+  real_instruction = instruction;
+  /* real EFUN is stored as an short after F_EFUN0 - F_EFUNV instructions */
+  if (instruction >= F_EFUN0 && instruction <= F_EFUNV) {
+    COPY_SHORT(&real_instruction, pc);
+    if (real_instruction < EFUN_BASE || real_instruction > NUM_OPCODES) {
+      fatal("Error in icode.");
+    }
+  }
+#  ifdef TRACE_CODE
+  previous_instruction[last] = real_instruction;
+  previous_pc[last] = pc - 1;
+  stack_size[last] = sp - fp - csp->num_local_variables;
+  last = (last + 1) % (sizeof previous_instruction / sizeof(int));
+#  endif
+#  ifdef TRACE
+  if (TRACEP(TRACE_EXEC)) {
+    do_trace("Exec ", query_instr_name(real_instruction), "\n");
+  }
+#  endif
+#  ifdef OPCPROF
+  if (real_instruction < EFUN_BASE) {
+    opc_eoper[real_instruction]++;
+  } else {
+    opc_efun[real_instruction - EFUN_BASE].count++;
+  }
+#  endif
+#  ifdef OPCPROF_2D
+  if (real_instruction < EFUN_BASE) {
+    if (last_eop) { opc_eoper_2d[last_eop][real_instruction]++; }
+    last_eop = real_instruction;
+  } else {
+    if (last_eop) { opc_eoper_2d[last_eop][EFUN_BASE]++; }
+    last_eop = EFUN_BASE;
+  }
+#  endif
+}
+#endif
+
+/*
+ * With THREADED_DISPATCH every handler fetches the next opcode itself and
+ * jumps straight to its handler through dispatch_table (computed goto),
+ * so each handler gets its own indirect branch to predict.  The switch
+ * stays for compilers without computed goto.  Running out of eval cost
+ * and the DBG_LPC line trace still go back round the loop.
+ */
+#if defined(COMPUTED_GOTO_DISPATCH) && defined(__GNUC__)
+#  define THREADED_DISPATCH
+#  define CASE(op) case op: L_##op
+#  define DEFAULT_CASE default: L_default
+#  ifdef DEBUG_MACRO
+#    define LPC_LINE_TRACE (debug_level & DBG_LPC)
+#  else
+#    define LPC_LINE_TRACE 0
+#  endif
+#  ifdef INSTRUCTION_HOOKS
+#    define DISPATCH_HOOKS instruction_hooks(instruction)
+#  else
+#    define DISPATCH_HOOKS
+#  endif
+#  define DISPATCH \
+  DEBUG_CHECK1(sp < fp + csp->num_local_variables - 1, \
+               "Bad stack after evaluation. Instruction %d\n", instruction); \
+  if (outoftime || LPC_LINE_TRACE) { continue; } \
+  instruction = EXTRACT_UCHAR(pc++); \
+  DISPATCH_HOOKS; \
+  goto *dispatch_table[instruction]
+#else
+#  define CASE(op) case op
+#  define DEFAULT_CASE default
+#  define DISPATCH break
+#endif
+
+/* run the handler of 'op' on the current operands instead */
+#ifdef THREADED_DISPATCH
+#  define REDISPATCH(op) SAFE(instruction = (op); goto *dispatch_table[op];)
+#else
+#  define REDISPATCH(op) SAFE(instruction = (op); goto redispatch;)
+#endif
+
 void
 eval_instruction(char *p)
 {
@@ -1953,13 +2057,100 @@ eval_instruction(char *p)
   LPC_FLOAT real;
   svalue_t *lval;
   int instruction;
-#if defined(TRACE_CODE) || defined(TRACE) || defined(OPCPROF) || defined(OPCPROF_2D)
-  int real_instruction;
-#endif
   unsigned short offset;
 
   IF_DEBUG(svalue_t * expected_stack);
 
+#ifdef THREADED_DISPATCH
+  static void *dispatch_table[256];
+
+  if (!dispatch_table[0]) {
+    for (i = 0; i < 256; i++) {
+      dispatch_table[i] = &&L_default;
+    }
+#  define TARGET(op) dispatch_table[op] = &&L_##op
+    TARGET(F_PUSH); TARGET(F_INC); TARGET(F_WHILE_DEC); TARGET(F_LOCAL_LVALUE);
+    TARGET(F_SHORT_INT); TARGET(F_NUMBER); TARGET(F_REAL); TARGET(F_BYTE);
+    TARGET(F_NBYTE); TARGET(F_BRANCH); TARGET(F_BBRANCH); TARGET(F_BRANCH_NE);
+    TARGET(F_BRANCH_GE); TARGET(F_BRANCH_LE); TARGET(F_BRANCH_EQ);
+    TARGET(F_BBRANCH_LT); TARGET(F_BRANCH_WHEN_ZERO);
+    TARGET(F_BRANCH_WHEN_NON_ZERO); TARGET(F_BBRANCH_WHEN_ZERO);
+    TARGET(F_BBRANCH_WHEN_NON_ZERO); TARGET(F_LOR); TARGET(F_LAND);
+    TARGET(F_LOOP_INCR); TARGET(F_LOOP_COND_LOCAL); TARGET(F_LOOP_COND_NUMBER);
+    TARGET(F_TRANSFER_LOCAL); TARGET(F_LOCAL); TARGET(F_LT); TARGET(F_ADD);
+    TARGET(F_VOID_ADD_EQ); TARGET(F_ADD_EQ); TARGET(F_AND); TARGET(F_AND_EQ);
+    TARGET(F_FUNCTION_CONSTRUCTOR); TARGET(F_FOREACH); TARGET(F_NEXT_FOREACH);
+    TARGET(F_EXIT_FOREACH); TARGET(F_EXPAND_VARARGS); TARGET(F_NEW_CLASS);
+    TARGET(F_NEW_EMPTY_CLASS); TARGET(F_AGGREGATE); TARGET(F_AGGREGATE_ASSOC);
+    TARGET(F_ASSIGN); TARGET(F_VOID_ASSIGN_LOCAL); TARGET(F_VOID_ASSIGN);
+    TARGET(F_CALL_FUNCTION_BY_ADDRESS); TARGET(F_CALL_INHERITED);
+    TARGET(F_COMPL); TARGET(F_CONST0); TARGET(F_CONST1); TARGET(F_PRE_DEC);
+    TARGET(F_DEC); TARGET(F_DIVIDE); TARGET(F_DIV_EQ); TARGET(F_EQ);
+    TARGET(F_GE); TARGET(F_GT); TARGET(F_GLOBAL); TARGET(F_PRE_INC);
+    TARGET(F_MEMBER); TARGET(F_MEMBER_LVALUE); TARGET(F_INDEX);
+    TARGET(F_RINDEX); TARGET(F_LE); TARGET(F_LSH); TARGET(F_LSH_EQ);
+    TARGET(F_MOD); TARGET(F_MOD_EQ); TARGET(F_MULTIPLY); TARGET(F_MULT_EQ);
+    TARGET(F_NE); TARGET(F_NEGATE); TARGET(F_NOT); TARGET(F_OR);
+    TARGET(F_OR_EQ); TARGET(F_PARSE_COMMAND); TARGET(F_POP_VALUE);
+    TARGET(F_POST_DEC); TARGET(F_POST_INC); TARGET(F_GLOBAL_LVALUE);
+    TARGET(F_INDEX_LVALUE); TARGET(F_RINDEX_LVALUE); TARGET(F_NN_RANGE_LVALUE);
+    TARGET(F_RN_RANGE_LVALUE); TARGET(F_RR_RANGE_LVALUE);
+    TARGET(F_NR_RANGE_LVALUE); TARGET(F_NN_RANGE); TARGET(F_RN_RANGE);
+    TARGET(F_NR_RANGE); TARGET(F_RR_RANGE); TARGET(F_NE_RANGE);
+    TARGET(F_RE_RANGE); TARGET(F_RETURN_ZERO); TARGET(F_RETURN); TARGET(F_RSH);
+    TARGET(F_RSH_EQ); TARGET(F_SSCANF); TARGET(F_STRING);
+    TARGET(F_SHORT_STRING); TARGET(F_SUBTRACT); TARGET(F_SUB_EQ);
+    TARGET(F_SIMUL_EFUN); TARGET(F_SWITCH); TARGET(F_XOR); TARGET(F_XOR_EQ);
+    TARGET(F_CATCH); TARGET(F_END_CATCH); TARGET(F_TIME_EXPRESSION);
+    TARGET(F_END_TIME_EXPRESSION); TARGET(F_TYPE_CHECK); TARGET(F_EFUN0);
+    TARGET(F_EFUN1); TARGET(F_EFUN2); TARGET(F_EFUN3); TARGET(F_EFUNV);
+    TARGET(F_CALL_OTHER_SITE);
+#  ifdef REF_RESERVED_WORD
+    TARGET(F_MAKE_REF); TARGET(F_KILL_REFS); TARGET(F_REF);
+    TARGET(F_REF_LVALUE);
+#  endif
+#  ifdef F_JUMP_WHEN_NON_ZERO
+    TARGET(F_JUMP_WHEN_NON_ZERO);
+#  endif
+#  ifdef DEBUG
+    TARGET(F_BREAK_POINT);
+#  endif
+#  ifdef F_JUMP_WHEN_ZERO
+    TARGET(F_JUMP_WHEN_ZERO);
+#  endif
+#  ifdef F_JUMP
+    TARGET(F_JUMP);
+#  endif
+#  ifdef F_LOCAL_BRANCH_WHEN_ZERO
+    TARGET(F_LOCAL_BRANCH_WHEN_ZERO);
+#  endif
+#  ifdef F_LOCAL_BRANCH_WHEN_NON_ZERO
+    TARGET(F_LOCAL_BRANCH_WHEN_NON_ZERO);
+#  endif
+#  ifdef F_LOCAL_LAND
+    TARGET(F_LOCAL_LAND);
+#  endif
+#  ifdef F_LOCAL_BYTE_BRANCH_GE
+    TARGET(F_LOCAL_BYTE_BRANCH_GE);
+#  endif
+#  ifdef F_VOID_ASSIGN_LOCAL_BYTE
+    TARGET(F_VOID_ASSIGN_LOCAL_BYTE);
+#  endif
+#  ifdef F_VOID_ADD_EQ_LOCAL
+    TARGET(F_VOID_ADD_EQ_LOCAL);
+#  endif
+#  ifdef TYPED_OPCODES
+    TARGET(F_INT_ADD); TARGET(F_INT_SUBTRACT); TARGET(F_INT_MULTIPLY);
+    TARGET(F_INT_EQ); TARGET(F_INT_NE); TARGET(F_INT_LE); TARGET(F_INT_LT);
+    TARGET(F_INT_GE); TARGET(F_INT_GT); TARGET(F_REAL_ADD);
+    TARGET(F_REAL_SUBTRACT); TARGET(F_REAL_MULTIPLY); TARGET(F_REAL_DIVIDE);
+    TARGET(F_REAL_LE); TARGET(F_REAL_LT); TARGET(F_REAL_GE); TARGET(F_REAL_GT);
+    TARGET(F_ARRAY_INDEX); TARGET(F_MAPPING_INDEX);
+#  endif
+#  undef TARGET
+  }
+#endif
+
   /* Next F_RETURN at this level will return out of eval_instruction() */
   csp->framekind |= FRAME_EXTERNAL;
   pc = p;
@@ -1974,42 +2165,8 @@ eval_instruction(char *p)
     }
 #  endif
     instruction = EXTRACT_UCHAR(pc++);
-#if defined(TRACE_CODE) || defined(TRACE) || defined(OPCPROF) || defined(OPCPROF_2D)
-    real_instruction = instruction;
-    /* real EFUN is stored as an short after F_EFUN0 - F_EFUNV instructions */
-    if (instruction >= F_EFUN0 && instruction <= F_EFUNV) {
-      COPY_SHORT(&real_instruction, pc);
-      if (real_instruction < EFUN_BASE || real_instruction > NUM_OPCODES) {
-        fatal("Error in icode.");
-      }
-    }
-#  ifdef TRACE_CODE
-    previous_instruction[last] = real_instruction;
-    previous_pc[last] = pc - 1;
-    stack_size[last] = sp - fp - csp->num_local_variables;
-    last = (last + 1) % (sizeof previous_instruction / sizeof(int));
-#  endif
-#  ifdef TRACE
-    if (TRACEP(TRACE_EXEC)) {
-      do_trace("Exec ", query_instr_name(real_instruction), "\n");
-    }
-#  endif
-#  ifdef OPCPROF
-    if (real_instruction < EFUN_BASE) {
-      opc_eoper[real_instruction]++;
-    } else {
-      opc_efun[real_instruction - EFUN_BASE].count++;
-    }
-#  endif
-#  ifdef OPCPROF_2D
-    if (real_instruction < EFUN_BASE) {
-      if (last_eop) { opc_eoper_2d[last_eop][real_instruction]++; }
-      last_eop = real_instruction;
-    } else {
-      if (last_eop) { opc_eoper_2d[last_eop][EFUN_BASE]++; }
-      last_eop = EFUN_BASE;
-    }
-#  endif
+#ifdef INSTRUCTION_HOOKS
+    instruction_hooks(instruction);
 #endif
     if (outoftime) {
       debug_message("object /%s: eval_cost too big %d\n",
@@ -2023,9 +2180,13 @@ eval_instruction(char *p)
      * LPC must return a value. This does not apply to control
      * instructions, like F_JUMP.
      */
-
+#ifdef THREADED_DISPATCH
+    goto *dispatch_table[instruction];
+#else
+redispatch:
+#endif
     switch (instruction) {
-      case F_PUSH:    /* Push a number of things onto the stack */
+      CASE(F_PUSH):    /* Push a number of things onto the stack */
         n = EXTRACT_UCHAR(pc++);
         while (n--) {
           i = EXTRACT_UCHAR(pc++);
@@ -2057,8 +2218,8 @@ eval_instruction(char *p)
               break;
           }
         }
-        break;
-      case F_INC:
+        DISPATCH;
+      CASE(F_INC):
         DEBUG_CHECK(sp->type != T_LVALUE,
                     "non-lvalue argument to ++\n");
         lval = (sp--)->u.lvalue;
@@ -2079,8 +2240,8 @@ eval_instruction(char *p)
           default:
             error("++ of non-numeric argument\n");
         }
-        break;
-      case F_WHILE_DEC: {
+        DISPATCH;
+      CASE(F_WHILE_DEC): {
         svalue_t *s;
 
         s = fp + EXTRACT_UCHAR(pc++);
@@ -2094,18 +2255,19 @@ eval_instruction(char *p)
         if (i) {
           COPY_SHORT(&offset, pc);
           pc -= offset;
+          EVAL_CHECK();
         } else {
           pc += 2;
         }
       }
-      break;
-      case F_LOCAL_LVALUE:
+      DISPATCH;
+      CASE(F_LOCAL_LVALUE):
         STACK_INC;
         sp->type = T_LVALUE;
         sp->u.lvalue = fp + EXTRACT_UCHAR(pc++);
-        break;
+        DISPATCH;
 #ifdef REF_RESERVED_WORD
-      case F_MAKE_REF: {
+      CASE(F_MAKE_REF): {
         ref_t *ref;
         int op = EXTRACT_UCHAR(pc++);
         /* global and local refs need no protection since they are
@@ -2134,16 +2296,16 @@ eval_instruction(char *p)
         }
         sp->type = T_REF;
         sp->u.ref = ref;
-        break;
+        DISPATCH;
       }
-      case F_KILL_REFS: {
+      CASE(F_KILL_REFS): {
         int num = EXTRACT_UCHAR(pc++);
         while (num--) {
           kill_ref(global_ref_list);
         }
-        break;
+        DISPATCH;
       }
-      case F_REF: {
+      CASE(F_REF): {
         svalue_t *s = fp + EXTRACT_UCHAR(pc++);
         svalue_t *reflval;
 
@@ -2166,9 +2328,9 @@ eval_instruction(char *p)
         }
         push_svalue(reflval);
 
-        break;
+        DISPATCH;
       }
-      case F_REF_LVALUE: {
+      CASE(F_REF_LVALUE): {
         svalue_t *s = fp + EXTRACT_UCHAR(pc++);
 
         if (s->type == T_REF) {
@@ -2182,32 +2344,32 @@ eval_instruction(char *p)
         } else {
           error("Non-reference value passed as reference argument.\n");
         }
-        break;
+        DISPATCH;
       }
 #endif
-      case F_SHORT_INT: {
+      CASE(F_SHORT_INT): {
         short s;
 
         LOAD_SHORT(s, pc);
         push_number(s);
-        break;
+        DISPATCH;
       }
-      case F_NUMBER:
+      CASE(F_NUMBER):
         LOAD_INT(i, pc);
         push_number(i);
-        break;
-      case F_REAL:
+        DISPATCH;
+      CASE(F_REAL):
         LOAD_FLOAT(real, pc);
         push_real(real);
-        break;
-      case F_BYTE:
+        DISPATCH;
+      CASE(F_BYTE):
         push_number(EXTRACT_UCHAR(pc++));
-        break;
-      case F_NBYTE:
+        DISPATCH;
+      CASE(F_NBYTE):
         push_number(-(EXTRACT_UCHAR(pc++)));
-        break;
+        DISPATCH;
 #ifdef F_JUMP_WHEN_NON_ZERO
-      case F_JUMP_WHEN_NON_ZERO:
+      CASE(F_JUMP_WHEN_NON_ZERO):
         if ((i = (sp->type == T_NUMBER)) && (sp->u.number == 0)) {
           pc += 2;
         } else {
@@ -2220,17 +2382,18 @@ eval_instruction(char *p)
         } else {
           pop_stack();
         }
-        break;
+        DISPATCH;
 #endif
-      case F_BRANCH:    /* relative offset */
+      CASE(F_BRANCH):    /* relative offset */
         COPY_SHORT(&offset, pc);
         pc += offset;
-        break;
-      case F_BBRANCH:   /* relative offset */
+        DISPATCH;
+      CASE(F_BBRANCH):   /* relative offset */
         COPY_SHORT(&offset, pc);
         pc -= offset;
-        break;
-      case F_BRANCH_NE:
+        EVAL_CHECK();
+        DISPATCH;
+      CASE(F_BRANCH_NE):
         f_ne();
         if ((sp--)->u.number) {
           COPY_SHORT(&offset, pc);
@@ -2238,8 +2401,8 @@ eval_instruction(char *p)
         } else {
           pc += 2;
         }
-        break;
-      case F_BRANCH_GE:
+        DISPATCH;
+      CASE(F_BRANCH_GE):
         f_ge();
         if ((sp--)->u.number) {
           COPY_SHORT(&offset, pc);
@@ -2247,8 +2410,8 @@ eval_instruction(char *p)
         } else {
           pc += 2;
         }
-        break;
-      case F_BRANCH_LE:
+        DISPATCH;
+      CASE(F_BRANCH_LE):
         f_le();
         if ((sp--)->u.number) {
           COPY_SHORT(&offset, pc);
@@ -2256,8 +2419,8 @@ eval_instruction(char *p)
         } else {
           pc += 2;
         }
-        break;
-      case F_BRANCH_EQ:
+        DISPATCH;
+      CASE(F_BRANCH_EQ):
         f_eq();
         if ((sp--)->u.number) {
           COPY_SHORT(&offset, pc);
@@ -2265,17 +2428,18 @@ eval_instruction(char *p)
         } else {
           pc += 2;
         }
-        break;
-      case F_BBRANCH_LT:
+        DISPATCH;
+      CASE(F_BBRANCH_LT):
         f_lt();
         if ((sp--)->u.number) {
           COPY_SHORT(&offset, pc);
           pc -= offset;
+          EVAL_CHECK();
         } else {
           pc += 2;
         }
-        break;
-      case F_BRANCH_WHEN_ZERO: /* relative offset */
+        DISPATCH;
+      CASE(F_BRANCH_WHEN_ZERO): /* relative offset */
         if (sp->type == T_NUMBER) {
           if (!((sp--)->u.number)) {
             COPY_SHORT(&offset, pc);
@@ -2284,8 +2448,8 @@ eval_instruction(char *p)
           }
         } else { pop_stack(); }
         pc += 2;    /* skip over the offset */
-        break;
-      case F_BRANCH_WHEN_NON_ZERO: /* relative offset */
+        DISPATCH;
+      CASE(F_BRANCH_WHEN_NON_ZERO): /* relative offset */
         if (sp->type == T_NUMBER) {
           if (!((sp--)->u.number)) {
             pc += 2;
@@ -2294,18 +2458,19 @@ eval_instruction(char *p)
         } else { pop_stack(); }
         COPY_SHORT(&offset, pc);
         pc += offset;
-        break;
-      case F_BBRANCH_WHEN_ZERO: /* relative backwards offset */
+        DISPATCH;
+      CASE(F_BBRANCH_WHEN_ZERO): /* relative backwards offset */
         if (sp->type == T_NUMBER) {
           if (!((sp--)->u.number)) {
             COPY_SHORT(&offset, pc);
             pc -= offset;
+            EVAL_CHECK();
             break;
           }
         } else { pop_stack(); }
         pc += 2;
-        break;
-      case F_BBRANCH_WHEN_NON_ZERO: /* relative backwards offset */
+        DISPATCH;
+      CASE(F_BBRANCH_WHEN_NON_ZERO): /* relative backwards offset */
         if (sp->type == T_NUMBER) {
           if (!((sp--)->u.number)) {
             pc += 2;
@@ -2314,8 +2479,9 @@ eval_instruction(char *p)
         } else { pop_stack(); }
         COPY_SHORT(&offset, pc);
         pc -= offset;
-        break;
-      case F_LOR:
+        EVAL_CHECK();
+        DISPATCH;
+      CASE(F_LOR):
         /* replaces F_DUP; F_BRANCH_WHEN_NON_ZERO; F_POP */
         if (sp->type == T_NUMBER) {
           if (!sp->u.number) {
@@ -2326,8 +2492,8 @@ eval_instruction(char *p)
         }
         COPY_SHORT(&offset, pc);
         pc += offset;
-        break;
-      case F_LAND:
+        DISPATCH;
+      CASE(F_LAND):
         /* replaces F_DUP; F_BRANCH_WHEN_ZERO; F_POP */
         if (sp->type == T_NUMBER) {
           if (!sp->u.number) {
@@ -2338,8 +2504,8 @@ eval_instruction(char *p)
           sp--;
         } else { pop_stack(); }
         pc += 2;
-        break;
-      case F_LOOP_INCR: /* this case must be just prior to
+        DISPATCH;
+      CASE(F_LOOP_INCR): /* this case must be just prior to
                        * F_LOOP_COND */
       {
         svalue_t *s;
@@ -2360,14 +2526,204 @@ eval_instruction(char *p)
         pc++;
         do_loop_cond_number();
       }
-      break;
-      case F_LOOP_COND_LOCAL:
+      DISPATCH;
+      CASE(F_LOOP_COND_LOCAL):
         do_loop_cond_local();
-        break;
-      case F_LOOP_COND_NUMBER:
+        DISPATCH;
+      CASE(F_LOOP_COND_NUMBER):
         do_loop_cond_number();
-        break;
-      case F_TRANSFER_LOCAL: {
+        DISPATCH;
+        /*
+         * Superinstructions, see superinstructions.spec.  Each does the
+         * work of its instruction sequence without pushing the local.
+         */
+#ifdef F_LOCAL_BRANCH_WHEN_ZERO
+      CASE(F_LOCAL_BRANCH_WHEN_ZERO):
+        lval = fp + EXTRACT_UCHAR(pc++);
+        if ((lval->type == T_OBJECT) && (lval->u.ob->flags & O_DESTRUCTED)) {
+          assign_svalue(lval, &const0u);
+        }
+        if (lval->type == T_NUMBER && !lval->u.number) {
+          COPY_SHORT(&offset, pc);
+          pc += offset;
+        } else {
+          pc += 2;
+        }
+        DISPATCH;
+#endif
+#ifdef F_LOCAL_BRANCH_WHEN_NON_ZERO
+      CASE(F_LOCAL_BRANCH_WHEN_NON_ZERO):
+        lval = fp + EXTRACT_UCHAR(pc++);
+        if ((lval->type == T_OBJECT) && (lval->u.ob->flags & O_DESTRUCTED)) {
+          assign_svalue(lval, &const0u);
+        }
+        if (lval->type == T_NUMBER && !lval->u.number) {
+          pc += 2;
+        } else {
+          COPY_SHORT(&offset, pc);
+          pc += offset;
+        }
+        DISPATCH;
+#endif
+#ifdef F_LOCAL_LAND
+      CASE(F_LOCAL_LAND):
+        /* local; F_LAND: a false local is the value of the && */
+        lval = fp + EXTRACT_UCHAR(pc++);
+        if ((lval->type == T_OBJECT) && (lval->u.ob->flags & O_DESTRUCTED)) {
+          assign_svalue(lval, &const0u);
+        }
+        if (lval->type == T_NUMBER && !lval->u.number) {
+          push_svalue(lval);
+          COPY_SHORT(&offset, pc);
+          pc += offset;
+        } else {
+          pc += 2;
+        }
+        DISPATCH;
+#endif
+#ifdef F_LOCAL_BYTE_BRANCH_GE
+      CASE(F_LOCAL_BYTE_BRANCH_GE):
+        lval = fp + EXTRACT_UCHAR(pc++);
+        i = EXTRACT_UCHAR(pc++);
+        if (lval->type == T_NUMBER) {
+          n = (lval->u.number >= i);
+        } else {
+          if ((lval->type == T_OBJECT) && (lval->u.ob->flags & O_DESTRUCTED)) {
+            assign_svalue(lval, &const0u);
+          }
+          push_svalue(lval);
+          push_number(i);
+          f_ge();
+          n = (sp--)->u.number;
+        }
+        if (n) {
+          COPY_SHORT(&offset, pc);
+          pc += offset;
+        } else {
+          pc += 2;
+        }
+        DISPATCH;
+#endif
+#ifdef F_VOID_ASSIGN_LOCAL_BYTE
+      CASE(F_VOID_ASSIGN_LOCAL_BYTE):
+        lval = fp + EXTRACT_UCHAR(pc++);
+        if (lval->type != T_NUMBER) {
+          free_svalue(lval, "F_VOID_ASSIGN_LOCAL_BYTE");
+          lval->type = T_NUMBER;
+        }
+        lval->subtype = 0;
+        lval->u.number = EXTRACT_UCHAR(pc++);
+        DISPATCH;
+#endif
+#ifdef F_VOID_ADD_EQ_LOCAL
+      CASE(F_VOID_ADD_EQ_LOCAL):
+        lval = fp + EXTRACT_UCHAR(pc++);
+        if (lval->type == T_NUMBER && sp->type == T_NUMBER) {
+          lval->u.number += (sp--)->u.number;
+          lval->subtype = 0;
+          DISPATCH;
+        }
+        /* anything else is F_LOCAL_LVALUE; F_VOID_ADD_EQ */
+        STACK_INC;
+        sp->type = T_LVALUE;
+        sp->u.lvalue = lval;
+        instruction = F_VOID_ADD_EQ;
+        goto void_add_eq;
+#endif
+#ifdef TYPED_OPCODES
+        /*
+         * Typed operators, see i_typed_operator().  The compiler's types
+         * aren't enforced (an int variable can be given a mixed value), so
+         * operands of any other type go to the generic operator.
+         */
+#  define INT_OP(name, generic, expr) \
+      CASE(F_INT_##name): \
+        if (((sp - 1)->type | sp->type) != T_NUMBER) { \
+          REDISPATCH(generic); \
+        } \
+        sp--; \
+        sp->u.number = (expr); \
+        sp->subtype = 0; \
+        DISPATCH
+#  define REAL_OP(name, generic, expr) \
+      CASE(F_REAL_##name): \
+        if (((sp - 1)->type | sp->type) != T_REAL) { \
+          REDISPATCH(generic); \
+        } \
+        sp--; \
+        sp->u.real = (expr); \
+        DISPATCH
+#  define REAL_CMP(name, generic, expr) \
+      CASE(F_REAL_##name): \
+        if (((sp - 1)->type | sp->type) != T_REAL) { \
+          REDISPATCH(generic); \
+        } \
+        sp--; \
+        sp->type = T_NUMBER; \
+        sp->subtype = 0; \
+        sp->u.number = (expr); \
+        DISPATCH
+      INT_OP(ADD, F_ADD, sp->u.number + sp[1].u.number);
+      INT_OP(SUBTRACT, F_SUBTRACT, sp->u.number - sp[1].u.number);
+      INT_OP(MULTIPLY, F_MULTIPLY, sp->u.number * sp[1].u.number);
+      INT_OP(EQ, F_EQ, sp->u.number == sp[1].u.number);
+      INT_OP(NE, F_NE, sp->u.number != sp[1].u.number);
+      INT_OP(LE, F_LE, sp->u.number <= sp[1].u.number);
+      INT_OP(LT, F_LT, sp->u.number < sp[1].u.number);
+      INT_OP(GE, F_GE, sp->u.number >= sp[1].u.number);
+      INT_OP(GT, F_GT, sp->u.number > sp[1].u.number);
+      REAL_OP(ADD, F_ADD, sp->u.real + sp[1].u.real);
+      REAL_OP(SUBTRACT, F_SUBTRACT, sp->u.real - sp[1].u.real);
+      REAL_OP(MULTIPLY, F_MULTIPLY, sp->u.real * sp[1].u.real);
+      REAL_CMP(LE, F_LE, sp->u.real <= sp[1].u.real);
+      REAL_CMP(LT, F_LT, sp->u.real < sp[1].u.real);
+      REAL_CMP(GE, F_GE, sp->u.real >= sp[1].u.real);
+      REAL_CMP(GT, F_GT, sp->u.real > sp[1].u.real);
+#  undef INT_OP
+#  undef REAL_OP
+#  undef REAL_CMP
+      CASE(F_REAL_DIVIDE):
+        /* division by zero gets its error from F_DIVIDE */
+        if (((sp - 1)->type | sp->type) != T_REAL || sp->u.real == 0.0) {
+          REDISPATCH(F_DIVIDE);
+        }
+        sp--;
+        sp->u.real /= sp[1].u.real;
+        DISPATCH;
+      CASE(F_ARRAY_INDEX): {
+        array_t *arr;
+        svalue_t *item;
+
+        if (sp->type != T_ARRAY || (sp - 1)->type != T_NUMBER ||
+            (sp - 1)->u.number < 0 || (sp - 1)->u.number >= sp->u.arr->size) {
+          REDISPATCH(F_INDEX);
+        }
+        arr = sp->u.arr;
+        item = &arr->item[(sp - 1)->u.number];
+        if (item->type == T_OBJECT && (item->u.ob->flags & O_DESTRUCTED)) {
+          assign_svalue(item, &const0u);
+        }
+        assign_svalue_no_free(--sp, item);
+        free_array(arr);
+        DISPATCH;
+      }
+      CASE(F_MAPPING_INDEX): {
+        svalue_t *v;
+        mapping_t *m;
+
+        if (sp->type != T_MAPPING) {
+          REDISPATCH(F_INDEX);
+        }
+        v = find_in_mapping(m = sp->u.map, sp - 1);
+        if (v->type == T_OBJECT && (v->u.ob->flags & O_DESTRUCTED)) {
+          assign_svalue(v, &const0u);
+        }
+        assign_svalue(--sp, v);
+        free_mapping(m);
+        DISPATCH;
+      }
+#endif
+      CASE(F_TRANSFER_LOCAL): {
         svalue_t *s;
 
         s = fp + EXTRACT_UCHAR(pc++);
@@ -2383,9 +2739,9 @@ eval_instruction(char *p)
         /* The optimizer has asserted this won't be used again.  Make
          * it look like a number to avoid double frees. */
         s->type = T_NUMBER;
-        break;
+        DISPATCH;
       }
-      case F_LOCAL: {
+      CASE(F_LOCAL): {
         svalue_t *s;
 
         s = fp + EXTRACT_UCHAR(pc++);
@@ -2400,12 +2756,12 @@ eval_instruction(char *p)
           assign_svalue(s, &const0u);
         }
         push_svalue(s);
-        break;
+        DISPATCH;
       }
-      case F_LT:
+      CASE(F_LT):
         f_lt();
-        break;
-      case F_ADD: {
+        DISPATCH;
+      CASE(F_ADD): {
         switch (sp->type) {
 #ifndef NO_BUFFER_TYPE
           case T_BUFFER: {
@@ -2543,10 +2899,13 @@ eval_instruction(char *p)
             error("Bad type argument to +.  Had %s and %s.\n",
                   type_name((sp - 1)->type), type_name(sp->type));
         }
-        break;
+        DISPATCH;
       }
-      case F_VOID_ADD_EQ:
-      case F_ADD_EQ:
+      CASE(F_VOID_ADD_EQ):
+      CASE(F_ADD_EQ):
+#ifdef F_VOID_ADD_EQ_LOCAL
+      void_add_eq:
+#endif
         DEBUG_CHECK(sp->type != T_LVALUE,
                     "non-lvalue argument to +=\n");
         lval = sp->u.lvalue;
@@ -2554,20 +2913,19 @@ eval_instruction(char *p)
         switch (lval->type) {
           case T_STRING:
             if (sp->type == T_STRING) {
-              SVALUE_STRING_JOIN(lval, sp, "f_add_eq: 1");
+              SVALUE_STRING_APPEND(lval, sp, "f_add_eq: 1");
             } else if (sp->type == T_NUMBER) {
               char buff[100];
               sprintf(buff, "%" LPC_INT_FMTSTR_P, sp->u.number);
-              EXTEND_SVALUE_STRING(lval, buff, "f_add_eq: 2");
+              APPEND_SVALUE_STRING(lval, buff, "f_add_eq: 2");
             } else if (sp->type == T_REAL) {
               char buff[400];
               sprintf(buff, "%" LPC_FLOAT_FMTSTR_P, sp->u.real);
-              EXTEND_SVALUE_STRING(lval, buff, "f_add_eq: 2");
+              APPEND_SVALUE_STRING(lval, buff, "f_add_eq: 2");
             } else if (sp->type == T_OBJECT) {
-              const char *fname = sp->u.ob->obname;
-              free_object(&(sp--)->u.ob, "f_add_eq: 2");
-              EXTEND_SVALUE_STRING(lval, "/", "f_add: str ob");
-              EXTEND_SVALUE_STRING(lval, fname, "f_add_eq: 2");
+              APPEND_SVALUE_STRING(lval, "/", "f_add: str ob");
+              APPEND_SVALUE_STRING(lval, sp->u.ob->obname, "f_add_eq: 2");
+              free_object(&sp->u.ob, "f_add_eq: 2");
             } else {
               bad_argument(sp, T_OBJECT | T_STRING | T_NUMBER | T_REAL, 2, instruction);
             }
@@ -2658,18 +3016,18 @@ eval_instruction(char *p)
            */
           sp--;
         }
-        break;
-      case F_AND:
+        DISPATCH;
+      CASE(F_AND):
         f_and();
-        break;
-      case F_AND_EQ:
+        DISPATCH;
+      CASE(F_AND_EQ):
         f_and_eq();
-        break;
-      case F_FUNCTION_CONSTRUCTOR:
+        DISPATCH;
+      CASE(F_FUNCTION_CONSTRUCTOR):
         f_function_constructor();
-        break;
+        DISPATCH;
 
-      case F_FOREACH: {
+      CASE(F_FOREACH): {
         int flags = EXTRACT_UCHAR(pc++);
 
         IF_DEBUG(stack_in_use_as_temporary++);
@@ -2686,6 +3044,7 @@ eval_instruction(char *p)
           STACK_INC;
           sp->type = T_LVALUE;
           if (flags & FOREACH_LEFT_GLOBAL) {
+            current_object->reclaim_flags |= O_RECLAIM_DIRTY;
             sp->u.lvalue = find_value((int)(READ_GLOBAL_INDEX(pc) + variable_index_offset));
           } else {
             sp->u.lvalue = fp + EXTRACT_UCHAR(pc++);
@@ -2705,6 +3064,7 @@ eval_instruction(char *p)
         }
 
         if (flags & FOREACH_RIGHT_GLOBAL) {
+          current_object->reclaim_flags |= O_RECLAIM_DIRTY;
           STACK_INC;
           sp->type = T_LVALUE;
           sp->u.lvalue = find_value((int)(READ_GLOBAL_INDEX(pc) + variable_index_offset));
@@ -2727,9 +3087,9 @@ eval_instruction(char *p)
           sp->type = T_LVALUE;
           sp->u.lvalue = fp + EXTRACT_UCHAR(pc++);
         }
-        break;
+        DISPATCH;
       }
-      case F_NEXT_FOREACH:
+      CASE(F_NEXT_FOREACH):
         if ((sp - 1)->type == T_LVALUE) {
           /* mapping */
           if ((sp - 2)->subtype--) {
@@ -2748,6 +3108,7 @@ eval_instruction(char *p)
             }
             COPY_SHORT(&offset, pc);
             pc -= offset;
+            EVAL_CHECK();
             break;
           }
         } else {
@@ -2772,17 +3133,18 @@ eval_instruction(char *p)
             }
             COPY_SHORT(&offset, pc);
             pc -= offset;
+            EVAL_CHECK();
             break;
           }
         }
         pc += 2;
         /* fallthrough */
-      case F_EXIT_FOREACH:
+      CASE(F_EXIT_FOREACH):
         IF_DEBUG(stack_in_use_as_temporary--);
         if (sp->type == T_REF) {
-          if (!(--sp->u.ref->ref) && sp->u.ref->lvalue == 0) {
-            FREE(sp->u.ref);
-          }
+          /* takes it off global_ref_list; freed there or by the loop variable */
+          sp->u.ref->ref--;
+          kill_ref(sp->u.ref);
         }
         if ((sp - 1)->type == T_LVALUE) {
           /* mapping */
@@ -2798,9 +3160,9 @@ eval_instruction(char *p)
             free_array((sp--)->u.arr);
           }
         }
-        break;
+        DISPATCH;
 
-      case F_EXPAND_VARARGS: {
+      CASE(F_EXPAND_VARARGS): {
         svalue_t *s, *t;
         array_t *arr;
 
@@ -2844,24 +3206,24 @@ eval_instruction(char *p)
           }
         }
         free_array(arr);
-        break;
+        DISPATCH;
       }
 
-      case F_NEW_CLASS: {
+      CASE(F_NEW_CLASS): {
         array_t *cl;
 
         cl = allocate_class(&current_prog->classes[EXTRACT_UCHAR(pc++)], 1);
         push_refed_class(cl);
       }
-      break;
-      case F_NEW_EMPTY_CLASS: {
+      DISPATCH;
+      CASE(F_NEW_EMPTY_CLASS): {
         array_t *cl;
 
         cl = allocate_class(&current_prog->classes[EXTRACT_UCHAR(pc++)], 0);
         push_refed_class(cl);
       }
-      break;
-      case F_AGGREGATE: {
+      DISPATCH;
+      CASE(F_AGGREGATE): {
         array_t *v;
 
         LOAD_SHORT(offset, pc);
@@ -2876,8 +3238,8 @@ eval_instruction(char *p)
         }
         push_refed_array(v);
       }
-      break;
-      case F_AGGREGATE_ASSOC: {
+      DISPATCH;
+      CASE(F_AGGREGATE_ASSOC): {
         mapping_t *m;
 
         LOAD_SHORT(offset, pc);
@@ -2886,9 +3248,9 @@ eval_instruction(char *p)
         num_varargs = 0;
         m = load_mapping_from_aggregate(sp -= offset, offset);
         push_refed_mapping(m);
-        break;
+        DISPATCH;
       }
-      case F_ASSIGN:
+      CASE(F_ASSIGN):
 #ifdef DEBUG
         if (sp->type != T_LVALUE) { fatal("Bad argument to F_ASSIGN\n"); }
 #endif
@@ -2916,8 +3278,8 @@ eval_instruction(char *p)
         }
         sp--;   /* ignore lvalue */
         /* rvalue is already in the correct place */
-        break;
-      case F_VOID_ASSIGN_LOCAL:
+        DISPATCH;
+      CASE(F_VOID_ASSIGN_LOCAL):
         if (sp->type != T_INVALID) {
           lval = fp + EXTRACT_UCHAR(pc++);
           free_svalue(lval, "F_VOID_ASSIGN_LOCAL");
@@ -2926,8 +3288,8 @@ eval_instruction(char *p)
           sp--;
           pc++;
         }
-        break;
-      case F_VOID_ASSIGN:
+        DISPATCH;
+      CASE(F_VOID_ASSIGN):
 #ifdef DEBUG
         if (sp->type != T_LVALUE) { fatal("Bad argument to F_VOID_ASSIGN\n"); }
 #endif
@@ -2958,13 +3320,13 @@ eval_instruction(char *p)
             }
           }
         } else { sp--; }
-        break;
+        DISPATCH;
 #ifdef DEBUG
-      case F_BREAK_POINT:
+      CASE(F_BREAK_POINT):
         break_point();
-        break;
+        DISPATCH;
 #endif
-      case F_CALL_FUNCTION_BY_ADDRESS: {
+      CASE(F_CALL_FUNCTION_BY_ADDRESS): {
         function_t *funp;
 
         LOAD_SHORT(offset, pc);
@@ -3007,8 +3369,8 @@ eval_instruction(char *p)
 
         pc = current_prog->program + funp->address;
       }
-      break;
-      case F_CALL_INHERITED: {
+      DISPATCH;
+      CASE(F_CALL_INHERITED): {
         inherit_t *ip = current_prog->inherit + EXTRACT_UCHAR(pc++);
         program_t *temp_prog = ip->prog;
         function_t *funp;
@@ -3030,21 +3392,21 @@ eval_instruction(char *p)
         csp->pc = pc;
         pc = current_prog->program + funp->address;
       }
-      break;
-      case F_COMPL:
+      DISPATCH;
+      CASE(F_COMPL):
         if (sp->type != T_NUMBER) {
           error("Bad argument to ~\n");
         }
         sp->u.number = ~sp->u.number;
         sp->subtype = 0;
-        break;
-      case F_CONST0:
+        DISPATCH;
+      CASE(F_CONST0):
         push_number(0);
-        break;
-      case F_CONST1:
+        DISPATCH;
+      CASE(F_CONST1):
         push_number(1);
-        break;
-      case F_PRE_DEC:
+        DISPATCH;
+      CASE(F_PRE_DEC):
         DEBUG_CHECK(sp->type != T_LVALUE,
                     "non-lvalue argument to --\n");
         lval = sp->u.lvalue;
@@ -3070,8 +3432,8 @@ eval_instruction(char *p)
           default:
             error("-- of non-numeric argument\n");
         }
-        break;
-      case F_DEC:
+        DISPATCH;
+      CASE(F_DEC):
         DEBUG_CHECK(sp->type != T_LVALUE,
                     "non-lvalue argument to --\n");
         lval = (sp--)->u.lvalue;
@@ -3092,8 +3454,8 @@ eval_instruction(char *p)
           default:
             error("-- of non-numeric argument\n");
         }
-        break;
-      case F_DIVIDE: {
+        DISPATCH;
+      CASE(F_DIVIDE): {
         switch ((sp - 1)->type | sp->type) {
 
           case T_NUMBER: {
@@ -3130,20 +3492,20 @@ eval_instruction(char *p)
           }
         }
       }
-      break;
-      case F_DIV_EQ:
+      DISPATCH;
+      CASE(F_DIV_EQ):
         f_div_eq();
-        break;
-      case F_EQ:
+        DISPATCH;
+      CASE(F_EQ):
         f_eq();
-        break;
-      case F_GE:
+        DISPATCH;
+      CASE(F_GE):
         f_ge();
-        break;
-      case F_GT:
+        DISPATCH;
+      CASE(F_GT):
         f_gt();
-        break;
-      case F_GLOBAL: {
+        DISPATCH;
+      CASE(F_GLOBAL): {
         svalue_t *s;
 
         s = find_value((int)(READ_GLOBAL_INDEX(pc) + variable_index_offset));
@@ -3156,9 +3518,9 @@ eval_instruction(char *p)
           assign_svalue(s, &const0u);
         }
         push_svalue(s);
-        break;
+        DISPATCH;
       }
-      case F_PRE_INC:
+      CASE(F_PRE_INC):
         DEBUG_CHECK(sp->type != T_LVALUE,
                     "non-lvalue argument to ++\n");
         lval = sp->u.lvalue;
@@ -3184,8 +3546,8 @@ eval_instruction(char *p)
           default:
             error("++ of non-numeric argument\n");
         }
-        break;
-      case F_MEMBER: {
+        DISPATCH;
+      CASE(F_MEMBER): {
         array_t *arr;
 
         if (sp->type != T_CLASS) {
@@ -3201,9 +3563,9 @@ eval_instruction(char *p)
         assign_svalue_no_free(sp, &arr->item[i]);
         free_class(arr);
 
-        break;
+        DISPATCH;
       }
-      case F_MEMBER_LVALUE: {
+      CASE(F_MEMBER_LVALUE): {
         array_t *arr;
 
         if (sp->type != T_CLASS) {
@@ -3219,9 +3581,9 @@ eval_instruction(char *p)
         lv_owner = (refed_t *)arr;
 #endif
         free_class(arr);
-        break;
+        DISPATCH;
       }
-      case F_INDEX:
+      CASE(F_INDEX):
         switch (sp->type) {
           case T_MAPPING: {
             svalue_t *v;
@@ -3289,8 +3651,8 @@ eval_instruction(char *p)
             }
             error("Cannot index value of type '%s'.\n", type_name(sp->type));
         }
-        break;
-      case F_RINDEX:
+        DISPATCH;
+      CASE(F_RINDEX):
         switch (sp->type) {
 #ifndef NO_BUFFER_TYPE
           case T_BUFFER: {
@@ -3346,9 +3708,9 @@ eval_instruction(char *p)
             }
             error("Cannot index value of type '%s'.\n", type_name(sp->type));
         }
-        break;
+        DISPATCH;
 #ifdef F_JUMP_WHEN_ZERO
-      case F_JUMP_WHEN_ZERO:
+      CASE(F_JUMP_WHEN_ZERO):
         if ((i = (sp->type == T_NUMBER)) && sp->u.number == 0) {
           COPY_SHORT(&offset, pc);
           pc = current_prog->program + offset;
@@ -3361,24 +3723,24 @@ eval_instruction(char *p)
         } else {
           pop_stack();
         }
-        break;
+        DISPATCH;
 #endif
 #ifdef F_JUMP
-      case F_JUMP:
+      CASE(F_JUMP):
         COPY_SHORT(&offset, pc);
         pc = current_prog->program + offset;
-        break;
+        DISPATCH;
 #endif
-      case F_LE:
+      CASE(F_LE):
         f_le();
-        break;
-      case F_LSH:
+        DISPATCH;
+      CASE(F_LSH):
         f_lsh();
-        break;
-      case F_LSH_EQ:
+        DISPATCH;
+      CASE(F_LSH_EQ):
         f_lsh_eq();
-        break;
-      case F_MOD: {
+        DISPATCH;
+      CASE(F_MOD): {
         CHECK_TYPES(sp - 1, T_NUMBER, 1, instruction);
         CHECK_TYPES(sp, T_NUMBER, 2, instruction);
         if ((sp--)->u.number == 0) {
@@ -3386,11 +3748,11 @@ eval_instruction(char *p)
         }
         sp->u.number %= (sp + 1)->u.number;
       }
-      break;
-      case F_MOD_EQ:
+      DISPATCH;
+      CASE(F_MOD_EQ):
         f_mod_eq();
-        break;
-      case F_MULTIPLY: {
+        DISPATCH;
+      CASE(F_MULTIPLY): {
         switch ((sp - 1)->type | sp->type) {
           case T_NUMBER: {
             sp--;
@@ -3431,14 +3793,14 @@ eval_instruction(char *p)
           }
         }
       }
-      break;
-      case F_MULT_EQ:
+      DISPATCH;
+      CASE(F_MULT_EQ):
         f_mult_eq();
-        break;
-      case F_NE:
+        DISPATCH;
+      CASE(F_NE):
         f_ne();
-        break;
-      case F_NEGATE:
+        DISPATCH;
+      CASE(F_NEGATE):
         if (sp->type == T_NUMBER) {
           sp->u.number = -sp->u.number;
           sp->subtype = 0;
@@ -3447,8 +3809,8 @@ eval_instruction(char *p)
         } else {
           error("Bad argument to unary minus\n");
         }
-        break;
-      case F_NOT:
+        DISPATCH;
+      CASE(F_NOT):
         if (sp->type == T_NUMBER) {
           sp->u.number = !sp->u.number;
           sp->subtype = 0;
@@ -3456,20 +3818,20 @@ eval_instruction(char *p)
           free_svalue(sp, "f_not");
           *sp = const0;
         }
-        break;
-      case F_OR:
+        DISPATCH;
+      CASE(F_OR):
         f_or();
-        break;
-      case F_OR_EQ:
+        DISPATCH;
+      CASE(F_OR_EQ):
         f_or_eq();
-        break;
-      case F_PARSE_COMMAND:
+        DISPATCH;
+      CASE(F_PARSE_COMMAND):
         f_parse_command();
-        break;
-      case F_POP_VALUE:
+        DISPATCH;
+      CASE(F_POP_VALUE):
         pop_stack();
-        break;
-      case F_POST_DEC:
+        DISPATCH;
+      CASE(F_POST_DEC):
         DEBUG_CHECK(sp->type != T_LVALUE,
                     "non-lvalue argument to --\n");
         lval = sp->u.lvalue;
@@ -3495,8 +3857,8 @@ eval_instruction(char *p)
           default:
             error("-- of non-numeric argument\n");
         }
-        break;
-      case F_POST_INC:
+        DISPATCH;
+      CASE(F_POST_INC):
         DEBUG_CHECK(sp->type != T_LVALUE,
                     "non-lvalue argument to ++\n");
         lval = sp->u.lvalue;
@@ -3522,50 +3884,51 @@ eval_instruction(char *p)
           default:
             error("++ of non-numeric argument\n");
         }
-        break;
-      case F_GLOBAL_LVALUE:
+        DISPATCH;
+      CASE(F_GLOBAL_LVALUE):
+        current_object->reclaim_flags |= O_RECLAIM_DIRTY;
         STACK_INC;
         sp->type = T_LVALUE;
         sp->u.lvalue = find_value((int)(READ_GLOBAL_INDEX(pc) +
                                         variable_index_offset));
-        break;
-      case F_INDEX_LVALUE:
+        DISPATCH;
+      CASE(F_INDEX_LVALUE):
         push_indexed_lvalue(0);
-        break;
-      case F_RINDEX_LVALUE:
+        DISPATCH;
+      CASE(F_RINDEX_LVALUE):
         push_indexed_lvalue(1);
-        break;
-      case F_NN_RANGE_LVALUE:
+        DISPATCH;
+      CASE(F_NN_RANGE_LVALUE):
         push_lvalue_range(0x00);
-        break;
-      case F_RN_RANGE_LVALUE:
+        DISPATCH;
+      CASE(F_RN_RANGE_LVALUE):
         push_lvalue_range(0x10);
-        break;
-      case F_RR_RANGE_LVALUE:
+        DISPATCH;
+      CASE(F_RR_RANGE_LVALUE):
         push_lvalue_range(0x11);
-        break;
-      case F_NR_RANGE_LVALUE:
+        DISPATCH;
+      CASE(F_NR_RANGE_LVALUE):
         push_lvalue_range(0x01);
-        break;
-      case F_NN_RANGE:
+        DISPATCH;
+      CASE(F_NN_RANGE):
         f_range(0x00);
-        break;
-      case F_RN_RANGE:
+        DISPATCH;
+      CASE(F_RN_RANGE):
         f_range(0x10);
-        break;
-      case F_NR_RANGE:
+        DISPATCH;
+      CASE(F_NR_RANGE):
         f_range(0x01);
-        break;
-      case F_RR_RANGE:
+        DISPATCH;
+      CASE(F_RR_RANGE):
         f_range(0x11);
-        break;
-      case F_NE_RANGE:
+        DISPATCH;
+      CASE(F_NE_RANGE):
         f_extract_range(0);
-        break;
-      case F_RE_RANGE:
+        DISPATCH;
+      CASE(F_RE_RANGE):
         f_extract_range(1);
-        break;
-      case F_RETURN_ZERO: {
+        DISPATCH;
+      CASE(F_RETURN_ZERO): {
         if (csp->framekind & FRAME_CATCH) {
           free_svalue(&catch_value, "F_RETURN_ZERO");
           catch_value = const0;
@@ -3603,8 +3966,8 @@ eval_instruction(char *p)
           return;
         }
       }
-      break;
-      case F_RETURN: {
+      DISPATCH;
+      CASE(F_RETURN): {
         svalue_t sv;
 
         if (csp->framekind & FRAME_CATCH) {
@@ -3647,31 +4010,31 @@ eval_instruction(char *p)
         if (csp[1].framekind & (FRAME_EXTERNAL | FRAME_RETURNED_FROM_CATCH)) {
           return;
         }
-        break;
+        DISPATCH;
       }
-      case F_RSH:
+      CASE(F_RSH):
         f_rsh();
-        break;
-      case F_RSH_EQ:
+        DISPATCH;
+      CASE(F_RSH_EQ):
         f_rsh_eq();
-        break;
-      case F_SSCANF:
+        DISPATCH;
+      CASE(F_SSCANF):
         f_sscanf();
-        break;
-      case F_STRING:
+        DISPATCH;
+      CASE(F_STRING):
         LOAD_SHORT(offset, pc);
         DEBUG_CHECK1(offset >= current_prog->num_strings,
                      "string %d out of range in F_STRING!\n",
                      offset);
         push_shared_string(current_prog->strings[offset]);
-        break;
-      case F_SHORT_STRING:
+        DISPATCH;
+      CASE(F_SHORT_STRING):
         DEBUG_CHECK1(EXTRACT_UCHAR(pc) >= current_prog->num_strings,
                      "string %d out of range in F_STRING!\n",
                      EXTRACT_UCHAR(pc));
         push_shared_string(current_prog->strings[EXTRACT_UCHAR(pc++)]);
-        break;
-      case F_SUBTRACT: {
+        DISPATCH;
+      CASE(F_SUBTRACT): {
         i = (sp--)->type;
         switch (i | sp->type) {
           case T_NUMBER:
@@ -3706,12 +4069,12 @@ eval_instruction(char *p)
               error("Bad right type to -.\n");
             } else { error("Arguments to - do not have compatible types.\n"); }
         }
-        break;
+        DISPATCH;
       }
-      case F_SUB_EQ:
+      CASE(F_SUB_EQ):
         f_sub_eq();
-        break;
-      case F_SIMUL_EFUN: {
+        DISPATCH;
+      CASE(F_SIMUL_EFUN): {
         unsigned short sindex;
         int num_args;
 
@@ -3720,17 +4083,17 @@ eval_instruction(char *p)
         num_varargs = 0;
         call_simul_efun(sindex, num_args);
       }
-      break;
-      case F_SWITCH:
+      DISPATCH;
+      CASE(F_SWITCH):
         f_switch();
-        break;
-      case F_XOR:
+        DISPATCH;
+      CASE(F_XOR):
         f_xor();
-        break;
-      case F_XOR_EQ:
+        DISPATCH;
+      CASE(F_XOR_EQ):
         f_xor_eq();
-        break;
-      case F_CATCH: {
+        DISPATCH;
+      CASE(F_CATCH): {
         /*
          * Compute address of next instruction after the CATCH
          * statement.
@@ -3744,9 +4107,9 @@ eval_instruction(char *p)
           return;
         }
 
-        break;
+        DISPATCH;
       }
-      case F_END_CATCH: {
+      CASE(F_END_CATCH): {
         free_svalue(&catch_value, "F_END_CATCH");
         catch_value = const0;
         /* We come here when no longjmp() was executed */
@@ -3754,16 +4117,16 @@ eval_instruction(char *p)
         push_number(0);
         return;   /* return to do_catch */
       }
-      case F_TIME_EXPRESSION: {
+      CASE(F_TIME_EXPRESSION): {
         long sec, usec;
 
         IF_DEBUG(stack_in_use_as_temporary++);
         get_usec_clock(&sec, &usec);
         push_number(sec);
         push_number(usec);
-        break;
+        DISPATCH;
       }
-      case F_END_TIME_EXPRESSION: {
+      CASE(F_END_TIME_EXPRESSION): {
         long sec, usec;
 
         get_usec_clock(&sec, &usec);
@@ -3771,49 +4134,50 @@ eval_instruction(char *p)
         sp -= 2;
         IF_DEBUG(stack_in_use_as_temporary--);
         push_number(usec);
-        break;
+        DISPATCH;
       }
-      case F_TYPE_CHECK: {
+      CASE(F_TYPE_CHECK): {
         int type = sp->u.number;
         pop_stack();
         if (sp->type != type && !(sp->type == T_NUMBER && sp->u.number == 0) &&
             !(sp->type == T_LVALUE)) {
           error("Trying to put %s in %s\n", type_name(sp->type), type_name(type));
         }
-        break;
+        DISPATCH;
       }
 #ifdef DEBUG
 #define CALL_THE_EFUN goto call_the_efun_debug
 #else
-#define CALL_THE_EFUN SAFE((*efun_table[instruction - EFUN_BASE])();)
+#define CALL_THE_EFUN PROFILER_CALL_EFUN(instruction, \
+                          (*efun_table[instruction - EFUN_BASE])())
 #endif
-      case F_EFUN0:
+      CASE(F_EFUN0):
         st_num_arg = 0;
         LOAD_SHORT(instruction, pc);
         CALL_THE_EFUN;
-        break;
-      case F_EFUN1:
+        DISPATCH;
+      CASE(F_EFUN1):
         st_num_arg = 1;
         LOAD_SHORT(instruction, pc);
         CHECK_TYPES(sp, instrs[instruction].type[0], 1, instruction);
         CALL_THE_EFUN;
-        break;
-      case F_EFUN2:
+        DISPATCH;
+      CASE(F_EFUN2):
         st_num_arg = 2;
         LOAD_SHORT(instruction, pc);
         CHECK_TYPES(sp - 1, instrs[instruction].type[0], 1, instruction);
         CHECK_TYPES(sp, instrs[instruction].type[1], 2, instruction);
         CALL_THE_EFUN;
-        break;
-      case F_EFUN3:
+        DISPATCH;
+      CASE(F_EFUN3):
         st_num_arg = 3;
         LOAD_SHORT(instruction, pc);
         CHECK_TYPES(sp - 2, instrs[instruction].type[0], 1, instruction);
         CHECK_TYPES(sp - 1, instrs[instruction].type[1], 2, instruction);
         CHECK_TYPES(sp, instrs[instruction].type[2], 3, instruction);
         CALL_THE_EFUN;
-        break;
-      case F_EFUNV: {
+        DISPATCH;
+      CASE(F_EFUNV): {
         int num;
         LOAD_SHORT(instruction, pc);
         st_num_arg = EXTRACT_UCHAR(pc++) + num_varargs;
@@ -3823,9 +4187,23 @@ eval_instruction(char *p)
           CHECK_TYPES(sp - st_num_arg + i, instrs[instruction].type[i - 1], i, instruction);
         }
         CALL_THE_EFUN;
-        break;
+        DISPATCH;
       }
-      default:
+      CASE(F_CALL_OTHER_SITE): {
+        /* F_EFUNV of call_other, which gets the site's inline cache */
+        unsigned short index;
+        LOAD_SHORT(index, pc);
+        st_num_arg = EXTRACT_UCHAR(pc++) + num_varargs;
+        num_varargs = 0;
+        instruction = F__CALL_OTHER;
+        for (i = 1; i <= instrs[instruction].min_arg; i++) {
+          CHECK_TYPES(sp - st_num_arg + i, instrs[instruction].type[i - 1], i, instruction);
+        }
+        call_other_site = get_call_site(current_prog, index);
+        CALL_THE_EFUN;
+        DISPATCH;
+      }
+      DEFAULT_CASE:
         /* un-recognized instruction */
         if (instruction < EFUN_BASE) {
           fatal("No case for eoperator %s (%d)\n",
@@ -3834,7 +4212,7 @@ eval_instruction(char *p)
           fatal("Undefined instruction %s (%d)\n",
                 query_instr_name(instruction), instruction);
         }
-        break;
+        DISPATCH;
 #ifdef DEBUG
 call_the_efun_debug:
         /* We have an efun.  Execute it.*/
@@ -3848,7 +4226,7 @@ call_the_efun_debug:
         }
         num_arg = st_num_arg;
 
-        (*efun_table[instruction - EFUN_BASE])();
+        PROFILER_CALL_EFUN(instruction, (*efun_table[instruction - EFUN_BASE])());
 
         if (expected_stack != sp)
           fatal("Bad stack after efun. Instruction %d, num arg %d\n",
@@ -3906,100 +4284,19 @@ do_catch(char *pc, unsigned short new_pc_offset)
   pop_context(&econ);
 }
 
-static program_t *ffbn_recurse(program_t *prog, char *name,
-                               int *indexp, int *runtime_index)
-{
-  register int high = prog->num_functions_defined - 1;
-  register int low = 0, mid;
-  int ri;
-  char *p;
-
-  /* Search our function table */
-  while (high >= low) {
-    mid = (high + low) >> 1;
-    p = prog->function_table[mid].funcname;
-    if (name < p) { high = mid - 1; }
-    else if (name > p) { low = mid + 1; }
-    else {
-      ri = mid + prog->last_inherited;
-
-      if (prog->function_flags[ri] &
-          (FUNC_UNDEFINED | FUNC_PROTOTYPE)) {
-        return 0;
-      }
-
-      *indexp = mid;
-      *runtime_index = ri;
-      return prog;
-    }
-  }
-
-  /* Search inherited function tables */
-  mid = prog->num_inherited;
-  while (mid--) {
-    program_t *ret = ffbn_recurse(prog->inherit[mid].prog, name, indexp,
-                                  runtime_index);
-    if (ret) {
-      *runtime_index += prog->inherit[mid].function_index_offset;
-      return ret;
-    }
-  }
-  return 0;
-}
-
-static program_t *ffbn_recurse2(program_t *prog, const char *name,
-                                int *indexp, int *runtime_index,
-                                int *fio, int *vio)
-{
-  register int high = prog->num_functions_defined - 1;
-  register int low = 0, mid;
-  int ri;
-  char *p;
-
-  /* Search our function table */
-  while (high >= low) {
-    mid = (high + low) >> 1;
-    p = prog->function_table[mid].funcname;
-    if (name < p) { high = mid - 1; }
-    else if (name > p) { low = mid + 1; }
-    else {
-      ri = mid + prog->last_inherited;
-
-      if (prog->function_flags[ri] &
-          (FUNC_UNDEFINED | FUNC_PROTOTYPE)) {
-        return 0;
-      }
-
-      *indexp = mid;
-      *runtime_index = ri;
-      *fio = *vio = 0;
-      return prog;
-    }
-  }
-
-  /* Search inherited function tables */
-  mid = prog->num_inherited;
-  while (mid--) {
-    program_t *ret = ffbn_recurse2(prog->inherit[mid].prog, name, indexp,
-                                   runtime_index, fio, vio);
-    if (ret) {
-      *runtime_index += prog->inherit[mid].function_index_offset;
-      *fio += prog->inherit[mid].function_index_offset;
-      *vio += prog->inherit[mid].variable_index_offset;
-      return ret;
-    }
-  }
-  return 0;
-}
-
 program_t *
 find_function_by_name(object_t *ob, const char *name,
                       int *indexp, int *runtime_index)
 {
+  const function_lookup_t *found;
   char *funname = findstring(name);
 
-  if (!funname) { return 0; }
-  return ffbn_recurse(ob->prog, funname, indexp, runtime_index);
+  if (!funname || !(found = lookup_function(ob->prog, funname))) {
+    return 0;
+  }
+  *indexp = found->index;
+  *runtime_index = found->runtime_index;
+  return found->prog;
 }
 
 static program_t *
@@ -4007,8 +4304,17 @@ find_function_by_name2(object_t *ob, const char **name,
                        int *indexp, int *runtime_index,
                        int *fio, int *vio)
 {
-  if (!(*name = findstring(*name))) { return 0; }
-  return ffbn_recurse2(ob->prog, *name, indexp, runtime_index, fio, vio);
+  const function_lookup_t *found;
+
+  if (!(*name = findstring(*name)) ||
+      !(found = lookup_function(ob->prog, *name))) {
+    return 0;
+  }
+  *indexp = found->index;
+  *runtime_index = found->runtime_index;
+  *fio = found->fio;
+  *vio = found->vio;
+  return found->prog;
 }
 
 
@@ -4053,29 +4359,100 @@ unsigned int apply_low_slots_used = 0;
 unsigned int apply_low_collisions = 0;
 #endif
 
-typedef struct cache_entry_s {
-  program_t *oprogp;
-  program_t *progp;
-  function_t *funp;
-  unsigned short function_index_offset;
-  unsigned short variable_index_offset;
-} cache_entry_t;
+/*
+ * The apply_low() cache is set associative, a miss replaces the least
+ * recently used entry of the set.  Its size comes from the config file.
+ */
+#define APPLY_CACHE_WAYS 4
+/* largest "apply cache size" taken from the config file, 192MB */
+#define APPLY_CACHE_MAX_SIZE (1 << 22)
 
-static cache_entry_t cache[APPLY_CACHE_SIZE] = { {0} }; // default initialized to 0
+typedef struct {
+  cache_entry_t entry;
+  const char *name;           /* referenced shared string */
+  unsigned int last_used;
+} apply_cache_entry_t;
 
-#ifdef DEBUGMALLOC_EXTENSIONS
-void mark_apply_low_cache()
+typedef struct {
+  apply_cache_entry_t ways[APPLY_CACHE_WAYS];
+#ifdef CACHE_STATS
+  unsigned int evictions;
+#endif
+} apply_cache_set_t;
+
+static apply_cache_set_t *apply_cache;
+static unsigned int apply_cache_mask;
+static unsigned int apply_cache_clock;
+
+void init_apply_cache()
 {
-  int i;
-  for (i = 0; i < APPLY_CACHE_SIZE; i++) {
-    if (cache[i].funp && !cache[i].progp) {
-      EXTRA_REF(BLOCK((char *)cache[i].funp))++;
+  unsigned int sets = 1;
+
+  if (APPLY_CACHE_SIZE < APPLY_CACHE_WAYS) {
+    APPLY_CACHE_SIZE = APPLY_CACHE_WAYS;
+  } else if (APPLY_CACHE_SIZE > APPLY_CACHE_MAX_SIZE) {
+    fprintf(stderr, "apply cache size %d is too large, using %d.\n",
+            (int) APPLY_CACHE_SIZE, APPLY_CACHE_MAX_SIZE);
+    APPLY_CACHE_SIZE = APPLY_CACHE_MAX_SIZE;
+  }
+  while (sets * APPLY_CACHE_WAYS < (unsigned int) APPLY_CACHE_SIZE) {
+    sets <<= 1;
+  }
+  APPLY_CACHE_SIZE = sets * APPLY_CACHE_WAYS;
+  apply_cache = CALLOCATE(sets, apply_cache_set_t, TAG_APPLY_CACHE,
+                          "init_apply_cache");
+  apply_cache_mask = sets - 1;
+}
+
+static inline unsigned int apply_cache_hash(const char *fun, program_t *prog)
+{
+  uint64_t h = (uint64_t)(POINTER_INT) fun * 0x9e3779b97f4a7c15ULL;
+
+  h = (h ^ (uint64_t)(POINTER_INT) prog) * 0xff51afd7ed558ccdULL;
+  return (unsigned int)(h >> 32);
+}
+
+#ifdef CACHE_STATS
+/* entries in use, and the sets with evictions and the most evictions */
+void apply_cache_occupancy(unsigned int *used, unsigned int *sets_evicted,
+                           unsigned int *max_evictions)
+{
+  unsigned int i;
+  int way;
+
+  *used = *sets_evicted = *max_evictions = 0;
+  for (i = 0; i <= apply_cache_mask; i++) {
+    for (way = 0; way < APPLY_CACHE_WAYS; way++) {
+      if (apply_cache[i].ways[way].entry.oprogp) {
+        (*used)++;
+      }
     }
-    if (cache[i].oprogp) {
-      cache[i].oprogp->extra_ref++;
+    if (apply_cache[i].evictions) {
+      (*sets_evicted)++;
+      *max_evictions = std::max(*max_evictions, apply_cache[i].evictions);
     }
-    if (cache[i].progp) {
-      cache[i].progp->extra_ref++;
+  }
+}
+#endif
+
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_apply_low_cache()
+{
+  unsigned int i;
+  int way;
+
+  DO_MARK(apply_cache, TAG_APPLY_CACHE);
+  for (i = 0; i <= apply_cache_mask; i++) {
+    for (way = 0; way < APPLY_CACHE_WAYS; way++) {
+      apply_cache_entry_t *ae = &apply_cache[i].ways[way];
+
+      if (ae->entry.oprogp) {
+        ae->entry.oprogp->extra_ref++;
+        EXTRA_REF(BLOCK(ae->name))++;
+      }
+      if (ae->entry.progp) {
+        ae->entry.progp->extra_ref++;
+      }
     }
   }
 }
@@ -4158,9 +4535,74 @@ void check_co_args(int num_arg, const program_t *prog, function_t *fun, int find
 }
 
 
+#ifdef CACHE_STATS
+unsigned int call_site_hits = 0;
+unsigned int call_site_misses = 0;
+#endif
+
+/* set by F_CALL_OTHER_SITE for f__call_other() */
+call_site_t *call_other_site = 0;
+
+/* Save a resolved call in a call site, replacing the entries in turn. */
+static void fill_call_site(call_site_t *site, const char *fun,
+                           cache_entry_t *entry)
+{
+  call_site_entry_t *e = 0;
+  int i;
+
+  for (i = 0; i < CALL_SITE_WAYS; i++) {
+    if (!site->entries[i].name) {
+      e = &site->entries[i];
+      break;
+    }
+  }
+  if (!e) {
+    e = &site->entries[site->next];
+    site->next = (site->next + 1) % CALL_SITE_WAYS;
+    free_string(e->name);
+  }
+  e->entry = *entry;
+  e->oprog_id = entry->oprogp->id;
+  e->name = ref_string(fun);
+}
+
+call_site_t *get_call_site(program_t *prog, int index)
+{
+  if (!prog->call_sites) {
+    prog->call_sites = CALLOCATE(prog->num_call_sites, call_site_t,
+                                 TAG_CALL_SITES, "get_call_site");
+  }
+  return &prog->call_sites[index];
+}
+
+void free_call_sites(call_site_t *sites, int num)
+{
+  int i, j;
+
+  for (i = 0; i < num; i++)
+    for (j = 0; j < CALL_SITE_WAYS; j++)
+      if (sites[i].entries[j].name) {
+        free_string(sites[i].entries[j].name);
+      }
+  FREE(sites);
+}
+
 int apply_low(const char *fun, object_t *ob, int num_arg)
+{
+  return apply_call_site(fun, ob, num_arg, 0);
+}
+
+/*
+ * apply_low() which first looks in the inline cache 'site', if any.  The
+ * site is keyed on the pointer 'fun', which should be a shared string.
+ */
+int apply_call_site(const char *fun, object_t *ob, int num_arg,
+                    call_site_t *site)
 {
   cache_entry_t *entry; /* The cache entry */
+  apply_cache_set_t *set;
+  apply_cache_entry_t *ae;
+  int way;
   program_t *target_prog; /* The target prog to call */
   int local_call_origin = call_origin;
   IF_DEBUG(control_stack_t * save_csp);
@@ -4181,8 +4623,14 @@ int apply_low(const char *fun, object_t *ob, int num_arg)
     pop_n_elems(num_arg);
     return 0;
   }
-  ob->flags &= ~O_RESET_STATE;
+  if (ob->flags & O_RESET_STATE) {
+    ob->flags &= ~O_RESET_STATE;
+    touch_object_reset(ob);
+  }
 #ifndef NO_SHADOWS
+  if (ob->shadowed || ob->shadowing) {
+    site = 0;
+  }
   /*
    * If there is a chain of objects shadowing, start with the first of
    * these.
@@ -4194,46 +4642,82 @@ int apply_low(const char *fun, object_t *ob, int num_arg)
 retry_for_shadow:
 #endif
   DEBUG_CHECK(ob->flags & O_DESTRUCTED, "apply() on destructed object\n");
+  if (site) {
+    call_site_entry_t *e = site->entries;
+    int i;
+
+    for (i = 0; i < CALL_SITE_WAYS; i++, e++) {
+      if (e->name == fun && e->entry.oprogp == ob->prog &&
+          e->oprog_id == ob->prog->id) {
+        break;
+      }
+    }
+    if (i < CALL_SITE_WAYS) {
+      site->hits++;
+#ifdef CACHE_STATS
+      call_site_hits++;
+#endif
+      entry = &e->entry;
+      target_prog = entry->progp;
+      goto found;
+    }
+    site->misses++;
+#ifdef CACHE_STATS
+    call_site_misses++;
+#endif
+    if (!site->offset) {
+      site->offset = pc - current_prog->program;
+    }
+  }
 #ifdef CACHE_STATS
   apply_low_call_others++;
 #endif
   /* Search in cache for this function. */
-  uint64_t ix; /* The cache index */
-  std::hash<void *> hash_fn;
-  ix = hash_fn((void *)fun);
-  ix ^= hash_fn((void *)ob->prog);
-  entry = &cache[ix % APPLY_CACHE_SIZE];
-  if (entry->oprogp == ob->prog && /* object must match */
-      (entry->progp ? (strcmp(entry->funp->funcname, fun) == 0) : /* function name must match */
-       strcmp((char *)entry->funp, fun) == 0)) {
+  set = &apply_cache[apply_cache_hash(fun, ob->prog) & apply_cache_mask];
+  for (way = 0; way < APPLY_CACHE_WAYS; way++) {
+    ae = &set->ways[way];
+    if (ae->entry.oprogp == ob->prog && /* object must match */
+        (ae->name == fun || strcmp(ae->name, fun) == 0)) { /* and name */
+      break;
+    }
+  }
+  if (way < APPLY_CACHE_WAYS) {
 #ifdef CACHE_STATS
     apply_low_cache_hits++;
 #endif
+    ae->last_used = ++apply_cache_clock;
+    entry = &ae->entry;
     target_prog = entry->progp;
   } else { /* not found in cache, search the function. */
     int findex = 0, runtime_index = 0, fio = 0, vio = 0;
     const char *sfun;
 
-    /* 1) Erase the current entry */
+    /* 1) Erase the least recently used entry of the set */
+    ae = &set->ways[0];
+    for (way = 1; way < APPLY_CACHE_WAYS && ae->entry.oprogp; way++) {
+      if (set->ways[way].last_used < ae->last_used ||
+          !set->ways[way].entry.oprogp) {
+        ae = &set->ways[way];
+      }
+    }
+    entry = &ae->entry;
 #ifdef CACHE_STATS
-    if (!entry->funp) {
+    if (!entry->oprogp) {
       apply_low_slots_used++;
     } else {
       apply_low_collisions++;
+      set->evictions++;
     }
 #endif
     if (entry->oprogp) {
       free_prog(&entry->oprogp);
       entry->oprogp = 0;
+      free_string(ae->name);
+      ae->name = 0;
     }
     if (entry->progp) {
       free_prog(&entry->progp);
       entry->progp = 0;
-    } else {
-      if (entry->funp) {
-        free_string((char *)entry->funp);
-        entry->funp = 0;
-      }
     }
     /* 2) Search for the function */
     sfun = fun;
@@ -4241,6 +4725,8 @@ retry_for_shadow:
     /* 3) Save result into cache */
     entry->oprogp = ob->prog;
     reference_prog(entry->oprogp, "apply_low() cache oprogp [miss]");
+    ae->name = sfun ? ref_string(sfun) : make_shared_string(fun);
+    ae->last_used = ++apply_cache_clock;
 
     entry->progp = target_prog;
     entry->function_index_offset = fio;
@@ -4250,14 +4736,13 @@ retry_for_shadow:
       reference_prog(entry->progp, "apply_low() cache progp [miss]");
       entry->funp = &target_prog->function_table[findex];
     } else {
-      if (sfun) {
-        ref_string(sfun);
-        entry->funp = (function_t *)sfun;
-      } else {
-        entry->funp = (function_t *)make_shared_string(fun);
-      }
+      entry->funp = 0;
     }
   } /* search in cache */
+  if (site) {
+    fill_call_site(site, fun, entry);
+  }
+found:
 #ifndef NO_SHADOWS
   if (!target_prog && ob->shadowing) {
     /*
@@ -4309,6 +4794,7 @@ retry_for_shadow:
     function_index_offset = entry->function_index_offset;
     variable_index_offset = entry->variable_index_offset;
     csp->fr.table_index = findex;
+    EVAL_CHECK();
 #ifdef PROFILE_FUNCTIONS
     get_cpu_times(&(csp->entry_secs), &(csp->entry_usecs));
     current_prog->function_table[findex].calls++;
@@ -4400,7 +4886,10 @@ void call___INIT(object_t *ob)
 
   /* No try_reset here for obvious reasons :) */
 
-  ob->flags &= ~O_RESET_STATE;
+  if (ob->flags & O_RESET_STATE) {
+    ob->flags &= ~O_RESET_STATE;
+    touch_object_reset(ob);
+  }
 
   progp = ob->prog;
   num_functions = progp->num_functions_defined;
@@ -5596,10 +6085,11 @@ int sort_elem_cmp(const sort_elem_t *se1, const sort_elem_t *se2)
   return COMPARE_NUMS(se2->num_calls, se1->num_calls);
 }
 
-void opcdump(char *tfn)
+void opcdump(const char *tfn)
 {
   int ind, i, j, len;
-  char tbuf[SMALL_STRING_SIZE], *fn;
+  char tbuf[SMALL_STRING_SIZE];
+  const char *fn;
   FILE *fp;
   sort_elem_t ops[(EFUN_BASE + 1) * (EFUN_BASE + 1)];
 
@@ -5627,12 +6117,14 @@ void opcdump(char *tfn)
       ops[ind].op2 = j;
     }
   }
-  qsort((char *) ops, (EFUN_BASE + 1) * (BASE + 1), sizeof(sort_elem_t),
-        sort_elem_cmp);
+  qsort((char *) ops, (EFUN_BASE + 1) * (EFUN_BASE + 1), sizeof(sort_elem_t),
+        (int (*)(const void *, const void *)) sort_elem_cmp);
   for (i = 0; i < (EFUN_BASE + 1) * (EFUN_BASE + 1); i++) {
     if (ops[i].num_calls)
-      fprintf(fp, "%-30s %-30s: %10d\n", query_instr_name(ops[i].op1),
-              query_instr_name(ops[i].op2), ops[i].num_calls);
+      fprintf(fp, "%-30s %-30s: %10d\n",
+              ops[i].op1 == EFUN_BASE ? "efun" : query_instr_name(ops[i].op1),
+              ops[i].op2 == EFUN_BASE ? "efun" : query_instr_name(ops[i].op2),
+              ops[i].num_calls);
   }
   fclose(fp);
 }
@@ -5772,6 +6264,9 @@ int save_context(error_context_t *econ)
   econ->save_csp = csp;
   econ->save_cgsp = cgsp;
   econ->save_context = current_error_context;
+#ifdef SAMPLING_PROFILER
+  econ->save_efun = (csp >= control_stack ? csp->efun : 0);
+#endif
 
   current_error_context = econ;
   return 1;
@@ -5800,6 +6295,11 @@ void restore_context(error_context_t *econ)
     restore_command_giver();
   }
   DEBUG_CHECK(csp < econ->save_csp, "csp is below econ->csp before unwinding.\n");
+#ifdef SAMPLING_PROFILER
+  if (csp >= control_stack) {
+    csp->efun = econ->save_efun;
+  }
+#endif
 
 
   pop_n_elems(sp - econ->save_sp);
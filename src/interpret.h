@@ -84,6 +84,9 @@ typedef struct control_stack_s {
   int variable_index_offset;  /* Same */
   short caller_type;          /* was this a locally called function? */
   short framekind;
+#ifdef SAMPLING_PROFILER
+  unsigned short efun;        /* efun running in this frame, or 0 */
+#endif
 } control_stack_t;
 
 typedef struct {
@@ -102,6 +105,9 @@ typedef struct error_context_s {
   svalue_t *save_sp;
   object_t **save_cgsp;
   struct error_context_s *save_context;
+#ifdef SAMPLING_PROFILER
+  unsigned short save_efun;
+#endif
 } error_context_t;
 
 typedef struct {
@@ -117,8 +123,8 @@ typedef struct {
   if (!((val)->type & (t))) bad_argument(val, t, arg, inst);
 
 /* Beek - add some sanity to joining strings */
-/* add to an svalue */
-#define EXTEND_SVALUE_STRING(x, y, z) \
+/* add to an svalue, resizing it with extend_string() or grow_string() */
+#define EXTEND_SVALUE_STRING_BY(x, y, z, grow) \
     SAFE( char *ess_res; \
         int ess_len; \
         int ess_r; \
@@ -126,7 +132,7 @@ typedef struct {
         if (ess_len > MAX_STRING_LENGTH) \
             error("Maximum string length exceeded in concatenation.\n"); \
         if ((x)->subtype == STRING_MALLOC && MSTR_REF((x)->u.string) == 1) { \
-            ess_res = (char *) extend_string((x)->u.string, ess_len); \
+            ess_res = (char *) grow((x)->u.string, ess_len); \
             if (!ess_res) fatal("Out of memory!\n"); \
             strcpy(ess_res + ess_r, (y)); \
         } else { \
@@ -138,6 +144,9 @@ typedef struct {
         } \
         (x)->u.string = ess_res; \
     )
+#define EXTEND_SVALUE_STRING(x, y, z) EXTEND_SVALUE_STRING_BY(x, y, z, extend_string)
+/* the same for +=, which is likely to append again */
+#define APPEND_SVALUE_STRING(x, y, z) EXTEND_SVALUE_STRING_BY(x, y, z, grow_string)
 
 /* <something that needs no free> + string svalue */
 #define SVALUE_STRING_ADD_LEFT(y, z) \
@@ -155,14 +164,14 @@ typedef struct {
      )
 
 /* basically, string + string; faster than using extend b/c of SVALUE_STRLEN */
-#define SVALUE_STRING_JOIN(x, y, z) \
+#define SVALUE_STRING_JOIN_BY(x, y, z, grow) \
     SAFE( char *ssj_res; int ssj_r; int ssj_len; \
         ssj_r = SVALUE_STRLEN(x); \
         ssj_len = ssj_r + SVALUE_STRLEN(y); \
         if (ssj_len > MAX_STRING_LENGTH) \
             error("Maximum string length exceeded in concatenation.\n"); \
         if ((x)->subtype == STRING_MALLOC && MSTR_REF((x)->u.string) == 1) { \
-            ssj_res = (char *) extend_string((x)->u.string, ssj_len); \
+            ssj_res = (char *) grow((x)->u.string, ssj_len); \
             if (!ssj_res) fatal("Out of memory!\n"); \
             (void) strcpy(ssj_res + ssj_r, (y)->u.string);  \
             free_string_svalue(y); \
@@ -176,6 +185,8 @@ typedef struct {
         } \
         (x)->u.string = ssj_res; \
     )
+#define SVALUE_STRING_JOIN(x, y, z) SVALUE_STRING_JOIN_BY(x, y, z, extend_string)
+#define SVALUE_STRING_APPEND(x, y, z) SVALUE_STRING_JOIN_BY(x, y, z, grow_string)
 
 /* macro calls */
 #define call_program(prog, offset) \
@@ -263,6 +274,9 @@ extern unsigned int apply_low_call_others;
 extern unsigned int apply_low_cache_hits;
 extern unsigned int apply_low_slots_used;
 extern unsigned int apply_low_collisions;
+extern unsigned int call_site_hits;
+extern unsigned int call_site_misses;
+extern call_site_t *call_other_site;
 extern int simul_efun_is_loading;
 extern program_t fake_prog;
 extern svalue_t global_lvalue_byte;
@@ -335,6 +349,9 @@ void bad_argument(svalue_t *, int, int, int);
 void check_for_destr(array_t *);
 int is_static(const char *, object_t *);
 int apply_low(const char *, object_t *, int);
+int apply_call_site(const char *, object_t *, int, call_site_t *);
+call_site_t *get_call_site(program_t *, int);
+void free_call_sites(call_site_t *, int);
 svalue_t *apply(const char *, object_t *, int, int);
 svalue_t *call_function_pointer(funptr_t *, int);
 svalue_t *safe_call_function_pointer(funptr_t *, int);
@@ -344,6 +361,8 @@ array_t *call_all_other(array_t *, const char *, int);
 const char *function_exists(const char *, object_t *, int);
 void call_function(program_t *, int);
 void mark_apply_low_cache(void);
+void init_apply_cache(void);
+void apply_cache_occupancy(unsigned int *, unsigned int *, unsigned int *);
 void translate_absolute_line(int, unsigned short *, int *, int *);
 char *add_slash(const char *const);
 int strpref(const char *, const char *);
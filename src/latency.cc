@@ -0,0 +1,149 @@
+/*
+ * latency.c
+ * Cheap always-on latency histograms for the backend, see latency.h for
+ * the bucket layout.  Recording is a couple of compares and an
+ * increment, so they stay enabled in production.
+ */
+
+#include "std.h"
+#include "lpc_incl.h"
+#include "comm.h"
+#include "latency.h"
+
+latency_histogram_t latency_event_loop;
+latency_histogram_t latency_tick_lag;
+latency_histogram_t latency_tick_callback;
+latency_histogram_t latency_command_output;
+
+static int latency_bucket(uint64_t usecs)
+{
+  int shift;
+
+  if (usecs < LATENCY_SUB_BUCKETS) {
+    return usecs;
+  }
+  shift = 63 - __builtin_clzll(usecs) - LATENCY_SUB_BITS;
+  return (shift + 1) * LATENCY_SUB_BUCKETS +
+         (usecs >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+/* the largest value which falls in bucket 'idx' */
+static uint64_t latency_bucket_top(int idx)
+{
+  int shift;
+
+  if (idx < LATENCY_SUB_BUCKETS) {
+    return idx;
+  }
+  shift = idx / LATENCY_SUB_BUCKETS - 1;
+  return ((uint64_t)(idx % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS + 1)
+          << shift) - 1;
+}
+
+void latency_record(latency_histogram_t *h, int64_t usecs)
+{
+  if (usecs < 0) {
+    usecs = 0;
+  } else if (usecs >= ((int64_t) 1 << LATENCY_MAX_BITS)) {
+    usecs = ((int64_t) 1 << LATENCY_MAX_BITS) - 1;
+  }
+  if (!h->count++ || (uint64_t) usecs < h->min) {
+    h->min = usecs;
+  }
+  if ((uint64_t) usecs > h->max) {
+    h->max = usecs;
+  }
+  h->sum += usecs;
+  h->buckets[latency_bucket(usecs)]++;
+}
+
+void latency_clear(latency_histogram_t *h)
+{
+  memset(h, 0, sizeof(latency_histogram_t));
+}
+
+/*
+ * The smallest recorded value v such that a fraction 'q' of all
+ * samples is <= v, rounded up to its bucket.
+ */
+uint64_t latency_percentile(latency_histogram_t *h, double q)
+{
+  uint64_t want, seen = 0;
+  int i;
+
+  if (!h->count) {
+    return 0;
+  }
+  want = (uint64_t)(q * h->count + 0.5);
+  if (want < 1) {
+    want = 1;
+  }
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= want) {
+      return std::min(latency_bucket_top(i), h->max);
+    }
+  }
+  return h->max;
+}
+
+#ifdef F_DRIVER_LATENCY_STATS
+/* with 'reset', the histogram starts over once it has been read */
+static mapping_t *latency_mapping(latency_histogram_t *h, int reset)
+{
+  mapping_t *m = allocate_mapping(8);
+
+  add_mapping_pair(m, "count", h->count);
+  add_mapping_pair(m, "min", h->min);
+  add_mapping_pair(m, "max", h->max);
+  add_mapping_pair(m, "mean", h->count ? h->sum / h->count : 0);
+  add_mapping_pair(m, "p50", latency_percentile(h, 0.5));
+  add_mapping_pair(m, "p90", latency_percentile(h, 0.9));
+  add_mapping_pair(m, "p99", latency_percentile(h, 0.99));
+  add_mapping_pair(m, "p99.9", latency_percentile(h, 0.999));
+  if (reset) {
+    latency_clear(h);
+  }
+  return m;
+}
+
+static void add_latency_mapping(mapping_t *m, const char *key,
+                                latency_histogram_t *h, int reset)
+{
+  mapping_t *value = latency_mapping(h, reset);
+
+  add_mapping_mapping(m, key, value);
+  free_mapping(value);
+}
+
+void f_driver_latency_stats(void)
+{
+  mapping_t *m;
+  int reset = 0;
+
+  if (st_num_arg == 2) {
+    reset = (sp--)->u.number;
+  }
+  if (st_num_arg && sp->type == T_OBJECT) {
+    interactive_t *ip = sp->u.ob->interactive;
+
+    m = ip ? latency_mapping(&ip->command_latency, reset) : 0;
+    pop_stack();
+    if (m) {
+      push_refed_mapping(m);
+    } else {
+      push_number(0);
+    }
+    return;
+  }
+  if (st_num_arg) {
+    sp--;       /* 0 for the driver's own histograms */
+  }
+  m = allocate_mapping(4);
+  add_latency_mapping(m, "event_loop", &latency_event_loop, reset);
+  add_latency_mapping(m, "tick_lag", &latency_tick_lag, reset);
+  add_latency_mapping(m, "tick_callback", &latency_tick_callback, reset);
+  add_latency_mapping(m, "command_output", &latency_command_output, reset);
+  push_refed_mapping(m);
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+/*
+ * latency.c
+ *
+ * Log-linear latency histograms in microseconds: values below 8 get a
+ * bucket each, above that every power of two is split in 8 buckets, so
+ * a reported value is never more than 12.5% off.  Values are clamped to
+ * 2^35 usecs (about 9.5 hours).
+ */
+#define LATENCY_SUB_BITS    3
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS    35
+#define LATENCY_BUCKETS     ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 2) * LATENCY_SUB_BUCKETS)
+
+typedef struct latency_histogram_s {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+/* the histograms kept by the backend */
+extern latency_histogram_t latency_event_loop;
+extern latency_histogram_t latency_tick_lag;
+extern latency_histogram_t latency_tick_callback;
+extern latency_histogram_t latency_command_output;
+
+void latency_record(latency_histogram_t *, int64_t);
+void latency_clear(latency_histogram_t *);
+uint64_t latency_percentile(latency_histogram_t *, double);
+
+#endif
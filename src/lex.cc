@@ -30,6 +30,7 @@
 #include "main.h"
 #include "cc.h"
 #include "master.h"
+#include "port.h"
 
 #define NELEM(a) (sizeof (a) / sizeof((a)[0]))
 #define LEX_EOF ((unsigned char) EOF)
@@ -62,6 +63,7 @@ int current_file_id;
 int pragmas;
 
 int num_parse_error;            /* Number of errors in the parser. */
+int num_parse_warning;          /* and of warnings logged */
 
 lpc_predef_t *lpc_predefs = NULL;
 
@@ -82,7 +84,8 @@ char *outp;
 
 typedef struct incstate_s {
   struct incstate_s *next;
-  int yyin_desc;
+  struct inc_file_s *inc;
+  int inc_pos;
   int line;
   char *file;
   int file_id;
@@ -96,6 +99,12 @@ static incstate_t *inctop = 0;
 #define MAX_INCLUDE_DEPTH 32
 static int incnum;
 
+/* the include file being read, 0 for the file being compiled */
+static struct inc_file_s *inc_cur;
+static int inc_pos;
+/* number of valid recordings in progress, see inc_note_lookup() */
+static int inc_recording;
+
 /* If more than this is needed, the code needs help :-) */
 #define MAX_FUNCTION_DEPTH 10
 
@@ -230,7 +239,11 @@ static void merge(char *name, char *dest);
 static void add_quoted_predefine(const char *, const char *);
 static void lexerror(const char *);
 static int skip_to(const char *, const char *);
-static int inc_open(char *, char *, int);
+static struct inc_file_s *inc_open(char *, char *, int);
+static int inc_read(char *, int);
+static void inc_note_lookup(const char *, defn_t *);
+static void inc_note_define(defn_t *);
+static void inc_invalidate(ifstate_t *, int);
 static void include_error(const char *, int);
 static void handle_include(char *, int);
 static int get_terminator(char *);
@@ -395,17 +408,273 @@ skip_to(const char *token, const char *atoken)
   }
 }
 
-static int
+/*
+ * The include cache.
+ *
+ * The text of #include files is kept between compiles, keyed by the file
+ * it was read from, and used again as long as that file's stat() hasn't
+ * changed.  A file changed less than a second before it was read might
+ * change again without its stat() changing, so it's read (and compared)
+ * again until it is older than that.
+ *
+ * While a file is included, what it does to the define table is recorded:
+ * the names it looked up and what they were (unless it set them itself),
+ * what it defined and undefined, the pragmas it set and the files it
+ * included in turn.  If that's all it did, without producing any tokens,
+ * errors or warnings, the recording is kept with the file, and a later
+ * #include of it in a define table that agrees on every name it looked up
+ * only repeats the changes instead of lexing the file again.
+ */
+#define INC_HASH_SIZE 256       /* must be a power of 2 */
+#define INC_RECORDINGS 4        /* kept per file, for different contexts */
+
+#define INC_LOOKUP  0
+#define INC_DEFINE  1
+#define INC_UNDEF   2
+#define INC_PRAGMA  3
+#define INC_INCLUDE 4
+
+typedef struct inc_op_s {
+  char kind;
+  /* INC_LOOKUP: its DEF_IS_PREDEF flag, or -1 if it wasn't defined;
+     INC_INCLUDE: 1 for "" includes */
+  signed char flags;
+  int nargs;
+  /* offsets in the recording's strings */
+  int name;                     /* INC_PRAGMA: the pragma */
+  int exps;                     /* INC_INCLUDE: file it was included from */
+  int path;                     /* INC_INCLUDE: file that was found */
+  unsigned int version;         /* INC_INCLUDE: of that file */
+} inc_op_t;
+
+typedef struct inc_record_s {
+  struct inc_record_s *next;
+  inc_op_t *ops;
+  int num_ops, max_ops;
+  char *strs;
+  int strs_size, strs_max;
+  int warnings;                 /* pragmas & PRAGMA_WARNINGS at the start */
+  int depth;                    /* of the deepest nested #include */
+  int64_t usecs;                /* lexing the file took */
+  /* only used while recording */
+  int serial;
+  int base;                     /* incnum at the start */
+  int errors;                   /* errors and warnings at the start */
+  ifstate_t *iftop;
+  int64_t start;
+} inc_record_t;
+
+typedef struct inc_file_s {
+  struct inc_file_s *next;
+  char *name;                   /* as in current_file */
+  char *path;                   /* the file it was read from */
+  char *text;
+  int size;
+  time_t mtime, ctime;
+  ino_t ino;
+  int racy;                     /* changed too recently to trust stat() */
+  int busy;                     /* being lexed or replayed */
+  int dead;                     /* replaced while busy */
+  unsigned int version;
+  unsigned int last_used;
+  int64_t usecs;                /* reading the file took */
+  inc_record_t *records;
+} inc_file_t;
+
+static inc_file_t *inc_table[INC_HASH_SIZE];
+/* one for every include being lexed, 0 when it can't be repeated */
+static inc_record_t *inc_recs[MAX_INCLUDE_DEPTH];
+static int num_inc_recs;
+static int inc_serial;
+static unsigned int inc_version, inc_clock;
+static int inc_files, inc_bytes;
+static int inc_hits, inc_misses, inc_replays;
+static int64_t inc_saved_usecs;
+
+static int inc_record_size(inc_record_t *rec)
+{
+  return sizeof(inc_record_t) + rec->max_ops * sizeof(inc_op_t) + rec->strs_max;
+}
+
+static void inc_free_record(inc_record_t *rec)
+{
+  FREE(rec->ops);
+  FREE(rec->strs);
+  FREE(rec);
+}
+
+static void inc_free_file(inc_file_t *inc)
+{
+  inc_record_t *rec;
+
+  while ((rec = inc->records)) {
+    inc->records = rec->next;
+    inc_bytes -= inc_record_size(rec);
+    inc_free_record(rec);
+  }
+  inc_bytes -= inc->size;
+  inc_files--;
+  FREE(inc->name);
+  FREE(inc->path);
+  FREE(inc->text);
+  FREE(inc);
+}
+
+static void inc_unlink(inc_file_t *inc)
+{
+  inc_file_t **incp;
+
+  incp = &inc_table[whashstr(inc->path) & (INC_HASH_SIZE - 1)];
+  while (*incp != inc) {
+    incp = &(*incp)->next;
+  }
+  *incp = inc->next;
+}
+
+/* drop the least recently used files until 'size' more bytes fit */
+static void inc_trim(int size)
+{
+  while (inc_bytes + size > INCLUDE_CACHE_SIZE) {
+    inc_file_t *inc, *lru = 0;
+    int i;
+
+    for (i = 0; i < INC_HASH_SIZE; i++) {
+      for (inc = inc_table[i]; inc; inc = inc->next) {
+        if (!inc->busy && (!lru || inc->last_used < lru->last_used)) {
+          lru = inc;
+        }
+      }
+    }
+    if (!lru) {
+      return;
+    }
+    inc_unlink(lru);
+    inc_free_file(lru);
+  }
+}
+
+static void inc_release(inc_file_t *inc)
+{
+  if (--inc->busy == 0) {
+    if (inc->dead) {
+      inc_free_file(inc);
+    } else {
+      inc_trim(0);
+    }
+  }
+}
+
+static char *inc_strdup(const char *str)
+{
+  char *p = (char *)DXALLOC(strlen(str) + 1, TAG_INCLUDE_CACHE, "inc_strdup");
+
+  strcpy(p, str);
+  return p;
+}
+
+/*
+ * The text of 'path', #included as 'name', from the cache unless the file
+ * changed.  0 if it can't be read.
+ */
+static inc_file_t *inc_lookup(const char *name, const char *path)
+{
+  inc_file_t *inc;
+  struct stat st;
+  int64_t start;
+  time_t now;
+  char *text;
+  int f, h, size, n, r = 0;
+
+  if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+  h = whashstr(path) & (INC_HASH_SIZE - 1);
+  for (inc = inc_table[h]; inc; inc = inc->next) {
+    if (!strcmp(inc->path, path) && !strcmp(inc->name, name)) {
+      break;
+    }
+  }
+  if (inc && !inc->racy && inc->size == st.st_size &&
+      inc->mtime == st.st_mtime && inc->ctime == st.st_ctime &&
+      inc->ino == st.st_ino) {
+    inc->last_used = ++inc_clock;
+    inc_hits++;
+    inc_saved_usecs += inc->usecs;
+    return inc;
+  }
+
+  start = get_monotonic_usec();
+  now = time(NULL);
+  if ((f = open(path, O_RDONLY)) == -1) {
+    return 0;
+  }
+  if (fstat(f, &st) == -1) {
+    close(f);
+    return 0;
+  }
+  size = st.st_size;
+  text = (char *)DXALLOC(size + 1, TAG_INCLUDE_CACHE, "inc_lookup: text");
+  for (n = 0; n < size; n += r) {
+    if ((r = read(f, text + n, size - n)) <= 0) {
+      break;
+    }
+  }
+  close(f);
+  if (r < 0) {
+    FREE(text);
+    return 0;
+  }
+
+  if (inc && inc->size == n && !memcmp(inc->text, text, n)) {
+    /* the same after all */
+    FREE(text);
+  } else {
+    if (inc) {
+      inc_unlink(inc);
+      if (inc->busy) {
+        inc->dead = 1;
+      } else {
+        inc_free_file(inc);
+      }
+    }
+    inc_trim(n);
+    inc = ALLOCATE(inc_file_t, TAG_INCLUDE_CACHE, "inc_lookup");
+    inc->name = inc_strdup(name);
+    inc->path = inc_strdup(path);
+    inc->text = text;
+    inc->size = n;
+    inc->busy = 0;
+    inc->dead = 0;
+    inc->version = ++inc_version;
+    inc->records = 0;
+    inc->next = inc_table[h];
+    inc_table[h] = inc;
+    inc_files++;
+    inc_bytes += n;
+  }
+  inc->mtime = st.st_mtime;
+  inc->ctime = st.st_ctime;
+  inc->ino = st.st_ino;
+  inc->racy = (n != size || st.st_mtime >= now - 1 || st.st_ctime >= now - 1);
+  inc->last_used = ++inc_clock;
+  inc->usecs = get_monotonic_usec() - start;
+  inc_misses++;
+  return inc;
+}
+
+static inc_file_t *
 inc_open(char *buf, char *name, int check_local)
 {
-  int i, f;
+  int i;
   char *p;
   const char *tmp;
+  inc_file_t *inc;
+
   if (check_local) {
     merge(name, buf);
     tmp = check_valid_path(buf, master_ob, "include", 0);
-    if (tmp && (f = open(tmp, O_RDONLY)) != -1) {
-      return f;
+    if (tmp && (inc = inc_lookup(buf, tmp))) {
+      return inc;
     }
   }
   /*
@@ -413,17 +682,335 @@ inc_open(char *buf, char *name, int check_local)
    */
   for (p = strchr(name, '.'); p; p = strchr(p + 1, '.')) {
     if (p[1] == '.') {
-      return -1;
+      return 0;
     }
   }
   for (i = 0; i < inc_list_size; i++) {
     sprintf(buf, "%s/%s", inc_list[i], name);
     tmp = check_valid_path(buf, master_ob, "include", 0);
-    if (tmp && (f = open(tmp, O_RDONLY)) != -1) {
-      return f;
+    if (tmp && (inc = inc_lookup(buf, tmp))) {
+      return inc;
     }
   }
-  return -1;
+  return 0;
+}
+
+/* read() from the include file being lexed */
+static int inc_read(char *buf, int n)
+{
+  if (n > inc_cur->size - inc_pos) {
+    n = inc_cur->size - inc_pos;
+  }
+  memcpy(buf, inc_cur->text + inc_pos, n);
+  inc_pos += n;
+  return n;
+}
+
+static inc_op_t *inc_add_op(inc_record_t *rec, int kind)
+{
+  inc_op_t *op;
+
+  if (rec->num_ops == rec->max_ops) {
+    rec->max_ops *= 2;
+    rec->ops = RESIZE(rec->ops, rec->max_ops, inc_op_t, TAG_INCLUDE_CACHE, "inc_add_op");
+  }
+  op = &rec->ops[rec->num_ops++];
+  op->kind = kind;
+  return op;
+}
+
+static int inc_add_str(inc_record_t *rec, const char *str)
+{
+  int len = strlen(str) + 1;
+  int off = rec->strs_size;
+
+  if (off + len > rec->strs_max) {
+    while (off + len > rec->strs_max) {
+      rec->strs_max *= 2;
+    }
+    rec->strs = (char *)DREALLOC(rec->strs, rec->strs_max, TAG_INCLUDE_CACHE, "inc_add_str");
+  }
+  memcpy(rec->strs + off, str, len);
+  rec->strs_size += len;
+  return off;
+}
+
+/*
+ * Recording.  Every change is added to all the recordings in progress,
+ * those of the files that include the current one too.  Defines remember
+ * the last recording that set them, so that lookups of names the file set
+ * itself needn't be checked when it's repeated.
+ */
+static void inc_note_lookup(const char *name, defn_t *p)
+{
+  inc_record_t *rec;
+  inc_op_t *op;
+  int i;
+
+  for (i = 0; i < num_inc_recs; i++) {
+    if (!(rec = inc_recs[i]) || (p && p->touched >= rec->serial)) {
+      continue;
+    }
+    op = inc_add_op(rec, INC_LOOKUP);
+    op->name = inc_add_str(rec, name);
+    if (p && !(p->flags & DEF_IS_UNDEFINED)) {
+      op->flags = p->flags & DEF_IS_PREDEF;
+      op->nargs = p->nargs;
+      op->exps = inc_add_str(rec, p->exps);
+    } else {
+      op->flags = -1;
+    }
+  }
+}
+
+/* after #define or #undef of p */
+static void inc_note_define(defn_t *p)
+{
+  inc_record_t *rec;
+  inc_op_t *op;
+  int i;
+
+  p->touched = inc_serial;
+  for (i = 0; i < num_inc_recs; i++) {
+    if (!(rec = inc_recs[i])) {
+      continue;
+    }
+    if (p->flags & DEF_IS_UNDEFINED) {
+      op = inc_add_op(rec, INC_UNDEF);
+    } else {
+      op = inc_add_op(rec, INC_DEFINE);
+      op->nargs = p->nargs;
+      op->exps = inc_add_str(rec, p->exps);
+    }
+    op->name = inc_add_str(rec, p->name);
+  }
+}
+
+static void inc_note_pragma(const char *str)
+{
+  int i;
+
+  for (i = 0; i < num_inc_recs; i++) {
+    if (inc_recs[i]) {
+      inc_add_op(inc_recs[i], INC_PRAGMA)->name = inc_add_str(inc_recs[i], str);
+    }
+  }
+}
+
+/* 'path' was #included as 'name' at 'depth' */
+static void inc_note_include(const char *from, const char *name, int local,
+                             const char *path, unsigned int version, int depth)
+{
+  inc_record_t *rec;
+  inc_op_t *op;
+  int i;
+
+  for (i = 0; i < num_inc_recs; i++) {
+    if (!(rec = inc_recs[i])) {
+      continue;
+    }
+    op = inc_add_op(rec, INC_INCLUDE);
+    op->flags = local;
+    op->name = inc_add_str(rec, name);
+    op->exps = inc_add_str(rec, from);
+    op->path = inc_add_str(rec, path);
+    op->version = version;
+    if (depth - rec->base > rec->depth) {
+      rec->depth = depth - rec->base;
+    }
+  }
+}
+
+/*
+ * Give up the recordings in progress that couldn't be repeated: all of
+ * them, or those that started inside the #if 'top'.
+ */
+static void inc_invalidate(ifstate_t *top, int all)
+{
+  int i;
+
+  for (i = 0; i < num_inc_recs; i++) {
+    if (inc_recs[i] && (all || inc_recs[i]->iftop == top)) {
+      inc_free_record(inc_recs[i]);
+      inc_recs[i] = 0;
+      inc_recording--;
+    }
+  }
+}
+
+/* start lexing 'inc', which the caller has marked busy */
+static void inc_begin(inc_file_t *inc)
+{
+  inc_record_t *rec;
+
+  inc_cur = inc;
+  inc_pos = 0;
+
+  rec = ALLOCATE(inc_record_t, TAG_INCLUDE_CACHE, "inc_begin");
+  rec->max_ops = 16;
+  rec->num_ops = 0;
+  rec->ops = CALLOCATE(rec->max_ops, inc_op_t, TAG_INCLUDE_CACHE, "inc_begin: ops");
+  rec->strs_max = 256;
+  rec->strs_size = 0;
+  rec->strs = (char *)DXALLOC(rec->strs_max, TAG_INCLUDE_CACHE, "inc_begin: strs");
+  rec->warnings = pragmas & PRAGMA_WARNINGS;
+  rec->depth = 0;
+  rec->serial = ++inc_serial;
+  rec->base = incnum;
+  rec->errors = num_parse_error + num_parse_warning;
+  rec->iftop = iftop;
+  rec->start = get_monotonic_usec();
+  inc_recs[num_inc_recs++] = rec;
+  inc_recording++;
+}
+
+/* done with the include being lexed, at its end if 'done' */
+static void inc_end(int done)
+{
+  inc_record_t *rec, **recp;
+  int n;
+
+  if ((rec = inc_recs[--num_inc_recs])) {
+    inc_recording--;
+    if (done && !lex_fatal && iftop == rec->iftop &&
+        num_parse_error + num_parse_warning == rec->errors) {
+      rec->usecs = get_monotonic_usec() - rec->start;
+      rec->next = inc_cur->records;
+      inc_cur->records = rec;
+      inc_bytes += inc_record_size(rec);
+      for (recp = &inc_cur->records, n = 0; *recp && n < INC_RECORDINGS; n++) {
+        recp = &(*recp)->next;
+      }
+      while ((rec = *recp)) {
+        *recp = rec->next;
+        inc_bytes -= inc_record_size(rec);
+        inc_free_record(rec);
+      }
+    } else {
+      inc_free_record(rec);
+    }
+  }
+  inc_release(inc_cur);
+}
+
+/* whether the define table and the nested includes still fit 'rec' */
+static int inc_check(inc_record_t *rec)
+{
+  char buf[MAXLINE];
+  inc_op_t *op, *end = rec->ops + rec->num_ops;
+
+  for (op = rec->ops; op < end; op++) {
+    if (op->kind == INC_LOOKUP) {
+      defn_t *p = lookup_definition(rec->strs + op->name);
+
+      if (p && (p->flags & DEF_IS_UNDEFINED)) {
+        p = 0;
+      }
+      if (op->flags == -1) {
+        if (p) {
+          return 0;
+        }
+      } else if (!p || (p->flags & DEF_IS_PREDEF) != op->flags ||
+                 p->nargs != op->nargs || strcmp(p->exps, rec->strs + op->exps)) {
+        return 0;
+      }
+    } else if (op->kind == INC_INCLUDE) {
+      char *file = current_file;
+      inc_file_t *inc;
+
+      current_file = rec->strs + op->exps;
+      inc = inc_open(buf, rec->strs + op->name, op->flags);
+      current_file = file;
+      if (!inc || inc->version != op->version) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/*
+ * Repeat a recording of 'inc' instead of lexing it, if one fits.  The
+ * caller has marked it busy.
+ */
+static int inc_replay(inc_file_t *inc)
+{
+  inc_record_t *rec, **recp;
+  inc_op_t *op, *end;
+  int64_t start = get_monotonic_usec(), usecs;
+  defn_t *p;
+
+  for (recp = &inc->records; (rec = *recp); recp = &rec->next) {
+    if (rec->warnings == (pragmas & PRAGMA_WARNINGS) &&
+        incnum + rec->depth < MAX_INCLUDE_DEPTH && inc_check(rec)) {
+      break;
+    }
+  }
+  if (!rec) {
+    return 0;
+  }
+  *recp = rec->next;
+  rec->next = inc->records;
+  inc->records = rec;
+
+  add_program_file(inc->name, 0);
+  end = rec->ops + rec->num_ops;
+  for (op = rec->ops; op < end; op++) {
+    char *name = rec->strs + op->name;
+
+    switch (op->kind) {
+      case INC_LOOKUP:
+        if (inc_recording) {
+          inc_note_lookup(name, lookup_definition(name));
+        }
+        break;
+      case INC_DEFINE:
+        add_define(name, op->nargs, rec->strs + op->exps);
+        break;
+      case INC_UNDEF:
+        if ((p = lookup_definition(name))) {
+          p->flags |= DEF_IS_UNDEFINED;
+          if (inc_recording) {
+            inc_note_define(p);
+          }
+        }
+        break;
+      case INC_PRAGMA:
+        handle_pragma(name);
+        if (inc_recording) {
+          inc_note_pragma(name);
+        }
+        break;
+      case INC_INCLUDE:
+        add_program_file(rec->strs + op->path, 0);
+        if (inc_recording) {
+          inc_note_include(rec->strs + op->exps, name, op->flags, rec->strs + op->path,
+                           op->version, incnum + rec->depth);
+        }
+        break;
+    }
+  }
+
+  inc_replays++;
+  usecs = rec->usecs - (get_monotonic_usec() - start);
+  if (usecs > 0) {
+    inc_saved_usecs += usecs;
+  }
+  return 1;
+}
+
+int include_cache_status(outbuffer_t *out, int verbose)
+{
+  if (verbose == 1) {
+    outbuf_add(out, "Include cache:\n");
+    outbuf_add(out, "--------------\n");
+    outbuf_addv(out, "Files: %d, %d bytes (limit %d)\n",
+                inc_files, inc_bytes, INCLUDE_CACHE_SIZE);
+    outbuf_addv(out, "Read from cache: %d, from disk: %d, defines replayed: %d\n",
+                inc_hits, inc_misses, inc_replays);
+    outbuf_addv(out, "Compile time saved: %.3f secs\n", inc_saved_usecs / 1000000.0);
+  }
+  return inc_bytes;
 }
 
 static void
@@ -450,7 +1037,8 @@ handle_include(char *name, int global)
   char *p;
   static char buf[MAXLINE];
   incstate_t *is;
-  int delim, f;
+  inc_file_t *inc;
+  int delim;
 
   if (*name != '"' && *name != '<') {
     defn_t *d;
@@ -485,9 +1073,23 @@ handle_include(char *name, int global)
   *p = 0;
   if (++incnum == MAX_INCLUDE_DEPTH) {
     include_error("Maximum include depth exceeded.", global);
-  } else if ((f = inc_open(buf, name, delim == '"')) != -1) {
+  } else if ((inc = inc_open(buf, name, delim == '"'))) {
+    inc->busy++;
+    if (inc_recording) {
+      inc_note_include(current_file, name, delim == '"', buf, inc->version, incnum);
+    }
+    if (inc_replay(inc)) {
+      inc_release(inc);
+      incnum--;
+      if (outp == last_nl + 1) {
+        refill_buffer();
+      }
+      pop_stack();
+      return;
+    }
     is = ALLOCATE(incstate_t, TAG_COMPILER, "handle_include: 1");
-    is->yyin_desc = yyin_desc;
+    is->inc = inc_cur;
+    is->inc_pos = inc_pos;
     is->line = current_line;
     is->file = current_file;
     is->file_id = current_file_id;
@@ -502,7 +1104,7 @@ handle_include(char *name, int global)
     current_line = 1;
     current_file = make_shared_string(buf);
     current_file_id = add_program_file(buf, 0);
-    yyin_desc = f;
+    inc_begin(inc);
     refill_buffer();
   } else {
     sprintf(buf, "Cannot #include %s", name);
@@ -1139,7 +1741,7 @@ static void refill_buffer()
         flag = 1;
       }
 
-      size = correct_read(yyin_desc, p, MAXLINE);
+      size = inc_read(p, MAXLINE);
       end = p += size;
       if (flag) { cur_lbuf->buf_end = p; }
       if (size < MAXLINE) {
@@ -1213,7 +1815,20 @@ static void lex_breakpoint()
 {
 }
 
+static int lex_token(void);
+
 int yylex()
+{
+  int token = lex_token();
+
+  /* an include that makes tokens has to be lexed every time */
+  if (inc_recording) {
+    inc_invalidate(0, 1);
+  }
+  return token;
+}
+
+static int lex_token()
 {
   static char partial[MAXLINE + 5];   /* extra 5 for safety buffer */
   static char terminator[MAXLINE + 5];
@@ -1238,7 +1853,7 @@ int yylex()
           incstate_t *p;
 
           p = inctop;
-          close(yyin_desc);
+          inc_end(1);
           save_file_info(current_file_id, current_line - current_line_saved);
           current_line_saved = p->line - 1;
           /* add the lines from this file, and readjust to be relative
@@ -1258,7 +1873,8 @@ int yylex()
           current_file_id = p->file_id;
           current_line = p->line;
 
-          yyin_desc = p->yyin_desc;
+          inc_cur = p->inc;
+          inc_pos = p->inc_pos;
           last_nl = p->last_nl;
           outp = p->outp;
           inctop = p->next;
@@ -1595,10 +2211,19 @@ int yylex()
               deltrail(sp);
               handle_cond(lookup_define(sp) == 0);
             } else if (strcmp("elif", yytext) == 0) {
+              if (inc_recording) {
+                inc_invalidate(iftop, 0);
+              }
               handle_elif(sp);
             } else if (strcmp("else", yytext) == 0) {
+              if (inc_recording) {
+                inc_invalidate(iftop, 0);
+              }
               handle_else();
             } else if (strcmp("endif", yytext) == 0) {
+              if (inc_recording) {
+                inc_invalidate(iftop, 0);
+              }
               handle_endif();
             } else if (strcmp("undef", yytext) == 0) {
               defn_t *d;
@@ -1609,9 +2234,15 @@ int yylex()
                   yyerror("Illegal to #undef a predefined value.");
                 } else {
                   d->flags |= DEF_IS_UNDEFINED;
+                  if (inc_recording) {
+                    inc_note_define(d);
+                  }
                 }
               }
             } else if (strcmp("echo", yytext) == 0) {
+              if (inc_recording) {
+                inc_invalidate(0, 1);
+              }
               debug_message("%s\n", sp);
             } else if (strcmp("error", yytext) == 0) {
               char buf[MAXLINE + 1];
@@ -1625,7 +2256,13 @@ int yylex()
               yywarn(buf);
             } else if (strcmp("pragma", yytext) == 0) {
               handle_pragma(sp);
+              if (inc_recording) {
+                inc_note_pragma(sp);
+              }
             } else if (strcmp("breakpoint", yytext) == 0) {
+              if (inc_recording) {
+                inc_invalidate(0, 1);
+              }
               lex_breakpoint();
             } else {
               yyerror("Unrecognised # directive");
@@ -2112,10 +2749,11 @@ void end_new_file()
     incstate_t *p;
 
     p = inctop;
-    close(yyin_desc);
+    inc_end(0);
     free_string(current_file);
     current_file = p->file;
-    yyin_desc = p->yyin_desc;
+    inc_cur = p->inc;
+    inc_pos = p->inc_pos;
     inctop = p->next;
     FREE((char *) p);
   }
@@ -2410,6 +3048,7 @@ static void init_instrs()
   add_instr_name("ref_lvalue", "C_REF_LVALUE(%i);\n", F_REF_LVALUE, T_LVALUE);
   add_instr_name("transfer_local", "C_TRANSFER_LOCAL(%i);\n", F_TRANSFER_LOCAL, T_ANY);
   add_instr_name("number", 0, F_NUMBER, T_NUMBER);
+  add_instr_name("short_int", 0, F_SHORT_INT, T_NUMBER);
   add_instr_name("real", 0, F_REAL, T_REAL);
   add_instr_name("local_lvalue", "C_LVALUE(fp + %i);\n", F_LOCAL_LVALUE, T_LVALUE);
   add_instr_name("while_dec", "C_WHILE_DEC(%i); if (lpc_int)\n", F_WHILE_DEC, -1);
@@ -2432,6 +3071,7 @@ static void init_instrs()
   add_instr_name("branch_when_zero", 0, F_BRANCH_WHEN_ZERO, -1);
   add_instr_name("branch_when_non_zero", 0, F_BRANCH_WHEN_NON_ZERO, -1);
   add_instr_name("pop", "pop_stack();\n", F_POP_VALUE, -1);
+  add_instr_name("push", 0, F_PUSH, -1);
   add_instr_name("const0", "push_number(0);\n", F_CONST0, T_NUMBER);
 #ifdef F_JUMP_WHEN_ZERO
   add_instr_name("jump_when_zero", F_JUMP_WHEN_ZERO, -1);
@@ -2463,6 +3103,7 @@ static void init_instrs()
   add_instr_name("simul_efun",
                  "call_simul_efun(%i, (lpc_int = %i + num_varargs, num_varargs = 0, lpc_int));\n",
                  F_SIMUL_EFUN, T_ANY);
+  add_instr_name("call_other_site", 0, F_CALL_OTHER_SITE, T_ANY);
   add_instr_name("global_lvalue", "C_LVALUE(&current_object->variables[variable_index_offset + %i]);\n", F_GLOBAL_LVALUE, T_LVALUE);
   add_instr_name("|", "f_or();\n", F_OR, T_ARRAY | T_NUMBER);
   add_instr_name("<<", "f_lsh();\n", F_LSH, T_NUMBER);
@@ -2493,6 +3134,45 @@ static void init_instrs()
   add_instr_name("switch", 0, F_SWITCH, -1);
   add_instr_name("time_expression", 0, F_TIME_EXPRESSION, -1);
   add_instr_name("end_time_expression", 0, F_END_TIME_EXPRESSION, T_NUMBER);
+#ifdef F_LOCAL_BRANCH_WHEN_ZERO
+  add_instr_name("local_branch_when_zero", 0, F_LOCAL_BRANCH_WHEN_ZERO, -1);
+#endif
+#ifdef F_LOCAL_BRANCH_WHEN_NON_ZERO
+  add_instr_name("local_branch_when_non_zero", 0, F_LOCAL_BRANCH_WHEN_NON_ZERO, -1);
+#endif
+#ifdef F_LOCAL_LAND
+  add_instr_name("local_land", 0, F_LOCAL_LAND, -1);
+#endif
+#ifdef F_LOCAL_BYTE_BRANCH_GE
+  add_instr_name("local_byte_branch_ge", 0, F_LOCAL_BYTE_BRANCH_GE, -1);
+#endif
+#ifdef F_VOID_ASSIGN_LOCAL_BYTE
+  add_instr_name("void_assign_local_byte", 0, F_VOID_ASSIGN_LOCAL_BYTE, -1);
+#endif
+#ifdef F_VOID_ADD_EQ_LOCAL
+  add_instr_name("void_add_eq_local", 0, F_VOID_ADD_EQ_LOCAL, -1);
+#endif
+#ifdef TYPED_OPCODES
+  add_instr_name("int_add", 0, F_INT_ADD, T_NUMBER);
+  add_instr_name("int_subtract", 0, F_INT_SUBTRACT, T_NUMBER);
+  add_instr_name("int_multiply", 0, F_INT_MULTIPLY, T_NUMBER);
+  add_instr_name("int_eq", 0, F_INT_EQ, T_NUMBER);
+  add_instr_name("int_ne", 0, F_INT_NE, T_NUMBER);
+  add_instr_name("int_le", 0, F_INT_LE, T_NUMBER);
+  add_instr_name("int_lt", 0, F_INT_LT, T_NUMBER);
+  add_instr_name("int_ge", 0, F_INT_GE, T_NUMBER);
+  add_instr_name("int_gt", 0, F_INT_GT, T_NUMBER);
+  add_instr_name("real_add", 0, F_REAL_ADD, T_REAL);
+  add_instr_name("real_subtract", 0, F_REAL_SUBTRACT, T_REAL);
+  add_instr_name("real_multiply", 0, F_REAL_MULTIPLY, T_REAL);
+  add_instr_name("real_divide", 0, F_REAL_DIVIDE, T_REAL);
+  add_instr_name("real_le", 0, F_REAL_LE, T_NUMBER);
+  add_instr_name("real_lt", 0, F_REAL_LT, T_NUMBER);
+  add_instr_name("real_ge", 0, F_REAL_GE, T_NUMBER);
+  add_instr_name("real_gt", 0, F_REAL_GT, T_NUMBER);
+  add_instr_name("array_index", 0, F_ARRAY_INDEX, T_ANY);
+  add_instr_name("mapping_index", 0, F_MAPPING_INDEX, T_ANY);
+#endif
 }
 
 #define get_next_char(c) if ((c = *outp++) == '\n' && outp == last_nl + 1) refill_buffer()
@@ -2740,6 +3420,23 @@ void mark_all_defines()
       tmp = tmp->next;
     }
   }
+
+  for (i = 0; i < INC_HASH_SIZE; i++) {
+    inc_file_t *inc;
+    inc_record_t *rec;
+
+    for (inc = inc_table[i]; inc; inc = inc->next) {
+      DO_MARK(inc, TAG_INCLUDE_CACHE);
+      DO_MARK(inc->name, TAG_INCLUDE_CACHE);
+      DO_MARK(inc->path, TAG_INCLUDE_CACHE);
+      DO_MARK(inc->text, TAG_INCLUDE_CACHE);
+      for (rec = inc->records; rec; rec = rec->next) {
+        DO_MARK(rec, TAG_INCLUDE_CACHE);
+        DO_MARK(rec->ops, TAG_INCLUDE_CACHE);
+        DO_MARK(rec->strs, TAG_INCLUDE_CACHE);
+      }
+    }
+  }
 }
 #endif
 
@@ -2766,6 +3463,7 @@ static void add_predefine(const char *name, int nargs, const char *exps)
     strcpy(p->exps, exps);
     p->flags = DEF_IS_PREDEF;
     p->nargs = nargs;
+    p->touched = 0;
     h = defhash(name);
     p->next = defns[h];
     defns[h] = p;
@@ -2904,6 +3602,9 @@ static char *expand_define2(char *text)
 
   /* special handling for __LINE__ macro */
   if (!strcmp(text, "__LINE__")) {
+    if (inc_recording) {
+      inc_invalidate(0, 1);
+    }
     expand_buffer = (char *)DXALLOC(20, TAG_COMPILER, "expand_define2");
     sprintf(expand_buffer, "%i", current_line);
     return expand_buffer;
@@ -42,6 +42,7 @@ typedef struct defn_s {
   char *exps;
   int flags;
   int nargs;
+  int touched;       /* include cache recording that last set it */
 } defn_t;
 
 /* must be a power of 4 */
@@ -150,7 +150,7 @@ int main(int argc, char **argv)
     exit(-1);
   }
 
-  current_virtual_time = get_current_time();
+  init_virtual_time();
 #ifdef POSIX_TIMERS
   /*
    * Initialize the POSIX timers.
@@ -177,6 +177,7 @@ int main(int argc, char **argv)
   printf("Initializing internal tables....\n");
   init_strings();   /* in stralloc.c */
   init_otable();    /* in otable.c */
+  init_apply_cache();   /* in interpret.c */
   init_identifiers();   /* in lex.c */
   init_locals();              /* in compiler.c */
 
@@ -61,6 +61,11 @@ int outbuf_extend(outbuffer_t *, int);
 #define TAG_DB              (TAG_PERMANENT + 40)
 #endif
 #define TAG_INTERPRETER     (TAG_PERMANENT + 41)
+#define TAG_RESET           (TAG_PERMANENT + 50)
+#define TAG_CALL_SITES      (TAG_PERMANENT + 51)
+#define TAG_FUNC_LOOKUP     (TAG_PERMANENT + 52)
+#define TAG_APPLY_CACHE     (TAG_PERMANENT + 53)
+#define TAG_INCLUDE_CACHE   (TAG_PERMANENT + 54)
 
 #define TAG_STRING          (TAG_DATA + 40)
 #define TAG_MALLOC_STRING   (TAG_DATA + 41)
@@ -10,11 +10,10 @@
 #include <map>
 
 int num_mappings = 0;
+int num_small_mappings = 0;
 int total_mapping_size = 0;
 int total_mapping_nodes = 0;
 
-mapping_node_t *locked_map_nodes = 0;
-
 /*
  * LPC mapping (associative arrays) module.  Contains routines for
  * easy value and lvalue manipulation.
@@ -26,6 +25,8 @@ mapping_node_t *locked_map_nodes = 0;
  *   after the one Perl uses in hash.c - 92/07/08 - by Truilkan@TMI
  * - Beek reduced mem usage and improved speed 95/09/08; Sym optimized this
  *   at some point as well.
+ * - the chained hash table was replaced by an open addressed one, with the
+ *   nodes stored in blocks that belong to each mapping; see mapping.h.
  */
 
 LPC_INT sval_hash(svalue_t x)
@@ -41,62 +42,177 @@ LPC_INT sval_hash(svalue_t x)
       return (LPC_INT)(((POINTER_INT)((x).u.number)) >> 5);
   }
 }
+
 /*
-  growMap: based on hash.c:hsplit() from Larry Wall's Perl.
+ * sval_hash() of numbers is the number itself, and keys like 0, 64, 128
+ * would all start probing at the same slot.  The hash kept in the table is
+ * spread over all bits first (Fibonacci hashing).
+ */
+#define MAP_HASH(x) ((unsigned int)(((uint64_t)(x) * 0x9e3779b97f4a7c15ULL) >> 32))
 
-  growMap doubles the size of the hash table.  It is called when FILL_PERCENT
-  of the buckets in the hash table contain values.  This routine is
-  efficient since the entries in the table don't need to be rehashed (even
-  though the entries are redistributed across the both halves of the hash
-  table).
-*/
+/* # of keys a table with 'size' slots takes before it has to grow */
+#define TABLE_FILL(size) ((size) * (unsigned)FILL_PERCENT / (unsigned)100)
+
+#define NODE_BLOCK_BYTES(n) \
+  (sizeof(mapping_node_block_t) + ((n) - 1) * sizeof(mapping_node_t))
+
+/*
+ * Unused nodes are chained through their key.  A node deleted while the
+ * mapping is locked keeps its value, which a ref may still point at, and
+ * is marked by the subtype of its key until unlock_mapping().
+ */
+#define NEXT_FREE_NODE(mn) ((mapping_node_t *)(mn)->values[0].u.lvalue)
+#define NODE_PARKED 1
 
-static unsigned long node_hash(mapping_node_t *mn)
+static unsigned int node_hash(mapping_node_t *mn)
 {
-  return MAP_SVAL_HASH(mn->values[0]);
+  return MAP_HASH(MAP_SVAL_HASH(mn->values[0]));
 }
 
-int growMap(mapping_t *m)
+/*
+ * find_slot: the slot holding the key, or -1.  Robin Hood insertion keeps
+ * the keys of a probe sequence ordered by how far they are from their
+ * home slot, so the search can stop at the first key which is closer to
+ * its home than the one looked for would be.
+ */
+static inline int find_slot(mapping_t *m, svalue_t *key, unsigned int hash)
 {
-  int oldsize = m->table_size + 1;
-  int newsize = oldsize << 1;
+  unsigned int mask = m->table_size;
+  unsigned int i = hash & mask, dist = 0;
+  mapping_slot_t *s;
+
+  while ((s = m->table + i)->node) {
+    if (s->hash == hash && msameval(s->node->values, key)) {
+      return i;
+    }
+    if (((i - s->hash) & mask) < dist) {
+      break;
+    }
+    i = (i + 1) & mask;
+    dist++;
+  }
+  return -1;
+}
+
+/*
+ * find_node: the node holding the key, or 0.  A small mapping has no
+ * table; its few nodes are compared with the key one by one, which for
+ * strings compares shared string pointers.
+ */
+static inline mapping_node_t *find_node(mapping_t *m, svalue_t *key, unsigned int hash)
+{
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
   int i;
-  mapping_node_t **a, **b, **eltp, *elt;
 
-  /* resize the hash table to be twice the old size */
-  m->table = a = RESIZE(m->table, newsize, mapping_node_t *, TAG_MAP_TBL, "growMap");
-  if (!a) {
-    /*
-      We couldn't grow the hash table.  Rather than die, we just
-      accept the performance hit resulting from having an overfull
-      table.
-      This trick won't work.  m->table is now zero. -Beek
-      */
-    m->unfilled = m->table_size;
+  if (!m->table) {
+    MAP_NODE_LOOP(m, mnb, elt) {
+      if (msameval(elt->values, key)) {
+        return elt;
+      }
+    }
     return 0;
   }
+  i = find_slot(m, key, hash);
+  return (i >= 0 ? m->table[i].node : 0);
+}
+
+/* insert_slot: put a node for a key that isn't in the table yet */
+static void insert_slot(mapping_slot_t *table, unsigned int mask,
+                        unsigned int hash, mapping_node_t *node)
+{
+  mapping_slot_t cur, tmp;
+  unsigned int i = hash & mask, dist = 0, d;
+
+  cur.hash = hash;
+  cur.node = node;
+  while (table[i].node) {
+    /* take the slot from a key that is closer to home than this one */
+    if ((d = (i - table[i].hash) & mask) < dist) {
+      tmp = table[i];
+      table[i] = cur;
+      cur = tmp;
+      dist = d;
+    }
+    i = (i + 1) & mask;
+    dist++;
+  }
+  table[i] = cur;
+}
+
+/*
+ * remove_slot: empty slot i, moving the keys probed past it one slot
+ * back so that no tombstones are needed.
+ */
+static void remove_slot(mapping_t *m, unsigned int i)
+{
+  unsigned int mask = m->table_size, j;
+  mapping_slot_t *table = m->table;
+
+  for (j = (i + 1) & mask; table[j].node && ((j - table[j].hash) & mask);
+       j = (j + 1) & mask) {
+    table[i] = table[j];
+    i = j;
+  }
+  table[i].node = 0;
+}
+
+/*
+  growMap: doubles the size of the hash table.  It is called when a key is
+  added to a table which already holds FILL_PERCENT of its size.  The keys
+  aren't looked at, their hashes are kept in the table, and the nodes don't
+  move.
+*/
+
+int growMap(mapping_t *m)
+{
+  unsigned int oldsize = m->table_size + 1;
+  unsigned int newsize = oldsize << 1;
+  unsigned int i;
+  mapping_slot_t *a = m->table, *b;
+
+  b = CALLOCATE(newsize, mapping_slot_t, TAG_MAP_TBL, "growMap");
+  if (!b) {
+    return 0;
+  }
+  for (i = 0; i < oldsize; i++) {
+    if (a[i].node) {
+      insert_slot(b, newsize - 1, a[i].hash, a[i].node);
+    }
+  }
+  FREE((char *)a);
+  m->table = b;
+  m->table_size = newsize - 1;
+  m->unfilled += TABLE_FILL(newsize) - TABLE_FILL(oldsize);
   /* hash table doubles in size -- keep track of the memory used */
-  total_mapping_size += sizeof(mapping_node_t *) * oldsize;
+  total_mapping_size += sizeof(mapping_slot_t) * oldsize;
   debug(mapping, "mapping.c: growMap ptr = %p, size = %d\n", (void *)m, newsize);
-  m->unfilled = oldsize * (unsigned)FILL_PERCENT / (unsigned)100;
-  m->table_size = newsize - 1;
-  /* zero out the new storage area (2nd half of table) */
-  memset(a += oldsize, 0, oldsize * sizeof(mapping_node_t *));
-  i = oldsize;
-  while (a--, i--) {
-    if ((elt = *a)) {
-      eltp = a, b = a + oldsize;
-      do {
-        if (node_hash(elt) & oldsize) {
-          *eltp = elt->next;
-          if (!(elt->next = *b)) { m->unfilled--; }
-          *b = elt;
-          elt = *eltp;
-        } else { elt = *(eltp = &elt->next); }
-      } while (elt);
-      if (!*a) { m->unfilled++; }
-    }
+  return 1;
+}
+
+/*
+ * make_table: give a small mapping its hash table, when a key is added to
+ * one that has MAP_SMALL_SIZE already.  The nodes stay where they are.
+ */
+static int make_table(mapping_t *m)
+{
+  unsigned int size, c = MAP_COUNT(m);
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
+
+  for (size = MAP_HASH_TABLE_SIZE; TABLE_FILL(size) <= c; size <<= 1)
+    ;
+  m->table = CALLOCATE(size, mapping_slot_t, TAG_MAP_TBL, "make_table");
+  if (!m->table) {
+    return 0;
+  }
+  m->table_size = size - 1;
+  m->unfilled = TABLE_FILL(size) - c;
+  MAP_NODE_LOOP(m, mnb, elt) {
+    insert_slot(m->table, size - 1, node_hash(elt), elt);
   }
+  num_small_mappings--;
+  total_mapping_size += sizeof(mapping_slot_t) * size;
   return 1;
 }
 
@@ -110,16 +226,13 @@ int growMap(mapping_t *m)
 
 mapping_t *mapTraverse(mapping_t *m, int (*func)(mapping_t *, mapping_node_t *, void *), void *extra)
 {
-  mapping_node_t *elt, *nelt;
-  int j = m->table_size;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
 
   debug(mapping, "mapTraverse %p\n", (void *)m);
-  do {
-    for (elt = m->table[j]; elt; elt = nelt) {
-      nelt = elt->next;
-      if ((*func)(m, elt, extra)) { return m; }
-    }
-  } while (j--);
+  MAP_NODE_LOOP(m, mnb, elt) {
+    if ((*func)(m, elt, extra)) { return m; }
+  }
   return m;
 }
 
@@ -128,33 +241,41 @@ mapping_t *mapTraverse(mapping_t *m, int (*func)(mapping_t *, mapping_node_t *,
 void
 dealloc_mapping(mapping_t *m)
 {
+  mapping_node_block_t *mnb, *next;
+  mapping_node_t *elt;
+  int c = MAP_COUNT(m);
+
   debug(mapping, "mapping.c: actual free of %p\n", (void *)m);
   num_mappings--;
-  {
-    int j = m->table_size, c = MAP_COUNT(m);
-    mapping_node_t *elt, *nelt, **a = m->table;
-
-    total_mapping_size -= (sizeof(mapping_t) +
-                           sizeof(mapping_node_t *) * (j + 1) +
-                           sizeof(mapping_node_t) * c);
-    total_mapping_nodes -= c;
+  total_mapping_size -= sizeof(mapping_t);
+  if (m->table) {
+    total_mapping_size -= sizeof(mapping_slot_t) * (m->table_size + 1);
+  } else {
+    num_small_mappings--;
+  }
+  total_mapping_nodes -= c;
 #ifdef PACKAGE_MUDLIB_STATS
-    add_array_size(&m->stats, - (c << 1));
+  add_array_size(&m->stats, - (c << 1));
 #endif
 
-    do {
-      for (elt = a[j]; elt; elt = nelt) {
-        nelt = elt->next;
+  for (mnb = m->blocks; mnb; mnb = next) {
+    next = mnb->next;
+    for (elt = mnb->nodes; elt < mnb->nodes + mnb->used; elt++) {
+      if (!MAP_NODE_FREE(elt)) {
         free_svalue(elt->values, "free_mapping");
-        free_node(m, elt);
+        free_svalue(elt->values + 1, "free_mapping");
+      } else if (elt->values[0].subtype == NODE_PARKED) {
+        free_svalue(elt->values + 1, "free_mapping");
       }
-    } while (j--);
-
-
-    debug(mapping, ("in free_mapping: before table\n"));
-    FREE((char *)a);
+    }
+    total_mapping_size -= NODE_BLOCK_BYTES(mnb->size);
+    FREE((char *)mnb);
   }
 
+  debug(mapping, ("in free_mapping: before table\n"));
+  if (m->table) {
+    FREE((char *)m->table);
+  }
   debug(mapping, ("in free_mapping: after table\n"));
   FREE((char *) m);
   debug(mapping, ("in free_mapping: after m\n"));
@@ -172,75 +293,141 @@ free_mapping(mapping_t *m)
   dealloc_mapping(m);
 }
 
-static mapping_node_t *free_nodes = 0;
-mapping_node_block_t *mapping_node_blocks = 0;
-
-#ifdef DEBUGMALLOC_EXTENSIONS
-void mark_mapping_node_blocks()
+static mapping_node_block_t *new_node_block(mapping_t *m, unsigned int size)
 {
-  mapping_node_block_t *mnb = mapping_node_blocks;
+  mapping_node_block_t *mnb;
 
-  while (mnb) {
-    DO_MARK(mnb, TAG_MAP_NODE_BLOCK);
-    mnb = mnb->next;
+  mnb = (mapping_node_block_t *)DXALLOC(NODE_BLOCK_BYTES(size),
+                                        TAG_MAP_NODE_BLOCK, "new_node_block");
+  if (!mnb) {
+    error("Out of memory\n");
   }
+  mnb->size = size;
+  mnb->used = 0;
+  mnb->next = m->blocks;
+  m->blocks = mnb;
+  total_mapping_size += NODE_BLOCK_BYTES(size);
+  return mnb;
 }
-#endif
 
-mapping_node_t *new_map_node()
+/*
+ * new_map_node: a deleted node if there is one, the next unused one of
+ * the newest block otherwise.  A new block gets enough nodes to fill the
+ * table up to the point where it grows, so the blocks double in size
+ * along with the table.  Small mappings start with the number of nodes
+ * they were allocated for and double from there.
+ */
+static mapping_node_t *new_map_node(mapping_t *m)
 {
-  mapping_node_block_t *mnb;
+  mapping_node_block_t *mnb = m->blocks;
   mapping_node_t *ret;
-  int i;
+  unsigned int have = 0, want;
 
-  if ((ret = free_nodes)) {
-    free_nodes = ret->next;
-  } else {
-    mnb = ALLOCATE(mapping_node_block_t, TAG_MAP_NODE_BLOCK, "new_map_node");
-    mnb->next = mapping_node_blocks;
-    mapping_node_blocks = mnb;
-    mnb->nodes[MNB_SIZE - 1].next = 0;
-    for (i = MNB_SIZE - 1; i--;) {
-      mnb->nodes[i].next = &mnb->nodes[i + 1];
+  if ((ret = m->free_nodes)) {
+    m->free_nodes = NEXT_FREE_NODE(ret);
+    return ret;
+  }
+  if (!mnb || mnb->used == mnb->size) {
+    for (; mnb; mnb = mnb->next) {
+      have += mnb->size;
+    }
+    if (!m->table) {
+      want = (have ? have : m->table_size);
+    } else {
+      want = TABLE_FILL(m->table_size + 1);
+      want = (want > have ? want - have : have);
     }
-    ret = &mnb->nodes[0];
-    free_nodes = &mnb->nodes[1];
+    mnb = new_node_block(m, want);
+  }
+  return &mnb->nodes[mnb->used++];
+}
+
+/* free_node: the key has been freed already */
+static void free_node(mapping_t *m, mapping_node_t *mn)
+{
+  mn->values[0].type = T_INVALID;
+  if (m->count & MAP_LOCKED) {
+    mn->values[0].subtype = NODE_PARKED;
+  } else {
+    free_svalue(mn->values + 1, "free_node");
+    mn->values[1] = const0;
+    mn->values[0].subtype = 0;
+    mn->values[0].u.lvalue = (m->free_nodes ? m->free_nodes->values : 0);
+    m->free_nodes = mn;
   }
-  return ret;
 }
 
 void unlock_mapping(mapping_t *m)
 {
-  mapping_node_t **mn = &locked_map_nodes;
-  mapping_node_t *tmp;
-
-  while (*mn) {
-    if ((*mn)->values[0].u.map == m) {
-      free_svalue((*mn)->values + 1, "free_locked_nodes");
-      /* take it out of the locked list ... */
-      tmp = *mn;
-      *mn = (*mn)->next;
-      /* and add it to the free list */
-      tmp->next = free_nodes;
-      free_nodes = tmp;
-    } else {
-      mn = &((*mn)->next);
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
+
+  m->count &= ~MAP_LOCKED;
+  for (mnb = m->blocks; mnb; mnb = mnb->next) {
+    for (elt = mnb->nodes; elt < mnb->nodes + mnb->used; elt++) {
+      if (MAP_NODE_FREE(elt) && elt->values[0].subtype == NODE_PARKED) {
+        free_node(m, elt);
+      }
     }
   }
-  m->count &= ~MAP_LOCKED;
 }
 
-void free_node(mapping_t *m, mapping_node_t *mn)
+/*
+ * add_node: a node for a key which isn't in the mapping yet.  The caller
+ * has to fill in both the key and the value.
+ */
+static mapping_node_t *add_node(mapping_t *m, unsigned int hash)
 {
-  if (m->count & MAP_LOCKED) {
-    mn->next = locked_map_nodes;
-    locked_map_nodes = mn;
-    mn->values[0].u.map = m;
-  } else {
-    free_svalue(mn->values + 1, "free_node");
-    mn->next = free_nodes;
-    free_nodes = mn;
+  mapping_node_t *elt;
+
+  if (MAP_COUNT(m) >= (unsigned)MAX_MAPPING_SIZE) {
+    debug(mapping, ("mapping.c: too full"));
+    mapping_too_large();
   }
+  if (!m->table) {
+    if (MAP_COUNT(m) >= MAP_SMALL_SIZE && !make_table(m)) {
+      error("Out of memory\n");
+    }
+  } else if (!m->unfilled && !growMap(m)) {
+    error("Out of memory\n");
+  }
+  elt = new_map_node(m);
+  if (m->table) {
+    insert_slot(m->table, m->table_size, hash, elt);
+    m->unfilled--;
+  }
+  m->count++;
+  total_mapping_nodes++;
+#ifdef PACKAGE_MUDLIB_STATS
+  add_array_size(&m->stats, 2);
+#endif
+  return elt;
+}
+
+/* remove_node: take the key out of the mapping and free its node */
+static void remove_node(mapping_t *m, svalue_t *key, unsigned int hash)
+{
+  mapping_node_t *elt;
+  int i;
+
+  if (m->table) {
+    if ((i = find_slot(m, key, hash)) < 0) {
+      return;
+    }
+    elt = m->table[i].node;
+    remove_slot(m, i);
+    m->unfilled++;
+  } else if (!(elt = find_node(m, key, hash))) {
+    return;
+  }
+  m->count--;
+  total_mapping_nodes--;
+#ifdef PACKAGE_MUDLIB_STATS
+  add_array_size(&m->stats, -2);
+#endif
+  debug(mapping, "mapping delete: count = %i", MAP_COUNT(m));
+  free_svalue(elt->values, "mapping_delete");
+  free_node(m, elt);
 }
 
 /* allocate_mapping(int n)
@@ -254,7 +441,7 @@ mapping_t *
 allocate_mapping(int n)
 {
   mapping_t *newmap;
-  mapping_node_t **a;
+  unsigned int size;
 
   if (n > MAX_MAPPING_SIZE) { n = MAX_MAPPING_SIZE; }
   newmap = ALLOCATE(mapping_t, TAG_MAPPING, "allocate_mapping: 1");
@@ -263,30 +450,31 @@ allocate_mapping(int n)
     error("Allocate_mapping - out of memory.\n");
   }
 
-  if (n > MAP_HASH_TABLE_SIZE) {
-    n |= n >> 1;
-    n |= n >> 2;
-    n |= n >> 4;
-    if (n & 0xff00) { n |= n >> 8; }
-    newmap->table_size = n++;
-  } else { newmap->table_size = (n = MAP_HASH_TABLE_SIZE) - 1; }
-  /* The size is actually 1 higher */
-  newmap->unfilled = n * (unsigned)FILL_PERCENT / (unsigned)100;
-  a = newmap->table =
-        (mapping_node_t **)DXALLOC(n *= sizeof(mapping_node_t *),
-                                   TAG_MAP_TBL, "allocate_mapping: 3");
-  if (!a) {
-    error("Allocate_mapping 2 - out of memory.\n");
+  newmap->blocks = 0;
+  newmap->free_nodes = 0;
+  if (n <= MAP_SMALL_SIZE) {
+    newmap->table = 0;
+    newmap->table_size = (n ? n : MAP_SMALL_SIZE / 2);
+    newmap->unfilled = 0;
+    num_small_mappings++;
+    total_mapping_size += sizeof(mapping_t);
+  } else {
+    for (size = MAP_HASH_TABLE_SIZE; TABLE_FILL(size) < (unsigned)n; size <<= 1)
+      ;
+    newmap->table = CALLOCATE(size, mapping_slot_t, TAG_MAP_TBL, "allocate_mapping: 3");
+    if (!newmap->table) {
+      FREE((char *) newmap);
+      error("Allocate_mapping 2 - out of memory.\n");
+    }
+    newmap->table_size = size - 1;
+    newmap->unfilled = TABLE_FILL(size);
+    total_mapping_size += sizeof(mapping_t) + sizeof(mapping_slot_t) * size;
   }
-  /* zero out the hash table */
-  memset(a, 0, n);
-  total_mapping_size += sizeof(mapping_t) + n;
   newmap->ref = 1;
   newmap->count = 0;
 #ifdef PACKAGE_MUDLIB_STATS
   if (current_object) {
     assign_stats(&newmap->stats, current_object);
-    add_array_size(&newmap->stats, n << 1);
   } else {
     null_stats(&newmap->stats);
   }
@@ -341,51 +529,70 @@ mkmapping(array_t *k, array_t *v)
 }
 
 /*
-  copyMapping: make a copy of a mapping
+  copyMapping: make a copy of a mapping.  The table is copied slot for
+  slot, and the nodes go into a single block.  A small mapping stays
+  small and keeps the order of its nodes.
 */
 
 static mapping_t *
 copyMapping(mapping_t *m)
 {
   mapping_t *newmap;
-  int k = m->table_size;
-  mapping_node_t *elt, *nelt, **a, **b = m->table, **c;
+  unsigned int i, k = m->table_size + 1, c = MAP_COUNT(m);
+  mapping_slot_t *a = m->table, *b = 0;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt, *elt2;
 
   newmap = ALLOCATE(mapping_t, TAG_MAPPING, "copy_mapping: 1");
   if (newmap == NULL) { error("copyMapping - out of memory.\n"); }
-  newmap->table_size = k++;
-  newmap->unfilled = m->unfilled;
   newmap->ref = 1;
-  c = newmap->table = CALLOCATE(k, mapping_node_t *, TAG_MAP_TBL, "copy_mapping: 2");
-  if (!c) {
-    FREE((char *) newmap);
-    error("copyMapping 2 - out of memory.\n");
+  newmap->blocks = 0;
+  newmap->free_nodes = 0;
+  if (!a) {
+    newmap->table = 0;
+    newmap->table_size = (c ? c : MAP_SMALL_SIZE / 2);
+    newmap->unfilled = 0;
+    num_small_mappings++;
+    total_mapping_size += sizeof(mapping_t);
+  } else {
+    newmap->table_size = k - 1;
+    newmap->unfilled = m->unfilled;
+    b = newmap->table = CALLOCATE(k, mapping_slot_t, TAG_MAP_TBL, "copy_mapping: 2");
+    if (!b) {
+      FREE((char *) newmap);
+      error("copyMapping 2 - out of memory.\n");
+    }
+    total_mapping_size += sizeof(mapping_t) + sizeof(mapping_slot_t) * k;
   }
-  newmap->count = m->count;
-  total_mapping_nodes += MAP_COUNT(m);
-  memset(c, 0, k * sizeof(mapping_node_t *));
-  total_mapping_size += (sizeof(mapping_t) +
-                         sizeof(mapping_node_t *) * k +
-                         sizeof(mapping_node_t) * MAP_COUNT(m));
+  newmap->count = c;
+  total_mapping_nodes += c;
 
 #ifdef PACKAGE_MUDLIB_STATS
   if (current_object) {
     assign_stats(&newmap->stats, current_object);
-    add_array_size(&newmap->stats, MAP_COUNT(m) << 1);
+    add_array_size(&newmap->stats, c << 1);
   } else { null_stats(&newmap->stats); }
 #endif
   num_mappings++;
-  while (k--) {
-    if ((elt = b[k])) {
-      a = c + k;
-      do {
-        nelt = new_map_node();
-
-        assign_svalue_no_free(nelt->values, elt->values);
-        assign_svalue_no_free(nelt->values + 1, elt->values + 1);
-        nelt->next = *a;
-        *a = nelt;
-      } while ((elt = elt->next));
+  if (!c) {
+    return newmap;
+  }
+  elt = new_node_block(newmap, c)->nodes;
+  newmap->blocks->used = c;
+  if (!a) {
+    MAP_NODE_LOOP(m, mnb, elt2) {
+      assign_svalue_no_free(elt->values, elt2->values);
+      assign_svalue_no_free(elt->values + 1, elt2->values + 1);
+      elt++;
+    }
+    return newmap;
+  }
+  for (i = 0; i < k; i++) {
+    if (a[i].node) {
+      assign_svalue_no_free(elt->values, a[i].node->values);
+      assign_svalue_no_free(elt->values + 1, a[i].node->values + 1);
+      b[i].hash = a[i].hash;
+      b[i].node = elt++;
     }
   }
   return newmap;
@@ -479,30 +686,7 @@ int msameval(svalue_t *arg1, svalue_t *arg2)
 
 void mapping_delete(mapping_t *m, svalue_t *lv)
 {
-  int i = svalue_to_int(lv) & m->table_size;
-  mapping_node_t **prev = m->table + i, *elt;
-
-  if ((elt = *prev)) {
-    do {
-      if (msameval(elt->values, lv)) {
-        if (!(*prev = elt->next) && !m->table[i]) {
-          m->unfilled++;
-          debug(mapping, "mapping delete: bucket empty, unfilled = %i",
-                m->unfilled);
-        }
-        m->count--;
-        total_mapping_nodes--;
-        total_mapping_size -= sizeof(mapping_node_t);
-        debug(mapping, "mapping delete: count = %i", MAP_COUNT(m));
-        free_svalue(elt->values, "mapping_delete");
-        free_node(m, elt);
-        return;
-
-      }
-      prev = &(elt->next);
-    } while ((elt = elt->next));
-
-  }
+  remove_node(m, lv, MAP_HASH(svalue_to_int(lv)));
 }
 
 /*
@@ -515,52 +699,21 @@ void mapping_delete(mapping_t *m, svalue_t *lv)
 svalue_t *
 find_for_insert(mapping_t *m, svalue_t *lv, int doTheFree)
 {
-  int oi = svalue_to_int(lv);
-  unsigned int i = oi & m->table_size;
-  mapping_node_t *n, *newnode, **a = m->table + i;
-
-  debug(mapping, "mapping.c: hashed to %d\n", i);
-  if ((n = *a)) {
-    do {
-      if (msameval(lv, n->values)) {
-        /* normally, the f_assign would free the old value */
-        debug(mapping, "mapping.c: found %p\n", (void *)(n->values));
-        if (doTheFree) { free_svalue(n->values + 1, "find_for_insert"); }
-        return n->values + 1;
-      }
-    } while ((n = n->next));
-    debug(mapping, "mapping.c: didn't find %p\n", (void *)lv);
-    n = *a;
-  } else if (!(--m->unfilled)) {
-    int size = m->table_size + 1;
-
-    if (growMap(m)) {
-      if (oi & size) { i |= size; }
-      n = *(a = m->table + i);
-    } else {
-      error("Out of memory\n");
-    }
+  unsigned int hash = MAP_HASH(svalue_to_int(lv));
+  mapping_node_t *elt = find_node(m, lv, hash);
+
+  if (elt) {
+    /* normally, the f_assign would free the old value */
+    debug(mapping, "mapping.c: found %p\n", (void *)(elt->values));
+    if (doTheFree) { free_svalue(elt->values + 1, "find_for_insert"); }
+    return elt->values + 1;
   }
+  debug(mapping, "mapping.c: didn't find %p\n", (void *)lv);
 
-  m->count++;
-  if (MAP_COUNT(m) > MAX_MAPPING_SIZE) {
-    m->count--;
-    debug(mapping, ("mapping.c: too full"));
-    mapping_too_large();
-  }
-#ifdef PACKAGE_MUDLIB_STATS
-  add_array_size(&m->stats, 2);
-#endif
-  total_mapping_size += sizeof(mapping_node_t);
-  debug(mapping, ("mapping.c: allocated a node\n"));
-  newnode = new_map_node();
-  assign_svalue_no_free(newnode->values, lv);
-  /* insert at head of bucket */
-  (*a = newnode)->next = n;
-  lv = newnode->values + 1;
-  *lv = const0u;
-  total_mapping_nodes++;
-  return lv;
+  elt = add_node(m, hash);
+  assign_svalue_no_free(elt->values, lv);
+  elt->values[1] = const0u;
+  return elt->values + 1;
 }
 
 #ifdef F_UNIQUE_MAPPING
@@ -667,64 +820,29 @@ mapping_t *
 load_mapping_from_aggregate(svalue_t *sp, int n)
 {
   mapping_t *m;
-  int mask, i, oi, count = 0;
-  mapping_node_t **a, *elt, *elt2;
+  unsigned int hash;
+  mapping_node_t *elt;
 
   debug(mapping, "mapping.c: load_mapping_from_aggregate begin, size = %d\n", n);
   m = allocate_mapping(n >> 1);
   if (!n) { return m; }
-  mask = m->table_size;
-  a = m->table;
   do {
-    i = (oi = svalue_to_int(++sp)) & mask;
-    if ((elt2 = elt = a[i])) {
-      do {
-        if (msameval(sp, elt->values)) {
-          free_svalue(sp++, "load_mapping_from_aggregate: duplicate key");
-          free_svalue(elt->values + 1, "load_mapping_from_aggregate");
-          *(elt->values + 1) = *sp;
-          break;
-        }
-      } while ((elt = elt->next));
-      if (elt) { continue; }
-    } else if (!(--m->unfilled)) {
-      if (growMap(m)) {
-        a = m->table;
-        if (oi & ++mask) { elt2 = a[i |= mask]; }
-        mask <<= 1;
-        mask--;
-      } else {
-#ifdef PACKAGE_MUDLIB_STATS
-        add_array_size(&m->stats, count << 1);
-#endif
-        total_mapping_size += sizeof(mapping_node_t) * (m->count = count);
-        total_mapping_nodes += count;
-        free_mapping(m);
-        error("Out of memory\n");
-      }
+    hash = MAP_HASH(svalue_to_int(++sp));
+    if ((elt = find_node(m, sp, hash))) {
+      free_svalue(sp++, "load_mapping_from_aggregate: duplicate key");
+      free_svalue(elt->values + 1, "load_mapping_from_aggregate");
+      *(elt->values + 1) = *sp;
+      continue;
     }
-
-    if (++count > MAX_MAPPING_SIZE) {
-#ifdef PACKAGE_MUDLIB_STATS
-      add_array_size(&m->stats, (--count) << 1);
-#endif
-      total_mapping_size += sizeof(mapping_node_t) * (m->count = count);
-      total_mapping_nodes += count;
-
+    if (MAP_COUNT(m) >= (unsigned)MAX_MAPPING_SIZE) {
       free_mapping(m);
       mapping_too_large();
     }
 
-    elt = new_map_node();
+    elt = add_node(m, hash);
     *elt->values = *sp++;
     *(elt->values + 1) = *sp;
-    (a[i] = elt)->next = elt2;
   } while (n -= 2);
-#ifdef PACKAGE_MUDLIB_STATS
-  add_array_size(&m->stats, count << 1);
-#endif
-  total_mapping_size += sizeof(mapping_node_t) * (m->count = count);
-  total_mapping_nodes += count;
   debug(mapping, ("mapping.c: load_mapping_from_aggregate end\n"));
   return m;
 }
@@ -734,14 +852,11 @@ load_mapping_from_aggregate(svalue_t *sp, int n)
 svalue_t *
 find_in_mapping(mapping_t *m, svalue_t *lv)
 {
-  int i = svalue_to_int(lv) & m->table_size;
-  mapping_node_t *n = m->table[i];
+  mapping_node_t *elt = find_node(m, lv, MAP_HASH(svalue_to_int(lv)));
 
-  while (n) {
-    if (msameval(n->values, lv)) { return n->values + 1; }
-    n = n->next;
+  if (elt) {
+    return elt->values + 1;
   }
-
   return &const0u;
 }
 
@@ -749,178 +864,75 @@ svalue_t *
 find_string_in_mapping(mapping_t *m, const char *p)
 {
   char *ss = findstring(p);
-  int i;
-  mapping_node_t *n;
+  mapping_node_t *elt;
   static svalue_t str = {T_STRING, STRING_SHARED};
   if (!ss) { return &const0u; }
   str.u.string = ss;
-  i = MAP_SVAL_HASH(str);
-  n = m->table[i & m->table_size];
-
-  while (n) {
-    if (n->values->type == T_STRING && n->values->u.string == ss) {
-      return n->values + 1;
-    }
-    n = n->next;
+  elt = find_node(m, &str, MAP_HASH(MAP_SVAL_HASH(str)));
+  if (elt && elt->values->type == T_STRING) {
+    return elt->values + 1;
   }
   return &const0u;
 }
 
 /*
-    add_to_mapping: adds mapping m2 to m1
+    merge_node: adds node elt2 of another mapping to m1.  An existing
+                key gets the new value only if replace is set.
 */
 
 static void
-add_to_mapping(mapping_t *m1, mapping_t *m2, int free_flag)
+merge_node(mapping_t *m1, mapping_node_t *elt2, unsigned int hash,
+           int replace, int free_flag)
 {
-  int mask = m1->table_size, j = m2->table_size;
-  int count = MAP_COUNT(m1);
-  int i, oi;
-  mapping_node_t *elt1, *elt2, *newnode, *n;
-  mapping_node_t **a1 = m1->table, **a2 = m2->table;
-  svalue_t *sv;
+  mapping_node_t *elt1 = find_node(m1, elt2->values, hash);
 
-  do {
-    for (elt2 = a2[j]; elt2; elt2 = elt2->next) {
-      i = (oi = node_hash(elt2)) & mask;
-      sv = elt2->values;
-      if ((n = elt1 = a1[i])) {
-        do {
-          if (msameval(sv, elt1->values)) {
-            assign_svalue(elt1->values + 1, sv + 1);
-            break;
-          }
-        } while ((elt1 = elt1->next));
-        if (elt1) { continue; }
-      } else if (!(--m1->unfilled)) {
-        if (growMap(m1)) {
-          a1 = m1->table;
-          if (oi & ++mask) { n = a1[i |= mask]; }
-          mask <<= 1;
-          mask--;
-        } else {
-          count -= MAP_COUNT(m1);
-#ifdef PACKAGE_MUDLIB_STATS
-          add_array_size(&m1->stats, count << 1);
-#endif
-          total_mapping_size += count * sizeof(mapping_node_t);
-          total_mapping_nodes += count;
-          m1->count += count;
-          if (free_flag) { free_mapping(m1); }
-          error("Out of memory\n");
-        }
-      }
-      count++;
-      if (count > MAX_MAPPING_SIZE) {
-        if (count -= MAP_COUNT(m1) + 1) {
-#ifdef PACKAGE_MUDLIB_STATS
-          add_array_size(&m1->stats, count << 1);
-#endif
-          total_mapping_size += count * sizeof(mapping_node_t);
-          total_mapping_nodes += count;
-        }
-        m1->count += count;
-        mapping_too_large();
-      }
-
-      newnode = new_map_node();
-      assign_svalue_no_free(newnode->values, elt2->values);
-      assign_svalue_no_free(newnode->values + 1, elt2->values + 1);
-      (a1[i] = newnode)->next = n;
+  if (elt1) {
+    if (replace) {
+      assign_svalue(elt1->values + 1, elt2->values + 1);
     }
-  } while (j--);
-
-  if (count -= MAP_COUNT(m1)) {
-#ifdef PACKAGE_MUDLIB_STATS
-    add_array_size(&m1->stats, count << 1);
-#endif
-    total_mapping_size += count * sizeof(mapping_node_t);
-    total_mapping_nodes += count;
+    return;
+  }
+  if (MAP_COUNT(m1) >= (unsigned)MAX_MAPPING_SIZE) {
+    if (free_flag) { free_mapping(m1); }
+    mapping_too_large();
   }
 
-  m1->count += count;
+  elt1 = add_node(m1, hash);
+  assign_svalue_no_free(elt1->values, elt2->values);
+  assign_svalue_no_free(elt1->values + 1, elt2->values + 1);
 }
 
 /*
-    unique_add_to_mapping : adds m2 to m1 but doesn't do anything
-                            if they have common keys
+    add_to_mapping: adds mapping m2 to m1.  With unique set, keys that
+                    m1 has already are left alone.
 */
 
 static void
-unique_add_to_mapping(mapping_t *m1, mapping_t *m2, int free_flag)
+add_to_mapping(mapping_t *m1, mapping_t *m2, int unique, int free_flag)
 {
-  int mask = m1->table_size, j = m2->table_size;
-  int count = MAP_COUNT(m1);
-  int i, oi;
-  mapping_node_t *elt1, *elt2, *newnode, *n;
-  mapping_node_t **a1 = m1->table, **a2 = m2->table;
-  svalue_t *sv;
-
-  do {
-    for (elt2 = a2[j]; elt2; elt2 = elt2->next) {
-      i = (oi = node_hash(elt2)) & mask;
-      sv = elt2->values;
-      if ((n = elt1 = a1[i])) {
-        do {
-          if (msameval(sv, elt1->values)) { break; }
-        } while ((elt1 = elt1->next));
-        if (elt1) { continue; }
-      } else if (!(--m1->unfilled)) {
-        if (growMap(m1)) {
-          a1 = m1->table;
-          if (oi & ++mask) { n = a1[i |= mask]; }
-          mask <<= 1;
-          mask--;
-        } else {
-          ++m1->unfilled;
-          count -= MAP_COUNT(m1);
-#ifdef PACKAGE_MUDLIB_STATS
-          add_array_size(&m1->stats, count << 1);
-#endif
-          total_mapping_size += count * sizeof(mapping_node_t);
-          total_mapping_nodes += count;
-          m1->count += count;
-          if (free_flag) { free_mapping(m1); }
-
-          error("Out of memory\n");
-        }
-      }
-
-      if (++count > MAX_MAPPING_SIZE) {
-        if (count -= MAP_COUNT(m1) + 1) {
-#ifdef PACKAGE_MUDLIB_STATS
-          add_array_size(&m1->stats, count << 1);
-#endif
-          total_mapping_size += count * sizeof(mapping_node_t);
-          total_mapping_nodes += count;
-        }
-        m1->count += count;
-        mapping_too_large();
-      }
+  unsigned int j;
+  mapping_slot_t *a2 = m2->table;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt2;
 
-      newnode = new_map_node();
-      assign_svalue_no_free(newnode->values, elt2->values);
-      assign_svalue_no_free(newnode->values + 1, elt2->values + 1);
-      (a1[i] = newnode)->next = n;
+  if (!a2) {
+    MAP_NODE_LOOP(m2, mnb, elt2) {
+      merge_node(m1, elt2, node_hash(elt2), !unique, free_flag);
+    }
+    return;
+  }
+  for (j = 0; j <= m2->table_size; j++) {
+    if (a2[j].node) {
+      merge_node(m1, a2[j].node, a2[j].hash, !unique, free_flag);
     }
-  } while (j--);
-
-  if (count -= MAP_COUNT(m1)) {
-#ifdef PACKAGE_MUDLIB_STATS
-    add_array_size(&m1->stats, count << 1);
-#endif
-    total_mapping_size += count * sizeof(mapping_node_t);
-    total_mapping_nodes += count;
   }
-
-  m1->count += count;
 }
 
 void absorb_mapping(mapping_t *m1, mapping_t *m2)
 {
   if (MAP_COUNT(m2)) {
     if (m1 != m2) {
-      add_to_mapping(m1, m2, 0);
+      add_to_mapping(m1, m2, 0, 0);
     }
   }
 }
@@ -938,11 +950,11 @@ add_mapping(mapping_t *m1, mapping_t *m2)
   debug(mapping, "mapping.c: add_mapping begin: %p, %p", (void *)m1, (void *)m2);
   if (MAP_COUNT(m1) >= MAP_COUNT(m2)) {
     if (MAP_COUNT(m2)) {
-      add_to_mapping(newmap = copyMapping(m1), m2, 1);
+      add_to_mapping(newmap = copyMapping(m1), m2, 0, 1);
       return newmap;
     } else { return copyMapping(m1); }
   } else if (MAP_COUNT(m1)) {
-    unique_add_to_mapping(newmap = copyMapping(m2), m1, 1);
+    add_to_mapping(newmap = copyMapping(m2), m1, 1, 1);
     return newmap;
   } else { return copyMapping(m2); }
   debug(mapping, ("mapping.c: add_mapping end\n"));
@@ -958,8 +970,8 @@ void
 map_mapping(svalue_t *arg, int num_arg)
 {
   mapping_t *m;
-  mapping_node_t **a, *elt;
-  int j;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
   svalue_t *ret;
   function_to_call_t ftc;
 
@@ -973,18 +985,14 @@ map_mapping(svalue_t *arg, int num_arg)
     m = arg->u.map;
   }
 
-  j = m->table_size;
-  a = m->table;
   debug(mapping, ("mapping.c: map_mapping\n"));
-  do {
-    for (elt = a[j]; elt ; elt = elt->next) {
-      push_svalue(elt->values);
-      push_svalue(elt->values + 1);
-      ret = call_efun_callback(&ftc, 2);
-      if (ret) { assign_svalue(elt->values + 1, ret); }
-      else { break; }
-    }
-  } while (j--);
+  MAP_NODE_LOOP(m, mnb, elt) {
+    push_svalue(elt->values);
+    push_svalue(elt->values + 1);
+    ret = call_efun_callback(&ftc, 2);
+    if (ret) { assign_svalue(elt->values + 1, ret); }
+    else { break; }
+  }
 
   pop_n_elems(num_arg - 1);
 }
@@ -995,11 +1003,9 @@ void
 filter_mapping(svalue_t *arg, int num_arg)
 {
   mapping_t *m, *newmap;
-  mapping_node_t **a, *elt;
-  mapping_node_t **b, *newnode, *n;
-  int j, count = 0, size;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt, *newnode;
   svalue_t *ret;
-  unsigned int tb_index;
   function_to_call_t ftc;
 
   process_efun_callback(1, &ftc, F_FILTER);
@@ -1014,63 +1020,20 @@ filter_mapping(svalue_t *arg, int num_arg)
 
   newmap = allocate_mapping(0);
   push_refed_mapping(newmap);
-  b = newmap->table;
-  size = newmap->table_size;
 
-  a = m->table;
-  j = m->table_size;
   debug(mapping, ("mapping.c: filter_mapping\n"));
-  do {
-    for (elt = a[j]; elt ; elt = elt->next) {
-      push_svalue(elt->values);
-      push_svalue(elt->values + 1);
-      ret = call_efun_callback(&ftc, 2);
-      if (!ret) { break; }
-      else if (ret->type != T_NUMBER || ret->u.number) {
-        tb_index = node_hash(elt) & size;
-        b = newmap->table + tb_index;
-        if (!(n = *b) && !(--newmap->unfilled)) {
-          if (growMap(newmap)) {
-            size = newmap->table_size;
-            tb_index = node_hash(elt) & size;
-            n = *(b = newmap->table + tb_index);
-          } else {
-#ifdef PACKAGE_MUDLIB_STATS
-            add_array_size(&newmap->stats, count << 1);
-#endif
-            total_mapping_size += count * sizeof(mapping_node_t);
-            total_mapping_nodes += count;
-            newmap->count = count;
-            error("Out of memory in filter_mapping\n");
-          }
-        }
-        if (++count > MAX_MAPPING_SIZE) {
-          count--;
-#ifdef PACKAGE_MUDLIB_STATS
-          add_array_size(&newmap->stats, count << 1);
-#endif
-          total_mapping_size += count * sizeof(mapping_node_t);
-          total_mapping_nodes += count;
-          newmap->count = count;
-          mapping_too_large();
-        }
-
-        newnode = new_map_node();
-        assign_svalue_no_free(newnode->values, elt->values);
-        assign_svalue_no_free(newnode->values + 1, elt->values + 1);
-        (*b = newnode)->next = n;
-      }
+  MAP_NODE_LOOP(m, mnb, elt) {
+    push_svalue(elt->values);
+    push_svalue(elt->values + 1);
+    ret = call_efun_callback(&ftc, 2);
+    if (!ret) { goto done; }
+    else if (ret->type != T_NUMBER || ret->u.number) {
+      newnode = add_node(newmap, node_hash(elt));
+      assign_svalue_no_free(newnode->values, elt->values);
+      assign_svalue_no_free(newnode->values + 1, elt->values + 1);
     }
-  } while (j--);
-
-  if (count) {
-#ifdef PACKAGE_MUDLIB_STATS
-    add_array_size(&newmap->stats, count << 1);
-#endif
-    total_mapping_size += count * sizeof(mapping_node_t);
-    total_mapping_nodes += count;
-    newmap->count += count;
   }
+done:
 
   sp--;
   pop_n_elems(num_arg);
@@ -1083,46 +1046,25 @@ filter_mapping(svalue_t *arg, int num_arg)
 mapping_t *
 compose_mapping(mapping_t *m1, mapping_t *m2, unsigned short flag)
 {
-  mapping_node_t *elt, *elt2, **a, **b = m2->table, **prev;
-  unsigned int j = m1->table_size, deleted = 0;
-  unsigned int mask = m2->table_size;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
+  mapping_node_t *elt2;
   svalue_t *sv;
 
   debug(mapping, ("mapping.c: compose_mapping\n"));
   if (flag) {
     m1 = copyMapping(m1);
   }
-  a = m1->table;
 
-  do {
-    if ((elt = *(prev = a))) {
-      do {
-        sv = elt->values + 1;
-        if ((elt2 = b[svalue_to_int(sv) & mask])) {
-          do {
-            if (msameval(sv, elt2->values)) {
-              if (sv != elt2->values + 1) { /* if m1 == m2 */
-                assign_svalue(sv, elt2->values + 1);
-              }
-              break;
-            }
-          } while ((elt2 = elt2->next));
-        }
-        if (!elt2) {
-          if (!(*prev = elt->next) && !(*a)) { m1->unfilled++; }
-          deleted++;
-          free_node(m1, elt);
-        } else {
-          prev = &(elt->next);
-        }
-      } while ((elt = *prev));
+  MAP_NODE_LOOP(m1, mnb, elt) {
+    sv = elt->values + 1;
+    if ((elt2 = find_node(m2, sv, MAP_HASH(svalue_to_int(sv))))) {
+      if (sv != elt2->values + 1) { /* if m1 == m2 */
+        assign_svalue(sv, elt2->values + 1);
+      }
+    } else {
+      remove_node(m1, elt->values, node_hash(elt));
     }
-  } while (a++, j--);
-
-  if (deleted) {
-    m1->count -= deleted;
-    total_mapping_nodes -= deleted;
-    total_mapping_size -= deleted * sizeof(mapping_node_t);
   }
 
   return m1;
@@ -1134,19 +1076,17 @@ array_t *
 mapping_indices(mapping_t *m)
 {
   array_t *v;
-  int j = m->table_size;
-  mapping_node_t *elt, **a = m->table;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
   svalue_t *sv;
 
   debug(mapping, "mapping_indices: size = %d\n", MAP_COUNT(m));
 
   v = allocate_empty_array(MAP_COUNT(m));
   sv = v->item;
-  do {
-    for (elt = a[j]; elt; elt = elt->next) {
-      assign_svalue_no_free(sv++, elt->values);
-    }
-  } while (j--);
+  MAP_NODE_LOOP(m, mnb, elt) {
+    assign_svalue_no_free(sv++, elt->values);
+  }
   return v;
 }
 
@@ -1156,19 +1096,17 @@ array_t *
 mapping_values(mapping_t *m)
 {
   array_t *v;
-  int j = m->table_size;
-  mapping_node_t *elt, **a = m->table;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
   svalue_t *sv;
 
   debug(mapping, "mapping_values: size = %d\n", MAP_COUNT(m));
 
   v = allocate_empty_array(MAP_COUNT(m));
   sv = v->item;
-  do {
-    for (elt = a[j]; elt; elt = elt->next) {
-      assign_svalue_no_free(sv++, elt->values + 1);
-    }
-  } while (j--);
+  MAP_NODE_LOOP(m, mnb, elt) {
+    assign_svalue_no_free(sv++, elt->values + 1);
+  }
   return v;
 }
 
@@ -1240,6 +1178,17 @@ void add_mapping_array(mapping_t *m, const char *key, array_t *value)
   value->ref++;
 }
 
+void add_mapping_mapping(mapping_t *m, const char *key, mapping_t *value)
+{
+  svalue_t *s;
+
+  s = insert_in_mapping(m, key);
+  s->type = T_MAPPING;
+  s->subtype = 0;
+  s->u.map = value;
+  value->ref++;
+}
+
 void add_mapping_shared_string(mapping_t *m, const char *key, char *value)
 {
   svalue_t *s;
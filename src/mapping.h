@@ -12,19 +12,41 @@
 //#define MAP_SVAL_HASH(x) (((POINTER_INT)((x).u.number)) >> 5)
 LPC_INT sval_hash(svalue_t);
 
+/*
+ * A key and its value.  Nodes are kept in blocks that belong to the
+ * mapping and never move, so a pointer to a value stays good while the
+ * node is in the mapping; lvalues and refs rely on that.  A node that
+ * isn't in use has a T_INVALID key.
+ */
 typedef struct mapping_node_s {
-  struct mapping_node_s *next;
   svalue_t values[2];
 } mapping_node_t;
 
-#define MNB_SIZE 256
+#define MAP_NODE_FREE(elt) ((elt)->values[0].type == T_INVALID)
 
 typedef struct mapping_node_block_s {
   struct mapping_node_block_s *next;
-  mapping_node_t nodes[MNB_SIZE];
+  unsigned int size;          /* # of nodes in the block */
+  unsigned int used;          /* # of nodes handed out so far */
+  mapping_node_t nodes[1];
 } mapping_node_block_t;
 
+/*
+ * Mappings with up to MAP_SMALL_SIZE keys have no hash table, a lookup
+ * compares the key with each of their nodes.  The table is made when a
+ * key more is added, and stays.
+ *
+ * One entry of the open addressed hash table.  Collisions are resolved
+ * by linear probing with Robin Hood insertion, and the hash of the key
+ * is cached here so probing and growing never have to look at the key.
+ */
+typedef struct mapping_slot_s {
+  unsigned int hash;
+  mapping_node_t *node;       /* 0 if the slot is empty */
+} mapping_slot_t;
+
 #define MAP_HASH_TABLE_SIZE 8   /* must be a power of 2 */
+#define MAP_SMALL_SIZE 8        /* # of keys a mapping holds without a table */
 #define FILL_PERCENT 80         /* must not be larger than 99 */
 
 #define MAPSIZE(size) sizeof(mapping_t)
@@ -38,15 +60,27 @@ typedef struct mapping_s {
 #ifdef DEBUGMALLOC_EXTENSIONS
   int extra_ref;
 #endif
-  mapping_node_t **table;     /* the hash table */
-  unsigned int table_size;  /* # of buckets in hash table == power of 2 */
-  unsigned int unfilled;    /* # of buckets among 80% of total buckets that do not have entries */
+  mapping_slot_t *table;      /* the hash table, 0 while the mapping is small */
+  unsigned int table_size;    /* # of slots in hash table - 1, slots == power of 2;
+                                 * while small, # of nodes in the first block */
+  unsigned int unfilled;      /* # of keys that can be added before the table grows */
   unsigned int count;         /* total # of nodes actually in mapping  */
+  mapping_node_block_t *blocks; /* the nodes, newest block first */
+  mapping_node_t *free_nodes; /* deleted nodes, ready for reuse */
 #ifdef PACKAGE_MUDLIB_STATS
   statgroup_t stats;          /* creators of the mapping */
 #endif
 } mapping_t;
 
+/*
+ * Walks the nodes in use of mapping m, newest block first.  The node
+ * being looked at may be deleted; 'break' only leaves the inner loop.
+ */
+#define MAP_NODE_LOOP(m, b, elt) \
+  for ((b) = (m)->blocks; (b); (b) = (b)->next) \
+    for ((elt) = (b)->nodes; (elt) < (b)->nodes + (b)->used; (elt)++) \
+      if (!MAP_NODE_FREE(elt))
+
 typedef struct finfo_s {
   char *func;
   object_t *obj;
@@ -70,9 +104,9 @@ typedef struct minfo_s {
  * mapping.c
  */
 extern int num_mappings;
+extern int num_small_mappings;
 extern int total_mapping_size;
 extern int total_mapping_nodes;
-extern mapping_node_t *locked_map_nodes;
 
 int msameval(svalue_t *, svalue_t *);
 int mapping_save_size(mapping_t *);
@@ -87,10 +121,8 @@ svalue_t *find_for_insert(mapping_t *, svalue_t *, int);
 void absorb_mapping(mapping_t *, mapping_t *);
 void mapping_delete(mapping_t *, svalue_t *);
 mapping_t *add_mapping(mapping_t *, mapping_t *);
-mapping_node_t *new_map_node(void);
 int restore_hash_string(char **str, svalue_t *);
 int growMap(mapping_t *);
-void free_node(mapping_t *, mapping_node_t *);
 void unlock_mapping(mapping_t *);
 void map_mapping(svalue_t *, int);
 void filter_mapping(svalue_t *, int);
@@ -100,7 +132,6 @@ array_t *mapping_values(mapping_t *);
 array_t *mapping_each(mapping_t *);
 char *save_mapping(mapping_t *);
 void dealloc_mapping(mapping_t *);
-void mark_mapping_node_blocks(void);
 mapping_t *mkmapping(array_t *, array_t *);
 LPC_INT svalue_to_int(svalue_t *);
 void add_mapping_pair(mapping_t *, const char *, long);
@@ -108,6 +139,7 @@ void add_mapping_string(mapping_t *, const char *, const char *);
 void add_mapping_malloced_string(mapping_t *, const char *, char *);
 void add_mapping_object(mapping_t *, const char *, object_t *);
 void add_mapping_array(mapping_t *, const char *, array_t *);
+void add_mapping_mapping(mapping_t *, const char *, mapping_t *);
 void add_mapping_shared_string(mapping_t *, const char *, char *);
 
 #endif                          /* _MAPPING_H */
@@ -17,6 +17,9 @@
 #ifdef PACKAGE_PARSER
 #include "packages/parser.h"
 #endif
+#ifdef PACKAGE_ASYNC
+#include "packages/async.h"
+#endif
 
 /*
    note: do not use MALLOC() etc. in this module.  Unbridled recursion
@@ -57,7 +60,8 @@ static const char *sources[] = {
   "compiler local blocks", "compiled program", "users", "debugmalloc overhead",
   "heart_beat list", "parser", "input_to", "sockets",
   "strings", "malloc strings", "shared strings", "function pointers", "arrays",
-  "mappings", "mapping nodes", "mapping tables", "buffers", "classes"
+  "mappings", "mapping nodes", "mapping tables", "buffers", "classes",
+  "reset queue", "call sites", "function lookup tables", "apply cache"
 };
 
 int malloc_mask = 121;
@@ -386,6 +390,17 @@ static void mark_funp(funptr_t *fp)
     case FP_FUNCTIONAL | FP_NOT_BINDABLE:
       fp->f.functional.prog->extra_func_ref++;
       break;
+    case FP_EFUN:
+      if (fp->f.efun.site) {
+        int i;
+
+        DO_MARK(fp->f.efun.site, TAG_CALL_SITES);
+        for (i = 0; i < CALL_SITE_WAYS; i++)
+          if (fp->f.efun.site->entries[i].name) {
+            EXTRA_REF(BLOCK(fp->f.efun.site->entries[i].name))++;
+          }
+      }
+      break;
   }
 }
 
@@ -496,8 +511,6 @@ void mark_sockets(void)
 #endif
 
 #ifdef STRING_STATS
-static int base_overhead = 0;
-
 /* Compute the correct values of allocd_strings, allocd_bytes, and
  * bytes_distinct_strings based on blocks that are actually allocated.
  */
@@ -561,10 +574,8 @@ void check_string_stats(outbuffer_t *out)
 
   compute_string_totals(&as, &ab, &bytes);
 
-  if (!base_overhead) {
-    base_overhead = overhead_bytes - overhead;
-  }
-  overhead += base_overhead;
+  /* the shared string table(s) */
+  overhead += totals[TAG_STR_TBL & 0xff];
 
   if (num != num_distinct_strings) {
     need_dump = 1;
@@ -592,10 +603,10 @@ void check_string_stats(outbuffer_t *out)
     need_dump = 1;
     if (out) {
       outbuf_addv(out, "WARNING: bytes_distinct_strings is: %i should be: %i\n",
-                  bytes_distinct_strings, bytes - (overhead - base_overhead));
+                  bytes_distinct_strings, bytes);
     } else {
       printf("WARNING: bytes_distinct_strings is: %i should be: %i\n",
-             bytes_distinct_strings, bytes - (overhead - base_overhead));
+             bytes_distinct_strings, bytes);
       abort();
     }
   }
@@ -642,6 +653,7 @@ void check_all_blocks(int flag)
 #endif
   funptr_t *fp;
   mapping_node_t *node;
+  mapping_node_block_t *nodes;
   program_t *prog;
   sentence_t *sent;
   char *ptr;
@@ -762,8 +774,8 @@ void check_all_blocks(int flag)
     if (blocks[TAG_CONFIG & 0xff] > 1) {
       outbuf_add(&out, "WARNING: more than config file table allocated.\n");
     }
-    if (blocks[TAG_STR_TBL & 0xff] > 1) {
-      outbuf_add(&out, "WARNING: more than string table allocated.\n");
+    if (blocks[TAG_STR_TBL & 0xff] > 2) {
+      outbuf_add(&out, "WARNING: more than two string tables allocated.\n");
     }
     {
       int a = totals[TAG_CALL_OUT & 0xff];
@@ -806,9 +818,9 @@ void check_all_blocks(int flag)
     if (blocks[TAG_MAPPING & 0xff] != num_mappings)
       outbuf_addv(&out, "WARNING: num_mappings is: %i should be: %i\n",
                   num_mappings, blocks[TAG_MAPPING & 0xff]);
-    if (blocks[TAG_MAP_TBL & 0xff] != num_mappings)
-      outbuf_addv(&out, "WARNING: %i tables for %i mappings\n",
-                  blocks[TAG_MAP_TBL & 0xff], num_mappings);
+    if (blocks[TAG_MAP_TBL & 0xff] != num_mappings - num_small_mappings)
+      outbuf_addv(&out, "WARNING: %i tables for %i mappings, %i small\n",
+                  blocks[TAG_MAP_TBL & 0xff], num_mappings, num_small_mappings);
     if (blocks[TAG_INTERACTIVE & 0xff] != num_user)
       outbuf_addv(&out, "WATNING: num_user is: %i should be: %i\n",
                   num_user, blocks[TAG_INTERACTIVE & 0xff]);
@@ -848,6 +860,12 @@ void check_all_blocks(int flag)
           DO_MARK(all_users[i]->compressed_stream, TAG_INTERACTIVE);
         }
 #endif
+#ifdef HAVE_ZLIB
+        if (all_users[i]->ws_deflate) {
+          DO_MARK(all_users[i]->ws_deflate, TAG_INTERACTIVE);
+          DO_MARK(all_users[i]->ws_inflate, TAG_INTERACTIVE);
+        }
+#endif
 
 #ifndef NO_ADD_ACTION
         if (all_users[i]->iflags & NOTIFY_FAIL_FUNC) {
@@ -886,9 +904,11 @@ void check_all_blocks(int flag)
     mark_stack();
     mark_command_giver_stack();
     mark_call_outs();
+#ifdef PACKAGE_ASYNC
+    mark_async_reqs();
+#endif
     mark_simuls();
     mark_apply_low_cache();
-    mark_mapping_node_blocks();
     mark_config();
 
     mark_svalue(&apply_ret_value);
@@ -951,15 +971,20 @@ void check_all_blocks(int flag)
             break;
           case TAG_MAPPING:
             map = NODET_TO_PTR(entry, mapping_t *);
-            DO_MARK(map->table, TAG_MAP_TBL);
+            if (map->table) {
+              DO_MARK(map->table, TAG_MAP_TBL);
+            }
 
-            i = map->table_size;
-            do {
-              for (node = map->table[i]; node; node = node->next) {
-                mark_svalue(node->values);
+            for (nodes = map->blocks; nodes; nodes = nodes->next) {
+              DO_MARK(nodes, TAG_MAP_NODE_BLOCK);
+              for (node = nodes->nodes; node < nodes->nodes + nodes->used; node++) {
+                if (!MAP_NODE_FREE(node)) {
+                  mark_svalue(node->values);
+                }
+                /* values of nodes deleted from a locked mapping live on */
                 mark_svalue(node->values + 1);
               }
-            } while (i--);
+            }
             break;
           case TAG_OBJECT:
             ob = NODET_TO_PTR(entry, object_t *);
@@ -1024,6 +1049,21 @@ void check_all_blocks(int flag)
             }
 
             EXTRA_REF(BLOCK(prog->filename))++;
+
+            if (prog->func_lookup) {
+              DO_MARK(prog->func_lookup, TAG_FUNC_LOOKUP);
+            }
+
+            if (prog->call_sites) {
+              int j;
+
+              DO_MARK(prog->call_sites, TAG_CALL_SITES);
+              for (i = 0; i < prog->num_call_sites; i++)
+                for (j = 0; j < CALL_SITE_WAYS; j++)
+                  if (prog->call_sites[i].entries[j].name) {
+                    EXTRA_REF(BLOCK(prog->call_sites[i].entries[j].name))++;
+                  }
+            }
         }
       }
     }
@@ -1148,6 +1188,7 @@ void check_all_blocks(int flag)
           case TAG_CALL_OUT:
           case TAG_USERS:
           case TAG_HEART_BEAT:
+          case TAG_RESET:
           case TAG_INPUT_TO:
             break;
           default:
@@ -85,19 +85,18 @@ int svalue_save_size(svalue_t *v)
     }
 
     case T_MAPPING: {
-      mapping_node_t **a = v->u.map->table, *elt;
-      int j = v->u.map->table_size, size = 0;
+      mapping_node_block_t *mnb;
+      mapping_node_t *elt;
+      int size = 0;
 
       if (++save_svalue_depth > MAX_SAVE_SVALUE_DEPTH) {
         save_svalue_depth = 0;
         too_deep_save_error();
       }
-      do {
-        for (elt = a[j]; elt; elt = elt->next) {
-          size += svalue_save_size(elt->values) +
-                  svalue_save_size(elt->values + 1);
-        }
-      } while (j--);
+      MAP_NODE_LOOP(v->u.map, mnb, elt) {
+        size += svalue_save_size(elt->values) +
+                svalue_save_size(elt->values + 1);
+      }
       save_svalue_depth--;
       return size + 5;
     }
@@ -183,19 +182,17 @@ void save_svalue(svalue_t *v, char **buf)
     }
 
     case T_MAPPING: {
-      int j = v->u.map->table_size;
-      mapping_node_t **a = v->u.map->table, *elt;
+      mapping_node_block_t *mnb;
+      mapping_node_t *elt;
 
       *(*buf)++ = '(';
       *(*buf)++ = '[';
-      do {
-        for (elt = a[j]; elt; elt = elt->next) {
-          save_svalue(elt->values, buf);
-          *(*buf)++ = ':';
-          save_svalue(elt->values + 1, buf);
-          *(*buf)++ = ',';
-        }
-      } while (j--);
+      MAP_NODE_LOOP(v->u.map, mnb, elt) {
+        save_svalue(elt->values, buf);
+        *(*buf)++ = ':';
+        save_svalue(elt->values + 1, buf);
+        *(*buf)++ = ',';
+      }
 
       *(*buf)++ = ']';
       *(*buf)++ = ')';
@@ -530,25 +527,13 @@ static int parse_numeric(char **cpp, unsigned char c, svalue_t *dest)
   }
 }
 
-static void add_map_stats(mapping_t *m, int count)
-{
-  total_mapping_nodes += count;
-  total_mapping_size += count * sizeof(mapping_node_t);
-#ifdef PACKAGE_MUDLIB_STATS
-  add_array_size(&m->stats, count << 1);
-#endif
-  m->count = count;
-}
-
 static int
 restore_mapping(char **str, svalue_t *sv)
 {
-  int size, i, mask, count = 0;
-  unsigned long oi;
+  int size;
   char c;
   mapping_t *m;
-  svalue_t key, value;
-  mapping_node_t **a, *elt, *elt2;
+  svalue_t key, value, *elt;
   char *cp = *str;
   int err;
 
@@ -562,8 +547,7 @@ restore_mapping(char **str, svalue_t *sv)
     return 0;
   }
   m = allocate_mapping(size >> 1); /* have to clean up after this or */
-  a = m->table;                    /* we'll leak */
-  mask = m->table_size;
+                                   /* we'll leak */
 
   while (1) {
     switch (c = *cp++) {
@@ -609,7 +593,6 @@ restore_mapping(char **str, svalue_t *sv)
 
       case ']':
         *str = ++cp;
-        add_map_stats(m, count);
         sv->type = T_MAPPING;
         sv->u.map = m;
         return 0;
@@ -684,67 +667,34 @@ restore_mapping(char **str, svalue_t *sv)
 
     /* both key and value are valid, referenced svalues */
 
-    oi = MAP_SVAL_HASH(key);
-    i = oi & mask;
-    if ((elt2 = elt = a[i])) {
-      do {
-        /* This should never happen, but don't bail on it */
-        if (msameval(&key, elt->values)) {
-          free_svalue(&key, "restore_mapping: duplicate key");
-          free_svalue(elt->values + 1, "restore_mapping: replaced value");
-          *(elt->values + 1) = value;
-          break;
-        }
-      } while ((elt = elt->next));
-      if (elt) {
-        continue;
-      }
-    } else if (!(--m->unfilled)) {
-      if (growMap(m)) {
-        a = m->table;
-        if (oi & ++mask) { elt2 = a[i |= mask]; }
-        mask <<= 1;
-        mask--;
-      } else {
-        add_map_stats(m, count);
-        free_mapping(m);
-        free_svalue(&key, "restore_mapping: out of memory");
-        free_svalue(&value, "restore_mapping: out of memory");
-        error("Out of memory\n");
-      }
-    }
-
-    if (++count > MAX_MAPPING_SIZE) {
-      add_map_stats(m, count - 1);
+    if (MAP_COUNT(m) >= (unsigned)MAX_MAPPING_SIZE &&
+        find_in_mapping(m, &key) == &const0u) {
       free_mapping(m);
       free_svalue(&key, "restore_mapping: mapping too large");
       free_svalue(&value, "restore_mapping: mapping too large");
       mapping_too_large();
     }
 
-    elt = new_map_node();
-    *elt->values = key;
-    *(elt->values + 1) = value;
-    (a[i] = elt)->next = elt2;
+    /* a duplicate key should never happen, but don't bail on it */
+    elt = find_for_insert(m, &key, 1);
+    free_svalue(&key, "restore_mapping");
+    *elt = value;
   }
 
   /* something went wrong */
 value_numeral_error:
   free_svalue(&key, "restore_mapping: numeral value error");
 key_numeral_error:
-  add_map_stats(m, count);
   free_mapping(m);
   return ROB_NUMERAL_ERROR;
 generic_value_error:
   free_svalue(&key, "restore_mapping: generic value error");
 generic_key_error:
-  add_map_stats(m, count);
   free_mapping(m);
   return ROB_MAPPING_ERROR;
 value_error:
   free_svalue(&key, "restore_mapping: value error");
 key_error:
-  add_map_stats(m, count);
   free_mapping(m);
   return err;
 }
@@ -1142,6 +1092,7 @@ restore_object_from_line(object_t *ob, char *line, int noclear)
   if (line[0] == '#') { /* ignore 'comments' in savefiles */
     return ;
   }
+  ob->reclaim_flags |= O_RECLAIM_DIRTY;
   space = strchr(line, ' ');
   if (!space || ((space - line) >= sizeof(var))) {
     error("restore_object(): Illegal file format - 1 (%s).\n", line);
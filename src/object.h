@@ -57,6 +57,10 @@
  * Note: use of more than 16 bits means extending flags to an unsigned long
  */
 
+/* reclaim_flags */
+#define O_RECLAIM_DIRTY         0x01    /* a variable was assigned since the last reclaim */
+#define O_RECLAIM_REFS          0x02    /* variables may refer to other objects */
+
 typedef struct sentence_s {
 #ifndef NO_ADD_ACTION
   char *verb;
@@ -82,6 +86,8 @@ typedef struct object_s {
   int next_reset;             /* Time of next reset of this object */
 #endif
   int time_of_ref;            /* Time when last referenced. Used by clean_uo */
+  int reset_index;            /* Position in the reset queue, 0 if not queued */
+  unsigned char reclaim_flags;  /* O_RECLAIM_*, see reclaim.cc */
   program_t *prog;
   struct object_s *next_all;
   struct object_s *prev_all;
@@ -117,6 +123,7 @@ typedef struct object_s {
 #ifdef PACKAGE_PARSER
   struct parse_info_s *pinfo;
 #endif
+  struct pending_call_s *call_outs;  /* pending call outs owned by us */
   svalue_t variables[1];      /* All variables to this program */
   /* The variables MUST come last in the struct */
 } object_t;
@@ -66,6 +66,7 @@ operator not, negate, compl;
 
 operator function_constructor;
 operator simul_efun;
+operator call_other_site;
 
 operator sscanf;
 operator parse_command;
@@ -74,3 +75,17 @@ operator new_class, new_empty_class;
 operator expand_varargs;
 operator type_check;
 
+
+/* fused opcodes; selected from profile data, see superinstructions.spec */
+#ifdef SUPERINSTRUCTIONS
+#include "superinstructions.spec"
+#endif
+
+/* operators for operands of known type, see TYPED_OPCODES */
+#ifdef TYPED_OPCODES
+operator int_add, int_subtract, int_multiply;
+operator int_eq, int_ne, int_le, int_lt, int_ge, int_gt;
+operator real_add, real_subtract, real_multiply, real_divide;
+operator real_le, real_lt, real_ge, real_gt;
+operator array_index, mapping_index;
+#endif
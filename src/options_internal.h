@@ -50,18 +50,48 @@
 #define ARRAY_STATS
 #define CLASS_STATS
 
-/* APPLY_CACHE_BITS: defines the number of bits to use in the func lookup cache
- *   (in interpret.c).
+/* APPLY_CACHE_BITS: the default number of entries in the func lookup cache
+ *   (in interpret.c) is 1 << APPLY_CACHE_BITS, used when the config file
+ *   has no "apply cache size" line.  Each entry takes 48 bytes.
  *
- *   22 bites : (1  << 22) * (3 * 8 + 2 * 2) ~= 112MB.
+ *   14 bits : (1 << 14) * 48 ~= 768KB.
  */
-#define APPLY_CACHE_BITS 22
+#define APPLY_CACHE_BITS 14
 
 /* CACHE_STATS: define this if you want call_other (apply_low) cache
  * statistics.  Causes HAS_CACHE_STATS to be defined in all LPC objects.
  */
 #define CACHE_STATS
 
+/* BINARIES: save compiled programs in the "save binaries directory" of the
+ *   config file, and load objects from there instead of compiling while
+ *   their source, includes and inherits are unchanged.  Adds the
+ *   flush_program_cache() efun.  No programs are saved if the config file
+ *   doesn't name a directory, and only programs the master's
+ *   valid_save_binary() approves are saved or loaded.
+ */
+#define BINARIES
+
+/* SAMPLING_PROFILER: adds the start_profiler() and stop_profiler() efuns
+ *   and the "profile" console command.  While running, the LPC call stack
+ *   is sampled on a CPU time timer and stop_profiler() returns how often
+ *   each stack was seen, in the folded format flamegraph tools read.
+ *   Costs two stores per efun call when the profiler isn't running.
+ *   The master's valid_profiler() decides who may use the efuns.
+ */
+#define SAMPLING_PROFILER
+
+/* EVAL_DEADLINE: set_eval() only records when the evaluation has to end,
+ *   on the monotonic clock, instead of arming a timer with a system call
+ *   for every heart beat, call_out and command.  The deadline is checked
+ *   every few backward branches and function calls, and a periodic CPU
+ *   time timer which is set up once catches code that is stuck in an
+ *   efun.  Note that the "maximum evaluation cost" then counts real time
+ *   instead of CPU time, so time the driver spends waiting (paging, other
+ *   processes on the machine) is charged to the running code.
+ */
+#undef EVAL_DEADLINE
+
 /* NONINTERACTIVE_STDERR_WRITE: if defined, all writes/tells/etc to
  *   noninteractive objects will be written to stderr prefixed with a ']'
  *   (old behavior).
@@ -176,6 +206,28 @@
  */
 #define TRAP_CRASHES
 
+/* COMPUTED_GOTO_DISPATCH: let each opcode handler in eval_instruction()
+ *   jump straight to the next one (GCC/clang computed goto) instead of
+ *   going back through the switch.  Ignored by other compilers; #undef it
+ *   in local_options to get the plain switch.
+ */
+#define COMPUTED_GOTO_DISPATCH
+
+/* SUPERINSTRUCTIONS: compile common instruction sequences (testing a local,
+ *   assigning a small constant to one, ...) into single fused opcodes.
+ *   Which ones are used is listed in superinstructions.spec; regenerate it
+ *   from an OPCPROF_2D dump with 'make superinstructions PROFILE=<file>'.
+ */
+#define SUPERINSTRUCTIONS
+
+/* TYPED_OPCODES: in functions compiled with strict types, +, -, *, /, the
+ *   comparisons and indexing use operators for the operand types the
+ *   compiler found (int, float, array or mapping), which skip the type
+ *   dispatch of the generic ones.  A value of another type, which the
+ *   compiler can't rule out, is handed to the generic operator.
+ */
+#define TYPED_OPCODES
+
 /* This define has became default, define it has no value.*/
 #define CALLOUT_HANDLES
 
@@ -190,6 +242,30 @@
  */
 #define HEART_BEAT_CHUNK      32
 
+/* HEART_BEAT_SLICES: heart beats are spread over HEARTBEAT_INTERVAL, each
+ * object runs in one of this many evenly spaced slices.  1 runs all heart
+ * beats in one burst, like older drivers did.
+ */
+#define HEART_BEAT_SLICES     20
+
+/* RESET_USECS_PER_TICK: objects that are due for reset() or clean_up() are
+ * handled for about this many microseconds each second, the rest wait for
+ * the next second.
+ */
+#define RESET_USECS_PER_TICK  5000
+
+/* RECLAIM_USECS_PER_TICK: the automatic reclaim_objects() pass is spread
+ * over as many seconds as needed, using about this many microseconds each.
+ */
+#define RECLAIM_USECS_PER_TICK 2000
+
+/* INCLUDE_CACHE_SIZE: #include files are kept in memory between compiles,
+ * along with the defines they made, and only read and lexed again once they
+ * change on disk.  This is about how many bytes they may use; the least
+ * recently used ones are dropped beyond that.  0 keeps nothing.
+ */
+#define INCLUDE_CACHE_SIZE    (8 * 1024 * 1024)
+
 /* Some maximum string sizes
  */
 #define SMALL_STRING_SIZE     100
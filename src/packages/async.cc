@@ -6,6 +6,11 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include <unordered_map>
 #ifdef F_ASYNC_GETDIR
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE
@@ -17,6 +22,8 @@
 #include "../file.h"
 #include "../function.h"
 #include "../eval.h"
+#include "../event.h"
+#include "../hash.h"
 #ifdef F_ASYNC_DB_EXEC
 #include "db.h"
 #endif
@@ -45,12 +52,30 @@ struct request {
   struct request *next;
   svalue_t tmp;
   enum atypes type;
+  /* work function, run in a worker thread */
+  void *(*func)(struct request *);
+  /* requests with the same key run in order, see do_stuff() */
+  unsigned int key;
+  struct request *after;
+  /* list of all requests not yet handled, main thread only */
+  struct request *pending_prev, *pending_next;
 };
 
-void add_req(struct request *req);
-
 #if defined(F_ASYNC_READ) || defined(F_ASYNC_WRITE)
 
+/*
+ * Requests are run by a fixed pool of worker threads, fed through a
+ * bounded queue.  Finished requests are put on a completion list and the
+ * main thread is woken up through an eventfd registered in the event
+ * loop, which calls the LPC callbacks right away.
+ *
+ * Requests on the same path (or database handle) are run in the order
+ * they were made: a request is held back behind the one before it, and
+ * the worker finishing that one runs it next.
+ */
+#define ASYNC_QUEUE_SIZE 1024
+#define ASYNC_MAX_WORKERS 16
+
 struct cb_mem {
   function_to_call_t cb;
   struct cb_mem *next;
@@ -61,91 +86,153 @@ struct req_mem {
   struct req_mem *next;
 } *reqms;
 
-struct stuff {
-  void *(*func)(struct request *);
-  struct request *data;
-  struct stuff *next;
-} *todo, *lasttodo;
-
-struct stuff_mem {
-  struct stuff stuff;
-  struct stuff_mem *next;
-} *stuffs;
-
-pthread_mutex_t mem_mut;
-
-
-struct stuff *get_stuff() {
-  struct stuff *ret;
-  if (stuffs) {
-    pthread_mutex_lock(&mem_mut);
-    ret = &stuffs->stuff;
-    stuffs = stuffs->next;
-    ((struct stuff_mem *)ret)->next = 0;
-    pthread_mutex_unlock(&mem_mut);
-  } else {
-    ret = (struct stuff *)MALLOC(sizeof(struct stuff_mem));
-    ((struct stuff_mem *)ret)->next = 0;
-  }
-  return ret;
+static struct {
+  pthread_mutex_t mut;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_cond_t finished;
+  struct request *queue[ASYNC_QUEUE_SIZE];
+  int head;
+  int count;
+  /* finished requests, most recent first */
+  struct request *done;
+  int notify_fd[2];
+  struct event *ev;
+  int num_workers;
+} async_pool;
+
+/* main thread only */
+static int num_reqs = 0;
+static struct request *pending_reqs = NULL;
+static std::unordered_map<unsigned int, struct request *> last_req_by_key;
+
+static void on_async_complete(evutil_socket_t, short, void *);
+
+static void async_notify()
+{
+#ifdef __linux__
+  uint64_t one = 1;
+#else
+  char one = 1;
+#endif
+  ssize_t res = write(async_pool.notify_fd[1], &one, sizeof(one));
+  (void) res; /* can only fail when a wakeup is already pending */
 }
 
-void free_stuff(struct stuff *stuff)
+static void async_clear_notify()
 {
-  struct stuff_mem *stufft = (struct stuff_mem *)stuff;
-  pthread_mutex_lock(&mem_mut);
-  stufft->next = stuffs;
-  stuffs = stufft;
-  pthread_mutex_unlock(&mem_mut);
+#ifdef __linux__
+  uint64_t val;
+#else
+  char val[64];
+#endif
+  while (read(async_pool.notify_fd[0], &val, sizeof(val)) > 0) {
+    ;
+  }
 }
 
-pthread_mutex_t mut;
-pthread_mutex_t work_mut;
-int thread_started = 0;
-
 void *thread_func(void *mydata)
 {
   while (1) {
-    pthread_mutex_lock(&mut);
-    while (todo) {
-      pthread_mutex_lock(&work_mut);
-      struct stuff *work = todo;
-      todo = todo->next;
-      if (!todo) {
-        lasttodo = NULL;
+    pthread_mutex_lock(&async_pool.mut);
+    while (!async_pool.count) {
+      pthread_cond_wait(&async_pool.not_empty, &async_pool.mut);
+    }
+    struct request *req = async_pool.queue[async_pool.head];
+    async_pool.head = (async_pool.head + 1) % ASYNC_QUEUE_SIZE;
+    async_pool.count--;
+    pthread_cond_signal(&async_pool.not_full);
+    pthread_mutex_unlock(&async_pool.mut);
+
+    while (req) {
+      req->func(req);
+
+      pthread_mutex_lock(&async_pool.mut);
+      struct request *next = req->after;
+      int was_idle = !async_pool.done;
+      req->status = DONE;
+      req->next = async_pool.done;
+      async_pool.done = req;
+      pthread_cond_broadcast(&async_pool.finished);
+      pthread_mutex_unlock(&async_pool.mut);
+      if (was_idle) {
+        async_notify();
       }
-      pthread_mutex_unlock(&work_mut);
-      work->func(work->data);
-      free_stuff(work);
+
+      req = next;
     }
   }
+  return NULL;
 }
 
-void do_stuff(void * (*func)(struct request *), struct request *data)
+static void start_workers()
 {
-  if (!thread_started) {
-    pthread_mutex_init(&mut, NULL);
-    pthread_mutex_init(&mem_mut, NULL);
-    pthread_mutex_init(&work_mut, NULL);
-    pthread_mutex_lock(&mut);
+#ifdef __linux__
+  async_pool.notify_fd[0] = async_pool.notify_fd[1] =
+                              eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (async_pool.notify_fd[0] == -1) {
+    fatal("async: eventfd() failed: %s\n", strerror(errno));
+  }
+#else
+  if (pipe(async_pool.notify_fd) == -1) {
+    fatal("async: pipe() failed: %s\n", strerror(errno));
+  }
+  evutil_make_socket_nonblocking(async_pool.notify_fd[0]);
+  evutil_make_socket_nonblocking(async_pool.notify_fd[1]);
+#endif
+  async_pool.ev = event_new(g_event_base, async_pool.notify_fd[0],
+                            EV_READ | EV_PERSIST, on_async_complete, NULL);
+  event_add(async_pool.ev, NULL);
+
+  pthread_mutex_init(&async_pool.mut, NULL);
+  pthread_cond_init(&async_pool.not_empty, NULL);
+  pthread_cond_init(&async_pool.not_full, NULL);
+  pthread_cond_init(&async_pool.finished, NULL);
+
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  async_pool.num_workers = ncpu < 2 ? 2 :
+                           (ncpu > ASYNC_MAX_WORKERS ? ASYNC_MAX_WORKERS : ncpu);
+  for (int i = 0; i < async_pool.num_workers; i++) {
     pthread_t t;
-    pthread_create(&t, NULL, &thread_func, NULL);
-    thread_started = 1;
+    if (pthread_create(&t, NULL, &thread_func, NULL)) {
+      fatal("async: can not create worker thread.\n");
+    }
+    pthread_detach(t);
   }
-  struct stuff *work = get_stuff();
-  work->func = func;
-  work->data = data;
-  work->next = NULL;
-  pthread_mutex_lock(&work_mut);
-  add_req(data);
-  if (lasttodo) {
-    lasttodo->next = work;
-    lasttodo = work;
+  debug_message("async: started %d worker threads.\n", async_pool.num_workers);
+}
+
+void do_stuff(void * (*func)(struct request *), struct request *data)
+{
+  if (!async_pool.num_workers) {
+    start_workers();
+  }
+  data->func = func;
+  data->after = NULL;
+  data->status = BUSY;
+  num_reqs++;
+  data->pending_prev = NULL;
+  data->pending_next = pending_reqs;
+  if (pending_reqs) {
+    pending_reqs->pending_prev = data;
+  }
+  pending_reqs = data;
+
+  pthread_mutex_lock(&async_pool.mut);
+  auto iter = last_req_by_key.find(data->key);
+  if (iter != last_req_by_key.end() && iter->second->status == BUSY) {
+    /* runs right after the previous one on the same key */
+    iter->second->after = data;
   } else {
-    todo = lasttodo = work;
+    while (async_pool.count == ASYNC_QUEUE_SIZE) {
+      pthread_cond_wait(&async_pool.not_full, &async_pool.mut);
+    }
+    async_pool.queue[(async_pool.head + async_pool.count) % ASYNC_QUEUE_SIZE] = data;
+    async_pool.count++;
+    pthread_cond_signal(&async_pool.not_empty);
   }
-  pthread_mutex_unlock(&work_mut);
-  pthread_mutex_unlock(&mut);
+  last_req_by_key[data->key] = data;
+  pthread_mutex_unlock(&async_pool.mut);
 }
 
 function_to_call_t *get_cb()
@@ -156,7 +243,7 @@ function_to_call_t *get_cb()
     cbs = cbs->next;
     ((struct cb_mem *)ret)->next = 0;
   } else {
-    ret = (function_to_call_t *)MALLOC(sizeof(struct cb_mem));
+    ret = (function_to_call_t *)DMALLOC(sizeof(struct cb_mem), TAG_PERMANENT, "async: get_cb");
     ((struct cb_mem *)ret)->next = 0;
   }
   memset(ret, 0, sizeof(function_to_call_t));
@@ -177,7 +264,7 @@ struct request *get_req() {
     reqms = reqms->next;
     ((struct req_mem *)ret)->next = 0;
   } else {
-    ret = (struct request *)MALLOC(sizeof(struct req_mem));
+    ret = (struct request *)DMALLOC(sizeof(struct req_mem), TAG_PERMANENT, "async: get_req");
     ((struct req_mem *)ret)->next = 0;
   }
   return ret;
@@ -190,20 +277,6 @@ void free_req(struct request *req)
   reqms = reqt;
 }
 
-
-static struct request *reqs = NULL;
-static struct request *lastreq = NULL;
-void add_req(struct request *req)
-{
-  if (lastreq) {
-    lastreq->next = req;
-  } else {
-    reqs = req;
-  }
-  req->next = NULL;
-  lastreq = req;
-}
-
 #ifdef PACKAGE_COMPRESS
 #include <zlib.h>
 
@@ -211,14 +284,12 @@ void *gzreadthread(struct request *req)
 {
   gzFile file = gzopen(req->path, "rb");
   req->ret = gzread(file, (void *)(req->buf), req->size);
-  req->status = DONE;
   gzclose(file);
   return NULL;
 }
 
 int aio_gzread(struct request *req)
 {
-  req->status = BUSY;
   do_stuff(gzreadthread, req);
   return 0;
 }
@@ -229,14 +300,12 @@ void *gzwritethread(struct request *req)
                 : O_CREAT | O_WRONLY | O_APPEND, S_IRWXU | S_IRWXG);
   gzFile file = gzdopen(fd, "wb");
   req->ret = gzwrite(file, (void *)(req->buf), req->size);
-  req->status = DONE;
   gzclose(file);
   return NULL;
 }
 
 int aio_gzwrite(struct request *req)
 {
-  req->status = BUSY;
   do_stuff(gzwritethread, req);
   return 0;
 }
@@ -249,14 +318,12 @@ void *writethread(struct request *req)
 
   req->ret =  write(fd, req->buf, req->size);
 
-  req->status = DONE;
   close(fd);
   return NULL;
 }
 
 int aio_write(struct request *req)
 {
-  req->status = BUSY;
   do_stuff(writethread, req);
   return 0;
 }
@@ -265,14 +332,12 @@ void *readthread(struct request *req)
 {
   int fd = open(req->path, O_RDONLY);
   req->ret = read(fd, (void *)(req->buf), req->size);
-  req->status = DONE;
   close(fd);
   return NULL;
 }
 
 int aio_read(struct request *req)
 {
-  req->status = BUSY;
   do_stuff(readthread, req);
   return 0;
 }
@@ -306,13 +371,11 @@ void *dbexecthread(struct request *req)
   pthread_mutex_unlock(db_mut);
 
   req->ret = ret;
-  req->status = DONE;
   return NULL;
 }
 
 int aio_db_exec(struct request *req)
 {
-  req->status = BUSY;
   do_stuff(dbexecthread, req);
   return 0;
 }
@@ -326,26 +389,22 @@ void *getdirthread(struct request *req)
   if (size == -1) {
     close(fd);
     req->ret = 0;
-    req->status = DONE;
     return NULL;
   }
   req->ret = size;
   while ((size = syscall(SYS_getdents, fd, req->buf + req->ret, req->size - req->ret))) {
     if (size == -1) {
       close(fd);
-      req->status = DONE;
       return NULL;
     }
     req->ret += size;
   }
-  req->status = DONE;
   close(fd);
   return NULL;
 }
 
 int aio_getdir(struct request *req)
 {
-  req->status = BUSY;
   do_stuff(getdirthread, req);
   return 0;
 }
@@ -357,11 +416,12 @@ int add_read(const char *fname, function_to_call_t *fun)
   if (fname) {
     struct request *req = get_req();
     //printf("fname: %s\n", fname);
-    req->buf = (char *)MALLOC(READ_FILE_MAX_SIZE);
+    req->buf = (char *)DMALLOC(READ_FILE_MAX_SIZE, TAG_PERMANENT, "async: add_read");
     req->size = READ_FILE_MAX_SIZE;
     req->fun = fun;
     req->type = aread;
     strcpy(req->path, fname);
+    req->key = whashstr(req->path);
 #ifdef PACKAGE_COMPRESS
     return aio_gzread(req);
 #else
@@ -380,11 +440,12 @@ int add_getdir(const char *fname, function_to_call_t *fun)
   if (fname) {
     //printf("fname: %s\n", fname);
     struct request *req = get_req();
-    req->buf = (char *)MALLOC(sizeof(struct dirent) * max_array_size);
+    req->buf = (char *)DMALLOC(sizeof(struct dirent) * max_array_size, TAG_PERMANENT, "async: add_getdir");
     req->size = sizeof(struct dirent) * max_array_size;
     req->fun = fun;
     req->type = agetdir;
     strcpy(req->path, fname);
+    req->key = whashstr(req->path);
     return aio_getdir(req);
   } else {
     error("permission denied\n");
@@ -403,6 +464,7 @@ int add_write(const char *fname, const char *buf, int size, char flags, function
     req->type = awrite;
     req->flags = flags;
     strcpy(req->path, fname);
+    req->key = whashstr(req->path);
     assign_svalue_no_free(&req->tmp, sp - 2);
 #ifdef PACKAGE_COMPRESS
     if (flags & 2) {
@@ -423,6 +485,7 @@ int add_db_exec(long handle, function_to_call_t *fun)
   req->fun = fun;
   req->type = adbexec;
   req->buf = (char *)handle;
+  req->key = (unsigned int) handle;
   assign_svalue_no_free(&req->tmp, sp - 1);
   return aio_db_exec(req);
 }
@@ -516,53 +579,108 @@ void handle_db_exec(struct request *req)
   safe_call_efun_callback(req->fun, 1);
 }
 
-void check_reqs()
-{
-  while (reqs) {
-    int val = reqs->status;
-    if (val != BUSY) {
-      enum atypes type = (reqs->type);
-      reqs->type = done;
-      switch (type) {
-        case aread:
-          handle_read(reqs);
-          break;
-        case awrite:
-          handle_write(reqs);
-          break;
+static void handle_req(struct request *req)
+{
+  switch (req->type) {
+    case aread:
+      handle_read(req);
+      break;
+    case awrite:
+      handle_write(req);
+      break;
 #ifdef F_ASYNC_GETDIR
-        case agetdir:
-          handle_getdir(reqs);
-          break;
+    case agetdir:
+      handle_getdir(req);
+      break;
 #endif
 #ifdef F_ASYNC_DB_EXEC
-        case adbexec:
-          handle_db_exec(reqs);
-          break;
+    case adbexec:
+      handle_db_exec(req);
+      break;
 #endif
-        case done:
-          //must have had an error while handling it before.
-          break;
-        default:
-          fatal("unknown async type\n");
-      }
-      struct request *here = reqs;
-      reqs = reqs->next;
-      if (!reqs) {
-        lastreq = reqs;
-      }
-      free_funp(here->fun->f.fp);
-      free_cb(here->fun);
-      free_req(here);
+    default:
+      fatal("unknown async type\n");
+  }
+}
+
+/*
+ * Run callbacks of all finished requests, in the order they finished.
+ */
+static void check_reqs()
+{
+  struct request *finished = NULL, *req;
+
+  pthread_mutex_lock(&async_pool.mut);
+  req = async_pool.done;
+  async_pool.done = NULL;
+  while (req) {
+    struct request *next = req->next;
+    req->next = finished;
+    finished = req;
+    req = next;
+  }
+  /* held back requests can only be queued after this */
+  for (req = finished; req; req = req->next) {
+    auto iter = last_req_by_key.find(req->key);
+    if (iter != last_req_by_key.end() && iter->second == req) {
+      last_req_by_key.erase(iter);
+    }
+  }
+  pthread_mutex_unlock(&async_pool.mut);
+
+  error_context_t econ;
+  save_context(&econ);
+  while (finished) {
+    req = finished;
+    finished = finished->next;
+    num_reqs--;
+    if (req->pending_prev) {
+      req->pending_prev->pending_next = req->pending_next;
     } else {
-      return;
+      pending_reqs = req->pending_next;
+    }
+    if (req->pending_next) {
+      req->pending_next->pending_prev = req->pending_prev;
     }
+    try {
+      handle_req(req);
+    } catch (const char *) {
+      restore_context(&econ);
+    }
+    free_funp(req->fun->f.fp);
+    free_cb(req->fun);
+    free_req(req);
   }
+  pop_context(&econ);
+}
+
+static void on_async_complete(evutil_socket_t fd, short what, void *arg)
+{
+  event_dispatch_started();
+  async_clear_notify();
+  check_reqs();
 }
 
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_async_reqs()
+{
+  for (struct request *req = pending_reqs; req; req = req->pending_next) {
+    req->fun->f.fp->hdr.extra_ref++;
+    if (req->type == awrite || req->type == adbexec) {
+      mark_svalue(&req->tmp);
+    }
+  }
+}
+#endif
+
 void complete_all_asyncio()
 {
-  while (reqs) {
+  while (num_reqs) {
+    pthread_mutex_lock(&async_pool.mut);
+    while (!async_pool.done) {
+      pthread_cond_wait(&async_pool.finished, &async_pool.mut);
+    }
+    pthread_mutex_unlock(&async_pool.mut);
     check_reqs();
   }
 }
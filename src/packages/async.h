@@ -1,6 +1,8 @@
 #ifndef ASYNC_H_
 #define ASYNC_H_
 
-void check_reqs();
 void complete_all_asyncio();
+#ifdef DEBUGMALLOC_EXTENSIONS
+void mark_async_reqs();
+#endif
 #endif /*ASYNC_H_*/
@@ -179,6 +179,7 @@ f_store_variable(void)
     return ;
   }
   assign_svalue(&ob->variables[idx], sv);
+  ob->reclaim_flags |= O_RECLAIM_DIRTY;
   pop_n_elems(st_num_arg);
 }
 #endif
@@ -573,7 +574,6 @@ f_terminal_colour(void)
   int resetstrlen = 0;
   int num, i, j, k, col, start, space, *lens, maybe_at_end;
   int space_garbage = 0;
-  mapping_node_t *elt, **mtab;
   int buflen, max_buflen, space_buflen;
   int wrap = 0;
   int indent = 0;
@@ -686,7 +686,6 @@ f_terminal_colour(void)
   /* Could keep track of the lens as we create parts, removing the need
      for a strlen() below */
   lens = CALLOCATE(num, int, TAG_TEMPORARY, "f_terminal_colour: lens");
-  mtab = sp->u.map->table;
 
   // First setup some little things.
   curcolour[0] = 0;
@@ -694,21 +693,12 @@ f_terminal_colour(void)
 
   // Find the reset colour string.
   resetstrname = findstring("RESET");
-  k = sp->u.map->table_size;
   if (resetstrname) {
-    static svalue_t str = {T_STRING, STRING_SHARED};
-    int tmp;
-    str.u.string = resetstrname;
-    tmp = MAP_SVAL_HASH(str);
-
-    for (elt = mtab[tmp & k]; elt; elt = elt->next) {
-      if (elt->values->type == T_STRING &&
-          (elt->values + 1)->type == T_STRING &&
-          resetstrname == elt->values->u.string) {
-        resetstr = (elt->values + 1)->u.string;
-        resetstrlen = strlen((elt->values + 1)->u.string);
-        break;
-      }
+    svalue_t *val = find_string_in_mapping(sp->u.map, resetstrname);
+
+    if (val->type == T_STRING) {
+      resetstr = val->u.string;
+      resetstrlen = strlen(val->u.string);
     }
   }
 
@@ -725,7 +715,7 @@ f_terminal_colour(void)
   space = 0;
   maybe_at_end = 0;
   buflen = max_buflen = space_buflen = 0;
-  for (j = i = 0, k = sp->u.map->table_size; i < num; i++) {
+  for (j = i = 0; i < num; i++) {
     // Look it up in the mapping.
     repused = 0;
     copy_and_push_string(parts[i]);
@@ -737,32 +727,24 @@ f_terminal_colour(void)
     }
 
     if ((repused && (cp = findstring(rep))) || (!repused && (cp = findstring(parts[i])))) {
-      static svalue_t str = {T_STRING, STRING_SHARED};
-      int tmp;
-      str.u.string = cp;
-      tmp = MAP_SVAL_HASH(str);
-      for (elt = mtab[tmp & k]; elt; elt = elt->next) {
-        if (elt->values->type == T_STRING &&
-            (elt->values + 1)->type == T_STRING &&
-            cp == elt->values->u.string) {
-          parts[i] = (elt->values + 1)->u.string;
-          /* Negative indicates don't count for wrapping */
-          lens[i] = SVALUE_STRLEN(elt->values + 1);
-          if (wrap) { lens[i] = -lens[i]; }
-          // Do stuff for continueing colour codes.
-          if (!strcmp(resetstr, parts[i])) {
-            curcolour[0] = 0;
-            curcolourlen = 0;
-          } else {
-            if (curcolourlen + strlen((elt->values + 1)->u.string) < MAX_COLOUR_STRING - 1) {
-              strcat(curcolour, (elt->values + 1)->u.string);
-              curcolourlen += strlen((elt->values + 1)->u.string);
-            }
+      svalue_t *val = find_string_in_mapping(sp->u.map, cp);
+
+      if (val->type == T_STRING) {
+        parts[i] = val->u.string;
+        /* Negative indicates don't count for wrapping */
+        lens[i] = SVALUE_STRLEN(val);
+        if (wrap) { lens[i] = -lens[i]; }
+        // Do stuff for continueing colour codes.
+        if (!strcmp(resetstr, parts[i])) {
+          curcolour[0] = 0;
+          curcolourlen = 0;
+        } else {
+          if (curcolourlen + strlen(val->u.string) < MAX_COLOUR_STRING - 1) {
+            strcat(curcolour, val->u.string);
+            curcolourlen += strlen(val->u.string);
           }
-          break;
         }
-      }
-      if (!elt) { //end of for loop, so not found!
+      } else { // not found!
         if (repused) {
           parts[i] = rep;
           lens[i] = wrap ? -SVALUE_STRLEN(reptmp) : SVALUE_STRLEN(reptmp);
@@ -2046,6 +2028,9 @@ static int memory_share(svalue_t *sv)
       }
       calldepth++;
       subtotal = sizeof(mapping_t);
+      if (sv->u.map->table) {
+        subtotal += sizeof(mapping_slot_t) * (sv->u.map->table_size + 1);
+      }
       mapTraverse(sv->u.map, node_share, &subtotal);
       calldepth--;
       return total + subtotal / sv->u.map->ref;
@@ -2066,6 +2051,9 @@ static int memory_share(svalue_t *sv)
       switch (sv->u.fp->hdr.type) {
         case FP_EFUN:
           subtotal += sizeof(efun_ptr_t);
+          if (sv->u.fp->f.efun.site) {
+            subtotal += sizeof(call_site_t);
+          }
           break;
         case FP_LOCAL | FP_NOT_BINDABLE:
           subtotal += sizeof(local_ptr_t);
@@ -733,35 +733,35 @@ void f_roulette_wheel()
 {
   long num;
   mapping_t *m = sp->u.map;
-  int j, found;
-  mapping_node_t *elt, **a = m->table;
-  svalue_t *val;
+  int found;
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
+  svalue_t *val = 0;
 
   // Loop through the mapping, adding up the weights.
-  j = m->table_size;
-  if (!j || !m->count) {
+  if (!MAP_COUNT(m)) {
     error("empty mapping in roulette_wheel.\n");
   }
   num = 0;
-  do {
-    for (elt = a[j]; elt; elt = elt->next) {
-      val = elt->values + 1;
-
-      if (val->type != T_NUMBER || val->u.number < 0) {
-        error("Weights must be non-negative integers.\n");
-      }
+  MAP_NODE_LOOP(m, mnb, elt) {
+    val = elt->values + 1;
 
-      num += val->u.number;
+    if (val->type != T_NUMBER || val->u.number < 0) {
+      error("Weights must be non-negative integers.\n");
     }
-  } while (j--);
+
+    num += val->u.number;
+  }
 
   num = 1 + random_number(num);
   found = 0;
 
   // Loop again, and stop when the sum of the weights comes to num.
-  j = m->table_size;
-  do {
-    for (elt = a[j]; elt; elt = elt->next) {
+  for (mnb = m->blocks; mnb && !found; mnb = mnb->next) {
+    for (elt = mnb->nodes; elt < mnb->nodes + mnb->used; elt++) {
+      if (MAP_NODE_FREE(elt)) {
+        continue;
+      }
       val = elt->values + 1;
       num -= val->u.number;
 
@@ -770,7 +770,7 @@ void f_roulette_wheel()
         break;
       }
     }
-  } while (j-- && !found);
+  }
 
   if (!found) {     // This shouldn't happen...
     error("Something went wrong!\n");
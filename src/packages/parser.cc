@@ -1202,16 +1202,13 @@ static void init_users()
  */
 static void add_nicknames(mapping_t *map)
 {
-  int i;
-
-  for (i = 0; i < map->table_size; i++) {
-    mapping_node_t *mn;
+  mapping_node_block_t *mnb;
+  mapping_node_t *mn;
 
-    for (mn = map->table[i]; mn; mn = mn->next) {
-      if (mn->values[0].type == T_STRING) {
-        hash_entry_t *he = add_hash_entry(mn->values[0].u.string);
-        he->flags |= HV_NICKNAME;
-      }
+  MAP_NODE_LOOP(map, mnb, mn) {
+    if (mn->values[0].type == T_STRING) {
+      hash_entry_t *he = add_hash_entry(mn->values[0].u.string);
+      he->flags |= HV_NICKNAME;
     }
   }
 }
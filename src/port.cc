@@ -37,6 +37,17 @@ long get_current_time()
   return time(0l);    /* Just use the old time() for now */
 }
 
+/*
+ * Same clock as get_current_time(), in milliseconds.
+ */
+int64_t get_current_time_ms()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (int64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
 const char *time_string(time_t t)
 {
   const char *res = ctime(&t);
@@ -59,6 +70,17 @@ get_usec_clock(long *sec, long *usec)
   *usec = tv.tv_usec;
 }
 
+/*
+ * Microseconds from a monotonic clock, for measuring intervals.
+ */
+int64_t get_monotonic_usec()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 long get_cpu_times(unsigned long *secs, unsigned long *usecs)
 {
   struct rusage rus;
@@ -7,8 +7,10 @@
 #ifndef _FUNC_SPEC_
 int64_t random_number(int64_t);
 long get_current_time(void);
+int64_t get_current_time_ms(void);
 const char *time_string(time_t);
 void get_usec_clock(long *, long *);
+int64_t get_monotonic_usec(void);
 long get_cpu_times(unsigned long *, unsigned long *);
 char *get_current_dir(char *, int);
 #endif
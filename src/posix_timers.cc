@@ -12,7 +12,9 @@ static timer_t eval_timer_id,  hb_timer_id;
  */
 void sigalrm_handler(int sig, siginfo_t *si, void *uc)
 {
-#ifndef POSIX_TIMERS
+#ifdef EVAL_DEADLINE
+  eval_watchdog();
+#elif !defined(POSIX_TIMERS)
   outoftime = 1;
 #else
   if (!si->si_value.sival_ptr) {
@@ -46,6 +48,10 @@ void init_posix_timers(void)
   sa.sa_sigaction = sigalrm_handler;
   sigemptyset(&sa.sa_mask);
   sa.sa_flags = SA_SIGINFO;
+#ifdef EVAL_DEADLINE
+  /* the watchdog keeps firing while the driver is busy */
+  sa.sa_flags |= SA_RESTART;
+#endif
 
   i = sigaction(SIGVTALRM, &sa, NULL);
   if (i < 0) {
@@ -68,6 +74,19 @@ void posix_eval_timer_set(LPC_INT micros)
   timer_settime(eval_timer_id, 0, &it, NULL);
 }
 
+#ifdef EVAL_DEADLINE
+/* Fire the eval_timer every 'micros' of CPU time from now on */
+void posix_eval_watchdog_set(LPC_INT micros)
+{
+  struct itimerspec it;
+
+  it.it_interval.tv_sec = it.it_value.tv_sec = micros / 1000000;
+  it.it_interval.tv_nsec = it.it_value.tv_nsec = micros % 1000000 * 1000;
+
+  timer_settime(eval_timer_id, 0, &it, NULL);
+}
+#endif
+
 /* Return the number of microseconds remaining on the eval_timer */
 LPC_INT posix_eval_timer_get(void)
 {
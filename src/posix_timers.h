@@ -7,6 +7,9 @@ void sigalrm_handler(int, siginfo_t *, void *);
 void init_posix_timers(void);
 void posix_eval_timer_set(LPC_INT micros);
 LPC_INT posix_eval_timer_get(void);
+#ifdef EVAL_DEADLINE
+void posix_eval_watchdog_set(LPC_INT micros);
+#endif
 #endif
 
 #endif
@@ -35,6 +35,11 @@ defn_t *lookup_define(const char *s)
 {
   defn_t *p = lookup_definition(s);
 
+#ifdef LEXER
+  if (inc_recording) {
+    inc_note_lookup(s, p);
+  }
+#endif
   if (p && (p->flags & DEF_IS_UNDEFINED)) {
     return 0;
   } else {
@@ -47,6 +52,12 @@ static void add_define(const char *name, int nargs, const char *exps)
   defn_t *p = lookup_definition(name);
   int h, len;
 
+#ifdef LEXER
+  if (inc_recording) {
+    inc_note_lookup(name, p);
+  }
+#endif
+
   /* trim off leading and trailing whitespace */
   while (uisspace(*exps)) { exps++; }
   for (len = strlen(exps);  len && uisspace(exps[len - 1]);  len--) { ; }
@@ -95,10 +106,16 @@ static void add_define(const char *name, int nargs, const char *exps)
     p->exps[len] = 0;
     p->flags = 0;
     p->nargs = nargs;
+    p->touched = 0;
     h = defhash(name);
     p->next = defns[h];
     defns[h] = p;
   }
+#ifdef LEXER
+  if (inc_recording) {
+    inc_note_define(p);
+  }
+#endif
 }
 
 #ifdef LEXER
@@ -0,0 +1,355 @@
+/*
+ * profiler.c
+ * Sampling LPC profiler, see profiler.h.
+ *
+ * The signal handler may interrupt the driver anywhere, so it only reads
+ * the control stack and stores plain values in a single producer, single
+ * consumer ring.  push_control_stack() fills a frame before making csp
+ * point to it, and its function index starts out as -1, so the handler
+ * never sees a half made frame.  Programs are named when the ring is
+ * drained, which happens from the backend loop and from
+ * deallocate_program(), so every program pointer in the ring is still
+ * valid by then.
+ */
+
+#include "std.h"
+
+#ifdef SAMPLING_PROFILER
+#include "lpc_incl.h"
+#include "file.h"
+#include "lex.h"
+#include "master.h"
+#include "profiler.h"
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <signal.h>
+#include <sys/time.h>
+#ifdef POSIX_TIMERS
+#include <time.h>
+#include <sys/syscall.h>
+#endif
+
+/* innermost frames kept per sample; deeper stacks start with "..." */
+#define PROFILER_DEPTH  24
+#define PROFILER_RING   4096
+
+typedef struct {
+  program_t *prog;
+  int index;
+  short kind;
+} sample_frame_t;
+
+typedef struct {
+  int depth;
+  int truncated;
+  int efun;
+  sample_frame_t frames[PROFILER_DEPTH];
+} sample_t;
+
+static sample_t ring[PROFILER_RING];
+static std::atomic<unsigned> ring_head, ring_tail;
+static std::atomic<unsigned> samples_dropped;
+static int running;
+static int samples_taken;
+#ifdef POSIX_TIMERS
+static timer_t profiler_timer;
+#endif
+
+static std::unordered_map<std::string, long> stacks;
+
+static void profiler_handler(int sig)
+{
+  int saved_errno = errno;
+  unsigned head = ring_head.load(std::memory_order_relaxed);
+  control_stack_t *top = csp;
+  control_stack_t *p;
+  sample_t *s;
+  int n;
+
+  if (head - ring_tail.load(std::memory_order_acquire) >= PROFILER_RING) {
+    samples_dropped.fetch_add(1, std::memory_order_relaxed);
+    errno = saved_errno;
+    return;
+  }
+  s = &ring[head % PROFILER_RING];
+  s->efun = (top >= control_stack ? top->efun : 0);
+  s->truncated = 0;
+  p = &control_stack[0];
+  if (top - p >= PROFILER_DEPTH) {
+    p = top - PROFILER_DEPTH + 1;
+    s->truncated = 1;
+  }
+  for (n = 0; p <= top; p++, n++) {
+    s->frames[n].kind = p->framekind & FRAME_MASK;
+    s->frames[n].index = p->fr.table_index;
+    s->frames[n].prog = (p == top ? current_prog : p[1].prog);
+  }
+  s->depth = n;
+  ring_head.store(head + 1, std::memory_order_release);
+  errno = saved_errno;
+}
+
+/* stack labels can't contain the separators of the folded format */
+static void append_label(std::string &out, const char *str)
+{
+  for (; *str; str++) {
+    out += (*str == ';' || *str == ' ' || *str == '\n') ? '_' : *str;
+  }
+}
+
+static void name_sample(std::string &out, const sample_t *s)
+{
+  const sample_frame_t *f;
+  int i;
+
+  if (s->truncated) {
+    out += "...;";
+  }
+  for (i = 0; i < s->depth; i++) {
+    f = &s->frames[i];
+    switch (f->kind) {
+      case FRAME_FUNCTION:
+        if (f->prog && f->prog->filename) {
+          out += '/';
+          append_label(out, f->prog->filename);
+          if (f->index >= 0 && f->index < f->prog->num_functions_defined &&
+              f->prog->function_table[f->index].funcname) {
+            out += ':';
+            append_label(out, f->prog->function_table[f->index].funcname);
+          }
+        } else {
+          out += "<unknown>";
+        }
+        break;
+      case FRAME_FUNP:
+        out += "<function>";
+        break;
+      case FRAME_CATCH:
+        out += "<catch>";
+        break;
+      default:
+        out += "<fake>";
+        break;
+    }
+    out += ';';
+  }
+  if (!s->depth) {
+    out += "[driver]";
+  } else if (s->efun > 0 && s->efun < MAX_INSTRS) {
+    out += '[';
+    append_label(out, query_instr_name(s->efun));
+    out += ']';
+  } else {
+    /* no efun running, the stack ends in the innermost function */
+    out.erase(out.size() - 1);
+  }
+}
+
+void profiler_drain()
+{
+  unsigned tail = ring_tail.load(std::memory_order_relaxed);
+  unsigned head = ring_head.load(std::memory_order_acquire);
+  std::string name;
+
+  for (; tail != head; tail++) {
+    name.clear();
+    name_sample(name, &ring[tail % PROFILER_RING]);
+    stacks[name]++;
+    samples_taken++;
+  }
+  ring_tail.store(tail, std::memory_order_release);
+}
+
+static int set_profiler_timer(int usecs)
+{
+#ifdef POSIX_TIMERS
+  struct itimerspec it;
+
+  it.it_interval.tv_sec = it.it_value.tv_sec = usecs / 1000000;
+  it.it_interval.tv_nsec = it.it_value.tv_nsec = usecs % 1000000 * 1000;
+  return timer_settime(profiler_timer, 0, &it, NULL);
+#else
+  struct itimerval it;
+
+  it.it_interval.tv_sec = it.it_value.tv_sec = usecs / 1000000;
+  it.it_interval.tv_usec = it.it_value.tv_usec = usecs % 1000000;
+  return setitimer(ITIMER_PROF, &it, NULL);
+#endif
+}
+
+int profiler_start(int usecs)
+{
+  struct sigaction sa;
+
+  if (running) {
+    return -1;
+  }
+  if (usecs <= 0) {
+    usecs = 1000;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = profiler_handler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  if (sigaction(SIGPROF, &sa, NULL) < 0) {
+    return -1;
+  }
+
+#ifdef POSIX_TIMERS
+  struct sigevent sev;
+  int i;
+
+  /* CPU time of this thread, and the signal is delivered to it too */
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_signo = SIGPROF;
+#if defined(__linux__) && defined(SIGEV_THREAD_ID)
+  sev.sigev_notify = SIGEV_THREAD_ID;
+#ifdef sigev_notify_thread_id
+  sev.sigev_notify_thread_id = syscall(SYS_gettid);
+#else
+  sev._sigev_un._tid = syscall(SYS_gettid);
+#endif
+#else
+  sev.sigev_notify = SIGEV_SIGNAL;
+#endif
+#if defined(__CYGWIN__) || defined(__FreeBSD__)
+  i = timer_create(CLOCK_REALTIME, &sev, &profiler_timer);
+#else
+  i = timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &profiler_timer);
+#endif
+  if (i < 0) {
+    return -1;
+  }
+#endif
+
+  stacks.clear();
+  samples_taken = 0;
+  samples_dropped = 0;
+  if (set_profiler_timer(usecs) < 0) {
+#ifdef POSIX_TIMERS
+    timer_delete(profiler_timer);
+#endif
+    return -1;
+  }
+  running = 1;
+  return 0;
+}
+
+int profiler_stop()
+{
+  if (!running) {
+    return -1;
+  }
+  set_profiler_timer(0);
+#ifdef POSIX_TIMERS
+  timer_delete(profiler_timer);
+#endif
+  running = 0;
+  profiler_drain();
+  if (samples_dropped) {
+    debug_message("Profiler: %u samples dropped, the ring was full.\n",
+                  samples_dropped.load());
+  }
+  return samples_taken;
+}
+
+int profiler_running()
+{
+  return running;
+}
+
+int profiler_dump(FILE *f)
+{
+  int num = 0;
+
+  profiler_drain();
+  for (auto &it : stacks) {
+    fprintf(f, "%s %ld\n", it.first.c_str(), it.second);
+    num++;
+  }
+  stacks.clear();
+  return num;
+}
+
+mapping_t *profiler_results()
+{
+  mapping_t *m;
+
+  profiler_drain();
+  m = allocate_mapping(stacks.size());
+  for (auto &it : stacks) {
+    add_mapping_pair(m, it.first.c_str(), it.second);
+  }
+  stacks.clear();
+  return m;
+}
+
+/* ask the master whether current_object may start or stop the profiler */
+static void check_profiler_access(const char *efun)
+{
+  svalue_t *res;
+
+  push_object(current_object);
+  push_constant_string(efun);
+  res = apply_master_ob(APPLY_VALID_PROFILER, 2);
+  if (!MASTER_APPROVED(res)) {
+    error("Master object denied permission to %s().\n", efun);
+  }
+}
+
+#ifdef F_START_PROFILER
+void f_start_profiler(void)
+{
+  int usecs = 1000;
+
+  if (st_num_arg) {
+    usecs = sp->u.number;
+    pop_stack();
+  }
+  if (usecs <= 0) {
+    error("Bad argument 1 to start_profiler(): interval must be positive.\n");
+  }
+  check_profiler_access("start_profiler");
+  if (profiler_start(usecs) < 0) {
+    error("start_profiler(): %s.\n", running ? "the profiler is already running"
+          : strerror(errno));
+  }
+}
+#endif
+
+#ifdef F_STOP_PROFILER
+void f_stop_profiler(void)
+{
+  const char *file = 0;
+  FILE *f;
+  int num, num_arg = st_num_arg;
+
+  /* before check_valid_path(), whose result the next apply overwrites */
+  check_profiler_access("stop_profiler");
+  if (num_arg) {
+    file = check_valid_path(sp->u.string, current_object, "stop_profiler", 1);
+    if (!file) {
+      error("stop_profiler(): no write permission for %s.\n", sp->u.string);
+    }
+  }
+  if (profiler_stop() < 0) {
+    error("stop_profiler(): the profiler isn't running.\n");
+  }
+  if (!file) {
+    push_refed_mapping(profiler_results());
+    return;
+  }
+  if (!(f = fopen(file, "w"))) {
+    stacks.clear();
+    error("stop_profiler(): can't write %s: %s.\n", file, strerror(errno));
+  }
+  num = profiler_dump(f);
+  fclose(f);
+  free_string_svalue(sp);
+  put_number(num);
+}
+#endif
+#endif
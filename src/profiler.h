@@ -0,0 +1,43 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+ * profiler.c
+ *
+ * Sampling profiler for LPC code.  A CPU time timer interrupts the driver
+ * and the signal handler copies the control stack into a ring buffer,
+ * as program pointers and function indices only; the samples are turned
+ * into names later, outside of the handler, and counted per distinct
+ * stack.
+ */
+#ifdef SAMPLING_PROFILER
+/*
+ * eval_instruction() notes the efun it calls in the current frame, which
+ * is where the signal handler looks for it; other instructions cost
+ * nothing.  restore_context() puts back the efun of the frame it returns
+ * to.
+ */
+#define PROFILER_CALL_EFUN(x, call) \
+  SAFE(csp->efun = (x); call; csp->efun = 0;)
+
+/* start sampling every 'usecs' of CPU time; -1 if already running */
+int profiler_start(int usecs);
+/* stop sampling and return the number of samples taken, -1 if not running */
+int profiler_stop(void);
+int profiler_running(void);
+/*
+ * Name and count the samples in the ring.  Has to be called before a
+ * program which may be in a sample is freed.
+ */
+void profiler_drain(void);
+/*
+ * The counted stacks as "outer;...;inner[;[efun]] count" lines.  Both
+ * clear the counts.
+ */
+int profiler_dump(FILE *);
+mapping_t *profiler_results(void);
+#else
+#define PROFILER_CALL_EFUN(x, call) SAFE(call;)
+#endif
+
+#endif
@@ -1,5 +1,6 @@
 #include "std.h"
 #include "lpc_incl.h"
+#include "profiler.h"
 
 int total_num_prog_blocks, total_prog_block_size;
 
@@ -16,6 +17,11 @@ void deallocate_program(program_t *progp)
 
   debug(d_flag, "free_prog: /%s\n", progp->filename);
 
+#ifdef SAMPLING_PROFILER
+  /* samples in the ring may point to this program */
+  profiler_drain();
+#endif
+
   total_prog_block_size -= progp->total_size;
   total_num_prog_blocks -= 1;
 
@@ -47,6 +53,13 @@ void deallocate_program(program_t *progp)
     FREE(progp->file_info);
   }
 
+  if (progp->call_sites) {
+    free_call_sites(progp->call_sites, progp->num_call_sites);
+  }
+  if (progp->func_lookup) {
+    FREE(progp->func_lookup);
+  }
+
   FREE((char *) progp);
 }
 
@@ -121,3 +134,112 @@ function_t *find_func_entry(program_t *prog, int index)
   return prog->function_table + index;
 }
 
+
+static inline unsigned int func_lookup_hash(const char *name)
+{
+  return (unsigned int)(((uint64_t)(POINTER_INT) name *
+                         0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+static function_lookup_t *func_lookup_slot(function_lookup_t *table,
+                                           unsigned int mask,
+                                           const char *name)
+{
+  unsigned int h;
+
+  for (h = func_lookup_hash(name) & mask; table[h].name; h = (h + 1) & mask) {
+    if (table[h].name == name) {
+      break;
+    }
+  }
+  return &table[h];
+}
+
+/*
+ * Every name visible from a program is in its runtime function table,
+ * so the lookup table is sized from that.  Our own functions come
+ * first, then whatever the inherits (last one first) can see that isn't
+ * hidden yet, taken from their lookup tables.  Undefined functions and
+ * prototypes are kept with prog == 0, so they hide inherited functions
+ * of the same name.  Nothing here depends on the order of the function
+ * table, which only holds for programs compiled in this process.
+ */
+static void build_func_lookup(program_t *prog)
+{
+  int num = prog->last_inherited + prog->num_functions_defined;
+  unsigned int size = 4, mask, j;
+  int i;
+  function_lookup_t *table, *entry, *from;
+  program_t *iprog;
+  const char *name;
+
+  while (size < 2 * (unsigned int) num) {
+    size <<= 1;
+  }
+  mask = size - 1;
+  table = CALLOCATE(size, function_lookup_t, TAG_FUNC_LOOKUP,
+                    "build_func_lookup");
+
+  for (i = 0; i < prog->num_functions_defined; i++) {
+    if (!(name = prog->function_table[i].funcname)) {
+      continue;
+    }
+    entry = func_lookup_slot(table, mask, name);
+    if (entry->name) {
+      continue;
+    }
+    entry->name = name;
+    if (!(prog->function_flags[i + prog->last_inherited] &
+          (FUNC_UNDEFINED | FUNC_PROTOTYPE))) {
+      entry->prog = prog;
+      entry->index = i;
+      entry->runtime_index = i + prog->last_inherited;
+    }
+  }
+
+  i = prog->num_inherited;
+  while (i--) {
+    iprog = prog->inherit[i].prog;
+    if (!iprog->func_lookup) {
+      build_func_lookup(iprog);
+    }
+    for (j = 0; j <= iprog->func_lookup_mask; j++) {
+      from = &iprog->func_lookup[j];
+      if (!from->prog) {
+        continue;
+      }
+      entry = func_lookup_slot(table, mask, from->name);
+      if (entry->name) {
+        continue;
+      }
+      *entry = *from;
+      entry->runtime_index += prog->inherit[i].function_index_offset;
+      entry->fio += prog->inherit[i].function_index_offset;
+      entry->vio += prog->inherit[i].variable_index_offset;
+    }
+  }
+  prog->func_lookup = table;
+  prog->func_lookup_mask = mask;
+}
+
+/*
+ * The function called 'name' as seen from 'prog', or 0 if there is none.
+ * 'name' must be a shared string, otherwise it is never found.
+ */
+const function_lookup_t *lookup_function(program_t *prog, const char *name)
+{
+  unsigned int h;
+  function_lookup_t *entry;
+
+  if (!prog->func_lookup) {
+    build_func_lookup(prog);
+  }
+  h = func_lookup_hash(name) & prog->func_lookup_mask;
+  while ((entry = &prog->func_lookup[h])->name) {
+    if (entry->name == name) {
+      return entry->prog ? entry : 0;
+    }
+    h = (h + 1) & prog->func_lookup_mask;
+  }
+  return 0;
+}
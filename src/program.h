@@ -195,6 +195,52 @@ typedef struct {
   unsigned short type_mod;
 } inherit_t;
 
+/* a resolved call, as kept by the apply_low() cache */
+typedef struct cache_entry_s {
+  struct program_s *oprogp;
+  struct program_s *progp;
+  function_t *funp;
+  unsigned short function_index_offset;
+  unsigned short variable_index_offset;
+} cache_entry_t;
+
+/*
+ * Inline cache of a call_other site (F_CALL_OTHER_SITE, or a function
+ * pointer to the call_other efun), keyed by the
+ * program of the called object and the (shared) function name, so a hit
+ * needs only pointer compares.  Functions which weren't found are cached
+ * too.  Programs aren't referenced from here; the program id catches a
+ * freed program's address being reused.
+ */
+#define CALL_SITE_WAYS 4
+
+typedef struct {
+  cache_entry_t entry;
+  unsigned int oprog_id;
+  const char *name;           /* referenced shared string */
+} call_site_entry_t;
+
+typedef struct call_site_s {
+  call_site_entry_t entries[CALL_SITE_WAYS];
+  unsigned int hits;
+  unsigned int misses;
+  ADDRESS_TYPE offset;        /* in the program, for cache_stats() */
+  unsigned char next;         /* entry to replace next */
+} call_site_t;
+
+/*
+ * What a lookup by name from some program finds: the function visible
+ * under 'name' through all the inherits, or prog == 0 if there is none.
+ * Names are shared strings owned by the function tables.
+ */
+typedef struct {
+  const char *name;
+  struct program_s *prog;     /* defining program */
+  unsigned short index;       /* in prog->function_table */
+  unsigned short runtime_index;
+  unsigned short fio, vio;    /* function and variable index offsets */
+} function_lookup_t;
+
 typedef struct program_s {
   const char *filename;                 /* Name of file that defined prog */
   unsigned short flags;
@@ -243,6 +289,12 @@ typedef struct program_s {
   unsigned short num_variables_total;
   unsigned short num_variables_defined;
   unsigned short num_inherited;
+  unsigned short num_call_sites;
+  unsigned int id;            /* unique, see call_site_t */
+  call_site_t *call_sites;    /* allocated when first used */
+  unsigned int func_lookup_mask;
+  function_lookup_t *func_lookup;     /* built when first used */
+  uint64_t source_hash;       /* of the sources, see binaries.c */
 } program_t;
 
 extern int total_num_prog_blocks;
@@ -252,6 +304,7 @@ void free_prog(program_t **);
 void deallocate_program(program_t *);
 char *variable_name(program_t *, int);
 function_t *find_func_entry(program_t *, int);
+const function_lookup_t *lookup_function(program_t *, const char *);
 
 #endif
 
@@ -213,7 +213,8 @@ void set_defaults(char *filename)
   CONFIG_STR(__SWAP_FILE__) = alloc_cstring(tmp, "config file: sf");
   scan_config_line("debug log file : %[^\n]", tmp, -1);
   CONFIG_STR(__DEBUG_LOG_FILE__) = alloc_cstring(tmp, "config file: dlf");
-  CONFIG_STR(__PLACEHOLDER1__) = alloc_cstring("__placeholder", "config file: placeholder");
+  scan_config_line("save binaries directory : %[^\n]", tmp, 0);
+  CONFIG_STR(__SAVE_BINARIES_DIR__) = alloc_cstring(tmp, "config file: sbd");
   scan_config_line("default error message : %[^\n]", tmp, 0);
   CONFIG_STR(__DEFAULT_ERROR_MESSAGE__) = alloc_cstring(tmp, "config file: dem");
   scan_config_line("default fail message : %[^\n]", tmp, 0);
@@ -301,6 +302,10 @@ void set_defaults(char *filename)
                    &CONFIG_INT(__SHARED_STRING_HASH_TABLE_SIZE__), 1);
   scan_config_line("object table size : %d\n",
                    &CONFIG_INT(__OBJECT_HASH_TABLE_SIZE__), 1);
+  if (!scan_config_line("apply cache size : %d\n",
+                        &CONFIG_INT(__APPLY_CACHE_SIZE__), 0)) {
+    CONFIG_INT(__APPLY_CACHE_SIZE__) = 1 << APPLY_CACHE_BITS;
+  }
 
   /* check for ports */
   if (port_start == 1) {
@@ -26,10 +26,10 @@ check_svalue(svalue_t *v)
 {
   register int idx;
 
-  nested++;
-  if (nested > MAX_RECURSION) {
+  if (nested >= MAX_RECURSION) {
     return;
   }
+  nested++;
   switch (v->type) {
     case T_OBJECT:
       if (v->u.ob->flags & O_DESTRUCTED) {
@@ -84,53 +84,135 @@ gc_mapping(mapping_t *m)
    * just call check_svalue() b/c the hash would be wrong and the '0'
    * element we add would be unreferenceable (in most cases)
    */
-  mapping_node_t **prev, *elt;
-  int j = m->table_size;
-
-  do {
-    prev = m->table + j;
-    while ((elt = *prev)) {
-      if (elt->values[0].type == T_OBJECT) {
-        if (elt->values[0].u.ob->flags & O_DESTRUCTED) {
-          free_object(&elt->values[0].u.ob, "gc_mapping");
-          elt->values[0].u.ob = 0;
-          /* found one, do a map_delete() */
-          if (!(*prev = elt->next) && !m->table[j]) {
-            m->unfilled++;
-          }
-          cleaned++;
-          m->count--;
-          total_mapping_nodes--;
-          total_mapping_size -= sizeof(mapping_node_t);
-          free_node(m, elt);
-          continue;
-        }
-      } else {
-        /* in case the key is a mapping or something */
-        check_svalue(elt->values);
+  mapping_node_block_t *mnb;
+  mapping_node_t *elt;
+
+  MAP_NODE_LOOP(m, mnb, elt) {
+    if (elt->values[0].type == T_OBJECT) {
+      if (elt->values[0].u.ob->flags & O_DESTRUCTED) {
+        /* found one, do a map_delete(); that frees the key as well */
+        mapping_delete(m, elt->values);
+        cleaned++;
+        continue;
       }
-      check_svalue(elt->values + 1);
-      prev = &(elt->next);
+    } else {
+      /* in case the key is a mapping or something */
+      check_svalue(elt->values);
+    }
+    check_svalue(elt->values + 1);
+  }
+}
+
+/*
+ * The automatic reclaim is incremental: a sweep walks obj_list from a
+ * cursor that survives between ticks, and every tick spends at most
+ * RECLAIM_USECS_PER_TICK on it.  A new sweep only starts once an object
+ * has been destructed since the last one started, otherwise there is
+ * nothing to drop.
+ *
+ * Objects that only held numbers, strings and the like at their last scan
+ * can't refer to a destructed object, they are skipped until one of their
+ * variables is assigned again (O_RECLAIM_DIRTY).
+ */
+static object_t *reclaim_cursor = 0;
+static int reclaim_sweeping = 0, reclaim_wanted = 0;
+
+static int reclaim_scanned, reclaim_skipped, reclaim_cleaned, reclaim_sweeps;
+
+static void reclaim_object(object_t *ob)
+{
+  int refs = 0;
+
+  if (!ob->prog) {
+    return;
+  }
+  if (!ob->reclaim_flags) {
+    reclaim_skipped++;
+    return;
+  }
+  reclaim_scanned++;
+  for (int i = 0; i < ob->prog->num_variables_total; i++) {
+    svalue_t *sv = &ob->variables[i];
+
+    check_svalue(sv);
+    if (sv->type & (T_OBJECT | T_FUNCTION | T_ARRAY | T_CLASS | T_MAPPING)) {
+      refs = 1;
+    }
+  }
+  ob->reclaim_flags = refs ? O_RECLAIM_REFS : 0;
+}
+
+/* An object is leaving obj_list, keep the cursor on the list. */
+void reclaim_object_destructed(object_t *ob)
+{
+  if (ob == reclaim_cursor) {
+    reclaim_cursor = ob->next_all;
+  }
+  reclaim_wanted = 1;
+}
+
+void reclaim_objects_tick()
+{
+  add_tick_event(1, tick_event::callback_type(reclaim_objects_tick));
+
+  if (!reclaim_sweeping) {
+    if (!reclaim_wanted) {
+      return;
     }
-  } while (j--);
+    reclaim_wanted = 0;
+    reclaim_sweeping = 1;
+    reclaim_sweeps++;
+    reclaim_cursor = obj_list;
+    reclaim_call_outs();
+  }
+
+  int64_t deadline = get_monotonic_usec() + RECLAIM_USECS_PER_TICK;
+  int n = 0;
+
+  nested = 0;
+  cleaned = 0;
+  while (reclaim_cursor) {
+    object_t *ob = reclaim_cursor;
+
+    reclaim_cursor = ob->next_all;
+    reclaim_object(ob);
+    if (!(++n & 63) && get_monotonic_usec() >= deadline) {
+      break;
+    }
+  }
+  reclaim_cleaned += cleaned;
+  if (!reclaim_cursor) {
+    reclaim_sweeping = 0;
+  }
 }
 
-int reclaim_objects(bool is_auto)
+int reclaim_status(outbuffer_t *ob, int verbose)
 {
-  if (is_auto) {
-    add_tick_event(30 + random_number(30), tick_event::callback_type(std::bind(reclaim_objects, true)));
+  if (verbose == 1) {
+    outbuf_add(ob, "Reclaim information:\n");
+    outbuf_add(ob, "--------------------\n");
+    outbuf_addv(ob, "Sweeps: %d (%s), objects scanned: %d, skipped: %d, "
+                "references cleaned: %d\n", reclaim_sweeps,
+                reclaim_sweeping ? "running" : "idle", reclaim_scanned,
+                reclaim_skipped, reclaim_cleaned);
   }
-  int i;
+  return 0;
+}
+
+/*
+ * A full pass at once, for the efun.
+ */
+int reclaim_objects()
+{
   object_t *ob;
 
   reclaim_call_outs();
 
   cleaned = nested = 0;
-  for (ob = obj_list; ob; ob = ob->next_all)
-    if (ob->prog)
-      for (i = 0; i < ob->prog->num_variables_total; i++) {
-        check_svalue(&ob->variables[i]);
-      }
+  for (ob = obj_list; ob; ob = ob->next_all) {
+    reclaim_object(ob);
+  }
+  reclaim_cleaned += cleaned;
 
   return cleaned;
 }
@@ -4,6 +4,9 @@
 /*
  * reclaim.c
  */
-int reclaim_objects(bool);
+int reclaim_objects(void);
+void reclaim_object_destructed(object_t *);
+void reclaim_objects_tick(void);
+int reclaim_status(outbuffer_t *, int);
 
 #endif
@@ -1,6 +1,7 @@
 #include "std.h"
 #include "replace_program.h"
 #include "simul_efun.h"
+#include "backend.h"
 #include "efun_protos.h"
 
 /*
@@ -78,6 +79,7 @@ void replace_programs(void)
     r_ob->ob->prog = r_ob->new_prog;
     r_next = r_ob->next;
     free_prog(&old_prog);
+    heart_beat_program_changed(r_ob->ob);
 
     debug(d_flag, ("program freed."));
 #ifndef NO_SHADOWS
@@ -2,6 +2,7 @@
 #include "lpc_incl.h"
 #include "file_incl.h"
 #include "call_out.h"
+#include "reclaim.h"
 #include "backend.h"
 #include "simul_efun.h"
 #include "compiler.h"
@@ -19,6 +20,7 @@
 #include "add_action.h"
 #include "object.h"
 #include "eval.h"
+#include "binaries.h"
 #ifdef DTRACE
 #include <sys/sdt.h>
 #else
@@ -436,36 +438,57 @@ object_t *int_load_object(const char *lname, int callcreate)
     error("Illegal path name '/%s'.\n", real_name);
   }
 
-  /* maybe move this section into compile_file? */
-  if (comp_flag) {
-    debug_message(" compiling /%s ...", real_name);
-  }
   f = open(real_name, O_RDONLY);
   if (f == -1) {
     debug_perror("compile_file", real_name);
     error("Could not read the file '/%s'.\n", real_name);
   }
+#ifdef BINARIES
   save_command_giver(command_giver);
-  prog = compile_file(f, obname);
-  restore_command_giver();
-  if (comp_flag) {
-    debug_message(" done\n");
+  try {
+    prog = load_binary(obname, f);
+  } catch (const char *) {
+    /* an inherit failed to load */
+    close(f);
+    throw;
   }
-  update_compile_av(total_lines);
-  total_lines = 0;
-  close(f);
-
-
-  /* Sorry, can't handle objects without programs yet. */
-  if (inherit_file == 0 && (num_parse_error > 0 || prog == 0)) {
-    if (num_parse_error == 0 && prog == 0) {
-      error("No program in object '/%s'!\n", name);
+  restore_command_giver();
+  if (prog) {
+    close(f);
+    /* loading the inherits may have loaded this object */
+    if ((ob = lookup_object_hash(name))) {
+      free_prog(&prog);
+      num_objects_this_thread--;
+      return ob;
     }
+  } else
+#endif
+  {
+    /* maybe move this section into compile_file? */
+    if (comp_flag) {
+      debug_message(" compiling /%s ...", real_name);
+    }
+    save_command_giver(command_giver);
+    prog = compile_file(f, obname);
+    restore_command_giver();
+    if (comp_flag) {
+      debug_message(" done\n");
+    }
+    update_compile_av(total_lines);
+    total_lines = 0;
+    close(f);
+
+    /* Sorry, can't handle objects without programs yet. */
+    if (inherit_file == 0 && (num_parse_error > 0 || prog == 0)) {
+      if (num_parse_error == 0 && prog == 0) {
+        error("No program in object '/%s'!\n", name);
+      }
 
-    if (prog) {
-      free_prog(&prog);
+      if (prog) {
+        free_prog(&prog);
+      }
+      error("Error in loading object '/%s'\n", name);
     }
-    error("Error in loading object '/%s'\n", name);
   }
   /*
    * This is an iterative process. If this object wants to inherit an
@@ -530,6 +553,7 @@ object_t *int_load_object(const char *lname, int callcreate)
   }
   obj_list = ob;
   enter_object_hash(ob);      /* add name to fast object lookup table */
+  schedule_object_reset(ob);  /* queued even if create() fails */
   save_command_giver(command_giver);
   push_object(ob);
   mret = apply_master_ob(APPLY_VALID_OBJECT, 1);
@@ -545,6 +569,7 @@ object_t *int_load_object(const char *lname, int callcreate)
       function_exists(APPLY_CLEAN_UP, ob, 1)) {
     ob->flags |= O_WILL_CLEAN_UP;
   }
+  schedule_object_reset(ob);
   restore_command_giver();
 
   if (ob) {
@@ -629,10 +654,12 @@ object_t *clone_object(const char *str1, int num_arg)
   new_ob->prev_all = 0;
   obj_list = new_ob;
   enter_object_hash(new_ob);  /* Add name to fast object lookup table */
+  schedule_object_reset(new_ob);
 
   init_object(new_ob);
 
   call_create(new_ob, num_arg);
+  schedule_object_reset(new_ob);
   restore_command_giver();
   /* Never know what can happen ! :-( */
   if (new_ob->flags & O_DESTRUCTED) {
@@ -982,6 +1009,9 @@ void destruct_object(object_t *ob)
     remove_object_hash(ob);
   }
 
+  unschedule_object_reset(ob);
+  reclaim_object_destructed(ob);
+
   /*
    * Now remove us out of the list of all objects. This must be done last,
    * because an error in the above code would halt execution.
@@ -1150,6 +1180,7 @@ void say(svalue_t *v, array_t *avoid)
     origin = current_object;
   }
 
+  broadcast_scope broadcast(buff, strlen(buff));
   /* To our surrounding object... */
   if ((ob = origin->super)) {
     if (ob->flags & O_LISTENER || ob->interactive) {
@@ -1213,6 +1244,7 @@ void tell_room(object_t *room, svalue_t *v, array_t *avoid)
       IF_DEBUG(buff = 0);
   }
 
+  broadcast_scope broadcast(buff, strlen(buff));
   for (ob = room->contains; ob; ob = ob->next_inv) {
     if (!ob->interactive && !(ob->flags & O_LISTENER)) {
       continue;
@@ -1254,6 +1286,7 @@ void shout_string(const char *str)
 
   check_legal_string(str);
 
+  broadcast_scope broadcast(str, strlen(str));
   for (ob = obj_list; ob; ob = ob->next_all) {
     if (!(ob->flags & O_LISTENER) || (ob == command_giver)
 #ifndef NO_ENVIRONMENT
@@ -2071,6 +2104,8 @@ void do_message(svalue_t *lclass, svalue_t *msg, array_t *scope, array_t *exclud
 {
   int i, j, valid;
   object_t *ob;
+  broadcast_scope broadcast(msg->type == T_STRING ? msg->u.string : 0,
+                            msg->type == T_STRING ? SVALUE_STRLEN(msg) : 0);
 
   for (i = 0; i < scope->size; i++) {
     switch (scope->item[i].type) {
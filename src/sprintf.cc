@@ -425,16 +425,17 @@ void svalue_to_string(svalue_t *obj, outbuffer_t *outbuf, int indent, int traili
     outbuf_add(outbuf, " :)");
     break;
     case T_MAPPING:
-      if (!(obj->u.map->count)) {
+      if (!MAP_COUNT(obj->u.map)) {
         outbuf_add(outbuf, "([ ])");
       } else {
         outbuf_add(outbuf, "([ /* sizeof() == ");
-        outbuf_addv(outbuf, "%u", obj->u.map->count);
+        outbuf_addv(outbuf, "%u", MAP_COUNT(obj->u.map));
         outbuf_add(outbuf, " */\n");
-        for (i = 0; i <= obj->u.map->table_size; i++) {
+        {
+          mapping_node_block_t *mnb;
           mapping_node_t *elm;
 
-          for (elm = obj->u.map->table[i]; elm; elm = elm->next) {
+          MAP_NODE_LOOP(obj->u.map, mnb, elm) {
             svalue_to_string(&(elm->values[0]), outbuf, indent + 2, 0, 0);
             outbuf_add(outbuf, " : ");
             svalue_to_string(&(elm->values[1]), outbuf, indent + 4, 1, 1);
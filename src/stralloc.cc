@@ -62,26 +62,39 @@ int search_len = 0;
 int num_str_searches = 0;
 #endif
 
-#define StrHash(s) (whashstr((s)) & (htable_size_minus_one))
+#define StrHash(s) whashstr((s))
 
 #define hfindblock(s, h) sfindblock(s, h = StrHash(s))
 #define findblock(s) sfindblock(s, StrHash(s))
 
-static block_t *sfindblock(const char *, int);
+static block_t *sfindblock(const char *, unsigned int);
 
 /*
  * hash table - list of pointers to heads of string chains.
- * Each string in chain has a pointer to the next string and a
- * reference count (char *, int) stored just before the start of the string.
- * HTABLE_SIZE is in config.h, and should be a prime, probably between
- * 1000 and 5000.
+ * Each string in chain has a pointer to the next string, a reference
+ * count and the full hash of the string stored just before the start of
+ * the string.  HTABLE_SIZE is in config.h and is only the initial size:
+ * the table doubles once it holds more strings than it has chains.
+ *
+ * The strings aren't all moved to the bigger table at once.  The old table
+ * is kept, and every make_shared_string() moves a few of its chains over
+ * (rehash_some()), so the move is done long before the new table fills up.
+ * Meanwhile the strings of an old chain that hasn't been moved yet are
+ * still found, added and removed there; chain_for() picks the right one.
  */
 
 static block_t **base_table = (block_t **) 0;
 static int htable_size;
 static int htable_size_minus_one;
 
-static block_t *alloc_new_string(const char *, int);
+static block_t **old_table = (block_t **) 0;  /* being moved to base_table */
+static int old_size;
+static int rehash_pos;          /* old chains below this have been moved */
+static int num_shared_strings;
+
+#define REHASH_STEP 4           /* old chains moved per make_shared_string() */
+
+static block_t *alloc_new_string(const char *, unsigned int);
 
 void init_strings()
 {
@@ -104,6 +117,61 @@ void init_strings()
   }
 }
 
+/* the chain a string with hash h is on */
+static inline block_t **chain_for(unsigned int h)
+{
+  if (old_table && (int)(h & (old_size - 1)) >= rehash_pos) {
+    return old_table + (h & (old_size - 1));
+  }
+  return base_table + (h & htable_size_minus_one);
+}
+
+/* start moving the strings to a table twice the size */
+static void grow_strings()
+{
+  block_t **new_table;
+
+  new_table = CALLOCATE(htable_size * 2, block_t *,
+                        TAG_STR_TBL, "grow_strings");
+  if (!new_table) {
+    return;
+  }
+  memset(new_table, 0, sizeof(block_t *) * htable_size * 2);
+#ifdef STRING_STATS
+  overhead_bytes += (sizeof(block_t *) * htable_size * 2);
+#endif
+  old_table = base_table;
+  old_size = htable_size;
+  rehash_pos = 0;
+  base_table = new_table;
+  htable_size *= 2;
+  htable_size_minus_one = htable_size - 1;
+}
+
+/* move the next few chains of the old table to the new one */
+static void rehash_some()
+{
+  block_t *b, *next, **chain;
+  int n;
+
+  for (n = 0; n < REHASH_STEP && rehash_pos < old_size; n++) {
+    for (b = old_table[rehash_pos]; b; b = next) {
+      next = NEXT(b);
+      chain = base_table + (HASH(b) & htable_size_minus_one);
+      NEXT(b) = *chain;
+      *chain = b;
+    }
+    old_table[rehash_pos++] = 0;
+  }
+  if (rehash_pos == old_size) {
+    FREE((char *)old_table);
+#ifdef STRING_STATS
+    overhead_bytes -= (sizeof(block_t *) * old_size);
+#endif
+    old_table = 0;
+  }
+}
+
 /*
  * Looks for a string in the table.  If it finds it, returns a pointer to
  * the start of the string part, and moves the entry for the string to
@@ -112,11 +180,12 @@ void init_strings()
  */
 
 static block_t *
-sfindblock(const char *s, int h)
+sfindblock(const char *s, unsigned int h)
 {
-  block_t *curr, *prev;
+  block_t *curr, *prev, **chain;
 
-  curr = base_table[h];
+  chain = chain_for(h);
+  curr = *chain;
   prev = NULL;
 #ifdef STRING_STATS
   num_str_searches++;
@@ -126,11 +195,11 @@ sfindblock(const char *s, int h)
 #ifdef STRING_STATS
     search_len++;
 #endif
-    if (*(STRING(curr)) == *s && !strcmp(STRING(curr), s)) {        /* found it */
+    if (HASH(curr) == h && !strcmp(STRING(curr), s)) {        /* found it */
       if (prev) {         /* not at head of list */
         NEXT(prev) = NEXT(curr);
-        NEXT(curr) = base_table[h];
-        base_table[h] = curr;
+        NEXT(curr) = *chain;
+        *chain = curr;
       }
       return (curr);      /* pointer to string */
     }
@@ -155,9 +224,9 @@ findstring(const char *s)
 /* alloc_new_string: Make a space for a string.  */
 
 static block_t *
-alloc_new_string(const char *string, int h)
+alloc_new_string(const char *string, unsigned int h)
 {
-  block_t *b;
+  block_t *b, **chain;
   int len = strlen(string);
   int size;
   int cut = 0;
@@ -171,13 +240,15 @@ alloc_new_string(const char *string, int h)
   STRING(b)[len] = '\0';      /* strncpy doesn't put on \0 if 'from' too
                                  * long */
   if (cut) {
-    h = whashstr(STRING(b)) & htable_size_minus_one;
+    h = whashstr(STRING(b));
   }
   SIZE(b) = (len > UINT_MAX ? UINT_MAX : len);
   REFS(b) = 1;
-  NEXT(b) = base_table[h];
+  chain = chain_for(h);
+  NEXT(b) = *chain;
   HASH(b) = h;
-  base_table[h] = b;
+  *chain = b;
+  num_shared_strings++;
   ADD_NEW_STRING(SIZE(b), sizeof(block_t));
   ADD_STRING(SIZE(b));
   return (b);
@@ -187,10 +258,16 @@ char *
 make_shared_string(const char *str)
 {
   block_t *b;
-  int h;
+  unsigned int h;
 
+  if (old_table) {
+    rehash_some();
+  }
   b = hfindblock(str, h);     /* hfindblock macro sets h = StrHash(s) */
   if (!b) {
+    if (num_shared_strings >= htable_size && !old_table) {
+      grow_strings();
+    }
     b = alloc_new_string(str, h);
   } else {
     if (REFS(b)) {
@@ -235,7 +312,6 @@ void
 free_string(const char *str)
 {
   block_t **prev, *b;
-  int h;
 
   b = BLOCK(str);
   DEBUG_CHECK1(b != findblock(str), "stralloc.c: free_string called on non-shared string: %s.\n", str);
@@ -256,9 +332,7 @@ free_string(const char *str)
     return;
   }
 
-  //h = StrHash(str);
-  h = HASH(BLOCK(str));
-  prev = base_table + h;
+  prev = chain_for(HASH(b));
   while ((b = *prev)) {
     if (STRING(b) == str) {
       *prev = NEXT(b);
@@ -268,6 +342,7 @@ free_string(const char *str)
   }
 
   DEBUG_CHECK1(!b, "free_string: not found in string table! (\"%s\")\n", str);
+  num_shared_strings--;
 
   SUB_NEW_STRING(SIZE(b), sizeof(block_t));
   FREE(b);
@@ -277,12 +352,9 @@ free_string(const char *str)
 void
 deallocate_string(char *str)
 {
-  int h;
   block_t *b, **prev;
 
-  //h = StrHash(str);
-  h = HASH(BLOCK(str));
-  prev = base_table + h;
+  prev = chain_for(HASH(BLOCK(str)));
   while ((b = *prev)) {
     if (STRING(b) == str) {
       *prev = NEXT(b);
@@ -291,10 +363,52 @@ deallocate_string(char *str)
     prev = &(NEXT(b));
   }
   DEBUG_CHECK1(!b, "stralloc.c: deallocate_string called on non-shared string: %s.\n", str);
+  num_shared_strings--;
   //printf("freeing string: %s\n", str);
   FREE(b);
 }
 
+#ifdef STRING_STATS
+/* count the chains of tbl in use and find the longest one */
+static void chain_lengths(block_t **tbl, int size, int *used, int *longest)
+{
+  block_t *b;
+  int i, len;
+
+  for (i = 0; i < size; i++) {
+    for (len = 0, b = tbl[i]; b; b = NEXT(b)) {
+      len++;
+    }
+    if (len) {
+      (*used)++;
+    }
+    if (len > *longest) {
+      *longest = len;
+    }
+  }
+}
+
+/* how full the shared string table is, and how long its chains are */
+static void shared_table_status(outbuffer_t *out)
+{
+  int used = 0, longest = 0;
+
+  chain_lengths(base_table, htable_size, &used, &longest);
+  if (old_table) {
+    chain_lengths(old_table, old_size, &used, &longest);
+  }
+  outbuf_addv(out, "Shared strings: %d in %d chains, load %.2f\n",
+              num_shared_strings, htable_size,
+              (double) num_shared_strings / htable_size);
+  outbuf_addv(out, "Chains in use: %d    Average length: %.3f    Longest: %d\n",
+              used, used ? (double) num_shared_strings / used : 0.0, longest);
+  if (old_table) {
+    outbuf_addv(out, "Growing: %d of %d old chains moved\n",
+                rehash_pos, old_size);
+  }
+}
+#endif
+
 int
 add_string_status(outbuffer_t *out, int verbose)
 {
@@ -313,6 +427,7 @@ add_string_status(outbuffer_t *out, int verbose)
                 (bytes_distinct_strings + overhead_bytes) * 100 / allocd_bytes);
     outbuf_addv(out, "Searches: %d    Average search length: %6.3f\n",
                 num_str_searches, (double) search_len / num_str_searches);
+    shared_table_status(out);
   }
   return (bytes_distinct_strings + overhead_bytes);
 #else
@@ -360,6 +475,7 @@ char *int_new_string(int size)
     ADD_NEW_STRING(UINT_MAX, sizeof(malloc_block_t));
   }
   mbt->ref = 1;
+  mbt->room = 0;
   ADD_STRING(mbt->size);
   CHECK_STRING_STATS;
   return (char *)(mbt + 1);
@@ -378,6 +494,44 @@ char *extend_string(const char *str, int len)
   } else {
     mbt->size = UINT_MAX;
   }
+  mbt->room = 0;
+  ADD_STRING_SIZE(mbt->size - oldsize);
+  CHECK_STRING_STATS;
+
+  return (char *)(mbt + 1);
+}
+
+/*
+ * grow_string: extend_string() for a string that is appended to over and
+ * over, like the left side of +=.  The block is made half again as large as
+ * needed, and later appends use up that room before reallocating, so
+ * building a string piece by piece doesn't copy it every time.
+ */
+char *grow_string(const char *str, int len)
+{
+  malloc_block_t *mbt = MSTR_BLOCK(str);
+  int want;
+#ifdef STRING_STATS
+  int oldsize = MSTR_SIZE(str);
+#endif
+
+  if (mbt->size < UINT_MAX && (unsigned int)len <= mbt->size + mbt->room) {
+    mbt->room = mbt->size + mbt->room - len;
+    mbt->size = len;
+  } else {
+    want = len + len / 2;
+    if (want > MAX_STRING_LENGTH) {
+      want = (len > MAX_STRING_LENGTH ? len : MAX_STRING_LENGTH);
+    }
+    mbt = (malloc_block_t *)DREALLOC(mbt, want + sizeof(malloc_block_t) + 1, TAG_MALLOC_STRING, "grow_string");
+    if (len < UINT_MAX) {
+      mbt->size = len;
+      mbt->room = want - len;
+    } else {
+      mbt->size = UINT_MAX;
+      mbt->room = 0;
+    }
+  }
   ADD_STRING_SIZE(mbt->size - oldsize);
   CHECK_STRING_STATS;
 
@@ -445,6 +599,7 @@ char *int_string_unlink(const char *str)
     ADD_NEW_STRING(mbt->size, sizeof(malloc_block_t));
   }
   newmbt->ref = 1;
+  newmbt->room = 0;
   CHECK_STRING_STATS;
 
   return (char *)(newmbt + 1);
@@ -50,7 +50,7 @@ void check_string_stats(outbuffer_t *);
 
 typedef struct malloc_block_s {
   void *dummy;
-  int bing;
+  unsigned int room;          /* bytes allocated past the end, see grow_string() */
 #ifdef DEBUGMALLOC_EXTENSIONS
   long extra_ref;
 #endif
@@ -136,6 +136,7 @@ void deallocate_string(char *);
 int add_string_status(outbuffer_t *, int);
 
 char *extend_string(const char *, int);
+char *grow_string(const char *, int);
 
 extern unsigned int svalue_strlen_size;
 
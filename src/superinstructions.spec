@@ -0,0 +1,8 @@
+/* autogenerated by 'edit_source -superinstructions speed.eop-2d' */
+
+operator local_branch_when_zero;	/* 3000002 */
+operator local_branch_when_non_zero;	/* 2000001 */
+operator local_land;	/* 7000000 */
+operator local_byte_branch_ge;	/* 1000000 */
+operator void_assign_local_byte;	/* 9000084 */
+operator void_add_eq_local;	/* 450000 */
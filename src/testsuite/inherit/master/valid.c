@@ -108,3 +108,16 @@ int valid_hide() {
 int valid_compile_to_c() {
     return 1;
 }
+
+// valid_profiler: called with the object using start_profiler() or
+// stop_profiler() and the name of the efun.
+int valid_profiler(object ob, string) {
+    return !ob->query_deny_profiler();
+}
+
+// valid_save_binary: called with the file name of each program the driver
+// would load from or save to the program cache.  Nothing else may write
+// to that directory.
+int valid_save_binary(string file) {
+    return file != "/binaries_denied.c";
+}
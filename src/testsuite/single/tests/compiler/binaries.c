@@ -0,0 +1,128 @@
+// Programs loaded from the binary cache behave like compiled ones, and
+// aren't used once an include or an inherited program has changed.
+
+#define BASE "/binaries_base"
+#define TOP "/binaries_top"
+#define INC "/binaries_inc.h"
+#define DENIED "/binaries_denied"
+
+// loaded, out of date, saved and denied programs, from mud_status()
+int *counts() {
+    int loaded, stale, saved, denied;
+
+    sscanf(mud_status(1), "%*sProgram cache:\n%*s\nLoaded: %d, out of date: %d, saved: %d, denied: %d",
+           loaded, stale, saved, denied);
+    return ({ loaded, stale, saved, denied });
+}
+
+// how much each count went up since 'before'
+int *since(int *before) {
+    int *now = counts();
+
+    return ({ now[0] - before[0], now[1] - before[1],
+              now[2] - before[2], now[3] - before[3] });
+}
+
+void write_base(string value) {
+    rm(BASE + ".c");
+    write_file(BASE + ".c", "string base() { return \"" + value + "\"; }\n");
+}
+
+void write_inc(int value) {
+    rm(INC);
+    write_file(INC, "#define VALUE " + value + "\n");
+}
+
+void write_top() {
+    rm(TOP + ".c");
+    write_file(TOP + ".c",
+               "#include \"" + INC + "\"\n"
+               "inherit \"" + BASE + "\";\n"
+               "int value() { return VALUE; }\n"
+               "string sw(string s) {\n"
+               "    switch (s) {\n"
+               "    case \"apple\": return \"a\";\n"
+               "    case \"banana\": return \"b\";\n"
+               "    case \"cherry\": return \"c\";\n"
+               "    case \"damson\": return \"d\";\n"
+               "    case 0: return \"zero\";\n"
+               "    default: return \"other\";\n"
+               "    }\n"
+               "}\n");
+}
+
+object reload() {
+    object ob;
+
+    if (ob = find_object(TOP)) {
+        destruct(ob);
+    }
+    if (ob = find_object(BASE)) {
+        destruct(ob);
+    }
+    return load_object(TOP);
+}
+
+void check(object ob, int value, string base) {
+    string s = "ban";
+
+    ASSERT_EQ(value, ob->value());
+    ASSERT_EQ(base, ob->base());
+    ASSERT_EQ("a", ob->sw("apple"));
+    ASSERT_EQ("b", ob->sw(s + "ana"));
+    ASSERT_EQ("c", ob->sw("cherry"));
+    ASSERT_EQ("d", ob->sw("damson"));
+    ASSERT_EQ("zero", ob->sw(0));
+    ASSERT_EQ("other", ob->sw("elderberry"));
+    ASSERT_EQ(TOP, function_exists("sw", ob));
+    ASSERT_EQ(BASE, function_exists("base", ob));
+}
+
+void do_tests() {
+#ifdef __BINARIES__
+    int *before;
+    object ob;
+
+    write_base("one");
+    write_inc(1);
+    write_top();
+    flush_program_cache();
+    before = counts();
+    check(reload(), 1, "one");
+    ASSERT_EQ(({ 0, 0, 2, 0 }), since(before));
+    // from the cache this time, the inherit too
+    before = counts();
+    check(reload(), 1, "one");
+    ASSERT_EQ(({ 2, 0, 0, 0 }), since(before));
+
+    write_inc(2);
+    before = counts();
+    check(reload(), 2, "one");
+    // the base is still cached; the top is tried again after loading it
+    ASSERT_EQ(({ 1, 2, 1, 0 }), since(before));
+    write_base("two");
+    check(reload(), 2, "two");
+    check(reload(), 2, "two");
+
+    ASSERT_EQ(1, flush_program_cache(TOP));
+    ASSERT_EQ(0, flush_program_cache(TOP));
+    check(reload(), 2, "two");
+
+    // the master's valid_save_binary() keeps this one out of the cache
+    write_file(DENIED + ".c", "int x() { return 1; }\n", 1);
+    before = counts();
+    ob = load_object(DENIED);
+    destruct(ob);
+    ob = load_object(DENIED);
+    ASSERT_EQ(1, ob->x());
+    ASSERT_EQ(({ 0, 0, 0, 2 }), since(before));
+    destruct(ob);
+    rm(DENIED + ".c");
+
+    destruct(find_object(TOP));
+    destruct(find_object(BASE));
+    rm(TOP + ".c");
+    rm(BASE + ".c");
+    rm(INC);
+#endif
+}
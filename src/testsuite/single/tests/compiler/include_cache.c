@@ -0,0 +1,74 @@
+// Include files are taken from the include cache, and the defines they
+// make are repeated without lexing them, while they are unchanged.
+
+#define INC "/include_cache_inc.h"
+#define INC2 "/include_cache_inc2.h"
+#define OB "/include_cache_ob"
+
+int count;
+
+void put(string file, string body) {
+    rm(file);
+    write_file(file, body);
+}
+
+// every object is new, so that it's compiled and not loaded from a binary
+mixed value(string pre) {
+    object ob;
+    mixed ret;
+
+    put(OB + ".c", "// " + count++ + "\n" + pre +
+          "#include \"" + INC + "\"\n"
+          "mixed value() { return VALUE; }\n");
+    ob = load_object(OB);
+    ret = ob->value();
+    destruct(ob);
+    return ret;
+}
+
+int replays() {
+    int n;
+
+    sscanf(mud_status(1), "%*sdefines replayed: %d", n);
+    return n;
+}
+
+void do_tests() {
+    int n;
+
+    put(INC, "#ifndef INC_H\n#define INC_H\n"
+               "#ifdef BIG\n#define VALUE 100\n#else\n#define VALUE 1\n#endif\n"
+               "#endif\n");
+    ASSERT_EQ(1, value(""));
+    n = replays();
+    ASSERT_EQ(1, value(""));
+    ASSERT_EQ(100, value("#define BIG\n"));
+    ASSERT_EQ(1, value("#include \"" + INC + "\"\n"));
+    ASSERT_EQ(100, value("#define BIG\n"));
+    ASSERT_EQ(1, value(""));
+    ASSERT(replays() >= n + 3);
+
+    // same size, and most likely the same second
+    put(INC, "#ifndef INC_H\n#define INC_H\n"
+               "#ifdef BIG\n#define VALUE 200\n#else\n#define VALUE 2\n#endif\n"
+               "#endif\n");
+    ASSERT_EQ(2, value(""));
+    ASSERT_EQ(200, value("#define BIG\n"));
+
+    put(INC2, "#define VALUE2 5\n");
+    put(INC, "#include \"" + INC2 + "\"\n#undef VALUE\n#define VALUE VALUE2\n");
+    ASSERT_EQ(5, value("#define VALUE 7\n"));
+    ASSERT_EQ(5, value(""));
+    put(INC2, "#define VALUE2 6\n");
+    ASSERT_EQ(6, value(""));
+    ASSERT_EQ(6, value(""));
+
+    // includes with code in them are lexed every time
+    put(INC, "#define VALUE f()\nint f() { return 9; }\n");
+    ASSERT_EQ(9, value(""));
+    ASSERT_EQ(9, value(""));
+
+    rm(OB + ".c");
+    rm(INC);
+    rm(INC2);
+}
@@ -0,0 +1,65 @@
+// Functions found by name through a deep inherit chain.
+
+#define DEPTH 15
+
+string file(int i) {
+    return "/inherit_lookup_" + i;
+}
+
+void make(int i) {
+    string code = "";
+
+    if (i) {
+        code += "inherit \"" + file(i - 1) + "\";\n";
+    }
+    code += "string f" + i + "() { return \"" + i + "\"; }\n";
+    if (i == 3) {
+        code += "string g();\n";
+    }
+    if (i == 7) {
+        code += "string f0() { return \"override7\"; }\n";
+    }
+    if (i == 10) {
+        code += "private string p10() { return \"10\"; }\n";
+    }
+    if (i == 12) {
+        code += "string g() { return \"12\"; }\n";
+    }
+    rm(file(i) + ".c");
+    write_file(file(i) + ".c", code);
+}
+
+void do_tests() {
+    object top, mid;
+    int i;
+
+    for (i = 0; i < DEPTH; i++) {
+        make(i);
+    }
+    top = load_object(file(DEPTH - 1));
+    mid = load_object(file(5));
+
+    for (i = 1; i < DEPTH; i++) {
+        ASSERT_EQ("" + i, call_other(top, "f" + i));
+        ASSERT_EQ(file(i), function_exists("f" + i, top));
+    }
+    ASSERT_EQ("override7", top->f0());
+    ASSERT_EQ(file(7), function_exists("f0", top));
+    ASSERT_EQ("12", top->g());
+    ASSERT(undefinedp(top->p10()));
+    ASSERT(!function_exists("p10", top));
+    ASSERT_EQ(file(10), function_exists("p10", top, 1));
+    ASSERT(undefinedp(top->no_such_function()));
+
+    ASSERT_EQ("0", mid->f0());
+    ASSERT(undefinedp(mid->g()));
+    ASSERT(!function_exists("g", mid));
+    ASSERT(undefinedp(mid->f6()));
+
+    for (i = 0; i < DEPTH; i++) {
+        if (find_object(file(i))) {
+            destruct(find_object(file(i)));
+        }
+        rm(file(i) + ".c");
+    }
+}
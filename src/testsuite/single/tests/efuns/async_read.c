@@ -0,0 +1,12 @@
+void do_tests() {
+#ifdef __PACKAGE_ASYNC__
+    /* requests on the same file complete in the order they were made */
+    async_write("/async_test_file", "hello async\n", 1, function(mixed res) {
+        ASSERT(!res);
+    });
+    async_read("/async_test_file", function(mixed res) {
+        ASSERT_EQ("hello async\n", res);
+        rm("/async_test_file");
+    });
+#endif
+}
@@ -1,5 +1,11 @@
 void do_tests() {
 #ifdef __CACHE_STATS__
-    ASSERT(stringp(cache_stats()));
+    string stats = cache_stats(), size;
+
+    ASSERT(stringp(stats));
+    ASSERT(strsrch(stats, "% occupancy:") != -1);
+    // "apply cache size : 250" in the config, rounded up to a power of two
+    ASSERT(sscanf(stats, "%*scache size:%s\n", size) == 2);
+    ASSERT_EQ(256, to_int(size));
 #endif
 }
@@ -69,7 +69,7 @@ void call_out_recursive(int last_cost) {
 
 void finish() {
     busy = 0;
-    ASSERT(called["basic_tests"] == 6);
+    ASSERT(called["basic_tests"] == 8);
     ASSERT(called["spin"] == 3);
     ASSERT(called["call_multiple"] == 1);
 }
@@ -92,6 +92,8 @@ void do_tests() {
     call_out( "one_arg", 4, 1);
     call_out( (: two_arg, 1 :), 5, 2);
     call_out( "two_arg", 6, 1, 2);
+    call_out( (: no_args :), 0.5);
+    call_out( "one_arg", 1.5, 1);
 
     // FIXME: move the recursive test out functional test. */
     /* All call_outs set up here should be called sucessfully */
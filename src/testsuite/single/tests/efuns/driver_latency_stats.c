@@ -0,0 +1,24 @@
+void do_tests() {
+    mapping m = driver_latency_stats();
+
+    ASSERT_EQ(({ "command_output", "event_loop", "tick_callback", "tick_lag" }),
+              sort_array(keys(m), 1));
+    foreach (string name, mapping h in m) {
+        ASSERT_EQ(8, sizeof(h));
+        ASSERT(h["min"] <= h["p50"]);
+        ASSERT(h["p50"] <= h["p90"]);
+        ASSERT(h["p90"] <= h["p99"]);
+        ASSERT(h["p99"] <= h["p99.9"]);
+        ASSERT(h["p99.9"] <= h["max"]);
+    }
+    ASSERT_EQ(0, driver_latency_stats(this_object()));
+    ASSERT_EQ(0, driver_latency_stats(this_object(), 1));
+
+    // nothing is recorded before this test returns
+    m = driver_latency_stats(0, 1);
+    ASSERT_EQ(4, sizeof(m));
+    foreach (string name, mapping h in driver_latency_stats()) {
+        ASSERT_EQ(0, h["count"]);
+        ASSERT_EQ(0, h["max"]);
+    }
+}
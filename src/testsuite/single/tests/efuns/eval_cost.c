@@ -0,0 +1,31 @@
+// The eval cost left goes down while code runs and is back to the limit
+// after set_eval_limit(0).
+
+int spin(int n) {
+    int i, total;
+
+    for (i = 0; i < n; i++) {
+        total += i % 7;
+    }
+    return total;
+}
+
+void do_tests() {
+    int limit = set_eval_limit(1);
+    int before, after;
+
+    ASSERT(limit > 0);
+    set_eval_limit(0);
+    before = eval_cost();
+    ASSERT(before > 0);
+    ASSERT(before <= limit);
+    ASSERT(limit - before < 1000000);
+
+    spin(200000);
+    after = eval_cost();
+    ASSERT(after < before);
+    ASSERT(set_eval_limit(-1) <= after);
+
+    set_eval_limit(0);
+    ASSERT(eval_cost() > after);
+}
@@ -39,6 +39,23 @@ int msame(mapping x, mapping y) {
     return 1;
 }
 
+mixed fail_at(mixed x, mixed bad) {
+    if (x == bad) error("bad element\n");
+    return x;
+}
+
+// the argument is changed in place only if nobody else has it
+void in_place() {
+    mixed *a = ({ 1, "a", 0, ({ 2 }), 0, 3 });
+
+    ASSERT(same(filter(a[0..], (: $1 :)), ({ 1, "a", a[3], 3 })));
+    ASSERT(same(filter(a, (: $1 :)), ({ 1, "a", a[3], 3 })));
+    ASSERT(sizeof(a) == 6);
+    ASSERT(!sizeof(filter(a[0..], (: 0 :))));
+    ASSERT(catch(filter(a[0..], (: fail_at, 3 :))));
+    ASSERT(same(a, ({ 1, "a", 0, a[3], 0, 3 })));
+}
+
 void do_tests() {
     // array
     ASSERT(same(filter( ({ 1, 2, 0, 3 }), (: $1 :)), ({ 1, 2, 3 })));
@@ -66,4 +83,6 @@ void do_tests() {
     ASSERT(sizeof(filter( ([ 0 : 0 ]), "whatever3", this_object(), 1)));
     ASSERT(sizeof(filter( ([ 0 : 0 ]), (: whatever3 :), 1)));
     ASSERT(sizeof(filter( ([ 0 : 0 ]), "whatever3", __FILE__, 1)));
+
+    in_place();
 }
@@ -1,7 +1,26 @@
 void do_tests() {
+    int h, *hs = ({ });
+
     ASSERT(find_call_out("foo") == -1);
     call_out("foo", 10);
     ASSERT_EQ(10, find_call_out("foo"));
     ASSERT_EQ(-1, find_call_out("bar"));
     remove_call_out("foo");
+    call_out("foo", 0.5);
+    ASSERT_EQ(1, find_call_out("foo"));
+    ASSERT(remove_call_out("foo") == 1);
+    ASSERT_EQ(-1, find_call_out("foo"));
+
+    // a removed handle stays invalid after its entry is reused
+    h = call_out("foo", 10);
+    ASSERT_EQ(10, find_call_out(h));
+    remove_call_out(h);
+    ASSERT_EQ(-1, find_call_out(h));
+    for (int i = 0; i < 600; i++)
+        hs += ({ call_out("foo", 20) });
+    ASSERT_EQ(-1, find_call_out(h));
+    ASSERT_EQ(20, find_call_out(hs[599]));
+    foreach (int x in hs)
+        ASSERT_EQ(20, remove_call_out(x));
+    ASSERT_EQ(-1, find_call_out("foo"));
 }
@@ -27,6 +27,22 @@ int whatever3(mixed x, mixed y, mixed z) {
     return z;
 }
 
+mixed fail_at(mixed x, mixed bad) {
+    if (x == bad) error("bad element\n");
+    return ({ x });
+}
+
+/* the argument is changed in place only if nobody else has it */
+void in_place() {
+    mixed *a = ({ 1, 2, 3 });
+
+    ASSERT(same(map(a[0..], (: $1 * 2 :)), ({ 2, 4, 6 })));
+    ASSERT(same(map(a, (: $1 * 2 :)), ({ 2, 4, 6 })));
+    ASSERT(same(a, ({ 1, 2, 3 })));
+    ASSERT(catch(map(a[0..], (: fail_at, 2 :))));
+    ASSERT(same(a, ({ 1, 2, 3 })));
+}
+
 void do_tests() {
     /* array */
     ASSERT(same(map( ({ 1, 2, 0, 3 }), (: $1 :)), ({ 1, 2, 0, 3 })));
@@ -51,4 +67,6 @@ void do_tests() {
     ASSERT(map( "xy", "whatever2", this_object(), 'c') == "cc");
     ASSERT(map( "xy", (: whatever2 :), 'c')== "cc");
     ASSERT(map( "xy", "whatever2", __FILE__, 'c')== "cc");
+
+    in_place();
 }
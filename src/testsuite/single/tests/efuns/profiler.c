@@ -0,0 +1,65 @@
+// Samples name the functions on the stack, outermost first.
+
+int deny_profiler;
+
+// asked by the master's valid_profiler()
+int query_deny_profiler() {
+    return deny_profiler;
+}
+
+int spin(int n) {
+    int i, total;
+
+    for (i = 0; i < n; i++) {
+        total += i % 7;
+    }
+    return total;
+}
+
+int busy() {
+    int start = rusage()["utime"], total;
+
+    // 200ms of CPU time
+    while (rusage()["utime"] - start < 200) {
+        total += spin(10000);
+    }
+    return total;
+}
+
+void do_tests() {
+#ifdef __SAMPLING_PROFILER__
+    mapping stacks;
+    string *found;
+    int n;
+
+    deny_profiler = 1;
+    ASSERT(catch(start_profiler()));
+    deny_profiler = 0;
+
+    start_profiler(200);
+    ASSERT(catch(start_profiler()));
+    busy();
+    stacks = stop_profiler();
+    ASSERT(catch(stop_profiler()));
+
+    ASSERT(sizeof(stacks));
+    found = filter(keys(stacks), (: strsrch($1, ":busy;") != -1 :));
+    ASSERT(sizeof(found));
+    // spin() calls no efuns, so its samples end with it
+    found = filter(found, (: regexp($1, ":busy;[^;]*:spin$") :));
+    ASSERT(sizeof(found));
+    foreach (string stack in keys(stacks)) {
+        ASSERT(stacks[stack] > 0);
+    }
+
+    start_profiler();
+    busy();
+    deny_profiler = 1;
+    ASSERT(catch(stop_profiler()));
+    deny_profiler = 0;
+    n = stop_profiler("/profiler.folded");
+    ASSERT(n > 0);
+    ASSERT_EQ(n, sizeof(explode(read_file("/profiler.folded"), "\n")));
+    rm("/profiler.folded");
+#endif
+}
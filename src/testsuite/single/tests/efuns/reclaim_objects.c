@@ -0,0 +1,14 @@
+mapping m;
+object *obs;
+
+void do_tests() {
+    object ob = new("/single/void");
+
+    m = ([ ob : 1 ]);
+    obs = ({ ob });
+    destruct(ob);
+    ASSERT(reclaim_objects() >= 2);
+    ASSERT_EQ(0, sizeof(m));
+    ASSERT_EQ(0, obs[0]);
+    ASSERT_EQ(0, reclaim_objects());
+}
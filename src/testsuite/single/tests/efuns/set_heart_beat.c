@@ -19,6 +19,16 @@ void heart_beat() {
 }
 
 void do_tests() {
+    object ob;
+
+    /* objects without heart_beat() keep their setting */
+    ob = new("/single/void");
+    evaluate(bind( (: set_heart_beat, 3 :), ob));
+    ASSERT_EQ(3, query_heart_beat(ob));
+    evaluate(bind( (: set_heart_beat, 0 :), ob));
+    ASSERT_EQ(0, query_heart_beat(ob));
+    destruct(ob);
+
     x = 0;
     set_heart_beat(0);
     ASSERT(!query_heart_beat(this_object()));
@@ -0,0 +1,33 @@
+// The shared string table grows while strings are added, and strings stay
+// findable while its chains are moved over to the bigger table.
+
+void do_tests() {
+    mapping *m = allocate(4);
+    string status;
+    int i, n, chains, longest = -1;
+
+    // mapping keys are shared strings
+    for (i = 0; i < 4; i++) {
+        m[i] = ([ ]);
+    }
+    for (i = 0; i < 40000; i++) {
+        m[i % 4]["shared string " + i] = i;
+        if (i % 997 == 0) {
+            ASSERT_EQ(i / 2, m[i / 2 % 4]["shared string " + (i / 2)]);
+        }
+    }
+    for (i = 0; i < 40000; i += 7) {
+        ASSERT_EQ(i, m[i % 4]["shared string " + i]);
+    }
+
+    status = mud_status(1);
+    sscanf(status, "%*sShared strings: %d in %d chains", n, chains);
+    ASSERT(n >= 40000);
+    ASSERT(chains >= 32768);
+    sscanf(status, "%*sLongest: %d", longest);
+    ASSERT(longest > 0 && longest < 20);
+
+    m = 0;
+    sscanf(mud_status(1), "%*sShared strings: %d in", i);
+    ASSERT(i <= n - 40000);
+}
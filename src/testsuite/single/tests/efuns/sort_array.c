@@ -14,4 +14,9 @@ void do_tests() {
   ASSERT_EQ(({ 1, 2, 3, 4 }), sort_array(tmp, "func"));
   ASSERT_EQ(({ 1, 2, 3, 4 }), sort_array(tmp, (: $1 - $2 :)));
   ASSERT_EQ(({ 4, 3, 2, 1 }), sort_array(tmp, (: $2 - $1 :)));
+
+  // an unshared argument is sorted in place, a shared one is left alone
+  ASSERT_EQ(({ 1, 2, 3, 4 }), sort_array(tmp + ({ }), 1));
+  ASSERT_EQ(({ 1, 2, 3, 4 }), sort_array(tmp[0..], (: $1 - $2 :)));
+  ASSERT_EQ(({ 4, 3, 2, 1 }), tmp);
 }
@@ -0,0 +1,110 @@
+// call_other() sites keep an inline cache; make sure it never answers
+// for the wrong program or function.
+
+#define N 6
+
+string file(int i) {
+    return "/call_other_site_" + i;
+}
+
+object make(int i, int value) {
+    object ob;
+
+    if (ob = find_object(file(i))) {
+        destruct(ob);
+    }
+    rm(file(i) + ".c");
+    write_file(file(i) + ".c",
+               "int id() { return " + value + "; }\n"
+               "int twice(int x) { return 2 * x; }\n");
+    return load_object(file(i));
+}
+
+mixed call_id(object ob) {
+    return ob->id();
+}
+
+#ifdef __CACHE_STATS__
+int site_hits() {
+    int hits;
+
+    sscanf(cache_stats(), "%*s\nsite hits: %d", hits);
+    return hits;
+}
+#endif
+
+void do_tests() {
+    object *obs = allocate(N);
+    function f, *fps;
+    mixed *results;
+    string name;
+    int i, j;
+
+    for (i = 0; i < N; i++) {
+        obs[i] = make(i, i);
+    }
+    // more programs than a site has entries
+    for (j = 0; j < 3; j++) {
+        for (i = 0; i < N; i++) {
+            ASSERT_EQ(i, call_id(obs[i]));
+            ASSERT_EQ(2 * i, obs[i]->twice(i));
+        }
+    }
+    // a recompiled program may get the old one's address
+    for (i = 0; i < N; i++) {
+        obs[i] = make(i, 100 + i);
+    }
+    for (i = 0; i < N; i++) {
+        ASSERT_EQ(100 + i, call_id(obs[i]));
+    }
+
+    ASSERT(undefinedp(obs[0]->no_such_function()));
+    name = "tw";
+    name += "ice";
+    ASSERT_EQ(6, call_other(obs[0], name, 3));
+    ASSERT_EQ(8, call_other(obs[0], ({ "twice", 4 })));
+    ASSERT_EQ(1, call_id(this_object()->self()));
+
+    // function pointers to call_other have a cache of their own
+    f = (: call_other :);
+    for (j = 0; j < 3; j++) {
+        for (i = 0; i < N; i++) {
+            ASSERT_EQ(100 + i, evaluate(f, obs[i], "id"));
+        }
+    }
+    obs[2] = make(2, 202);
+    ASSERT_EQ(202, evaluate(f, obs[2], "id"));
+    ASSERT_EQ(104, evaluate(bind(f, obs[4]), obs[4], "id"));
+    fps = allocate(N);
+    for (i = 0; i < N; i++) {
+        fps[i] = (: call_other, obs[i], "id" :);
+    }
+#ifdef __CACHE_STATS__
+    i = site_hits();
+    results = map(allocate(10), (: evaluate($(fps[0])) :));
+    ASSERT_EQ(9, site_hits() - i);
+    ASSERT_EQ(10, sizeof(results));
+    ASSERT_EQ(({ }), filter(results, (: $1 != 100 :)));
+#endif
+
+    destruct(obs[1]);
+    ASSERT(catch(call_id(obs[1])));
+#ifdef __CACHE_STATS__
+    ASSERT(strsrch(cache_stats(), "Call site caches") != -1);
+#endif
+
+    for (i = 0; i < N; i++) {
+        if (obs[i]) {
+            destruct(obs[i]);
+        }
+        rm(file(i) + ".c");
+    }
+}
+
+object self() {
+    return this_object();
+}
+
+int id() {
+    return 1;
+}
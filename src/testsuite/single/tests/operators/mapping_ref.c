@@ -0,0 +1,31 @@
+// A ref into a mapping locks the mapping, not the value, and the lock
+// doesn't show in its size and goes away with the last ref.
+
+void check_locked(mapping m, int ref x) {
+    ASSERT_EQ(2, sizeof(m));
+    ASSERT_EQ("([ /* sizeof() == 2 */", explode(sprintf("%O", m), "\n")[0]);
+    x = 3;
+}
+
+void do_tests() {
+    mapping m = ([ "a" : 1, "b" : 2 ]);
+    string k;
+
+    // m is only held in a local variable here
+    check_locked(m, ref m["a"]);
+    ASSERT_EQ(3, m["a"]);
+    ASSERT_EQ(2, sizeof(m));
+
+    // unlocked again, so deleting really removes the key
+    map_delete(m, "a");
+    ASSERT_EQ(([ "b" : 2 ]), m);
+
+    m = ([ "a" : 1, "b" : 2 ]);
+    foreach (k, int ref v in m) {
+        v += 10;
+    }
+    ASSERT_EQ(([ "a" : 11, "b" : 12 ]), m);
+    map_delete(m, "a");
+    ASSERT_EQ(([ "b" : 12 ]), m);
+    ASSERT_EQ(1, sizeof(m));
+}
@@ -0,0 +1,66 @@
+// Mappings with few keys have no hash table until they grow past
+// MAP_SMALL_SIZE keys; both forms behave the same.
+
+void set_after_growth(mapping m, int ref x) {
+    int i;
+
+    for (i = 0; i < 20; i++) {
+        m["g" + i] = i;
+    }
+    x = 9;
+}
+
+void do_tests() {
+    mapping m = ([ ]), m2;
+    int i;
+    string k;
+
+    for (i = 0; i < 20; i++) {
+        m["k" + i] = i;
+        ASSERT_EQ(i + 1, sizeof(m));
+        ASSERT_EQ(0, m["k0"]);
+        ASSERT_EQ(i, m["k" + i]);
+    }
+    for (i = 0; i < 20; i++) {
+        ASSERT_EQ(i, m["k" + i]);
+    }
+    ASSERT(undefinedp(m["k20"]));
+
+    // strings made at runtime find the shared keys
+    m = ([ "abc" : 1, 2 : "two", 2.5 : 3 ]);
+    k = "ab";
+    k += "c";
+    ASSERT_EQ(1, m[k]);
+    ASSERT_EQ("two", m[2]);
+    ASSERT_EQ(3, m[2.5]);
+    map_delete(m, k);
+    ASSERT_EQ(2, sizeof(m));
+    ASSERT(undefinedp(m["abc"]));
+    m["abc"] = 4;
+    ASSERT_EQ(3, sizeof(m));
+    ASSERT_EQ(4, m["abc"]);
+    ASSERT_EQ(m, restore_variable(save_variable(m)));
+
+    // a ref into a small mapping survives it getting a table
+    m = ([ "a" : 1 ]);
+    set_after_growth(m, ref m["a"]);
+    ASSERT_EQ(9, m["a"]);
+    ASSERT_EQ(21, sizeof(m));
+
+    m = ([ "a" : 1, "b" : 2, "c" : 3 ]);
+    m2 = m + ([ "b" : 5, "d" : 6 ]);
+    ASSERT_EQ(4, sizeof(m2));
+    ASSERT_EQ(5, m2["b"]);
+    ASSERT_EQ(6, m2["d"]);
+    m2 = ([ "b" : 5, "d" : 6 ]) + m;
+    ASSERT_EQ(2, m2["b"]);
+    m += ([ "x" : 1, "y" : 2, "z" : 3, "w" : 4, "v" : 5, "u" : 6 ]);
+    ASSERT_EQ(9, sizeof(m));
+    ASSERT_EQ(6, m["u"]);
+    m2 = filter(m, (: $2 % 2 :));
+    ASSERT_EQ(({ "a", "c", "v", "x", "z" }), sort_array(keys(m2), 1));
+    ASSERT_EQ(sort_array(keys(m), 1), sort_array(keys(copy(m)), 1));
+
+    ASSERT(strsrch(mud_status(), "Mappings(small):") >= 0);
+    ASSERT(mapp(memory_summary()));
+}
@@ -0,0 +1,104 @@
+// Mappings keep their contents while the hash table grows and keys are
+// deleted, and lvalues and refs into a mapping stay good meanwhile.
+
+void grow_then_set(mapping m, int ref x) {
+    int i;
+
+    for (i = 0; i < 500; i++) {
+        m[i] = i;
+    }
+    x = 42;
+}
+
+void delete_then_set(mapping m, int ref x) {
+    map_delete(m, "a");
+    x = 5;
+}
+
+void do_tests() {
+    mapping m = ([ ]), m2;
+    int i, sum;
+    string k;
+    int v;
+
+    // numbers with the same low bits all hash near each other
+    for (i = 0; i < 2000; i++) {
+        m[i * 1024] = i;
+    }
+    ASSERT_EQ(2000, sizeof(m));
+    for (i = 0; i < 2000; i += 2) {
+        map_delete(m, i * 1024);
+    }
+    ASSERT_EQ(1000, sizeof(m));
+    for (i = 0; i < 2000; i++) {
+        if (i % 2) {
+            ASSERT_EQ(i, m[i * 1024]);
+        } else {
+            ASSERT(undefinedp(m[i * 1024]));
+        }
+    }
+    // deleted nodes are reused
+    for (i = 0; i < 2000; i += 2) {
+        m[i * 1024] = -i;
+    }
+    ASSERT_EQ(2000, sizeof(m));
+    sum = 0;
+    foreach (i, v in m) {
+        sum += v;
+    }
+    ASSERT_EQ(-999000 + 1000000, sum);
+    ASSERT_EQ(2000, sizeof(keys(m)));
+    ASSERT_EQ(2000, sizeof(values(m)));
+
+    m = ([ "a" : 1, 1.5 : "x", this_object() : ({ 1 }) ]);
+    ASSERT_EQ(1, m["a"]);
+    ASSERT_EQ("x", m[1.5]);
+    ASSERT_EQ(({ 1 }), m[this_object()]);
+    map_delete(m, this_object());
+    ASSERT_EQ(m, restore_variable(save_variable(m)));
+
+    // a ref into the mapping survives the table growing under it
+    m = ([ "a" : 1 ]);
+    grow_then_set(m, ref m["a"]);
+    ASSERT_EQ(42, m["a"]);
+    ASSERT_EQ(501, sizeof(m));
+    ASSERT_EQ(499, m[499]);
+
+    // and writing through it after the key is gone doesn't touch the mapping
+    m = ([ "a" : 1, "b" : 2 ]);
+    delete_then_set(m, ref m["a"]);
+    ASSERT_EQ(([ "b" : 2 ]), m);
+    m["a"] = 3;
+    ASSERT_EQ(([ "a" : 3, "b" : 2 ]), m);
+
+    m = ([ "a" : 1, "b" : 2 ]);
+    foreach (k, int ref r in m) {
+        for (i = 0; i < 100; i++) {
+            m[k + i] = i;
+        }
+        r = 7;
+    }
+    ASSERT_EQ(202, sizeof(m));
+    ASSERT_EQ(7, m["a"]);
+    ASSERT_EQ(7, m["b"]);
+    ASSERT_EQ(99, m["b99"]);
+
+    m = ([ ]);
+    for (i = 0; i < 100; i++) {
+        m["k" + i] = i;
+    }
+    m2 = filter(m, (: $2 % 3 == 0 :));
+    ASSERT_EQ(34, sizeof(m2));
+    ASSERT_EQ(99, m2["k99"]);
+    m2 = map(m2, (: $2 * 2 :));
+    ASSERT_EQ(198, m2["k99"]);
+    m2 = m + m2;
+    ASSERT_EQ(100, sizeof(m2));
+    ASSERT_EQ(198, m2["k99"]);
+    ASSERT_EQ(98, m2["k98"]);
+    m2 = ([ "new" : 1 ]) + m;
+    ASSERT_EQ(101, sizeof(m2));
+    m2 += ([ "k0" : "zero" ]);
+    ASSERT_EQ("zero", m2["k0"]);
+    ASSERT_EQ(0, m["k0"]);
+}
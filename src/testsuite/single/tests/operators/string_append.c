@@ -0,0 +1,40 @@
+// += on a string keeps room to append into; the result must be the same
+// as building it any other way.
+
+string global_str;
+
+void do_tests() {
+    string s = "", t, u;
+    int i;
+
+    for (i = 0; i < 5000; i++) {
+        s += "line " + i + "\n";
+    }
+    ASSERT_EQ(5000, sizeof(explode(s, "\n")));
+    ASSERT_EQ("line 4999\n", s[<10..]);
+    ASSERT_EQ(strlen(implode(explode(s, "\n"), "\n")) + 1, strlen(s));
+
+    // appending to a string somebody else holds doesn't change theirs
+    t = s;
+    s += "end";
+    ASSERT_EQ("line 4999\n", t[<10..]);
+    ASSERT_EQ("end", s[<3..]);
+    ASSERT_EQ(strlen(t) + 3, strlen(s));
+
+    u = "abc";
+    u += 1;
+    u += 2.5;
+    u += "d";
+    ASSERT_EQ("abc12.500000d", u);
+    u += this_object();
+    ASSERT_EQ("abc12.500000d" + file_name(this_object()), u);
+    ASSERT_EQ(u, sprintf("%s", u));
+
+    global_str = "x";
+    for (i = 0; i < 1000; i++) {
+        global_str += "y";
+    }
+    ASSERT_EQ(1001, strlen(global_str));
+    ASSERT_EQ("xyy", global_str[0..2]);
+    ASSERT_EQ(global_str, "x" + repeat_string("y", 1000));
+}
@@ -0,0 +1,83 @@
+// Sequences the compiler fuses into superinstructions, with operands
+// that don't take the fast path.
+
+int truth(mixed x) {
+    if (x) return 1;
+    return 0;
+}
+
+int falsity(mixed x) {
+    if (!x) return 1;
+    return 0;
+}
+
+int below(mixed x) {
+    if (x < 10) return 1;
+    return 0;
+}
+
+mixed land(mixed x, mixed y) {
+    return x && y;
+}
+
+void do_tests() {
+    mixed x, y;
+    object ob;
+
+    ASSERT_EQ(1, truth(1));
+    ASSERT_EQ(0, truth(0));
+    ASSERT_EQ(1, truth(""));
+    ASSERT_EQ(1, truth(({})));
+    ASSERT_EQ(1, truth(0.0));
+    ASSERT_EQ(0, falsity(-1));
+    ASSERT_EQ(1, falsity(0));
+    ASSERT_EQ(0, falsity("x"));
+
+    ob = new("/single/void");
+    x = ob;
+    ASSERT_EQ(1, truth(x));
+    destruct(ob);
+    ASSERT_EQ(0, truth(x));
+    ASSERT_EQ(1, falsity(x));
+    ASSERT_EQ(0, land(x, 1));
+
+    ASSERT_EQ(1, below(9));
+    ASSERT_EQ(0, below(10));
+    ASSERT_EQ(1, below(-100));
+    ASSERT_EQ(1, below(9.5));
+    ASSERT_EQ(0, below(10.0));
+
+    ASSERT_EQ(0, land(0, 1));
+    ASSERT_EQ(2, land(1, 2));
+    ASSERT_EQ("b", land("a", "b"));
+    ASSERT_EQ(1, undefinedp(land(([])[0], 1)));
+
+    x = "string";
+    x = 7;
+    ASSERT_EQ(7, x);
+    x = 255;
+    ASSERT_EQ(255, x);
+    x = ({ 1 });
+    x = 0;
+    ASSERT_EQ(0, x);
+    ASSERT_EQ(0, undefinedp(x));
+
+    x = 1;
+    y = 2;
+    x += y;
+    ASSERT_EQ(3, x);
+    x += 0.5;
+    ASSERT_EQ(3, x);
+    x = "a";
+    x += "b";
+    ASSERT_EQ("ab", x);
+    x += 1;
+    ASSERT_EQ("ab1", x);
+    x = ({ 1 });
+    x += ({ 2 });
+    ASSERT(same(({ 1, 2 }), x));
+    x = 1.5;
+    x += 1;
+    ASSERT_EQ(2.5, x);
+    ASSERT(catch(x += "a"));
+}
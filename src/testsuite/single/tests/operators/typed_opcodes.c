@@ -0,0 +1,81 @@
+// Operators on operands the compiler knows the type of, including values
+// which don't have the declared type at runtime.
+
+#pragma strict_types
+
+int int_ops(int a, int b) {
+    return (a + b) * 1000 + (a - b) * 100 + (a * b) + (a < b) + (a <= b) * 2 +
+           (a > b) * 4 + (a >= b) * 8 + (a == b) * 16 + (a != b) * 32;
+}
+
+float real_ops(float a, float b) {
+    return (a + b) * 1000 + (a - b) * 100 + (a * b) + a / b;
+}
+
+int real_cmp(float a, float b) {
+    return (a < b) + (a <= b) * 2 + (a > b) * 4 + (a >= b) * 8;
+}
+
+mixed index_array(mixed *arr, int i) {
+    return arr[i];
+}
+
+mixed index_mapping(mapping m, string k) {
+    return m[k];
+}
+
+mixed add_ints(int a, int b) {
+    return a + b;
+}
+
+mixed lt_reals(float a, float b) {
+    return a < b;
+}
+
+void do_tests() {
+    mixed m, n;
+    object ob;
+
+    ASSERT_EQ(10000 - 400 + 21 + 1 + 2 + 32, int_ops(3, 7));
+    ASSERT_EQ(10000 + 400 + 21 + 4 + 8 + 32, int_ops(7, 3));
+    ASSERT_EQ(6000 + 9 + 2 + 8 + 16, int_ops(3, 3));
+    ASSERT_EQ(2500.0 + 50.0 + 1.5 + 1.5, real_ops(1.5, 1.0));
+    ASSERT_EQ(3, real_cmp(1.0, 2.0));
+    ASSERT_EQ(2 + 8, real_cmp(2.0, 2.0));
+    ASSERT_EQ(12, real_cmp(2.5, 2.0));
+
+    ASSERT_EQ(20, index_array(({ 10, 20, 30 }), 1));
+    ASSERT_EQ("b", index_mapping(([ "a": "x", "k": "b" ]), "k"));
+    ASSERT_EQ(0, index_mapping(([ "a": "x" ]), "k"));
+
+    // values which aren't what the function was declared with
+    m = "abc";
+    ASSERT_EQ("abc1", add_ints(m, 1));
+    m = 1.5;
+    ASSERT_EQ(3.5, add_ints(m, 2));
+    ASSERT_EQ(({ 1, 2 }), add_ints((mixed)({ 1 }), (mixed)({ 2 })));
+    m = 1;
+    ASSERT_EQ(1, lt_reals(m, 2.0));
+    ASSERT_EQ(0, lt_reals(2.5, m));
+    m = "a";
+    n = "b";
+    ASSERT_EQ(1, lt_reals(m, n));
+    ASSERT_EQ(2, index_array((mixed)"ab\x02", 2));
+    ASSERT_EQ("v", index_mapping((mixed)({ "a", "v" }), (mixed)1));
+    m = ([ 1: "one" ]);
+    ASSERT_EQ("one", index_array(m, 1));
+
+    // errors still come from the generic operators
+    ASSERT(catch(index_array(({ 1 }), 1)) == "*Array index out of bounds.\n");
+    ASSERT(catch(index_array(({ 1 }), -1)) ==
+           "*Array index must be positive or zero.\n");
+    ASSERT(catch(index_array(0, 0)) == "*Value being indexed is zero.\n");
+    ASSERT(catch(real_ops(1.0, 0.0)) == "*Division by zero\n");
+    ASSERT(catch(add_ints((mixed)([]), 1)));
+
+    ob = new("/single/void");
+    m = ({ ob });
+    destruct(ob);
+    ASSERT_EQ(0, index_array(m, 0));
+    ASSERT_EQ(({ 0 }), m);
+}